@@ -449,6 +449,32 @@ fz_device *fz_new_draw_device_with_bbox_proof(fz_context *ctx, fz_matrix transfo
 
 fz_device *fz_new_draw_device_type3(fz_context *ctx, fz_matrix transform, fz_pixmap *dest);
 
+/**
+	SumatraPDF: instruction sets used by the draw device for painting
+	rgb + alpha pixmaps. The vectorized painters give the same pixels
+	as the scalar ones.
+*/
+enum
+{
+	FZ_DRAW_SIMD_NONE,
+	FZ_DRAW_SIMD_SSE2,
+	FZ_DRAW_SIMD_AVX2
+};
+
+/**
+	Returns the instruction set used by the draw device: the best
+	one supported by the cpu, but no better than the maximum set
+	with fz_set_draw_simd_max_level.
+*/
+int fz_draw_simd_level(void);
+
+/**
+	Limit the instruction set used by the draw device (e.g.
+	FZ_DRAW_SIMD_NONE to only use the scalar painters). Affects
+	all contexts.
+*/
+void fz_set_draw_simd_max_level(int level);
+
 /**
 	struct fz_draw_options: Options for creating a pixmap and draw
 	device.
@@ -57,6 +57,12 @@ typedef struct fz_display_list fz_display_list;
 */
 fz_display_list *fz_new_display_list(fz_context *ctx, fz_rect mediabox);
 
+/**
+	SumatraPDF: returns non-zero if the storable is a display list
+	(for store statistics).
+*/
+int fz_is_display_list_storable(const fz_storable *sc);
+
 /**
 	Create a rendering device for a display list.
 
@@ -414,6 +414,22 @@ void fz_set_pixmap_image_tile(fz_context *ctx, fz_pixmap_image *cimg, fz_pixmap
 */
 fz_pixmap *fz_load_jpx(fz_context *ctx, const unsigned char *data, size_t size, fz_colorspace *cs);
 
+/**
+	SumatraPDF: Like fz_load_jpx, but skips up to *l2factor resolution
+	levels (each halving the size of the image). *l2factor is updated
+	to the amount of subsampling that is still left to do.
+*/
+fz_pixmap *fz_load_jpx_reduced(fz_context *ctx, const unsigned char *data, size_t size, fz_colorspace *cs, int *l2factor);
+
+/**
+	SumatraPDF: Reads only the header of a JPX image (fz_load_jpx_info
+	decodes the whole image). Returns the size of the image at full
+	resolution, the number of color and alpha components (-1 if they
+	are only known after decoding, e.g. for images with a palette)
+	and the bit depth of the components (-1 if they differ).
+*/
+void fz_load_jpx_header(fz_context *ctx, const unsigned char *data, size_t size, int *wp, int *hp, int *np, int *ap, int *bpcp);
+
 /**
 	Exposed for CBZ.
 */
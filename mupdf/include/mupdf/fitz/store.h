@@ -374,6 +374,46 @@ int fz_store_scavenge_external(fz_context *ctx, size_t size, int *phase);
 */
 int fz_shrink_store(fz_context *ctx, unsigned int percent);
 
+/**
+	SumatraPDF: return the number of bytes currently held by
+	the store (as counted towards its maximum size).
+*/
+size_t fz_store_current_size(fz_context *ctx);
+
+/**
+	SumatraPDF: return the maximum size the store is allowed
+	to grow to (FZ_STORE_UNLIMITED if unlimited).
+*/
+size_t fz_store_max_size(fz_context *ctx);
+
+/**
+	SumatraPDF: change the maximum size of the store. If the
+	store currently holds more than max bytes, evict items until
+	it fits (as far as possible).
+*/
+void fz_set_store_max_size(fz_context *ctx, size_t max);
+
+/**
+	SumatraPDF: evict at least tofree bytes from the store,
+	oldest items first. Items that are in use are not evicted.
+
+	Returns the number of bytes freed.
+*/
+size_t fz_evict_store_bytes(fz_context *ctx, size_t tofree);
+
+/**
+	Callback function called by fz_enumerate_store on every item
+	within the store. Called with the alloc lock held, so it must
+	not call back into the store.
+*/
+typedef void (fz_store_enumerate_fn)(void *arg, const fz_store_type *type, const fz_storable *val, size_t size);
+
+/**
+	SumatraPDF: call fn for every item in the store, most
+	recently used first. Used for memory statistics.
+*/
+void fz_enumerate_store(fz_context *ctx, fz_store_enumerate_fn *fn, void *arg);
+
 /**
 	Callback function called by fz_filter_store on every item within
 	the store.
@@ -177,6 +177,25 @@ void pdf_repair_xref(fz_context *ctx, pdf_document *doc);
 void pdf_repair_obj_stms(fz_context *ctx, pdf_document *doc);
 void pdf_repair_trailer(fz_context *ctx, pdf_document *doc);
 
+/*
+	SumatraPDF: optional, application provided storage for repaired
+	xref tables, so that broken files only need to be repaired once.
+
+	key identifies the file (size and hash of its start and end).
+	load returns a buffer previously passed to save (or NULL).
+*/
+#define PDF_REPAIR_CACHE_KEY_SIZE 64
+typedef fz_buffer *(pdf_repair_cache_load_fn)(fz_context *ctx, const char *key);
+typedef void (pdf_repair_cache_save_fn)(fz_context *ctx, const char *key, fz_buffer *buf);
+void pdf_set_repair_cache_funcs(pdf_repair_cache_load_fn *load, pdf_repair_cache_save_fn *save);
+
+/*
+	SumatraPDF: load a validated, previously repaired xref (returns 0 if
+	there's none) or save the current (repaired) xref.
+*/
+int pdf_load_repair_cache(fz_context *ctx, pdf_document *doc);
+void pdf_save_repair_cache(fz_context *ctx, pdf_document *doc);
+
 /*
 	Ensure that the current populating xref has a single subsection
 	that covers the entire range.
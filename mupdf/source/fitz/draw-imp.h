@@ -457,6 +457,19 @@ fz_solid_color_painter_t *fz_get_solid_color_painter(int n, const unsigned char
 fz_span_painter_t *fz_get_span_painter(int da, int sa, int n, int alpha, const fz_overprint * FZ_RESTRICT eop);
 fz_span_color_painter_t *fz_get_span_color_painter(int n, int da, const unsigned char * FZ_RESTRICT color, const fz_overprint * FZ_RESTRICT eop);
 
+/* SumatraPDF: vectorized versions of the most common painters (see draw-simd.c) */
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || (defined(__i386__) && defined(__SSE2__))
+#define FZ_DRAW_SSE2 1
+#else
+#define FZ_DRAW_SSE2 0
+#endif
+
+/* see fz_draw_simd_level() in mupdf/fitz/device.h */
+
+fz_solid_color_painter_t *fz_get_solid_color_painter_simd(int n, const unsigned char * FZ_RESTRICT color, int da);
+fz_span_painter_t *fz_get_span_painter_simd(int da, int sa, int n, int alpha);
+fz_span_color_painter_t *fz_get_span_color_painter_simd(int n, int da, const unsigned char * FZ_RESTRICT color);
+
 void fz_paint_image(fz_context *ctx, fz_pixmap * FZ_RESTRICT dst, const fz_irect * FZ_RESTRICT scissor, fz_pixmap * FZ_RESTRICT shape, fz_pixmap * FZ_RESTRICT group_alpha, fz_pixmap * FZ_RESTRICT img, fz_matrix ctm, int alpha, int lerp_allowed, const fz_overprint * FZ_RESTRICT eop);
 void fz_paint_image_with_color(fz_context *ctx, fz_pixmap * FZ_RESTRICT dst, const fz_irect * FZ_RESTRICT scissor, fz_pixmap * FZ_RESTRICT shape, fz_pixmap * FZ_RESTRICT group_alpha, fz_pixmap * FZ_RESTRICT img, fz_matrix ctm, const unsigned char * FZ_RESTRICT colorbv, int lerp_allowed, const fz_overprint * FZ_RESTRICT eop);
 
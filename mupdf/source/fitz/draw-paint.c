@@ -607,6 +607,12 @@ fz_get_solid_color_painter(int n, const byte * FZ_RESTRICT color, int da, const
 			return paint_solid_color_N_alpha_op;
 	}
 #endif /* FZ_ENABLE_SPOT_RENDERING */
+	{
+		/* SumatraPDF: use SSE2 / AVX2 versions if available */
+		fz_solid_color_painter_t *simd = fz_get_solid_color_painter_simd(n, color, da);
+		if (simd)
+			return simd;
+	}
 	switch (n-da)
 	{
 		case 0:
@@ -1127,6 +1133,12 @@ fz_get_span_color_painter(int n, int da, const byte * FZ_RESTRICT color, const f
 			return da ? paint_span_with_color_N_da_op_alpha : paint_span_with_color_N_op_alpha;
 	}
 #endif /* FZ_ENABLE_SPOT_RENDERING */
+	{
+		/* SumatraPDF: use SSE2 / AVX2 versions if available */
+		fz_span_color_painter_t *simd = fz_get_span_color_painter_simd(n, da, color);
+		if (simd)
+			return simd;
+	}
 	switch(n-da)
 	{
 	case 0:
@@ -2132,6 +2144,12 @@ fz_get_span_painter(int da, int sa, int n, int alpha, const fz_overprint * FZ_RE
 			return NULL;
 	}
 #endif /* FZ_ENABLE_SPOT_RENDERING */
+	{
+		/* SumatraPDF: use SSE2 / AVX2 versions if available */
+		fz_span_painter_t *simd = fz_get_span_painter_simd(da, sa, n, alpha);
+		if (simd)
+			return simd;
+	}
 	switch (n)
 	{
 	case 0:
@@ -0,0 +1,386 @@
+/* SumatraPDF: SSE2 / AVX2 versions of the most common span painters */
+
+/*
+	The painters here are pixel-exact equivalents of the scalar ones in
+	draw-paint.c for 4 byte pixels (rgb + alpha). They use the same
+	integer math, just on 4 (SSE2) or 8 (AVX2) pixels at a time.
+
+	AVX2 is only used if the cpu (and os) supports it. The maximum level
+	can be lowered with fz_set_draw_simd_max_level() which is used to
+	compare the vectorized painters against the scalar ones.
+*/
+
+#include "mupdf/fitz.h"
+
+#include "draw-imp.h"
+
+#include <string.h>
+
+#if FZ_DRAW_SSE2
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define FZ_TARGET_AVX2
+#else
+#define FZ_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+typedef unsigned char byte;
+
+static int simd_level = -1;
+static int simd_max_level = FZ_DRAW_SIMD_AVX2;
+
+static int
+detect_simd_level(void)
+{
+#if FZ_DRAW_SSE2
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] >= 7)
+	{
+		__cpuid(info, 1);
+		/* cpu supports AVX and os saves YMM registers */
+		if ((info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6)
+		{
+			__cpuidex(info, 7, 0);
+			if (info[1] & (1 << 5))
+				return FZ_DRAW_SIMD_AVX2;
+		}
+	}
+	return FZ_DRAW_SIMD_SSE2;
+#elif defined(__GNUC__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return FZ_DRAW_SIMD_AVX2;
+	return FZ_DRAW_SIMD_SSE2;
+#else
+	return FZ_DRAW_SIMD_SSE2;
+#endif
+#else
+	return FZ_DRAW_SIMD_NONE;
+#endif
+}
+
+int
+fz_draw_simd_level(void)
+{
+	/* racing threads all detect the same value */
+	if (simd_level < 0)
+		simd_level = detect_simd_level();
+	return fz_mini(simd_level, simd_max_level);
+}
+
+void
+fz_set_draw_simd_max_level(int level)
+{
+	simd_max_level = level;
+}
+
+/* scalar versions, used for the pixels left over by the vectorized loops */
+
+static void
+span_3_da_sa_tail(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT sp, int w)
+{
+	for (; w > 0; w--, dp += 4, sp += 4)
+	{
+		int t = FZ_EXPAND(sp[3]);
+		if (t == 0)
+			continue;
+		t = 256 - t;
+		dp[0] = sp[0] + FZ_COMBINE(dp[0], t);
+		dp[1] = sp[1] + FZ_COMBINE(dp[1], t);
+		dp[2] = sp[2] + FZ_COMBINE(dp[2], t);
+		dp[3] = sp[3] + FZ_COMBINE(dp[3], t);
+	}
+}
+
+static void
+span_3_da_sa_alpha_tail(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT sp, int w, int alpha)
+{
+	for (; w > 0; w--, dp += 4, sp += 4)
+	{
+		int masa = FZ_COMBINE(sp[3], alpha);
+		int t = FZ_EXPAND(255 - masa);
+		dp[0] = FZ_COMBINE(sp[0], alpha) + FZ_COMBINE(dp[0], t);
+		dp[1] = FZ_COMBINE(sp[1], alpha) + FZ_COMBINE(dp[1], t);
+		dp[2] = FZ_COMBINE(sp[2], alpha) + FZ_COMBINE(dp[2], t);
+		dp[3] = masa + FZ_COMBINE(dp[3], t);
+	}
+}
+
+static void
+blend_color_tail(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT mp, int w, const byte * FZ_RESTRICT color, int sa)
+{
+	for (; w > 0; w--, dp += 4)
+	{
+		int ma = sa;
+		if (mp)
+		{
+			ma = FZ_EXPAND(*mp);
+			mp++;
+		}
+		dp[0] = FZ_BLEND(color[0], dp[0], ma);
+		dp[1] = FZ_BLEND(color[1], dp[1], ma);
+		dp[2] = FZ_BLEND(color[2], dp[2], ma);
+		dp[3] = FZ_BLEND(255, dp[3], ma);
+	}
+}
+
+#if FZ_DRAW_SSE2
+
+static fz_forceinline __m128i
+load_rgba_color(const byte * FZ_RESTRICT color)
+{
+	return _mm_set1_epi32((int)(color[0] | (color[1] << 8) | (color[2] << 16) | 0xFF000000u));
+}
+
+/*
+	Per pixel factors are passed in 32 bit lanes (one lane per pixel) and
+	are spread over the 4 16 bit channels of the matching pixel, in the
+	same order in which _mm_unpack{lo,hi}_epi8 spreads out the pixels.
+*/
+
+/* FZ_COMBINE(x, f) for every byte, f is 0..256 */
+static fz_forceinline __m128i
+scale_sse2(__m128i x, __m128i f)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i f16 = _mm_or_si128(f, _mm_slli_epi32(f, 16));
+	__m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(x, zero), _mm_unpacklo_epi32(f16, f16));
+	__m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(x, zero), _mm_unpackhi_epi32(f16, f16));
+	return _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+}
+
+/* FZ_BLEND(c, d, f) for every byte, f is 0..256. The intermediate
+ * values wrap around in 16 bits but the final result always fits. */
+static fz_forceinline __m128i
+blend_sse2(__m128i c, __m128i d, __m128i f)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i f16 = _mm_or_si128(f, _mm_slli_epi32(f, 16));
+	__m128i dlo = _mm_unpacklo_epi8(d, zero);
+	__m128i dhi = _mm_unpackhi_epi8(d, zero);
+	__m128i lo = _mm_mullo_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(c, zero), dlo), _mm_unpacklo_epi32(f16, f16));
+	__m128i hi = _mm_mullo_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(c, zero), dhi), _mm_unpackhi_epi32(f16, f16));
+	lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_slli_epi16(dlo, 8)), 8);
+	hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_slli_epi16(dhi, 8)), 8);
+	return _mm_packus_epi16(lo, hi);
+}
+
+/* FZ_EXPAND(x) for 32 bit lanes */
+static fz_forceinline __m128i
+expand_sse2(__m128i x)
+{
+	return _mm_add_epi32(x, _mm_srli_epi32(x, 7));
+}
+
+static void
+paint_span_3_da_sa_sse2(byte * FZ_RESTRICT dp, int da, const byte * FZ_RESTRICT sp, int sa, int n, int w, int alpha, const fz_overprint * FZ_RESTRICT eop)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c256 = _mm_set1_epi32(256);
+	for (; w >= 4; w -= 4, dp += 16, sp += 16)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i *)sp);
+		__m128i d = _mm_loadu_si128((const __m128i *)dp);
+		__m128i a = _mm_srli_epi32(s, 24);
+		__m128i t = _mm_sub_epi32(c256, expand_sse2(a));
+		__m128i r = _mm_add_epi8(s, scale_sse2(d, t));
+		/* fully transparent source pixels leave the destination untouched */
+		__m128i keep = _mm_cmpeq_epi32(a, zero);
+		r = _mm_or_si128(_mm_and_si128(keep, d), _mm_andnot_si128(keep, r));
+		_mm_storeu_si128((__m128i *)dp, r);
+	}
+	span_3_da_sa_tail(dp, sp, w);
+}
+
+static void
+paint_span_3_da_sa_alpha_sse2(byte * FZ_RESTRICT dp, int da, const byte * FZ_RESTRICT sp, int sa, int n, int w, int alpha, const fz_overprint * FZ_RESTRICT eop)
+{
+	const __m128i c255 = _mm_set1_epi32(255);
+	__m128i va;
+	alpha = FZ_EXPAND(alpha);
+	va = _mm_set1_epi32(alpha);
+	for (; w >= 4; w -= 4, dp += 16, sp += 16)
+	{
+		__m128i s = scale_sse2(_mm_loadu_si128((const __m128i *)sp), va);
+		__m128i d = _mm_loadu_si128((const __m128i *)dp);
+		__m128i t = expand_sse2(_mm_sub_epi32(c255, _mm_srli_epi32(s, 24)));
+		_mm_storeu_si128((__m128i *)dp, _mm_add_epi8(s, scale_sse2(d, t)));
+	}
+	span_3_da_sa_alpha_tail(dp, sp, w, alpha);
+}
+
+static void
+paint_solid_color_3_da_sse2(byte * FZ_RESTRICT dp, int n, int w, const byte * FZ_RESTRICT color, int da, const fz_overprint * FZ_RESTRICT eop)
+{
+	int sa = FZ_EXPAND(color[3]);
+	__m128i c = load_rgba_color(color);
+	if (sa == 0)
+		return;
+	if (sa == 256)
+	{
+		unsigned int rgba = (unsigned int)_mm_cvtsi128_si32(c);
+		for (; w >= 4; w -= 4, dp += 16)
+			_mm_storeu_si128((__m128i *)dp, c);
+		for (; w > 0; w--, dp += 4)
+			memcpy(dp, &rgba, 4);
+	}
+	else
+	{
+		__m128i f = _mm_set1_epi32(sa);
+		for (; w >= 4; w -= 4, dp += 16)
+		{
+			__m128i d = _mm_loadu_si128((const __m128i *)dp);
+			_mm_storeu_si128((__m128i *)dp, blend_sse2(c, d, f));
+		}
+		blend_color_tail(dp, NULL, w, color, sa);
+	}
+}
+
+static void
+paint_span_with_color_3_da_solid_sse2(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT mp, int n, int w, const byte * FZ_RESTRICT color, int da, const fz_overprint * FZ_RESTRICT eop)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i c = load_rgba_color(color);
+	for (; w >= 4; w -= 4, dp += 16, mp += 4)
+	{
+		int m4;
+		__m128i m, d;
+		memcpy(&m4, mp, 4);
+		if (m4 == 0)
+			continue;
+		m = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(m4), zero), zero);
+		d = _mm_loadu_si128((const __m128i *)dp);
+		_mm_storeu_si128((__m128i *)dp, blend_sse2(c, d, expand_sse2(m)));
+	}
+	blend_color_tail(dp, mp, w, color, 0);
+}
+
+/* AVX2 versions of the above, 8 pixels at a time */
+
+static FZ_TARGET_AVX2 fz_forceinline __m256i
+scale_avx2(__m256i x, __m256i f)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i f16 = _mm256_or_si256(f, _mm256_slli_epi32(f, 16));
+	__m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(x, zero), _mm256_unpacklo_epi32(f16, f16));
+	__m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(x, zero), _mm256_unpackhi_epi32(f16, f16));
+	return _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8));
+}
+
+static FZ_TARGET_AVX2 fz_forceinline __m256i
+blend_avx2(__m256i c, __m256i d, __m256i f)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i f16 = _mm256_or_si256(f, _mm256_slli_epi32(f, 16));
+	__m256i dlo = _mm256_unpacklo_epi8(d, zero);
+	__m256i dhi = _mm256_unpackhi_epi8(d, zero);
+	__m256i lo = _mm256_mullo_epi16(_mm256_sub_epi16(_mm256_unpacklo_epi8(c, zero), dlo), _mm256_unpacklo_epi32(f16, f16));
+	__m256i hi = _mm256_mullo_epi16(_mm256_sub_epi16(_mm256_unpackhi_epi8(c, zero), dhi), _mm256_unpackhi_epi32(f16, f16));
+	lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_slli_epi16(dlo, 8)), 8);
+	hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_slli_epi16(dhi, 8)), 8);
+	return _mm256_packus_epi16(lo, hi);
+}
+
+static FZ_TARGET_AVX2 fz_forceinline __m256i
+expand_avx2(__m256i x)
+{
+	return _mm256_add_epi32(x, _mm256_srli_epi32(x, 7));
+}
+
+static FZ_TARGET_AVX2 void
+paint_span_3_da_sa_avx2(byte * FZ_RESTRICT dp, int da, const byte * FZ_RESTRICT sp, int sa, int n, int w, int alpha, const fz_overprint * FZ_RESTRICT eop)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i c256 = _mm256_set1_epi32(256);
+	for (; w >= 8; w -= 8, dp += 32, sp += 32)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i *)sp);
+		__m256i d = _mm256_loadu_si256((const __m256i *)dp);
+		__m256i a = _mm256_srli_epi32(s, 24);
+		__m256i t = _mm256_sub_epi32(c256, expand_avx2(a));
+		__m256i r = _mm256_add_epi8(s, scale_avx2(d, t));
+		__m256i keep = _mm256_cmpeq_epi32(a, zero);
+		_mm256_storeu_si256((__m256i *)dp, _mm256_blendv_epi8(r, d, keep));
+	}
+	span_3_da_sa_tail(dp, sp, w);
+}
+
+static FZ_TARGET_AVX2 void
+paint_span_3_da_sa_alpha_avx2(byte * FZ_RESTRICT dp, int da, const byte * FZ_RESTRICT sp, int sa, int n, int w, int alpha, const fz_overprint * FZ_RESTRICT eop)
+{
+	const __m256i c255 = _mm256_set1_epi32(255);
+	__m256i va;
+	alpha = FZ_EXPAND(alpha);
+	va = _mm256_set1_epi32(alpha);
+	for (; w >= 8; w -= 8, dp += 32, sp += 32)
+	{
+		__m256i s = scale_avx2(_mm256_loadu_si256((const __m256i *)sp), va);
+		__m256i d = _mm256_loadu_si256((const __m256i *)dp);
+		__m256i t = expand_avx2(_mm256_sub_epi32(c255, _mm256_srli_epi32(s, 24)));
+		_mm256_storeu_si256((__m256i *)dp, _mm256_add_epi8(s, scale_avx2(d, t)));
+	}
+	span_3_da_sa_alpha_tail(dp, sp, w, alpha);
+}
+
+static FZ_TARGET_AVX2 void
+paint_span_with_color_3_da_solid_avx2(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT mp, int n, int w, const byte * FZ_RESTRICT color, int da, const fz_overprint * FZ_RESTRICT eop)
+{
+	__m256i c = _mm256_set1_epi32((int)(color[0] | (color[1] << 8) | (color[2] << 16) | 0xFF000000u));
+	for (; w >= 8; w -= 8, dp += 32, mp += 8)
+	{
+		__m128i m8 = _mm_loadl_epi64((const __m128i *)mp);
+		__m256i d;
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(m8, _mm_setzero_si128())) == 0xFFFF)
+			continue;
+		d = _mm256_loadu_si256((const __m256i *)dp);
+		_mm256_storeu_si256((__m256i *)dp, blend_avx2(c, d, expand_avx2(_mm256_cvtepu8_epi32(m8))));
+	}
+	blend_color_tail(dp, mp, w, color, 0);
+}
+
+#endif /* FZ_DRAW_SSE2 */
+
+fz_span_painter_t *
+fz_get_span_painter_simd(int da, int sa, int n, int alpha)
+{
+#if FZ_DRAW_SSE2
+	int level = fz_draw_simd_level();
+	if (level == FZ_DRAW_SIMD_NONE || n != 3 || !da || !sa || alpha == 0)
+		return NULL;
+	if (alpha == 255)
+		return level >= FZ_DRAW_SIMD_AVX2 ? paint_span_3_da_sa_avx2 : paint_span_3_da_sa_sse2;
+	return level >= FZ_DRAW_SIMD_AVX2 ? paint_span_3_da_sa_alpha_avx2 : paint_span_3_da_sa_alpha_sse2;
+#else
+	return NULL;
+#endif
+}
+
+fz_solid_color_painter_t *
+fz_get_solid_color_painter_simd(int n, const byte * FZ_RESTRICT color, int da)
+{
+#if FZ_DRAW_SSE2
+	if (fz_draw_simd_level() == FZ_DRAW_SIMD_NONE || n != 4 || !da)
+		return NULL;
+	return paint_solid_color_3_da_sse2;
+#else
+	return NULL;
+#endif
+}
+
+fz_span_color_painter_t *
+fz_get_span_color_painter_simd(int n, int da, const byte * FZ_RESTRICT color)
+{
+#if FZ_DRAW_SSE2
+	int level = fz_draw_simd_level();
+	if (level == FZ_DRAW_SIMD_NONE || n != 4 || !da || color[3] != 255)
+		return NULL;
+	return level >= FZ_DRAW_SIMD_AVX2 ? paint_span_with_color_3_da_solid_avx2 : paint_span_with_color_3_da_solid_sse2;
+#else
+	return NULL;
+#endif
+}
@@ -1517,6 +1517,13 @@ fz_drop_display_list_imp(fz_context *ctx, fz_storable *list_)
 	fz_free(ctx, list);
 }
 
+/* SumatraPDF: used to attribute store memory to display lists */
+int
+fz_is_display_list_storable(const fz_storable *sc)
+{
+	return sc != NULL && sc->drop == fz_drop_display_list_imp;
+}
+
 fz_display_list *
 fz_new_display_list(fz_context *ctx, fz_rect mediabox)
 {
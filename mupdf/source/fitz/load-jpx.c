@@ -302,6 +302,13 @@ static OPJ_BOOL fz_opj_stream_seek(OPJ_OFF_T seek_pos, void * p_user_data)
 	return OPJ_TRUE;
 }
 
+/* SumatraPDF: size of a coordinate after skipping resolution levels (as openjpeg computes it) */
+static int32_t
+ceildivpow2(OPJ_UINT32 a, int b)
+{
+	return (int32_t)((((int64_t)a) + (((int64_t)1) << b) - 1) >> b);
+}
+
 static int32_t
 safe_mul32(fz_context *ctx, int32_t a, int32_t b)
 {
@@ -401,7 +408,7 @@ template_copy_comp(unsigned char *dst0, int w, int h, int stride, const OPJ_INT3
 }
 
 static void
-copy_jpx_to_pixmap(fz_context *ctx, fz_pixmap *img, opj_image_t *jpx)
+copy_jpx_to_pixmap(fz_context *ctx, fz_pixmap *img, opj_image_t *jpx, int reduce)
 {
 	unsigned char *dst;
 	int stride, comps;
@@ -420,8 +427,9 @@ copy_jpx_to_pixmap(fz_context *ctx, fz_pixmap *img, opj_image_t *jpx)
 		OPJ_UINT32 cdy = comp->dy;
 		OPJ_UINT32 cw = comp->w;
 		OPJ_UINT32 ch = comp->h;
-		int32_t oy = safe_mul32(ctx, comp->y0, cdy) - jpx->y0;
-		int32_t ox = safe_mul32(ctx, comp->x0, cdx) - jpx->x0;
+		/* SumatraPDF: component and image origins are in full resolution coordinates */
+		int32_t oy = safe_mul32(ctx, ceildivpow2(comp->y0, reduce), cdy) - ceildivpow2(jpx->y0, reduce);
+		int32_t ox = safe_mul32(ctx, ceildivpow2(comp->x0, reduce), cdx) - ceildivpow2(jpx->x0, reduce);
 		unsigned char *dst0 = dst + oy * stride;
 		int prec = comp->prec;
 		int sgnd = comp->sgnd;
@@ -447,8 +455,28 @@ copy_jpx_to_pixmap(fz_context *ctx, fz_pixmap *img, opj_image_t *jpx)
 	}
 }
 
+/* SumatraPDF: number of resolution levels that can be skipped for all components */
+static int
+jpx_max_reduce(opj_codec_t *codec)
+{
+	opj_codestream_info_v2_t *info = opj_get_cstr_info(codec);
+	int max_reduce = 0;
+	OPJ_UINT32 i;
+
+	if (info && info->m_default_tile_info.tccp_info)
+	{
+		max_reduce = 32;
+		for (i = 0; i < info->nbcomps; i++)
+			max_reduce = fz_mini(max_reduce, (int)info->m_default_tile_info.tccp_info[i].numresolutions - 1);
+	}
+	opj_destroy_cstr_info(&info);
+	return fz_maxi(max_reduce, 0);
+}
+
+/* reduce is the number of resolution levels to skip (each one halves the
+ * size of the image). It is updated to the number actually skipped. */
 static fz_pixmap *
-jpx_read_image(fz_context *ctx, fz_jpxd *state, const unsigned char *data, size_t size, fz_colorspace *defcs, int onlymeta)
+jpx_read_image(fz_context *ctx, fz_jpxd *state, const unsigned char *data, size_t size, fz_colorspace *defcs, int onlymeta, int *reduce)
 {
 	fz_pixmap *img = NULL;
 	opj_dparameters_t params;
@@ -505,6 +533,13 @@ jpx_read_image(fz_context *ctx, fz_jpxd *state, const unsigned char *data, size_
 		fz_throw(ctx, FZ_ERROR_GENERIC, "Failed to read JPX header");
 	}
 
+	if (reduce && *reduce > 0)
+	{
+		*reduce = fz_mini(*reduce, jpx_max_reduce(codec));
+		if (*reduce > 0 && !opj_set_decoded_resolution_factor(codec, *reduce))
+			*reduce = 0;
+	}
+
 	if (!opj_decode(codec, stream, jpx))
 	{
 		opj_stream_destroy(stream);
@@ -539,8 +574,16 @@ jpx_read_image(fz_context *ctx, fz_jpxd *state, const unsigned char *data, size_
 		}
 	}
 
-	w = state->width = jpx->x1 - jpx->x0;
-	h = state->height = jpx->y1 - jpx->y0;
+	if (reduce && *reduce > 0)
+	{
+		w = state->width = ceildivpow2(jpx->x1, *reduce) - ceildivpow2(jpx->x0, *reduce);
+		h = state->height = ceildivpow2(jpx->y1, *reduce) - ceildivpow2(jpx->y0, *reduce);
+	}
+	else
+	{
+		w = state->width = jpx->x1 - jpx->x0;
+		h = state->height = jpx->y1 - jpx->y0;
+	}
 	state->xres = 72; /* openjpeg does not read the JPEG 2000 resc box */
 	state->yres = 72; /* openjpeg does not read the JPEG 2000 resc box */
 
@@ -611,7 +654,7 @@ jpx_read_image(fz_context *ctx, fz_jpxd *state, const unsigned char *data, size_
 		a = !!a; /* ignore any superfluous alpha channels */
 		img = fz_new_pixmap(ctx, state->cs, w, h, NULL, a);
 		fz_clear_pixmap_with_value(ctx, img, 0);
-		copy_jpx_to_pixmap(ctx, img, jpx);
+		copy_jpx_to_pixmap(ctx, img, jpx, reduce ? *reduce : 0);
 
 		if (jpx->color_space == OPJ_CLRSPC_SYCC && n == 3 && a == 0)
 			jpx_ycc_to_rgb(ctx, img, 1, 1);
@@ -634,23 +677,173 @@ jpx_read_image(fz_context *ctx, fz_jpxd *state, const unsigned char *data, size_
 
 fz_pixmap *
 fz_load_jpx(fz_context *ctx, const unsigned char *data, size_t size, fz_colorspace *defcs)
+{
+	return fz_load_jpx_reduced(ctx, data, size, defcs, NULL);
+}
+
+fz_pixmap *
+fz_load_jpx_reduced(fz_context *ctx, const unsigned char *data, size_t size, fz_colorspace *defcs, int *l2factor)
 {
 	fz_jpxd state = { 0 };
 	fz_pixmap *pix = NULL;
+	int reduce = l2factor ? *l2factor : 0;
+	int retry = 0;
 
 	fz_try(ctx)
 	{
 		opj_lock(ctx);
-		pix = jpx_read_image(ctx, &state, data, size, defcs, 0);
+		pix = jpx_read_image(ctx, &state, data, size, defcs, 0, &reduce);
 	}
 	fz_always(ctx)
 		opj_unlock(ctx);
 	fz_catch(ctx)
-		fz_rethrow(ctx);
+	{
+		/* tiles may have fewer resolution levels than the main header */
+		if (reduce == 0)
+			fz_rethrow(ctx);
+		retry = 1;
+	}
 
+	if (retry)
+	{
+		fz_warn(ctx, "retrying JPX decode at full resolution");
+		reduce = 0;
+		pix = fz_load_jpx(ctx, data, size, defcs);
+	}
+
+	if (l2factor)
+		*l2factor -= reduce;
 	return pix;
 }
 
+/* SumatraPDF: palette (pclr) and channel definition (cdef) boxes are only
+ * applied by opj_decode, so with them the header doesn't tell how many color
+ * and alpha components the decoded image has */
+static int
+jp2_has_pclr_or_cdef(const unsigned char *data, size_t size)
+{
+	size_t pos = 0, end = size, hdr;
+	uint64_t len;
+	int i;
+
+	while (pos + 8 <= end)
+	{
+		hdr = 8;
+		len = ((uint64_t)data[pos] << 24) | ((uint64_t)data[pos + 1] << 16) | ((uint64_t)data[pos + 2] << 8) | data[pos + 3];
+		if (len == 1)
+		{
+			if (pos + 16 > end)
+				break;
+			len = 0;
+			for (i = 0; i < 8; i++)
+				len = (len << 8) | data[pos + 8 + i];
+			hdr = 16;
+		}
+		else if (len == 0)
+			len = end - pos;
+		if (len < hdr || len > end - pos)
+			break;
+
+		if (!memcmp(data + pos + 4, "pclr", 4) || !memcmp(data + pos + 4, "cdef", 4))
+			return 1;
+		if (!memcmp(data + pos + 4, "jp2c", 4))
+			break;
+		if (!memcmp(data + pos + 4, "jp2h", 4))
+		{
+			/* look at the boxes inside the header box */
+			end = pos + (size_t)len;
+			pos += hdr;
+		}
+		else
+			pos += (size_t)len;
+	}
+	return 0;
+}
+
+static void
+jpx_read_header(fz_context *ctx, const unsigned char *data, size_t size, int *wp, int *hp, int *np, int *ap, int *bpcp)
+{
+	opj_dparameters_t params;
+	opj_codec_t *codec;
+	opj_image_t *jpx = NULL;
+	opj_stream_t *stream;
+	OPJ_CODEC_FORMAT format;
+	stream_block sb;
+	OPJ_UINT32 i;
+	int ok;
+
+	if (size < 2)
+		fz_throw(ctx, FZ_ERROR_GENERIC, "not enough data to determine image format");
+
+	if (data[0] == 0xFF && data[1] == 0x4F)
+		format = OPJ_CODEC_J2K;
+	else
+		format = OPJ_CODEC_JP2;
+
+	opj_set_default_decoder_parameters(&params);
+	codec = opj_create_decompress(format);
+	opj_set_info_handler(codec, fz_opj_info_callback, ctx);
+	opj_set_warning_handler(codec, fz_opj_warning_callback, ctx);
+	opj_set_error_handler(codec, fz_opj_error_callback, ctx);
+	if (!opj_setup_decoder(codec, &params))
+	{
+		opj_destroy_codec(codec);
+		fz_throw(ctx, FZ_ERROR_GENERIC, "j2k decode failed");
+	}
+
+	stream = opj_stream_default_create(OPJ_TRUE);
+	sb.data = data;
+	sb.pos = 0;
+	sb.size = size;
+
+	opj_stream_set_read_function(stream, fz_opj_stream_read);
+	opj_stream_set_skip_function(stream, fz_opj_stream_skip);
+	opj_stream_set_seek_function(stream, fz_opj_stream_seek);
+	opj_stream_set_user_data(stream, &sb, NULL);
+	opj_stream_set_user_data_length(stream, size);
+
+	ok = opj_read_header(stream, codec, &jpx);
+	opj_stream_destroy(stream);
+	opj_destroy_codec(codec);
+	if (!ok || !jpx)
+	{
+		opj_image_destroy(jpx);
+		fz_throw(ctx, FZ_ERROR_GENERIC, "Failed to read JPX header");
+	}
+
+	*wp = jpx->x1 - jpx->x0;
+	*hp = jpx->y1 - jpx->y0;
+	*np = *ap = 0;
+	*bpcp = jpx->numcomps > 0 ? (int)jpx->comps[0].prec : -1;
+	for (i = 0; i < jpx->numcomps; ++i)
+	{
+		if (jpx->comps[i].alpha)
+			++*ap;
+		else
+			++*np;
+		if ((int)jpx->comps[i].prec != *bpcp)
+			*bpcp = -1;
+	}
+	opj_image_destroy(jpx);
+
+	if (format == OPJ_CODEC_JP2 && jp2_has_pclr_or_cdef(data, size))
+		*np = *ap = -1;
+}
+
+void
+fz_load_jpx_header(fz_context *ctx, const unsigned char *data, size_t size, int *wp, int *hp, int *np, int *ap, int *bpcp)
+{
+	fz_try(ctx)
+	{
+		opj_lock(ctx);
+		jpx_read_header(ctx, data, size, wp, hp, np, ap, bpcp);
+	}
+	fz_always(ctx)
+		opj_unlock(ctx);
+	fz_catch(ctx)
+		fz_rethrow(ctx);
+}
+
 void
 fz_load_jpx_info(fz_context *ctx, const unsigned char *data, size_t size, int *wp, int *hp, int *xresp, int *yresp, fz_colorspace **cspacep)
 {
@@ -659,7 +852,7 @@ fz_load_jpx_info(fz_context *ctx, const unsigned char *data, size_t size, int *w
 	fz_try(ctx)
 	{
 		opj_lock(ctx);
-		jpx_read_image(ctx, &state, data, size, NULL, 1);
+		jpx_read_image(ctx, &state, data, size, NULL, 1, NULL);
 	}
 	fz_always(ctx)
 		opj_unlock(ctx);
@@ -681,6 +874,18 @@ fz_load_jpx(fz_context *ctx, const unsigned char *data, size_t size, fz_colorspa
 	fz_throw(ctx, FZ_ERROR_GENERIC, "JPX support disabled");
 }
 
+fz_pixmap *
+fz_load_jpx_reduced(fz_context *ctx, const unsigned char *data, size_t size, fz_colorspace *defcs, int *l2factor)
+{
+	fz_throw(ctx, FZ_ERROR_GENERIC, "JPX support disabled");
+}
+
+void
+fz_load_jpx_header(fz_context *ctx, const unsigned char *data, size_t size, int *wp, int *hp, int *np, int *ap, int *bpcp)
+{
+	fz_throw(ctx, FZ_ERROR_GENERIC, "JPX support disabled");
+}
+
 void
 fz_load_jpx_info(fz_context *ctx, const unsigned char *data, size_t size, int *wp, int *hp, int *xresp, int *yresp, fz_colorspace **cspacep)
 {
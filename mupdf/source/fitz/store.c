@@ -1004,6 +1004,71 @@ fz_shrink_store(fz_context *ctx, unsigned int percent)
 	return success;
 }
 
+/* SumatraPDF: accessors used to enforce a store budget shared by many contexts */
+size_t fz_store_current_size(fz_context *ctx)
+{
+	size_t size;
+
+	if (ctx->store == NULL)
+		return 0;
+
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	size = ctx->store->size;
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+	return size;
+}
+
+size_t fz_store_max_size(fz_context *ctx)
+{
+	if (ctx->store == NULL)
+		return 0;
+	return ctx->store->max;
+}
+
+void fz_set_store_max_size(fz_context *ctx, size_t max)
+{
+	fz_store *store = ctx->store;
+
+	if (store == NULL)
+		return;
+
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	store->max = max;
+	if (max != FZ_STORE_UNLIMITED && store->size > max)
+		scavenge(ctx, store->size - max);
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+}
+
+size_t fz_evict_store_bytes(fz_context *ctx, size_t tofree)
+{
+	fz_store *store = ctx->store;
+	size_t before, after;
+
+	if (store == NULL || tofree == 0)
+		return 0;
+
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	before = store->size;
+	scavenge(ctx, tofree);
+	after = store->size;
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+
+	return before > after ? before - after : 0;
+}
+
+void fz_enumerate_store(fz_context *ctx, fz_store_enumerate_fn *fn, void *arg)
+{
+	fz_item *item;
+
+	if (ctx->store == NULL)
+		return;
+
+	fz_lock(ctx, FZ_LOCK_ALLOC);
+	for (item = ctx->store->head; item; item = item->next)
+		fn(arg, item->type, item->val, item->size);
+	fz_unlock(ctx, FZ_LOCK_ALLOC);
+}
+
 void fz_filter_store(fz_context *ctx, fz_store_filter_fn *fn, void *arg, const fz_store_type *type)
 {
 	fz_store *store;
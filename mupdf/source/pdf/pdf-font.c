@@ -609,6 +609,13 @@ pdf_drop_font_imp(fz_context *ctx, fz_storable *fontdesc_)
 	fz_free(ctx, fontdesc);
 }
 
+/* SumatraPDF: used to attribute store memory to fonts */
+int
+pdf_is_font_storable(const fz_storable *sc)
+{
+	return sc != NULL && sc->drop == pdf_drop_font_imp;
+}
+
 pdf_font_desc *
 pdf_new_font_desc(fz_context *ctx)
 {
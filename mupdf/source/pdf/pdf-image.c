@@ -241,6 +241,46 @@ pdf_is_jpx_image(fz_context *ctx, pdf_obj *dict)
 	return 0;
 }
 
+/* SumatraPDF: JPX images that don't need any post-processing of the decoded pixmap
+ * and whose codestream matches the image dictionary. The size of the image is
+ * taken from the codestream header, as that's what decoding it produces. */
+static int
+pdf_jpx_can_decode_lazily(fz_context *ctx, pdf_obj *dict, fz_colorspace *colorspace, fz_buffer *buf, int *wp, int *hp)
+{
+	unsigned char *data;
+	size_t len;
+	pdf_obj *obj;
+	int n, a, bpc;
+
+	if (!colorspace || fz_colorspace_is_indexed(ctx, colorspace))
+		return 0;
+	if (pdf_dict_geta(ctx, dict, PDF_NAME(Decode), PDF_NAME(D)))
+		return 0;
+	if (pdf_to_int(ctx, pdf_dict_get(ctx, dict, PDF_NAME(SMaskInData))) != 0)
+		return 0;
+
+	len = fz_buffer_storage(ctx, buf, &data);
+	fz_try(ctx)
+		fz_load_jpx_header(ctx, data, len, wp, hp, &n, &a, &bpc);
+	fz_catch(ctx)
+	{
+		fz_rethrow_if(ctx, FZ_ERROR_TRYLATER);
+		/* decoding it eagerly reports the error */
+		return 0;
+	}
+
+	/* alpha in the codestream (and SMask) or a different number of
+	 * components than the colorspace are sorted out by eager decoding */
+	if (a != 0 || n != fz_colorspace_n(ctx, colorspace))
+		return 0;
+	if (bpc < 1 || bpc > 16)
+		return 0;
+	obj = pdf_dict_geta(ctx, dict, PDF_NAME(BitsPerComponent), PDF_NAME(BPC));
+	if (pdf_is_int(ctx, obj) && pdf_to_int(ctx, obj) != bpc)
+		return 0;
+	return *wp > 0 && *hp > 0;
+}
+
 static fz_image *
 pdf_load_jpx(fz_context *ctx, pdf_document *doc, pdf_obj *dict, int forcemask)
 {
@@ -250,6 +290,7 @@ pdf_load_jpx(fz_context *ctx, pdf_document *doc, pdf_obj *dict, int forcemask)
 	pdf_obj *obj;
 	fz_image *mask = NULL;
 	fz_image *img = NULL;
+	int w, h;
 
 	fz_var(pix);
 	fz_var(buf);
@@ -268,6 +309,24 @@ pdf_load_jpx(fz_context *ctx, pdf_document *doc, pdf_obj *dict, int forcemask)
 		if (obj)
 			colorspace = pdf_load_colorspace(ctx, obj);
 
+		/* SumatraPDF: keep simple JPX images compressed so that they are only decoded
+		 * when drawn, and at the lowest sufficient resolution (see fz_load_jpx_reduced) */
+		if (!forcemask && pdf_jpx_can_decode_lazily(ctx, dict, colorspace, buf, &w, &h))
+		{
+			fz_compressed_buffer *cbuf;
+			int interpolate = pdf_to_bool(ctx, pdf_dict_geta(ctx, dict, PDF_NAME(Interpolate), PDF_NAME(I)));
+
+			obj = pdf_dict_geta(ctx, dict, PDF_NAME(SMask), PDF_NAME(Mask));
+			if (pdf_is_dict(ctx, obj))
+				mask = pdf_load_image_imp(ctx, doc, NULL, obj, NULL, 1);
+
+			cbuf = fz_malloc_struct(ctx, fz_compressed_buffer);
+			cbuf->params.type = FZ_IMAGE_JPX;
+			cbuf->buffer = fz_keep_buffer(ctx, buf);
+			img = fz_new_image_from_compressed_buffer(ctx, w, h, 8, colorspace, 96, 96, interpolate, 0, NULL, NULL, cbuf, mask);
+			break;
+		}
+
 		len = fz_buffer_storage(ctx, buf, &data);
 		pix = fz_load_jpx(ctx, data, len, colorspace);
 
@@ -749,3 +749,265 @@ pdf_repair_obj_stms(fz_context *ctx, pdf_document *doc)
 			fz_throw(ctx, FZ_ERROR_GENERIC, "invalid reference to non-object-stream: %d (%d 0 R)", (int)entry->ofs, i);
 	}
 }
+
+/* SumatraPDF: cache for repaired xref tables, so that a broken file is only
+ * scanned once. The cached data is keyed by a fingerprint of the file and
+ * is validated before use; the storage is provided by the application. */
+
+#define REPAIR_CACHE_MAGIC 0x43584d53 /* "SMXC" */
+#define REPAIR_CACHE_VERSION 1
+#define REPAIR_CACHE_FINGERPRINT_SIZE (64 * 1024)
+#define REPAIR_CACHE_SPOT_CHECKS 16
+
+static pdf_repair_cache_load_fn *repair_cache_load = NULL;
+static pdf_repair_cache_save_fn *repair_cache_save = NULL;
+
+void
+pdf_set_repair_cache_funcs(pdf_repair_cache_load_fn *load, pdf_repair_cache_save_fn *save)
+{
+	repair_cache_load = load;
+	repair_cache_save = save;
+}
+
+static void
+md5_file_range(fz_context *ctx, fz_stream *file, fz_md5 *md5, int64_t ofs, int64_t len)
+{
+	unsigned char buf[4096];
+	size_t n;
+
+	fz_seek(ctx, file, ofs, SEEK_SET);
+	while (len > 0)
+	{
+		n = fz_read(ctx, file, buf, (size_t)fz_mini64(len, sizeof buf));
+		if (n == 0)
+			break;
+		fz_md5_update(md5, buf, n);
+		len -= n;
+	}
+}
+
+/* the fingerprint is file size and md5 of the first and last 64 kB */
+static void
+repair_cache_key(fz_context *ctx, pdf_document *doc, char key[PDF_REPAIR_CACHE_KEY_SIZE])
+{
+	unsigned char digest[16];
+	fz_md5 md5;
+	int64_t len;
+	int i;
+
+	fz_seek(ctx, doc->file, 0, SEEK_END);
+	len = fz_tell(ctx, doc->file);
+
+	fz_md5_init(&md5);
+	fz_md5_update_int64(&md5, len);
+	md5_file_range(ctx, doc->file, &md5, 0, fz_mini64(len, REPAIR_CACHE_FINGERPRINT_SIZE));
+	if (len > REPAIR_CACHE_FINGERPRINT_SIZE)
+	{
+		int64_t ofs = fz_maxi64(len - REPAIR_CACHE_FINGERPRINT_SIZE, REPAIR_CACHE_FINGERPRINT_SIZE);
+		md5_file_range(ctx, doc->file, &md5, ofs, len - ofs);
+	}
+	fz_md5_final(&md5, digest);
+
+	fz_snprintf(key, PDF_REPAIR_CACHE_KEY_SIZE, "%016llx-", (unsigned long long)len);
+	for (i = 0; i < 16; i++)
+		fz_snprintf(key + 17 + i * 2, 3, "%02x", digest[i]);
+}
+
+static void
+append_int64_le(fz_context *ctx, fz_buffer *buf, int64_t x)
+{
+	fz_append_int32_le(ctx, buf, (int)(x & 0xffffffff));
+	fz_append_int32_le(ctx, buf, (int)(x >> 32));
+}
+
+void
+pdf_save_repair_cache(fz_context *ctx, pdf_document *doc)
+{
+	char key[PDF_REPAIR_CACHE_KEY_SIZE];
+	fz_buffer *buf = NULL;
+	fz_output *out = NULL;
+	pdf_xref_entry *entry;
+	pdf_obj *length;
+	int i, len, stm_len;
+
+	if (!repair_cache_save || !doc->file)
+		return;
+
+	fz_var(buf);
+	fz_var(out);
+
+	fz_try(ctx)
+	{
+		repair_cache_key(ctx, doc, key);
+
+		len = pdf_xref_len(ctx, doc);
+		buf = fz_new_buffer(ctx, 1024 + (size_t)len * 28);
+		fz_append_int32_le(ctx, buf, REPAIR_CACHE_MAGIC);
+		fz_append_int32_le(ctx, buf, REPAIR_CACHE_VERSION);
+		fz_append_int32_le(ctx, buf, len);
+		for (i = 0; i < len; i++)
+		{
+			entry = pdf_get_xref_entry_no_null(ctx, doc, i);
+
+			/* remember stream lengths corrected by pdf_repair_xref */
+			stm_len = -1;
+			if (entry->type == 'n' && entry->stm_ofs && pdf_is_dict(ctx, entry->obj))
+			{
+				length = pdf_dict_get(ctx, entry->obj, PDF_NAME(Length));
+				if (!pdf_is_indirect(ctx, length) && pdf_is_int(ctx, length))
+					stm_len = pdf_to_int(ctx, length);
+			}
+
+			fz_append_byte(ctx, buf, entry->type ? entry->type : 'f');
+			fz_append_int16_le(ctx, buf, entry->gen);
+			fz_append_int32_le(ctx, buf, entry->num);
+			append_int64_le(ctx, buf, entry->ofs);
+			append_int64_le(ctx, buf, entry->stm_ofs);
+			fz_append_int32_le(ctx, buf, stm_len);
+		}
+
+		out = fz_new_output_with_buffer(ctx, buf);
+		pdf_print_obj(ctx, out, pdf_trailer(ctx, doc), 1, 1);
+		fz_close_output(ctx, out);
+
+		repair_cache_save(ctx, key, buf);
+	}
+	fz_always(ctx)
+	{
+		fz_drop_output(ctx, out);
+		fz_drop_buffer(ctx, buf);
+	}
+	fz_catch(ctx)
+	{
+		fz_rethrow_if(ctx, FZ_ERROR_TRYLATER);
+		fz_warn(ctx, "cannot save repaired xref");
+	}
+}
+
+static int
+repair_cache_check_entry(fz_context *ctx, pdf_document *doc, int num, pdf_xref_entry *entry)
+{
+	pdf_lexbuf *buf = &doc->lexbuf.base;
+
+	fz_seek(ctx, doc->file, entry->ofs, SEEK_SET);
+	if (pdf_lex(ctx, doc->file, buf) != PDF_TOK_INT || buf->i != num)
+		return 0;
+	if (pdf_lex(ctx, doc->file, buf) != PDF_TOK_INT || buf->i != entry->gen)
+		return 0;
+	return pdf_lex(ctx, doc->file, buf) == PDF_TOK_OBJ;
+}
+
+int
+pdf_load_repair_cache(fz_context *ctx, pdf_document *doc)
+{
+	char key[PDF_REPAIR_CACHE_KEY_SIZE];
+	fz_buffer *buf = NULL;
+	fz_stream *stm = NULL;
+	pdf_obj *trailer = NULL;
+	pdf_obj *dict = NULL;
+	int *stm_lens = NULL;
+	pdf_xref_entry *entry;
+	int64_t file_len;
+	int i, len, step, checked;
+	int ok = 0;
+
+	if (!repair_cache_load || !doc->file)
+		return 0;
+
+	fz_var(buf);
+	fz_var(stm);
+	fz_var(trailer);
+	fz_var(dict);
+	fz_var(stm_lens);
+
+	fz_try(ctx)
+	{
+		repair_cache_key(ctx, doc, key);
+		buf = repair_cache_load(ctx, key);
+		if (buf)
+		{
+			fz_seek(ctx, doc->file, 0, SEEK_END);
+			file_len = fz_tell(ctx, doc->file);
+
+			stm = fz_open_buffer(ctx, buf);
+			if (fz_read_int32_le(ctx, stm) != REPAIR_CACHE_MAGIC || fz_read_int32_le(ctx, stm) != REPAIR_CACHE_VERSION)
+				fz_throw(ctx, FZ_ERROR_GENERIC, "unknown repaired xref format");
+			len = fz_read_int32_le(ctx, stm);
+			if (len <= 0 || len > PDF_MAX_OBJECT_NUMBER + 1)
+				fz_throw(ctx, FZ_ERROR_GENERIC, "invalid repaired xref length");
+
+			pdf_forget_xref(ctx, doc);
+			pdf_ensure_solid_xref(ctx, doc, len);
+			stm_lens = fz_malloc_array(ctx, len, int);
+
+			for (i = 0; i < len; i++)
+			{
+				entry = pdf_get_populating_xref_entry(ctx, doc, i);
+				entry->type = (char)fz_read_byte(ctx, stm);
+				entry->gen = fz_read_uint16_le(ctx, stm);
+				entry->num = fz_read_int32_le(ctx, stm);
+				entry->ofs = fz_read_int64_le(ctx, stm);
+				entry->stm_ofs = fz_read_int64_le(ctx, stm);
+				stm_lens[i] = fz_read_int32_le(ctx, stm);
+				if (entry->type == 'n' && (entry->ofs <= 0 || entry->ofs >= file_len || entry->stm_ofs < 0 || entry->stm_ofs >= file_len))
+					fz_throw(ctx, FZ_ERROR_GENERIC, "invalid repaired xref entry (%d 0 R)", i);
+				if (entry->type == 'o' && (entry->ofs <= 0 || entry->ofs >= len))
+					fz_throw(ctx, FZ_ERROR_GENERIC, "invalid repaired xref entry (%d 0 R)", i);
+				if (entry->type != 'n' && entry->type != 'o' && entry->type != 'f')
+					fz_throw(ctx, FZ_ERROR_GENERIC, "invalid repaired xref entry (%d 0 R)", i);
+			}
+
+			trailer = pdf_parse_stm_obj(ctx, doc, stm, &doc->lexbuf.base);
+			if (!pdf_is_dict(ctx, trailer))
+				fz_throw(ctx, FZ_ERROR_GENERIC, "invalid repaired xref trailer");
+			pdf_set_populating_xref_trailer(ctx, doc, trailer);
+
+			/* make sure the objects are where we think they are */
+			step = fz_maxi(1, len / REPAIR_CACHE_SPOT_CHECKS);
+			checked = 0;
+			for (i = 1; i < len && checked < REPAIR_CACHE_SPOT_CHECKS; i += step)
+			{
+				entry = pdf_get_populating_xref_entry(ctx, doc, i);
+				if (entry->type != 'n')
+					continue;
+				if (!repair_cache_check_entry(ctx, doc, i, entry))
+					fz_throw(ctx, FZ_ERROR_GENERIC, "repaired xref doesn't match file (%d 0 R)", i);
+				checked++;
+			}
+
+			/* re-apply stream lengths corrected by pdf_repair_xref (only done for unencrypted documents) */
+			if (!pdf_dict_get(ctx, trailer, PDF_NAME(Encrypt)))
+			{
+				for (i = 0; i < len; i++)
+				{
+					if (stm_lens[i] < 0)
+						continue;
+					dict = pdf_load_object(ctx, doc, i);
+					pdf_dict_put_int(ctx, dict, PDF_NAME(Length), stm_lens[i]);
+					pdf_drop_obj(ctx, dict);
+					dict = NULL;
+				}
+			}
+
+			/* repair_attempted stays 0 so that if the cached xref turns out
+			 * to be wrong later on, we can still do a full repair */
+			ok = 1;
+		}
+	}
+	fz_always(ctx)
+	{
+		pdf_drop_obj(ctx, dict);
+		pdf_drop_obj(ctx, trailer);
+		fz_drop_stream(ctx, stm);
+		fz_drop_buffer(ctx, buf);
+		fz_free(ctx, stm_lens);
+	}
+	fz_catch(ctx)
+	{
+		fz_rethrow_if(ctx, FZ_ERROR_TRYLATER);
+		fz_warn(ctx, "ignoring repaired xref from cache (%s)", fz_caught_message(ctx));
+		ok = 0;
+	}
+
+	return ok;
+}
@@ -1628,6 +1628,7 @@ pdf_init_document(fz_context *ctx, pdf_document *doc)
 {
 	pdf_obj *encrypt, *id;
 	int repaired = 0;
+	int repaired_from_cache = 0;
 
 	fz_try(ctx)
 	{
@@ -1675,7 +1676,10 @@ pdf_init_document(fz_context *ctx, pdf_document *doc)
 			/* pdf_repair_xref may access xref_index, so reset it properly */
 			if (doc->xref_index)
 				memset(doc->xref_index, 0, sizeof(int) * doc->max_xref_len);
-			pdf_repair_xref(ctx, doc);
+			/* SumatraPDF: re-use xref repaired when the file was last opened */
+			repaired_from_cache = pdf_load_repair_cache(ctx, doc);
+			if (!repaired_from_cache)
+				pdf_repair_xref(ctx, doc);
 			pdf_prime_xref_index(ctx, doc);
 		}
 
@@ -1687,9 +1691,10 @@ pdf_init_document(fz_context *ctx, pdf_document *doc)
 		/* Allow lazy clients to read encrypted files with a blank password */
 		(void)pdf_authenticate_password(ctx, doc, "");
 
-		if (repaired)
+		if (repaired && !repaired_from_cache)
 		{
 			pdf_repair_trailer(ctx, doc);
+			pdf_save_repair_cache(ctx, doc);
 		}
 	}
 	fz_catch(ctx)
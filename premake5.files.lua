@@ -732,6 +732,7 @@ function utils_files()
     "TempAllocator.*",
     "ThreadUtil.*",
     "TgaReader.*",
+    "Trace.*",
     "TrivialHtmlParser.*",
     "TxtParser.*",
     "UITask.*",
@@ -853,6 +854,7 @@ function mupdf_files()
     "draw-path.c",
     "draw-rasterize.c",
     "draw-scale-simple.c",
+    "draw-simd.c",
     "draw-unpack.c",
     "encode-basic.c",
     "encode-fax.c",
@@ -1126,6 +1128,7 @@ function test_util_files()
     "StrFormat.*",
     "StrUtil.*",
     "SquareTreeParser.*",
+    "ThreadUtil.*",
     "TrivialHtmlParser.*",
     "TempAllocator.*",
     "UtAssert.*",
@@ -1138,7 +1141,10 @@ function test_util_files()
     --"StressTesting.*",
     --"AppTools.*",
     "DisplayMode.*",
+    "FileHistory.*",
     "Flags.*",
+    "GlobalPrefs.*",
+    "PdfSync.*",
     "SumatraConfig.*",
     "SettingsStructs.*",
     "SumatraUnitTests.cpp",
@@ -1156,6 +1162,18 @@ function engine_dump_files()
   })
 end
 
+function engine_bench_files()
+  files_in_dir("src", {
+    "EngineBench.cpp",
+    "SumatraConfig.*",
+    "FzImgReader.*",
+    "TextSearch.*",
+    "TextSelection.*",
+    "mui/Mui.*",
+    "mui/TextRender.*"
+  })
+end
+
 function pdf_preview_files()
   files_in_dir("src/previewer", {
     "PdfPreview.*",
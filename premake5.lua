@@ -780,14 +780,37 @@ workspace "SumatraPDF"
       "version", "windowscodecs"
     }
 
+  -- headless benchmark of engines, see EngineBench.cpp
+  project "enginebench"
+    kind "ConsoleApp"
+    language "C++"
+    cppdialect "C++latest"
+    regconf()
+    includedirs { "src", "src/wingui", "mupdf/include" }
+    disablewarnings { "4100", "4267", "4457" }
+    engine_bench_files()
+    links_zlib()
+    links { "engines", "utils", "unrar", "mupdf", "unarrlib", "libwebp", "libdjvu" }
+    links {
+      "comctl32", "gdiplus", "msimg32", "psapi", "shlwapi",
+      "version", "windowscodecs"
+    }
+
   project "test_util"
     kind "ConsoleApp"
     language "C++"
     cppdialect "C++latest"
     regconf()
     disablewarnings { "4838" }
-    includedirs { "src" }
+    includedirs { "src", "mupdf/include" }
     test_util_files()
+    synctex_files()
+    -- for synctex
+    disablewarnings { "4100", "4244", "4267", "4706" }
+    uses_zlib()
+    includedirs { "ext/synctex" }
+    links_zlib()
+    links { "mupdf" }
     links { "gdiplus", "comctl32", "shlwapi", "Version" }
 
   project "logview"
@@ -2,11 +2,13 @@
    License: GPLv3 */
 
 #include "utils/BaseUtil.h"
+#include "utils/DirIter.h"
 #include "utils/FileUtil.h"
 #include "utils/FileWatcher.h"
 #include "utils/UITask.h"
 #include "utils/ScopedWin.h"
 #include "utils/WinUtil.h"
+#include "utils/StrFormat.h"
 #include "utils/Timer.h"
 
 #include "wingui/UIModels.h"
@@ -39,6 +41,32 @@ extern void RememberDefaultWindowPosition(MainWindow* win);
 
 static WatchedFile* gWatchedSettingsFile = nullptr;
 
+// Changes to the state of a single document (e.g. opening it or adding a
+// favorite) are appended to a journal instead of re-writing the whole settings
+// file (which includes the state of up to 1000 documents). Each process has its
+// own journal (as SaveSettings() only writes that process' state). All journals
+// are replayed after loading the settings and a process' journal is merged into
+// the settings file (and deleted) by its next SaveSettings(). Journals of
+// processes that have exited without saving are deleted by the next process
+// that has replayed and saved them. Entries are timestamped and only those
+// written after the settings file are replayed, as the journals of running
+// processes may contain states older than the last full save.
+constexpr const char* kSettingsJournalPrefix = "SumatraPDF-settings-journal-";
+constexpr const char* kSettingsJournalPattern = "SumatraPDF-settings-journal-*.txt";
+// after that many entries, SaveFileStateSettings() does a full SaveSettings()
+constexpr int kSettingsJournalMaxEntries = 64;
+
+// number of entries in this process' journal
+static int gSettingsJournalEntries = 0;
+
+// journals of other processes replayed by the last LoadSettings()
+struct ReplayedSettingsJournal {
+    char* path = nullptr;
+    i64 size = 0;
+    DWORD processId = 0;
+};
+static Vec<ReplayedSettingsJournal> gReplayedSettingsJournals;
+
 // number of weeks past since 2011-01-01
 static int GetWeekCount() {
     SYSTEMTIME date20110101{};
@@ -65,6 +93,95 @@ char* GetSettingsPathTemp() {
     return AppGenDataFilenameTemp(GetSettingsFileNameTemp());
 }
 
+static char* GetSettingsJournalPathTemp() {
+    char* name = fmt::FormatTemp("%s%d.txt", kSettingsJournalPrefix, (int)GetCurrentProcessId());
+    return AppGenDataFilenameTemp(name);
+}
+
+static bool IsProcessRunning(DWORD processId) {
+    AutoCloseHandle h = OpenProcess(SYNCHRONIZE, FALSE, processId);
+    return h.IsValid() && WaitForSingleObject(h, 0) == WAIT_TIMEOUT;
+}
+
+static void FreeReplayedSettingsJournals() {
+    for (auto& j : gReplayedSettingsJournals) {
+        str::Free(j.path);
+    }
+    gReplayedSettingsJournals.Reset();
+}
+
+static bool AppendToFile(const char* path, const ByteSlice& d) {
+    WCHAR* pathW = ToWstrTemp(path);
+    AutoCloseHandle h = CreateFileW(pathW, FILE_APPEND_DATA, FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+                                    FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (!h.IsValid()) {
+        return false;
+    }
+    DWORD written = 0;
+    BOOL ok = WriteFile(h, d.data(), (DWORD)d.size(), &written, nullptr);
+    return ok && written == (DWORD)d.size();
+}
+
+// merges the file states from the journal at path written after settingsTime,
+// returns the number of entries
+static int ReplaySettingsJournal(const char* path, const FILETIME& settingsTime, i64* sizeOut) {
+    ByteSlice journal = file::ReadFile(path);
+    *sizeOut = (i64)journal.size();
+    if (journal.empty()) {
+        return 0;
+    }
+    int nEntries = gFileHistory.MergeJournal((char*)journal.data(), settingsTime);
+    journal.Free();
+    return nEntries;
+}
+
+// applies changes to file states saved (by any process) since
+// the settings file was last written at settingsTime
+static void ReplaySettingsJournals(const FILETIME& settingsTime) {
+    gSettingsJournalEntries = 0;
+    FreeReplayedSettingsJournals();
+
+    char* ownPath = GetSettingsJournalPathTemp();
+    StrVec paths;
+    CollectPathsFromDirectory(AppGenDataFilenameTemp(kSettingsJournalPattern), paths, false);
+    int nEntries = 0;
+    for (char* path : paths) {
+        i64 size = 0;
+        int n = ReplaySettingsJournal(path, settingsTime, &size);
+        nEntries += n;
+        if (str::EqI(path, ownPath)) {
+            // left behind by an exited process with the same id
+            gSettingsJournalEntries = n;
+            continue;
+        }
+        const char* name = path::GetBaseNameTemp(path) + str::Len(kSettingsJournalPrefix);
+        ReplayedSettingsJournal j;
+        j.path = str::Dup(path);
+        j.size = size;
+        j.processId = (DWORD)atoi(name);
+        gReplayedSettingsJournals.Append(j);
+    }
+    logf("ReplaySettingsJournals: replayed %d entries from %d journals\n", nEntries, paths.Size());
+}
+
+// called once the settings file contains all changes from this process' journal
+// and from the journals replayed by the last LoadSettings()
+static void DeleteSettingsJournals() {
+    if (gSettingsJournalEntries > 0) {
+        file::Delete(GetSettingsJournalPathTemp());
+    }
+    gSettingsJournalEntries = 0;
+
+    // journals of running processes are deleted by their own SaveSettings()
+    // and the size check makes sure no entries have been added since replaying
+    for (auto& j : gReplayedSettingsJournals) {
+        if (!IsProcessRunning(j.processId) && file::GetSize(j.path) == j.size) {
+            file::Delete(j.path);
+        }
+    }
+    FreeReplayedSettingsJournals();
+}
+
 static void setMin(int& i, int minVal) {
     if (i < minVal) {
         i = minVal;
@@ -106,6 +223,10 @@ bool LoadSettings() {
         prefsData.Free();
     }
 
+    // TODO: verify that all states have a non-nullptr file path?
+    gFileHistory.UpdateStatesSource(gprefs->fileStates);
+    ReplaySettingsJournals(file::GetModificationTime(settingsPath));
+
     if (!gprefs->uiLanguage || !trans::ValidateLangCode(gprefs->uiLanguage)) {
         // guess the ui language on first start
         str::ReplaceWithCopy(&gprefs->uiLanguage, trans::DetectUserLang());
@@ -165,8 +286,6 @@ bool LoadSettings() {
     setMin(gprefs->treeFontSize, 0);
     setMinMax(gprefs->toolbarSize, 8, 64);
 
-    // TODO: verify that all states have a non-nullptr file path?
-    gFileHistory.UpdateStatesSource(gprefs->fileStates);
     //    auto fontName = ToWstrTemp(gprefs->fixedPageUI.ebookFontName);
     //    SetDefaultEbookFont(fontName.Get(), gprefs->fixedPageUI.ebookFontSize);
 
@@ -266,6 +385,7 @@ bool SaveSettings() {
 
     // only save if anything's changed at all
     if (prevPrefs.size() == prefs.size() && str::Eq(prefs, prevPrefs)) {
+        DeleteSettingsJournals();
         return true;
     }
 
@@ -273,11 +393,47 @@ bool SaveSettings() {
     bool ok = file::WriteFile(path, prefs);
     if (ok) {
         gGlobalPrefs->lastPrefUpdate = file::GetModificationTime(path);
+        // the settings file now contains all changes from the journals
+        DeleteSettingsJournals();
     }
     WatchedFileSetIgnore(gWatchedSettingsFile, false);
     return ok;
 }
 
+// cheaper alternative to SaveSettings() for when only the state of the document
+// filePath has changed: only appends that state to the settings journal
+// if isMostRecent, the document is moved to the front of the file history when
+// the journal is replayed (i.e. it has just been opened)
+// note: unlike SaveSettings(), this doesn't remember the session state
+bool SaveFileStateSettings(const char* filePath, bool isMostRecent) {
+    if (!HasPermission(Perm::SavePreferences)) {
+        return false;
+    }
+    FileState* fs = gFileHistory.FindByPath(filePath);
+    bool canJournal = fs && gGlobalPrefs->rememberStatePerDocument && gGlobalPrefs->rememberOpenedFiles;
+    if (!canJournal || gSettingsJournalEntries >= kSettingsJournalMaxEntries) {
+        return SaveSettings();
+    }
+
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    ByteSlice entry = SerializeFileStateJournalEntry(fs, isMostRecent, now);
+    if (entry.empty()) {
+        return SaveSettings();
+    }
+    str::Str data;
+    data.Append((const char*)entry.data(), entry.size());
+    data.Append(kSettingsJournalEntryEnd);
+    str::Free(entry.data());
+
+    bool ok = AppendToFile(GetSettingsJournalPathTemp(), data.AsByteSlice());
+    if (!ok) {
+        return SaveSettings();
+    }
+    gSettingsJournalEntries++;
+    return true;
+}
+
 // refresh the preferences when a different SumatraPDF process saves them
 // or if they are edited by the user using a text editor
 bool ReloadSettings() {
@@ -14,6 +14,7 @@ char* GetSettingsFileNameTemp();
 
 bool LoadSettings();
 bool SaveSettings();
+bool SaveFileStateSettings(const char* filePath, bool isMostRecent = false);
 bool ReloadSettings();
 void CleanUpSettings();
 void RegisterSettingsForFileChanges();
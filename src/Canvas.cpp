@@ -246,8 +246,10 @@ static bool StopDraggingAnnotation(MainWindow* win, int x, int y, bool aborted)
         r.dy = ar.dy;
         // logf("prev rect: x=%.2f, y=%.2f, dx=%.2f, dy=%.2f\n", ar.x, ar.y, ar.dx, ar.dy);
         // logf(" new rect: x=%.2f, y=%.2f, dx=%.2f, dy=%.2f\n", r.x, r.y, r.dx, r.dy);
+        RectF prevBounds = GetBounds(annot);
         SetRect(annot, r);
-        MainWindowRerender(win);
+        // only re-render where the annotation was and is now
+        MainWindowRerender(win, pageNo, prevBounds.Union(GetBounds(annot)));
         ToolbarUpdateStateForWindow(win, true);
         StartEditAnnotations(win->CurrentTab(), annot);
     } else {
@@ -894,7 +896,9 @@ static void DrawDocument(MainWindow* win, HDC hdc, RECT* rcArea) {
     Rect screen(Point(), dm->GetViewPort().Size());
 
     bool isRtl = IsUIRightToLeft();
-    for (int pageNo = 1; pageNo <= dm->PageCount(); ++pageNo) {
+    int firstVisiblePage = dm->FirstVisiblePageNo();
+    int lastVisiblePage = dm->LastVisiblePageNo();
+    for (int pageNo = firstVisiblePage; pageNo > 0 && pageNo <= lastVisiblePage; ++pageNo) {
         PageInfo* pageInfo = dm->GetPageInfo(pageNo);
         if (!pageInfo || 0.0f == pageInfo->visibleRatio) {
             continue;
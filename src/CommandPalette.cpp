@@ -81,6 +81,8 @@ static i32 gDocumentNotOpenWhitelist[] = {
     CmdDebugDownloadSymbols,
     CmdDebugShowNotif,
     CmdDebugStartStressTest,
+    CmdDebugToggleTrace,
+    CmdDebugShowMemoryStats,
     CmdDebugTestApp,
     CmdFavoriteToggle,
     CmdToggleFullscreen,
@@ -281,6 +283,8 @@ static bool AllowCommand(const CommandPaletteBuildCtx& ctx, i32 cmdId) {
 
     switch (cmdId) {
         case CmdDebugShowLinks:
+        case CmdDebugToggleTrace:
+        case CmdDebugShowMemoryStats:
             return gIsDebugBuild || gIsPreReleaseBuild;
         case CmdDebugTestApp:
         case CmdDebugShowNotif:
@@ -132,6 +132,8 @@ Cmd* enum (e.g. CmdOpen) and a human-readable name (not used yet).
     V(CmdDebugTestApp, "Debug: Test App")                                 \
     V(CmdDebugShowNotif, "Debug: Show Notification")                      \
     V(CmdDebugStartStressTest, "Debug: Start Stress Test")                \
+    V(CmdDebugToggleTrace, "Debug: Start/Stop Tracing")                   \
+    V(CmdDebugShowMemoryStats, "Debug: Show Memory Stats")                \
     V(CmdCreateAnnotText, "Create Text Annotation")                       \
     V(CmdCreateAnnotLink, "Create Link Annotation")                       \
     V(CmdCreateAnnotFreeText, "Create Free Text Annotation")              \
@@ -156,6 +156,7 @@ static char* BuildCrashInfoText(bool forCrash) {
     GetModules(s, true);
 
     s.Append("\n\n-------- Log -----------------\n\n");
+    FlushLogs();
     s.Append(gLogBuf->LendData());
 
     if (gSettingsFile) {
@@ -411,6 +412,14 @@ static LONG WINAPI DumpExceptionHandler(EXCEPTION_POINTERS* exceptionInfo) {
         return EXCEPTION_CONTINUE_SEARCH;
     }
 
+    // write out queued (asynchronous) log messages while we still format
+    // and allocate, so that they're part of the crash report
+    // (only once, in case we crashed while doing that)
+    static bool didFlushLogs = false;
+    if (!didFlushLogs) {
+        didFlushLogs = true;
+        FlushLogs();
+    }
     gReducedLogging = true;
 
     log("DumpExceptionHandler\n");
@@ -47,6 +47,7 @@
 #include "utils/WinUtil.h"
 #include "utils/ScopedWin.h"
 #include "utils/Timer.h"
+#include "utils/Trace.h"
 
 #include "wingui/UIModels.h"
 
@@ -67,6 +68,13 @@
 // if true, we pre-render the pages right before and after the visible pages
 static bool gPredictiveRender = true;
 
+// a pause this long between scroll events ends a scroll gesture
+constexpr double kScrollGestureMs = 400;
+// while scrolling, prefetch the pages that will be visible
+// this many frames (at 60 fps) from now
+constexpr int kPrefetchFrames = 30;
+constexpr int kMaxPrefetchPages = 4;
+
 static int ColumnsFromDisplayMode(DisplayMode displayMode) {
     if (!IsSingle(displayMode)) {
         return 2;
@@ -108,6 +116,10 @@ DisplayMode DisplayModel::GetDisplayMode() const {
     return displayMode;
 }
 
+bool DisplayModel::HasToc() {
+    return engine && engine->HasToc();
+}
+
 TocTree* DisplayModel::GetToc() {
     if (!engine) {
         return nullptr;
@@ -327,6 +339,18 @@ PageInfo* DisplayModel::GetPageInfo(int pageNo) const {
     return &(pagesInfo[pageNo - 1]);
 }
 
+// RecalcVisibleParts() only updates pageOnScreen of the pages in the view port,
+// this also works for pages that are scrolled out of view
+Rect DisplayModel::GetPageOnScreen(int pageNo) const {
+    PageInfo* pageInfo = GetPageInfo(pageNo);
+    if (!pageInfo) {
+        return Rect();
+    }
+    Rect r = pageInfo->pos;
+    r.Offset(-viewPort.x, -viewPort.y);
+    return r;
+}
+
 // Call this before the first Relayout
 void DisplayModel::SetInitialViewSettings(DisplayMode newDisplayMode, int newStartPage, Size viewPort, int screenDPI) {
     totalViewPortSize = viewPort;
@@ -430,6 +454,10 @@ bool DisplayModel::PageVisibleNearby(int pageNo) const {
     DisplayMode mode = GetDisplayMode();
     int columns = ColumnsFromDisplayMode(mode);
 
+    if (prefetchFirst <= pageNo && pageNo <= prefetchLast) {
+        return true;
+    }
+
     pageNo = FirstPageInARowNo(pageNo, columns, IsBookView(mode));
     for (int i = pageNo - columns; i < pageNo + 2 * columns; i++) {
         if (ValidPageNo(i) && PageVisible(i)) {
@@ -536,15 +564,19 @@ int DisplayModel::FirstVisiblePageNo() const {
         return kInvalidPageNo;
     }
 
-    for (int pageNo = 1; pageNo <= PageCount(); ++pageNo) {
-        PageInfo* pageInfo = GetPageInfo(pageNo);
-        if (pageInfo->visibleRatio > 0.0) {
-            return pageNo;
-        }
+    if (firstVisible > lastVisible) {
+        /* If no pages are visible */
+        return kInvalidPageNo;
     }
+    return firstVisible;
+}
 
-    /* If no pages are visible */
-    return kInvalidPageNo;
+int DisplayModel::LastVisiblePageNo() const {
+    CrashIf(!pagesInfo);
+    if (!pagesInfo || firstVisible > lastVisible) {
+        return kInvalidPageNo;
+    }
+    return lastVisible;
 }
 
 // we consider the most visible page the current one
@@ -562,7 +594,7 @@ int DisplayModel::CurrentPageNo() const {
     int mostVisiblePage = kInvalidPageNo;
     float ratio = 0;
 
-    for (int pageNo = 1; pageNo <= PageCount(); pageNo++) {
+    for (int pageNo = firstVisible; pageNo <= lastVisible; pageNo++) {
         PageInfo* pageInfo = GetPageInfo(pageNo);
         if (pageInfo->visibleRatio > ratio) {
             mostVisiblePage = pageNo;
@@ -660,6 +692,7 @@ void DisplayModel::Relayout(float newZoomVirtual, int newRotation) {
     if (!pagesInfo) {
         return;
     }
+    TRACE_SPAN("DisplayModel::Relayout");
 
     rotation = NormalizeRotation(newRotation);
 
@@ -848,6 +881,52 @@ RestartLayout:
     }
 
     canvasSize = Size(std::max(canvasDx, viewPort.dx), std::max(canvasDy, viewPort.dy));
+    BuildLayoutIndex();
+}
+
+// pages are laid out in rows from top to bottom, so the pages that
+// intersect a vertical range can be found with a binary search.
+// Must be called whenever the position of pages changes
+void DisplayModel::BuildLayoutIndex() {
+    int nPages = PageCount();
+    pagesMaxBottom.Reset();
+    pagesMinTop.Reset();
+    int* maxBottom = pagesMaxBottom.AppendBlanks(nPages);
+    int* minTop = pagesMinTop.AppendBlanks(nPages);
+    int bottom = INT_MIN;
+    for (int i = 0; i < nPages; i++) {
+        PageInfo* pageInfo = &(pagesInfo[i]);
+        if (pageInfo->shown) {
+            bottom = std::max(bottom, pageInfo->pos.y + pageInfo->pos.dy);
+        }
+        maxBottom[i] = bottom;
+    }
+    int top = INT_MAX;
+    for (int i = nPages - 1; i >= 0; i--) {
+        PageInfo* pageInfo = &(pagesInfo[i]);
+        if (pageInfo->shown) {
+            top = std::min(top, pageInfo->pos.y);
+        }
+        minTop[i] = top;
+    }
+}
+
+// returns the range of pages that might intersect the vertical range [y, y + dy)
+// of the canvas (all the pages outside of it don't). The range is empty
+// (*firstPageNo > *lastPageNo) if there are no such pages
+void DisplayModel::GetPagesInRange(int y, int dy, int* firstPageNo, int* lastPageNo) const {
+    int nPages = pagesMaxBottom.isize();
+    if (nPages == 0 || nPages != PageCount()) {
+        *firstPageNo = 1;
+        *lastPageNo = 0;
+        return;
+    }
+    const int* maxBottom = pagesMaxBottom.LendData();
+    const int* minTop = pagesMinTop.LendData();
+    // the pages before the first one ending below y end above it
+    *firstPageNo = (int)(std::upper_bound(maxBottom, maxBottom + nPages, y) - maxBottom) + 1;
+    // the pages after the last one starting above y + dy start below it
+    *lastPageNo = (int)(std::lower_bound(minTop, minTop + nPages, y + dy) - minTop);
 }
 
 void DisplayModel::ChangeStartPage(int newStartPage) {
@@ -871,6 +950,8 @@ void DisplayModel::ChangeStartPage(int newStartPage) {
         }
         pageInfo->visibleRatio = 0.0;
     }
+    firstVisible = 1;
+    lastVisible = 0;
     Relayout(zoomVirtual, rotation);
 }
 
@@ -884,7 +965,22 @@ void DisplayModel::RecalcVisibleParts() const {
         return;
     }
 
-    for (int pageNo = 1; pageNo <= PageCount(); ++pageNo) {
+    int first, last;
+    GetPagesInRange(viewPort.y, viewPort.dy, &first, &last);
+
+    // only the pages that were visible before might have been scrolled out of view
+    int nPages = PageCount();
+    for (int pageNo = std::max(firstVisible, 1); pageNo <= std::min(lastVisible, nPages); ++pageNo) {
+        if (pageNo < first || pageNo > last) {
+            PageInfo* pageInfo = GetPageInfo(pageNo);
+            pageInfo->visibleRatio = 0.0;
+            pageInfo->painted = false;
+        }
+    }
+
+    firstVisible = nPages + 1;
+    lastVisible = 0;
+    for (int pageNo = std::max(first, 1); pageNo <= std::min(last, nPages); ++pageNo) {
         PageInfo* pageInfo = GetPageInfo(pageNo);
         if (!pageInfo->shown) {
             CrashIf(0.0 != pageInfo->visibleRatio);
@@ -899,6 +995,10 @@ void DisplayModel::RecalcVisibleParts() const {
             CrashIf(pageRect.dx <= 0 || pageRect.dy <= 0);
             // calculate with floating point precision to prevent an integer overflow
             pageInfo->visibleRatio = 1.0f * visiblePart.dx * visiblePart.dy / ((float)pageRect.dx * pageRect.dy);
+            firstVisible = std::min(firstVisible, pageNo);
+            lastVisible = pageNo;
+        } else {
+            pageInfo->painted = false;
         }
         pageInfo->pageOnScreen = pageRect;
         pageInfo->pageOnScreen.Offset(-viewPort.x, -viewPort.y);
@@ -911,14 +1011,16 @@ int DisplayModel::GetPageNoByPoint(Point pt) const {
         return -1;
     }
 
-    for (int pageNo = 1; pageNo <= PageCount(); ++pageNo) {
+    int first, last;
+    GetPagesInRange(pt.y + viewPort.y, 1, &first, &last);
+    for (int pageNo = std::max(first, 1); pageNo <= std::min(last, PageCount()); ++pageNo) {
         PageInfo* pageInfo = GetPageInfo(pageNo);
         CrashIf(!(0.0 == pageInfo->visibleRatio || pageInfo->shown));
         if (!pageInfo->shown) {
             continue;
         }
 
-        if (pageInfo->pageOnScreen.Contains(pt)) {
+        if (GetPageOnScreen(pageNo).Contains(pt)) {
             return pageNo;
         }
     }
@@ -933,26 +1035,51 @@ int DisplayModel::GetPageNextToPoint(Point pt) const {
 
     unsigned int maxDist = UINT_MAX;
     int closest = startPage;
+    int nPages = PageCount();
+    int y = pt.y + viewPort.y;
 
-    for (int pageNo = 1; pageNo <= PageCount(); ++pageNo) {
-        PageInfo* pageInfo = GetPageInfo(pageNo);
-        CrashIf(0.0 != pageInfo->visibleRatio && !pageInfo->shown);
-        if (!pageInfo->shown) {
-            continue;
-        }
+    // returns true if a page in the vertical range [y - h, y + h) of the canvas contains pt
+    auto findClosest = [&](int h) -> bool {
+        int first, last;
+        GetPagesInRange(y - h, 2 * h, &first, &last);
+        for (int pageNo = std::max(first, 1); pageNo <= std::min(last, nPages); ++pageNo) {
+            PageInfo* pageInfo = GetPageInfo(pageNo);
+            CrashIf(0.0 != pageInfo->visibleRatio && !pageInfo->shown);
+            if (!pageInfo->shown) {
+                continue;
+            }
 
-        if (pageInfo->pageOnScreen.Contains(pt)) {
-            return pageNo;
+            Rect r = GetPageOnScreen(pageNo);
+            if (r.Contains(pt)) {
+                closest = pageNo;
+                return true;
+            }
+
+            unsigned int dist = distSq(pt.x - r.x - r.dx / 2, pt.y - r.y - r.dy / 2);
+            if (dist < maxDist) {
+                closest = pageNo;
+                maxDist = dist;
+            }
         }
+        return false;
+    };
 
-        Rect r = pageInfo->pageOnScreen;
-        unsigned int dist = distSq(pt.x - r.x - r.dx / 2, pt.y - r.y - r.dy / 2);
-        if (dist < maxDist) {
-            closest = pageNo;
-            maxDist = dist;
+    // widen the range around pt until it contains a page
+    int h = std::max(viewPort.dy, 1);
+    while (maxDist == UINT_MAX) {
+        if (findClosest(h)) {
+            return closest;
+        }
+        if (h > canvasSize.dy + abs(y)) {
+            // no page is shown
+            return closest;
         }
+        h *= 2;
     }
-
+    // the center of a page that doesn't intersect [y - h, y + h) is
+    // further away from pt than h, and so further than the closest page
+    h = (int)ceil(sqrt((double)maxDist)) + 1;
+    findClosest(h);
     return closest;
 }
 
@@ -994,7 +1121,7 @@ Point DisplayModel::CvtToScreen(int pageNo, PointF pt) {
 
     PointF p = engine->Transform(pt, pageNo, zoom, rotation);
     // don't add the full 0.5 for rounding to account for precision errors
-    Rect r = pageInfo->pageOnScreen;
+    Rect r = GetPageOnScreen(pageNo);
     p.x += 0.499 + r.x;
     p.y += 0.499 + r.y;
 
@@ -1019,7 +1146,7 @@ PointF DisplayModel::CvtFromScreen(Point pt, int pageNo) {
     }
 
     // don't add the full 0.5 for rounding to account for precision errors
-    Rect r = pageInfo->pageOnScreen;
+    Rect r = GetPageOnScreen(pageNo);
     PointF p = PointF(pt.x - 0.499 - r.x, pt.y - 0.499 - r.y);
 
     float zoom = getZoomSafe(this, pageNo, pageInfo);
@@ -1089,22 +1216,11 @@ bool DisplayModel::IsOverText(Point pt) {
 }
 
 void DisplayModel::RenderVisibleParts() {
-    int firstVisiblePage = 0;
-    int lastVisiblePage = 0;
-
-    for (int pageNo = 1; pageNo <= PageCount(); ++pageNo) {
-        PageInfo* pageInfo = GetPageInfo(pageNo);
-        if (pageInfo->visibleRatio > 0.0) {
-            CrashIf(!pageInfo->shown);
-            if (0 == firstVisiblePage) {
-                firstVisiblePage = pageNo;
-            }
-            lastVisiblePage = pageNo;
-        }
-    }
+    int firstVisiblePage = FirstVisiblePageNo();
+    int lastVisiblePage = LastVisiblePageNo();
     // no page is visible if e.g. the window is resized
     // vertically until only the title bar remains visible
-    if (0 == firstVisiblePage) {
+    if (kInvalidPageNo == firstVisiblePage) {
         return;
     }
 
@@ -1116,6 +1232,8 @@ void DisplayModel::RenderVisibleParts() {
     }
 
     if (gPredictiveRender) {
+        PrefetchPredictedPages(firstVisiblePage, lastVisiblePage);
+
         // prerender two more pages in facing and book view modes
         // if the rendering queue still has place for them
         if (!IsSingle(GetDisplayMode())) {
@@ -1141,6 +1259,90 @@ void DisplayModel::RenderVisibleParts() {
     }
 }
 
+// the scroll position in pages: the first visible page plus how much of it has
+// been scrolled past (in facing modes, a row of pages counts as two pages)
+float DisplayModel::GetScrollPagePos() const {
+    int columns = ColumnsFromDisplayMode(GetDisplayMode());
+    for (int pageNo = firstVisible; pageNo <= lastVisible; ++pageNo) {
+        PageInfo* pageInfo = GetPageInfo(pageNo);
+        if (pageInfo->visibleRatio <= 0 || pageInfo->pos.dy <= 0) {
+            continue;
+        }
+        float scrolled = (float)(viewPort.y - pageInfo->pos.y) / (float)pageInfo->pos.dy;
+        return (float)pageNo + limitValue(scrolled, 0.f, 1.f) * columns;
+    }
+    return 0;
+}
+
+// updates the scroll velocity used by PrefetchPredictedPages().
+// called whenever the user scrolls or changes the page
+void DisplayModel::TrackScrolling() {
+    float pos = GetScrollPagePos();
+    double dt = scrollPosTime.QuadPart != 0 ? TimeSinceInMs(scrollPosTime) : kScrollGestureMs;
+    float dpos = pos - scrollPos;
+    scrollPos = pos;
+    scrollPosTime = TimeGet();
+    if (dpos == 0) {
+        return;
+    }
+
+    float v = dpos / (float)std::max(dt, 1.0);
+    bool reversed = scrollVelocity != 0 && (v > 0) != (scrollVelocity > 0);
+    // the first event of a gesture and jumps (e.g. to a ToC item) don't tell where the user is going
+    bool isJump = dt >= kScrollGestureMs || fabsf(dpos) > kMaxPrefetchPages;
+    if ((reversed || isJump) && prefetchFirst <= prefetchLast) {
+        // what we've prefetched is not going to be needed
+        prefetchFirst = 0;
+        prefetchLast = -1;
+        cb->CancelPrefetchRendering();
+    }
+    if (isJump) {
+        scrollVelocity = 0;
+    } else if (reversed || scrollVelocity == 0) {
+        scrollVelocity = v;
+    } else {
+        // smooth out uneven intervals between scroll events
+        scrollVelocity = 0.5f * (scrollVelocity + v);
+    }
+}
+
+// while scrolling, requests the pages that are predicted to become visible
+// within the next kPrefetchFrames frames (beyond the pages right before
+// and after the visible ones, which are always prerendered)
+void DisplayModel::PrefetchPredictedPages(int firstVisiblePage, int lastVisiblePage) {
+    int nPages = 0;
+    if (scrollVelocity != 0 && TimeSinceInMs(scrollPosTime) < kScrollGestureMs) {
+        float aheadMs = kPrefetchFrames * 1000.f / 60.f;
+        nPages = (int)ceilf(fabsf(scrollVelocity) * aheadMs);
+        nPages = std::min(nPages, kMaxPrefetchPages);
+    }
+    prefetchFirst = 0;
+    prefetchLast = -1;
+    if (nPages == 0) {
+        return;
+    }
+
+    int nearby = IsSingle(GetDisplayMode()) ? 1 : 2;
+    if (scrollVelocity > 0) {
+        prefetchFirst = lastVisiblePage + nearby + 1;
+        prefetchLast = std::min(lastVisiblePage + nearby + nPages, PageCount());
+    } else {
+        prefetchFirst = std::max(firstVisiblePage - nearby - nPages, 1);
+        prefetchLast = firstVisiblePage - nearby - 1;
+    }
+
+    // requests of the same priority are rendered LIFO, so request the closest pages last
+    if (scrollVelocity > 0) {
+        for (int pageNo = prefetchLast; pageNo >= prefetchFirst; pageNo--) {
+            cb->PrefetchRendering(pageNo);
+        }
+    } else {
+        for (int pageNo = prefetchFirst; pageNo <= prefetchLast; pageNo++) {
+            cb->PrefetchRendering(pageNo);
+        }
+    }
+}
+
 void DisplayModel::SetViewPortSize(Size newViewPortSize) {
     ScrollState ss;
 
@@ -1271,6 +1473,7 @@ void DisplayModel::GoToPage(int pageNo, int scrollY, bool addNavPt, int scrollX)
     viewPort.y = limitValue(viewPort.y, 0, canvasSize.dy - viewPort.dy);
 
     RecalcVisibleParts();
+    TrackScrolling();
     RenderVisibleParts();
     cb->UpdateScrollbars(canvasSize);
     cb->PageNoChanged(this, pageNo);
@@ -1309,6 +1512,8 @@ void DisplayModel::SetDisplayMode(DisplayMode newDisplayMode, bool keepContinuou
             pageInfo->shown = true;
             pageInfo->visibleRatio = 0.0;
         }
+        firstVisible = 1;
+        lastVisible = 0;
         Relayout(zoomVirtual, rotation);
     }
     GoToPage(currPageNo, 0);
@@ -1391,7 +1596,7 @@ bool DisplayModel::GoToPrevPage(int scrollY) {
 
     // scroll to the bottom of the page
     if (-1 == scrollY) {
-        scrollY = GetPageInfo(firstPageInNewRow)->pageOnScreen.dy;
+        scrollY = GetPageInfo(firstPageInNewRow)->pos.dy;
     }
 
     GoToPage(firstPageInNewRow, scrollY);
@@ -1454,6 +1659,7 @@ void DisplayModel::ScrollYTo(int yOff) {
     int currPageNo = CurrentPageNo();
     viewPort.y = yOff;
     RecalcVisibleParts();
+    TrackScrolling();
     RenderVisibleParts();
 
     int newPageNo = CurrentPageNo();
@@ -1512,6 +1718,7 @@ void DisplayModel::ScrollYBy(int dy, bool changePage) {
     currPageNo = CurrentPageNo();
     viewPort.y = newYOff;
     RecalcVisibleParts();
+    TrackScrolling();
     RenderVisibleParts();
     cb->UpdateScrollbars(canvasSize);
     newPageNo = CurrentPageNo();
@@ -1718,7 +1925,7 @@ bool DisplayModel::ShowResultRectToScreen(TextSel* res) {
         return false;
     }
 
-    PageInfo* pageInfo = GetPageInfo(res->pages[0]);
+    Rect pageOnScreen = GetPageOnScreen(res->pages[0]);
     int sx = 0, sy = 0;
 
     // vertically, we try to position the search result between 40%
@@ -1736,10 +1943,10 @@ bool DisplayModel::ShowResultRectToScreen(TextSel* res) {
     // center of the screen, but don't scroll further than page
     // boundaries, so that as much context as possible remains visible
     if (extremes.x < 0) {
-        sx = std::max(extremes.x + extremes.dx / 2 - viewPort.dx / 2, pageInfo->pageOnScreen.x);
+        sx = std::max(extremes.x + extremes.dx / 2 - viewPort.dx / 2, pageOnScreen.x);
     } else if (extremes.x + extremes.dx >= viewPort.dx) {
         sx = std::min(extremes.x + extremes.dx / 2 - viewPort.dx / 2,
-                      pageInfo->pageOnScreen.x + pageInfo->pageOnScreen.dx - viewPort.dx);
+                      pageOnScreen.x + pageOnScreen.dx - viewPort.dx);
     }
 
     if (sx != 0) {
@@ -25,8 +25,13 @@ struct PageInfo {
 
     /* data that changes due to scrolling. Calculated in DisplayModel::RecalcVisibleParts() */
     float visibleRatio; /* (0.0 = invisible, 1.0 = fully visible) */
-    /* position of page relative to visible view port: pos.Offset(-viewPort.x, -viewPort.y) */
+    /* position of page relative to visible view port: pos.Offset(-viewPort.x, -viewPort.y)
+       (only up to date for the pages in the view port, for other pages
+       use DisplayModel::GetPageOnScreen()) */
     Rect pageOnScreen{};
+    /* set when the page is painted, reset when it's scrolled out of view.
+       For RenderCacheStats::pagesShown */
+    bool painted = false;
 
     // when zoomVirtual in DisplayMode is kZoomFitPage, kZoomFitWidth
     // or kZoomFitContent, this is per-page zoom level
@@ -93,6 +98,7 @@ struct DisplayModel : DocController {
     void SetViewPortSize(Size size) override;
 
     // table of contents
+    bool HasToc() override;
     TocTree* GetToc() override;
     void ScrollTo(int pageNo, RectF rect, float zoom) override;
     bool HandleLink(IPageDestination*, ILinkHandler*) override;
@@ -154,6 +160,7 @@ struct DisplayModel : DocController {
     bool PageVisible(int pageNo) const;
     bool PageVisibleNearby(int pageNo) const;
     int FirstVisiblePageNo() const;
+    int LastVisiblePageNo() const;
     bool FirstBookPageVisible() const;
     bool LastBookPageVisible() const;
 
@@ -175,6 +182,7 @@ struct DisplayModel : DocController {
     Annotation* GetAnnotationAtPos(Point pt, AnnotationType* allowedAnnots);
 
     int GetPageNoByPoint(Point pt) const;
+    Rect GetPageOnScreen(int pageNo) const;
     Point CvtToScreen(int pageNo, PointF pt);
     Rect CvtToScreen(int pageNo, RectF r);
     PointF CvtFromScreen(Point pt, int pageNo = kInvalidPageNo);
@@ -204,17 +212,32 @@ struct DisplayModel : DocController {
     Point GetContentStart(int pageNo) const;
     void RecalcVisibleParts() const;
     void RenderVisibleParts();
+    float GetScrollPagePos() const;
+    void TrackScrolling();
+    void PrefetchPredictedPages(int firstVisiblePage, int lastVisiblePage);
     void AddNavPoint();
     RectF GetContentBox(int pageNo) const;
     void CalcZoomReal(float zoomVirtual);
     void GoToPage(int pageNo, int scrollY, bool addNavPt = false, int scrollX = -1);
     bool GoToPrevPage(int scrollY);
     int GetPageNextToPoint(Point pt) const;
+    void BuildLayoutIndex();
+    void GetPagesInRange(int y, int dy, int* firstPageNo, int* lastPageNo) const;
 
     EngineBase* engine = nullptr;
 
     /* an array of PageInfo, len of array is pageCount */
     PageInfo* pagesInfo = nullptr;
+    /* for looking up the pages in a vertical range of the canvas with a binary search
+       (both are sorted). For page i (at index i - 1): the largest bottom edge of the
+       shown pages up to i and the smallest top edge of the shown pages from i on.
+       Calculated in DisplayModel::Relayout() */
+    Vec<int> pagesMaxBottom;
+    Vec<int> pagesMinTop;
+    /* the range of pages with visibleRatio > 0 (empty if firstVisible > lastVisible).
+       Calculated in DisplayModel::RecalcVisibleParts() */
+    mutable int firstVisible = 1;
+    mutable int lastVisible = 0;
 
     DisplayMode displayMode{DisplayMode::Automatic};
     /* In non-continuous mode is the first page from a file that we're
@@ -260,4 +283,13 @@ struct DisplayModel : DocController {
 
     /* allow resizing a window without triggering a new rendering (needed for window destruction) */
     bool dontRenderFlag = false;
+
+    /* for predictive rendering: the scroll position (in pages, see GetScrollPagePos()),
+       when it was last changed and how fast it's changing (in pages per ms) */
+    float scrollPos = 0;
+    LARGE_INTEGER scrollPosTime{};
+    float scrollVelocity = 0;
+    /* range of pages requested by PrefetchPredictedPages() (empty if prefetchFirst > prefetchLast) */
+    int prefetchFirst = 0;
+    int prefetchLast = -1;
 };
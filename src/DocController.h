@@ -53,6 +53,10 @@ struct DocControllerCallback {
     virtual void Repaint() = 0;
     virtual void UpdateScrollbars(Size canvas) = 0;
     virtual void RequestRendering(int pageNo) = 0;
+    // render a page that is predicted to become visible soon, if there's time
+    virtual void PrefetchRendering(int pageNo) = 0;
+    // drop prefetch requests after the prediction turned out to be wrong
+    virtual void CancelPrefetchRendering() = 0;
     virtual void CleanUp(DisplayModel* dm) = 0;
     virtual void RenderThumbnail(DisplayModel* dm, Size size, const onBitmapRenderedCb&) = 0;
     // ChmModel //
@@ -94,7 +98,7 @@ struct DocController {
     virtual void SetViewPortSize(Size size) = 0;
 
     // table of contents
-    bool HasToc() {
+    virtual bool HasToc() {
         auto* tree = GetToc();
         return tree != nullptr;
     }
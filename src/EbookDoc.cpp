@@ -149,59 +149,90 @@ char* NormalizeURL(const char* url, const char* base) {
     return norm.Release();
 }
 
-inline char decode64(char c) {
-    if ('A' <= c && c <= 'Z') {
-        return c - 'A';
-    }
-    if ('a' <= c && c <= 'z') {
-        return c - 'a' + 26;
-    }
-    if ('0' <= c && c <= '9') {
-        return c - '0' + 52;
-    }
-    if ('+' == c) {
-        return 62;
-    }
-    if ('/' == c) {
-        return 63;
+constexpr u8 kBase64Ws = 0xfd;
+constexpr u8 kBase64Padding = 0xfe;
+constexpr u8 kBase64Invalid = 0xff;
+
+// maps every byte to its base64 value or to one of the kBase64* markers
+struct Base64DecodeTable {
+    u8 vals[256];
+
+    Base64DecodeTable() {
+        memset(vals, kBase64Invalid, sizeof(vals));
+        for (int i = 0; i < 26; i++) {
+            vals['A' + i] = (u8)i;
+            vals['a' + i] = (u8)(i + 26);
+        }
+        for (int i = 0; i < 10; i++) {
+            vals['0' + i] = (u8)(i + 52);
+        }
+        vals['+'] = 62;
+        vals['/'] = 63;
+        vals['='] = kBase64Padding;
+        for (int c = 0; c < 256; c++) {
+            if (str::IsWs((char)c)) {
+                vals[c] = kBase64Ws;
+            }
+        }
     }
-    return -1;
-}
+};
 
 static ByteSlice Base64Decode(const ByteSlice& data) {
+    static const Base64DecodeTable table;
+    const u8* vals = table.vals;
+
     size_t sLen = data.size();
-    u8* s = data.data();
-    u8* end = data.data() + sLen;
+    const u8* s = data.data();
+    const u8* end = s + sLen;
     u8* result = AllocArray<u8>(sLen * 3 / 4);
     u8* curr = result;
-    u8 c = 0;
-    int step = 0;
-    for (; s < end && *s != '='; s++) {
-        char n = decode64(*s);
-        if (-1 == n) {
-            if (str::IsWs((char)*s)) {
+    u32 acc = 0;
+    int nAcc = 0;
+    while (s < end) {
+        // fast path: a full group of 4 characters (i.e. no whitespace
+        // and no padding) decodes into 3 bytes in one step
+        if (0 == nAcc && end - s >= 4) {
+            u32 a = vals[s[0]];
+            u32 b = vals[s[1]];
+            u32 c = vals[s[2]];
+            u32 d = vals[s[3]];
+            if ((a | b | c | d) < 64) {
+                curr[0] = (u8)((a << 2) | (b >> 4));
+                curr[1] = (u8)((b << 4) | (c >> 2));
+                curr[2] = (u8)((c << 6) | d);
+                curr += 3;
+                s += 4;
                 continue;
             }
+        }
+        u8 n = vals[*s++];
+        if (n == kBase64Padding) {
+            break;
+        }
+        if (n == kBase64Ws) {
+            continue;
+        }
+        if (n == kBase64Invalid) {
             free(result);
             return {};
         }
-        switch (step++ % 4) {
-            case 0:
-                c = n;
-                break;
-            case 1:
-                *curr++ = (c << 2) | (n >> 4);
-                c = n & 0xF;
-                break;
-            case 2:
-                *curr++ = (c << 4) | (n >> 2);
-                c = n & 0x3;
-                break;
-            case 3:
-                *curr++ = (c << 6) | (n >> 0);
-                break;
+        acc = (acc << 6) | n;
+        if (++nAcc == 4) {
+            curr[0] = (u8)(acc >> 16);
+            curr[1] = (u8)(acc >> 8);
+            curr[2] = (u8)acc;
+            curr += 3;
+            acc = 0;
+            nAcc = 0;
         }
     }
+    // a trailing incomplete group still yields 1 or 2 bytes
+    if (2 == nAcc) {
+        *curr++ = (u8)(acc >> 4);
+    } else if (3 == nAcc) {
+        *curr++ = (u8)(acc >> 10);
+        *curr++ = (u8)(acc >> 2);
+    }
     size_t size = curr - result;
     return {(u8*)result, size};
 }
@@ -768,17 +799,22 @@ const char* FB2_MAIN_NS = "http://www.gribuser.ru/xml/fictionbook/2.0";
 const char* FB2_XLINK_NS = "http://www.w3.org/1999/xlink";
 
 Fb2Doc::Fb2Doc(const char* fileName) : fileName(str::Dup(fileName)) {
+    InitializeCriticalSection(&imagesAccess);
 }
 
 Fb2Doc::Fb2Doc(IStream* stream) : stream(stream) {
+    InitializeCriticalSection(&imagesAccess);
     stream->AddRef();
 }
 
 Fb2Doc::~Fb2Doc() {
     for (auto&& img : images) {
-        str::Free(img.base);
         str::Free(img.fileName);
     }
+    for (auto&& img : decodedImages) {
+        img.base.Free();
+    }
+    DeleteCriticalSection(&imagesAccess);
     if (stream) {
         stream->Release();
     }
@@ -850,13 +886,13 @@ bool Fb2Doc::Load() {
     if (data.empty()) {
         return false;
     }
-    AutoFreeStr tmp = DecodeTextToUtf8(data, true);
+    fileData.Set(DecodeTextToUtf8(data, true));
     data.Free();
-    if (!tmp) {
+    if (!fileData) {
         return false;
     }
 
-    ByteSlice data2(tmp.Get());
+    ByteSlice data2(fileData.Get());
 
     HtmlPullParser parser(data2);
     HtmlToken* tok;
@@ -949,6 +985,10 @@ bool Fb2Doc::Load() {
         }
     }
 
+    // fileData is only needed for images
+    if (images.empty()) {
+        fileData.Reset();
+    }
     return xmlData.size() > 0;
 }
 
@@ -965,11 +1005,10 @@ void Fb2Doc::ExtractImage(HtmlPullParser* parser, HtmlToken* tok) {
         return;
     }
 
+    // most images are either never shown or only much later, so they're
+    // kept base64 encoded (within fileData) until they're drawn
     ImageData data;
-    data.base = Base64Decode({(u8*)tok->s, tok->sLen});
-    if (data.base.empty()) {
-        return;
-    }
+    data.base = ByteSlice((u8*)tok->s, tok->sLen);
     data.fileName = str::Join("#", id);
     data.fileId = images.size();
     images.Append(data);
@@ -979,6 +1018,7 @@ ByteSlice Fb2Doc::GetXmlData() const {
     return {(u8*)xmlData.Get(), xmlData.size()};
 }
 
+// returns the base64 encoded data of an image, see DecodeImage()
 ByteSlice* Fb2Doc::GetImageData(const char* fileName) const {
     for (size_t i = 0; i < images.size(); i++) {
         if (str::Eq(images.at(i).fileName, fileName)) {
@@ -995,6 +1035,74 @@ ByteSlice* Fb2Doc::GetCoverImage() const {
     return GetImageData(coverImage);
 }
 
+// enough for the size of all image formats, even for JPEG
+// images which start with a (usually small) EXIF thumbnail
+constexpr size_t kFb2ImageHeaderEncodedSize = 96 * 1024;
+// decoded images which are kept for redrawing
+constexpr size_t kFb2DecodedImagesMaxSize = 32 * 1024 * 1024;
+
+// only decodes as much of an image as is needed for reading its size
+Size Fb2Doc::GetImageSize(const ByteSlice& encoded) {
+    Size size;
+    if (encoded.size() > kFb2ImageHeaderEncodedSize) {
+        ByteSlice header = Base64Decode({encoded.data(), kFb2ImageHeaderEncodedSize});
+        if (!header.empty()) {
+            size = BitmapSizeFromData(header);
+        }
+        header.Free();
+        if (!size.IsEmpty()) {
+            return size;
+        }
+    }
+    ByteSlice data = DecodeImage(encoded);
+    if (!data.empty()) {
+        size = BitmapSizeFromData(data);
+    }
+    data.Free();
+    return size;
+}
+
+// returns the decoded data of an image, which the caller must free
+ByteSlice Fb2Doc::DecodeImage(const ByteSlice& encoded) {
+    ScopedCritSec scope(&imagesAccess);
+
+    for (size_t i = 0; i < decodedImages.size(); i++) {
+        ImageData img = decodedImages.at(i);
+        if (images.at(img.fileId).base.data() == encoded.data()) {
+            // move to the end as the most recently used image
+            decodedImages.RemoveAt(i);
+            decodedImages.Append(img);
+            return img.base.Clone();
+        }
+    }
+
+    ImageData img;
+    img.fileId = images.size();
+    for (size_t i = 0; i < images.size(); i++) {
+        if (images.at(i).base.data() == encoded.data()) {
+            img.fileId = i;
+            break;
+        }
+    }
+    if (img.fileId == images.size()) {
+        return {};
+    }
+    img.base = Base64Decode(encoded);
+    if (img.base.empty()) {
+        return {};
+    }
+    decodedImages.Append(img);
+    decodedImagesSize += img.base.size();
+    // evict the least recently used images (but always keep the one just decoded)
+    while (decodedImagesSize > kFb2DecodedImagesMaxSize && decodedImages.size() > 1) {
+        ImageData& oldest = decodedImages.at(0);
+        decodedImagesSize -= oldest.base.size();
+        oldest.base.Free();
+        decodedImages.RemoveAt(0);
+    }
+    return img.base.Clone();
+}
+
 char* Fb2Doc::GetProperty(DocumentProperty prop) const {
     return props.Get(prop);
 }
@@ -78,7 +78,17 @@ class Fb2Doc {
     IStream* stream = nullptr;
 
     str::Str xmlData;
+    // the whole document (converted to UTF-8)
+    AutoFreeStr fileData;
+    // base of each image is its base64 encoded data within fileData,
+    // images are only decoded when they're drawn (see DecodeImage())
     Vec<ImageData> images;
+    // the most recently decoded images (most recent last), fileId is
+    // the index into images. decodedImages is the only mutable member
+    // after Load() and access to it must be serialized
+    Vec<ImageData> decodedImages;
+    size_t decodedImagesSize = 0;
+    CRITICAL_SECTION imagesAccess;
     AutoFree coverImage;
     PropertyMap props;
     bool isZipped = false;
@@ -95,6 +105,8 @@ class Fb2Doc {
 
     ByteSlice* GetImageData(const char* fileName) const;
     ByteSlice* GetCoverImage() const;
+    Size GetImageSize(const ByteSlice& encoded);
+    ByteSlice DecodeImage(const ByteSlice& encoded);
 
     char* GetProperty(DocumentProperty prop) const;
     const char* GetFileName() const;
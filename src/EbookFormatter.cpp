@@ -7,6 +7,7 @@
 #include "utils/WinUtil.h"
 #include "utils/Archive.h"
 #include "utils/HtmlParserLookup.h"
+#include "utils/CssParser.h"
 #include "utils/HtmlPullParser.h"
 #include "mui/Mui.h"
 
@@ -250,7 +251,7 @@ Fb2Formatter::Fb2Formatter(HtmlFormatterArgs* args, Fb2Doc* doc)
     if (!cover) {
         return;
     }
-    EmitImage(cover);
+    EmitImage(cover, doc->GetImageSize(*cover));
     // render larger images alone on the cover page,
     // smaller images just separated by a horizontal line
     if (0 == currLineInstr.size()) {
@@ -275,7 +276,7 @@ void Fb2Formatter::HandleTagImg(HtmlToken* t) {
         img = fb2Doc->GetImageData(src);
     }
     if (img) {
-        EmitImage(img);
+        EmitImage(img, fb2Doc->GetImageSize(*img));
     }
 }
 
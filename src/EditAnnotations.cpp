@@ -163,6 +163,8 @@ struct EditAnnotationsWindow : Wnd {
     Vec<Annotation*>* annotations = nullptr;
     // currently selected annotation
     Annotation* annot = nullptr;
+    // area of the page covered by annot when it was last rendered
+    RectF annotBounds;
 
     bool skipGoToPage = false;
 
@@ -187,6 +189,15 @@ static EngineMupdf* GetEngineMupdf(EditAnnotationsWindow* ew) {
     return AsEngineMupdf(dm->GetEngine());
 }
 
+// after the selected annotation has been changed, only re-render
+// the area it covered before and covers now
+static void RerenderSelectedAnnotation(EditAnnotationsWindow* ew) {
+    RectF bounds = GetBounds(ew->annot);
+    RectF damaged = bounds.Union(ew->annotBounds);
+    ew->annotBounds = bounds;
+    MainWindowRerender(ew->tab->win, PageNo(ew->annot), damaged);
+}
+
 static void HidePerAnnotControls(EditAnnotationsWindow* ew) {
     ew->staticRect->SetIsVisible(false);
     ew->staticAuthor->SetIsVisible(false);
@@ -510,7 +521,7 @@ static void TextAlignmentSelectionChanged(EditAnnotationsWindow* ew) {
     int newQuadding = idx;
     SetQuadding(ew->annot, newQuadding);
     EnableSaveIfAnnotationsChanged(ew);
-    MainWindowRerender(ew->tab->win);
+    RerenderSelectedAnnotation(ew);
 }
 
 static void DoTextFont(EditAnnotationsWindow* ew, Annotation* annot) {
@@ -534,7 +545,7 @@ static void TextFontSelectionChanged(EditAnnotationsWindow* ew) {
     const char* font = seqstrings::IdxToStr(gFontNames, idx);
     SetDefaultAppearanceTextFont(ew->annot, font);
     EnableSaveIfAnnotationsChanged(ew);
-    MainWindowRerender(ew->tab->win);
+    RerenderSelectedAnnotation(ew);
 }
 
 static void DoTextSize(EditAnnotationsWindow* ew, Annotation* annot) {
@@ -556,7 +567,7 @@ static void TextFontSizeChanging(EditAnnotationsWindow* ew, TrackbarPosChangingE
     AutoFreeStr s = str::Format(_TRA("Text Size: %d"), fontSize);
     ew->staticTextSize->SetText(s.Get());
     EnableSaveIfAnnotationsChanged(ew);
-    MainWindowRerender(ew->tab->win);
+    RerenderSelectedAnnotation(ew);
 }
 
 static void DoTextColor(EditAnnotationsWindow* ew, Annotation* annot) {
@@ -575,7 +586,7 @@ static void TextColorSelectionChanged(EditAnnotationsWindow* ew) {
     auto col = GetDropDownColor(item);
     SetDefaultAppearanceTextColor(ew->annot, col);
     EnableSaveIfAnnotationsChanged(ew);
-    MainWindowRerender(ew->tab->win);
+    RerenderSelectedAnnotation(ew);
 }
 
 static void DoBorder(EditAnnotationsWindow* ew, Annotation* annot) {
@@ -599,7 +610,7 @@ static void BorderWidthChanging(EditAnnotationsWindow* ew, TrackbarPosChangingEv
     AutoFreeStr s = str::Format(_TRA("Border: %d"), borderWidth);
     ew->staticBorder->SetText(s.Get());
     EnableSaveIfAnnotationsChanged(ew);
-    MainWindowRerender(ew->tab->win);
+    RerenderSelectedAnnotation(ew);
 }
 
 static void DoLineStartEnd(EditAnnotationsWindow* ew, Annotation* annot) {
@@ -627,7 +638,7 @@ static void LineStartSelectionChanged(EditAnnotationsWindow* ew) {
     int newVal = idx;
     start = newVal;
     EnableSaveIfAnnotationsChanged(ew);
-    MainWindowRerender(ew->tab->win);
+    RerenderSelectedAnnotation(ew);
 }
 
 static void LineEndSelectionChanged(EditAnnotationsWindow* ew) {
@@ -638,7 +649,7 @@ static void LineEndSelectionChanged(EditAnnotationsWindow* ew) {
     int newVal = idx;
     end = newVal;
     EnableSaveIfAnnotationsChanged(ew);
-    MainWindowRerender(ew->tab->win);
+    RerenderSelectedAnnotation(ew);
 }
 
 static void DoIcon(EditAnnotationsWindow* ew, Annotation* annot) {
@@ -673,7 +684,7 @@ static void IconSelectionChanged(EditAnnotationsWindow* ew) {
     auto item = ew->dropDownIcon->items.at(idx);
     SetIconName(ew->annot, item);
     EnableSaveIfAnnotationsChanged(ew);
-    MainWindowRerender(ew->tab->win);
+    RerenderSelectedAnnotation(ew);
 }
 
 static void DoColor(EditAnnotationsWindow* ew, Annotation* annot) {
@@ -701,7 +712,7 @@ static void ColorSelectionChanged(EditAnnotationsWindow* ew) {
     auto col = GetDropDownColor(item);
     SetColor(ew->annot, col);
     EnableSaveIfAnnotationsChanged(ew);
-    MainWindowRerender(ew->tab->win);
+    RerenderSelectedAnnotation(ew);
 }
 
 static void DoInteriorColor(EditAnnotationsWindow* ew, Annotation* annot) {
@@ -722,7 +733,7 @@ static void InteriorColorSelectionChanged(EditAnnotationsWindow* ew) {
     auto col = GetDropDownColor(item);
     SetInteriorColor(ew->annot, col);
     EnableSaveIfAnnotationsChanged(ew);
-    MainWindowRerender(ew->tab->win);
+    RerenderSelectedAnnotation(ew);
 }
 
 static void DoOpacity(EditAnnotationsWindow* ew, Annotation* annot) {
@@ -751,12 +762,13 @@ static void OpacityChanging(EditAnnotationsWindow* ew, TrackbarPosChangingEvent*
     AutoFreeStr s = str::Format(_TRA("Opacity: %d"), opacity);
     ew->staticOpacity->SetText(s.Get());
     EnableSaveIfAnnotationsChanged(ew);
-    MainWindowRerender(ew->tab->win);
+    RerenderSelectedAnnotation(ew);
 }
 
 static void UpdateUIForSelectedAnnotation(EditAnnotationsWindow* ew, int itemNo) {
     int annotPageNo = -1;
     ew->annot = nullptr;
+    ew->annotBounds = RectF();
 
     // get annotation at index itemNo, skipping deleted annotations
     int idx = 0;
@@ -771,6 +783,7 @@ static void UpdateUIForSelectedAnnotation(EditAnnotationsWindow* ew, int itemNo)
             continue;
         }
         ew->annot = annot;
+        ew->annotBounds = GetBounds(annot);
         annotPageNo = PageNo(annot);
         break;
     }
@@ -841,6 +854,12 @@ static void ButtonEmbedAttachment(EditAnnotationsWindow* ew) {
 
 void DeleteAnnotationAndUpdateUI(WindowTab* tab, EditAnnotationsWindow* ew, Annotation* annot) {
     annot = FindMatchingAnnotation(ew, annot);
+    int pageNo = -1;
+    RectF bounds;
+    if (annot) {
+        pageNo = PageNo(annot);
+        bounds = GetBounds(annot);
+    }
     DeleteAnnotation(annot);
     if (ew != nullptr) {
         // can be null if called from Menu.cpp and annotations window is not visible
@@ -848,7 +867,7 @@ void DeleteAnnotationAndUpdateUI(WindowTab* tab, EditAnnotationsWindow* ew, Anno
         UpdateUIForSelectedAnnotation(ew, 0);
         ew->listBox->SetCurrentSelection(0);
     }
-    MainWindowRerender(tab->win);
+    MainWindowRerender(tab->win, pageNo, bounds);
     ToolbarUpdateStateForWindow(tab->win, false);
 }
 
@@ -48,6 +48,30 @@ TocItem* CreateWrapperItem(EngineBase* engine);
 
 /* EngineMupdf.cpp */
 
+// resident fz_store memory of a single document, in bytes
+struct MupdfStoreStats {
+    const char* filePath = nullptr;
+    i64 lastUsed = 0;
+    size_t images = 0;
+    size_t fonts = 0;
+    size_t colorspaces = 0;
+    size_t displayLists = 0;
+    size_t other = 0;
+    size_t total = 0;
+};
+
+size_t GetMupdfStoreBudget();
+void GetMupdfStoreStats(Vec<MupdfStoreStats>& statsOut);
+void SetMupdfRepairedXrefCacheDir(const char* dir);
+
+// pixels rendered by EngineMupdf and bytes written into frames after rasterization
+struct MupdfRenderCopyStats {
+    i64 pixels = 0;
+    i64 bytesCopied = 0;
+};
+
+void SetMupdfZeroCopyRender(bool enable);
+void GetMupdfRenderCopyStats(MupdfRenderCopyStats& statsOut, bool reset);
 bool IsEngineMupdfSupportedFileType(Kind);
 EngineBase* CreateEngineMupdfFromFile(const char* path, Kind kind, int displayDPI, PasswordUI* pwdUI = nullptr);
 EngineBase* CreateEngineMupdfFromStream(IStream* stream, const char* nameHint, PasswordUI* pwdUI = nullptr);
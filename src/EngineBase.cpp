@@ -99,6 +99,7 @@ TocItem::TocItem(TocItem* parent, const char* title, int pageNo) {
 }
 
 TocItem::~TocItem() {
+    delete children;
     delete child;
     if (!destNotOwned) {
         delete dest;
@@ -118,6 +119,9 @@ void TocItem::AddSibling(TocItem* sibling) {
     next = sibling;
     sibling->next = currNext;
     sibling->parent = parent;
+    if (parent) {
+        parent->ResetChildren();
+    }
 }
 
 void TocItem::AddSiblingAtEnd(TocItem* sibling) {
@@ -127,6 +131,9 @@ void TocItem::AddSiblingAtEnd(TocItem* sibling) {
     }
     item->next = sibling;
     sibling->parent = item->parent;
+    if (item->parent) {
+        item->parent->ResetChildren();
+    }
 }
 
 void TocItem::AddChild(TocItem* newChild) {
@@ -134,6 +141,7 @@ void TocItem::AddChild(TocItem* newChild) {
     child = newChild;
     newChild->parent = this;
     newChild->next = curr;
+    ResetChildren();
 }
 
 // regular delete is recursive, this deletes only this item
@@ -151,34 +159,36 @@ IPageDestination* TocItem::GetPageDestination() const {
     return dest;
 }
 
+// the linked list of children as an array
+// (the tree must not be modified other than through AddChild() and AddSibling())
+Vec<TocItem*>* TocItem::GetChildren() {
+    if (!children) {
+        children = new Vec<TocItem*>();
+        for (auto node = child; node; node = node->next) {
+            children->Append(node);
+        }
+    }
+    return children;
+}
+
+void TocItem::ResetChildren() {
+    delete children;
+    children = nullptr;
+}
+
 int TocItem::ChildCount() {
-    int n = 0;
-    auto node = child;
-    while (node) {
-        n++;
-        node = node->next;
+    if (!child) {
+        return 0;
     }
-    return n;
+    return GetChildren()->isize();
 }
 
 TocItem* TocItem::ChildAt(int n) {
-    if (n == 0) {
-        currChild = child;
-        currChildNo = 0;
-        return child;
+    Vec<TocItem*>* v = GetChildren();
+    if (n < 0 || n >= v->isize()) {
+        return nullptr;
     }
-    // speed up sequential iteration over children
-    if (currChild != nullptr && n == currChildNo + 1) {
-        currChild = currChild->next;
-        ++currChildNo;
-        return currChild;
-    }
-    auto node = child;
-    while (n > 0) {
-        n--;
-        node = node->next;
-    }
-    return node;
+    return v->at(n);
 }
 
 bool TocItem::IsExpanded() {
@@ -258,6 +268,61 @@ HTREEITEM TocTree::GetHandle(TreeItem ti) {
     return tocItem->hItem;
 }
 
+// visits items in the same order as VisitTreeModelItems()
+static void CollectTocItemsRec(TocItem* ti, Vec<TocItem*>& items, int& nItems) {
+    nItems++;
+    if (ti->pageNo >= 1) {
+        items.Append(ti);
+    }
+    for (auto node = ti->child; node; node = node->next) {
+        CollectTocItemsRec(node, items, nItems);
+    }
+}
+
+void TocTree::BuildPageIndex() {
+    itemsByPage.Reset();
+    nItems = 0;
+    if (!root) {
+        return;
+    }
+    CollectTocItemsRec(root, itemsByPage, nItems);
+    TocItem** items = itemsByPage.LendData();
+    std::stable_sort(items, items + itemsByPage.size(),
+                     [](const TocItem* a, const TocItem* b) { return a->pageNo < b->pageNo; });
+}
+
+// must be called when page numbers of items change
+void TocTree::InvalidatePageIndex() {
+    itemsByPage.Reset();
+    nItems = -1;
+}
+
+int TocTree::ItemCount() {
+    if (nItems < 0) {
+        BuildPageIndex();
+    }
+    return nItems;
+}
+
+// finds the item that best matches pageNo: the first item pointing to pageNo or,
+// if there's none, the last item pointing to the closest page before it.
+// returns the root if no item points to pageNo or a page before it
+TocItem* TocTree::FindItemForPageNo(int pageNo) {
+    if (nItems < 0) {
+        BuildPageIndex();
+    }
+    TocItem** items = itemsByPage.LendData();
+    TocItem** end = items + itemsByPage.size();
+    TocItem** it = std::lower_bound(items, end, pageNo, [](const TocItem* ti, int n) { return ti->pageNo < n; });
+    if (it != end && (*it)->pageNo == pageNo) {
+        return *it;
+    }
+    if (it != items) {
+        return *(it - 1);
+    }
+    return root;
+}
+
 // TODO: speed up by removing recursion
 bool VisitTocTree(TocItem* ti, const std::function<bool(TocItem*)>& f) {
     bool cont;
@@ -318,11 +383,6 @@ EngineBase::~EngineBase() {
     str::Free(defaultExt);
 }
 
-int EngineBase::PageCount() const {
-    CrashIf(pageCount < 0);
-    return pageCount;
-}
-
 RectF EngineBase::PageContentBox(int pageNo, RenderTarget) {
     return PageMediabox(pageNo);
 }
@@ -22,8 +22,9 @@ extern Kind kindEngineTxt;
 bool IsExternalUrl(const WCHAR* url);
 bool IsExternalUrl(const char* url);
 
-/* certain OCGs will only be rendered for some of these (e.g. watermarks) */
-enum class RenderTarget { View, Print, Export };
+/* certain OCGs will only be rendered for some of these (e.g. watermarks).
+   Preview is a View render where speed matters more than quality */
+enum class RenderTarget { View, Print, Export, Preview };
 
 struct PageLayout {
     enum class Type {
@@ -295,9 +296,9 @@ struct TocItem {
     // next sibling
     TocItem* next = nullptr;
 
-    // caching to speed up ChildAt
-    TocItem* currChild = nullptr;
-    int currChildNo = 0;
+    // child items in order, for ChildCount() and ChildAt() in O(1)
+    // (built on first use, reset by AddChild() and AddSibling())
+    Vec<TocItem*>* children = nullptr;
 
     // -- only for .EngineMulti
     // marks a node that represents a file
@@ -321,6 +322,8 @@ struct TocItem {
 
     IPageDestination* GetPageDestination() const;
 
+    Vec<TocItem*>* GetChildren();
+    void ResetChildren();
     int ChildCount();
     TocItem* ChildAt(int n);
     bool IsExpanded();
@@ -331,6 +334,11 @@ struct TocItem {
 struct TocTree : TreeModel {
     TocItem* root = nullptr;
 
+    // items with a page number, sorted by it (in tree order for the same page).
+    // built on first use by FindItemForPageNo()
+    Vec<TocItem*> itemsByPage;
+    int nItems = -1;
+
     TocTree() = default;
     explicit TocTree(TocItem* root);
     ~TocTree() override;
@@ -347,6 +355,11 @@ struct TocTree : TreeModel {
 
     void SetHandle(TreeItem, HTREEITEM) override;
     HTREEITEM GetHandle(TreeItem) override;
+
+    void BuildPageIndex();
+    void InvalidatePageIndex();
+    int ItemCount();
+    TocItem* FindItemForPageNo(int pageNo);
 };
 
 bool VisitTocTree(TocItem* ti, const std::function<bool(TocItem*)>& f);
@@ -399,7 +412,10 @@ class EngineBase {
     virtual EngineBase* Clone() = 0;
 
     // number of pages the loaded document contains
-    int PageCount() const;
+    int PageCount() const {
+        CrashIf(pageCount < 0);
+        return pageCount;
+    }
 
     // the box containing the visible page content (usually RectF(0, 0, pageWidth, pageHeight))
     virtual RectF PageMediabox(int pageNo) = 0;
@@ -464,7 +480,7 @@ class EngineBase {
     virtual IPageDestination* GetNamedDest(const char* name);
 
     // checks whether this document has an associated Table of Contents
-    bool HasToc();
+    virtual bool HasToc();
 
     // returns the root element for the loaded document's Table of Contents
     // caller must delete the result (when no longer needed)
@@ -0,0 +1,484 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+// headless benchmark of document engines. runs a corpus of documents
+// through opening, rendering of every page at several zoom levels,
+// text extraction and search, repeating each step to get percentiles.
+// results are written as JSON and can be compared against a baseline
+// (e.g. results of a previous run) to detect performance regressions
+
+#include "utils/BaseUtil.h"
+#include <psapi.h>
+#include "utils/ScopedWin.h"
+#include "utils/CmdLineArgsIter.h"
+#include "utils/DirIter.h"
+#include "utils/FileUtil.h"
+#include "utils/GdiPlusUtil.h"
+#include "utils/GuessFileType.h"
+#include "utils/JsonParser.h"
+#include "mui/Mui.h"
+#include "utils/Timer.h"
+#include "utils/WinUtil.h"
+
+#include "wingui/UIModels.h"
+
+#include "Settings.h"
+#include "DocController.h"
+#include "EngineBase.h"
+#include "EngineAll.h"
+#include "TextSelection.h"
+#include "TextSearch.h"
+
+void _uploadDebugReportIfFunc(__unused bool cond, __unused const char* condStr) {
+    // no-op implementation to satisfy SubmitBugReport()
+}
+
+#define ErrOut(msg, ...) fprintf(stderr, msg "\n", __VA_ARGS__)
+#define ErrOut1(msg) fprintf(stderr, "%s", msg "\n")
+
+// exit codes
+constexpr int kExitOk = 0;
+constexpr int kExitError = 1;
+constexpr int kExitUsage = 2;
+constexpr int kExitRegression = 3;
+
+struct BenchOptions {
+    int nWarmup = 1;
+    int nRepeat = 5;
+    Vec<float> zooms;
+    const char* searchText = "the";
+    const char* outPath = nullptr;
+    const char* baselinePath = nullptr;
+    // a result regresses if its p50 or p95 is this much slower than baseline
+    float thresholdPercent = 10.f;
+    // ...and at least this many ms slower, so that noise in very fast
+    // operations isn't reported
+    float minDeltaMs = 1.f;
+};
+
+// timings (in ms) of repeated runs of a single operation
+struct BenchOp {
+    char* name = nullptr;
+    Vec<double> samples;
+
+    ~BenchOp() {
+        str::Free(name);
+    }
+};
+
+struct BenchOpStats {
+    int n = 0;
+    double min = 0;
+    double mean = 0;
+    double p50 = 0;
+    double p95 = 0;
+    double p99 = 0;
+    double max = 0;
+};
+
+struct BenchFileResult {
+    char* path = nullptr;
+    int pageCount = 0;
+    bool failed = false;
+    // process-wide high-water mark after benchmarking this file (i.e. including
+    // all files benchmarked before it), not the memory used by this file
+    size_t cumulativePeakRssBytes = 0;
+    Vec<BenchOp*> ops;
+
+    ~BenchFileResult() {
+        str::Free(path);
+        DeleteVecMembers(ops);
+    }
+};
+
+static size_t GetPeakRss() {
+    PROCESS_MEMORY_COUNTERS pmc{};
+    pmc.cb = sizeof(pmc);
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        return 0;
+    }
+    return pmc.PeakWorkingSetSize;
+}
+
+static BenchOp* GetOp(BenchFileResult* res, const char* name) {
+    for (BenchOp* op : res->ops) {
+        if (str::Eq(op->name, name)) {
+            return op;
+        }
+    }
+    BenchOp* op = new BenchOp();
+    op->name = str::Dup(name);
+    res->ops.Append(op);
+    return op;
+}
+
+// nearest-rank percentile of sorted samples
+static double Percentile(Vec<double>& sorted, int percent) {
+    int n = sorted.isize();
+    int rank = (percent * n + 99) / 100;
+    rank = std::clamp(rank, 1, n);
+    return sorted[rank - 1];
+}
+
+static BenchOpStats CalcStats(BenchOp* op) {
+    BenchOpStats stats;
+    int n = op->samples.isize();
+    if (n == 0) {
+        return stats;
+    }
+    Vec<double> sorted(op->samples);
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0;
+    for (double v : sorted) {
+        sum += v;
+    }
+    stats.n = n;
+    stats.min = sorted[0];
+    stats.max = sorted[n - 1];
+    stats.mean = sum / (double)n;
+    stats.p50 = Percentile(sorted, 50);
+    stats.p95 = Percentile(sorted, 95);
+    stats.p99 = Percentile(sorted, 99);
+    return stats;
+}
+
+// runs all benchmarked operations once. when res is nullptr the timings
+// are discarded (used for warm-up runs)
+static bool BenchFileOnce(const char* path, BenchOptions& opts, BenchFileResult* res) {
+    auto t = TimeGet();
+    EngineBase* engine = CreateEngineFromFile(path, nullptr, true);
+    if (!engine) {
+        return false;
+    }
+    double openMs = TimeSinceInMs(t);
+    int nPages = engine->PageCount();
+    if (res) {
+        GetOp(res, "open")->samples.Append(openMs);
+        res->pageCount = nPages;
+    }
+
+    for (float zoom : opts.zooms) {
+        char name[32];
+        str::BufFmt(name, dimof(name), "render %d%%", (int)(zoom * 100.f + 0.5f));
+        BenchOp* op = res ? GetOp(res, name) : nullptr;
+        for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+            t = TimeGet();
+            RenderPageArgs args(pageNo, zoom, 0);
+            RenderedBitmap* bmp = engine->RenderPage(args);
+            double ms = TimeSinceInMs(t);
+            delete bmp;
+            if (op) {
+                op->samples.Append(ms);
+            }
+        }
+    }
+
+    // search re-uses text extracted into the cache, so that it only
+    // measures the search itself
+    DocumentTextCache textCache(engine);
+    BenchOp* op = res ? GetOp(res, "extract text") : nullptr;
+    for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+        t = TimeGet();
+        textCache.GetTextForPage(pageNo);
+        double ms = TimeSinceInMs(t);
+        if (op) {
+            op->samples.Append(ms);
+        }
+    }
+
+    if (!str::IsEmpty(opts.searchText) && nPages > 0) {
+        TextSearch search(engine, &textCache);
+        WCHAR* text = ToWstrTemp(opts.searchText);
+        t = TimeGet();
+        TextSel* sel = search.FindFirst(1, text);
+        while (sel) {
+            sel = search.FindNext();
+        }
+        double ms = TimeSinceInMs(t);
+        if (res) {
+            GetOp(res, "search")->samples.Append(ms);
+        }
+    }
+
+    delete engine;
+    return true;
+}
+
+static BenchFileResult* BenchFile(const char* path, BenchOptions& opts) {
+    fprintf(stderr, "%s\n", path);
+    auto res = new BenchFileResult();
+    res->path = str::Dup(path);
+    for (int i = 0; i < opts.nWarmup; i++) {
+        if (!BenchFileOnce(path, opts, nullptr)) {
+            ErrOut("Error: Couldn't create an engine for %s!", path);
+            res->failed = true;
+            return res;
+        }
+    }
+    for (int i = 0; i < opts.nRepeat; i++) {
+        if (!BenchFileOnce(path, opts, res)) {
+            ErrOut("Error: Couldn't create an engine for %s!", path);
+            res->failed = true;
+            break;
+        }
+    }
+    res->cumulativePeakRssBytes = GetPeakRss();
+    return res;
+}
+
+static void CollectFilesToBench(const char* path, StrVec& files) {
+    if (file::Exists(path)) {
+        files.Append(path);
+        return;
+    }
+    DirTraverse(path, true, [&files](const char* path) -> bool {
+        Kind kind = GuessFileType(path, true);
+        if (IsSupportedFileType(kind, true)) {
+            files.Append(path);
+        }
+        return true;
+    });
+}
+
+static void SerializeResults(str::Str& s, BenchOptions& opts, Vec<BenchFileResult*>& results) {
+    s.Append("{\n");
+    s.AppendFmt("  \"version\": 1,\n  \"warmup\": %d,\n  \"repeat\": %d,\n", opts.nWarmup, opts.nRepeat);
+    s.Append("  \"search\": ");
+    json::AppendString(s, opts.searchText ? opts.searchText : "");
+    s.AppendFmt(",\n  \"peakRssBytes\": %zu,\n", GetPeakRss());
+    s.Append("  \"files\": [");
+    for (int i = 0; i < results.isize(); i++) {
+        BenchFileResult* res = results[i];
+        s.Append(i == 0 ? "\n" : ",\n");
+        s.Append("    {\n      \"path\": ");
+        json::AppendString(s, res->path);
+        s.AppendFmt(",\n      \"failed\": %s,\n", res->failed ? "true" : "false");
+        s.AppendFmt("      \"pageCount\": %d,\n", res->pageCount);
+        s.AppendFmt("      \"cumulativePeakRssBytes\": %zu,\n", res->cumulativePeakRssBytes);
+        s.Append("      \"ops\": [");
+        for (int j = 0; j < res->ops.isize(); j++) {
+            BenchOp* op = res->ops[j];
+            BenchOpStats st = CalcStats(op);
+            s.Append(j == 0 ? "\n" : ",\n");
+            s.Append("        {\"name\": ");
+            json::AppendString(s, op->name);
+            s.AppendFmt(", \"n\": %d, \"min\": %.3f, \"mean\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, "
+                        "\"max\": %.3f}",
+                        st.n, st.min, st.mean, st.p50, st.p95, st.p99, st.max);
+        }
+        s.Append("\n      ]\n    }");
+    }
+    s.Append("\n  ]\n}\n");
+}
+
+// p50 and p95 of operations in a baseline file, keyed by "<path>\n<op name>"
+class BaselineVisitor : public json::ValueVisitor {
+  public:
+    StrVec filePaths;
+    // indexed by file and op index, resolved after parsing
+    StrVec opKeys;
+    Vec<int> opFileIdx;
+    Vec<int> opIdx;
+    Vec<float> p50;
+    Vec<float> p95;
+
+    int FindOp(int fileIdx, int idx) {
+        for (int i = 0; i < opIdx.isize(); i++) {
+            if (opFileIdx[i] == fileIdx && opIdx[i] == idx) {
+                return i;
+            }
+        }
+        opFileIdx.Append(fileIdx);
+        opIdx.Append(idx);
+        opKeys.Append(nullptr);
+        p50.Append(-1.f);
+        p95.Append(-1.f);
+        return opIdx.isize() - 1;
+    }
+
+    bool Visit(const char* path, const char* value, json::Type type) override {
+        int fileIdx, idx;
+        AutoFree field;
+        if (str::Parse(path, "/files[%d]/path%$", &fileIdx) && type == json::Type::String) {
+            while (filePaths.Size() <= fileIdx) {
+                filePaths.Append(nullptr);
+            }
+            filePaths.SetAt(fileIdx, value);
+            return true;
+        }
+        if (!str::Parse(path, "/files[%d]/ops[%d]/%S", &fileIdx, &idx, &field)) {
+            return true;
+        }
+        int i = FindOp(fileIdx, idx);
+        if (str::Eq(field, "name")) {
+            opKeys.SetAt(i, value);
+        } else if (str::Eq(field, "p50")) {
+            p50[i] = (float)atof(value);
+        } else if (str::Eq(field, "p95")) {
+            p95[i] = (float)atof(value);
+        }
+        return true;
+    }
+};
+
+static bool IsRegression(float base, double curr, BenchOptions& opts) {
+    if (base < 0) {
+        return false;
+    }
+    double delta = curr - (double)base;
+    if (delta < (double)opts.minDeltaMs) {
+        return false;
+    }
+    return delta * 100.0 > (double)base * (double)opts.thresholdPercent;
+}
+
+// returns number of regressions or -1 if baseline couldn't be read
+static int CompareWithBaseline(const char* baselinePath, BenchOptions& opts, Vec<BenchFileResult*>& results) {
+    ByteSlice d = file::ReadFile(baselinePath);
+    if (d.empty()) {
+        ErrOut("Error: Couldn't read baseline %s!", baselinePath);
+        return -1;
+    }
+    BaselineVisitor baseline;
+    bool ok = json::Parse((const char*)d.data(), &baseline);
+    d.Free();
+    if (!ok) {
+        ErrOut("Error: Couldn't parse baseline %s!", baselinePath);
+        return -1;
+    }
+
+    int nRegressions = 0;
+    for (int i = 0; i < baseline.opKeys.Size(); i++) {
+        int fileIdx = baseline.opFileIdx[i];
+        const char* path = fileIdx < baseline.filePaths.Size() ? baseline.filePaths.at(fileIdx) : nullptr;
+        const char* opName = baseline.opKeys.at(i);
+        if (!path || !opName) {
+            continue;
+        }
+        for (BenchFileResult* res : results) {
+            if (!str::EqI(res->path, path)) {
+                continue;
+            }
+            for (BenchOp* op : res->ops) {
+                if (!str::Eq(op->name, opName)) {
+                    continue;
+                }
+                BenchOpStats st = CalcStats(op);
+                bool p50Regressed = IsRegression(baseline.p50[i], st.p50, opts);
+                bool p95Regressed = IsRegression(baseline.p95[i], st.p95, opts);
+                if (p50Regressed || p95Regressed) {
+                    printf("REGRESSION: %s '%s' p50: %.2f => %.2f ms, p95: %.2f => %.2f ms\n", path, opName,
+                           baseline.p50[i], st.p50, baseline.p95[i], st.p95);
+                    nRegressions++;
+                }
+            }
+        }
+    }
+    return nRegressions;
+}
+
+static bool ParseZooms(const char* s, Vec<float>& zooms) {
+    StrVec parts;
+    Split(parts, s, ",", true);
+    for (char* part : parts) {
+        float zoom;
+        if (!str::Parse(part, "%f%?%%$", &zoom) || zoom <= 0.f) {
+            return false;
+        }
+        zooms.Append(zoom / 100.f);
+    }
+    return zooms.size() > 0;
+}
+
+int main(__unused int argc, __unused char** argv) {
+    setlocale(LC_ALL, "C");
+    DisableDataExecution();
+
+    CmdLineArgsIter argList(GetCommandLine());
+    int nArgs = argList.nArgs;
+
+    BenchOptions opts;
+    StrVec paths;
+
+    for (int i = 1; i < nArgs; i++) {
+        const char* arg = argList.at(i);
+        bool hasParam = i + 1 < nArgs;
+        if (str::Eq(arg, "-warmup") && hasParam) {
+            opts.nWarmup = atoi(argList.at(++i));
+        } else if (str::Eq(arg, "-repeat") && hasParam) {
+            opts.nRepeat = atoi(argList.at(++i));
+        } else if (str::Eq(arg, "-zoom") && hasParam) {
+            // e.g. -zoom 50,100,200
+            if (!ParseZooms(argList.at(++i), opts.zooms)) {
+                goto Usage;
+            }
+        } else if (str::Eq(arg, "-search") && hasParam) {
+            opts.searchText = argList.at(++i);
+        } else if (str::Eq(arg, "-out") && hasParam) {
+            opts.outPath = argList.at(++i);
+        } else if (str::Eq(arg, "-baseline") && hasParam) {
+            opts.baselinePath = argList.at(++i);
+        } else if (str::Eq(arg, "-threshold") && hasParam) {
+            // in percent
+            opts.thresholdPercent = (float)atof(argList.at(++i));
+        } else if (str::Eq(arg, "-min-delta") && hasParam) {
+            // in ms
+            opts.minDeltaMs = (float)atof(argList.at(++i));
+        } else if (arg[0] == '-') {
+            goto Usage;
+        } else {
+            paths.Append(arg);
+        }
+    }
+    if (paths.size() == 0 || opts.nRepeat < 1 || opts.nWarmup < 0) {
+    Usage:
+        ErrOut("%s [-warmup <n>][-repeat <n>][-zoom <pct>,<pct>...][-search <text>][-out <results.json>]\n"
+               "\t[-baseline <results.json>][-threshold <pct>][-min-delta <ms>] <file or dir>...",
+               path::GetBaseNameTemp(argList.args[0]));
+        return kExitUsage;
+    }
+    if (opts.zooms.size() == 0) {
+        opts.zooms.Append(1.f);
+    }
+
+    ScopedGdiPlus gdiPlus;
+    ScopedMui miniMui;
+
+    StrVec files;
+    for (char* path : paths) {
+        CollectFilesToBench(path, files);
+    }
+    if (files.size() == 0) {
+        ErrOut1("Error: No documents to benchmark!");
+        return kExitError;
+    }
+
+    Vec<BenchFileResult*> results;
+    for (char* path : files) {
+        results.Append(BenchFile(path, opts));
+    }
+
+    str::Str json;
+    SerializeResults(json, opts, results);
+    if (opts.outPath) {
+        if (!file::WriteFile(opts.outPath, json.AsByteSlice())) {
+            ErrOut("Error: Couldn't write %s!", opts.outPath);
+            DeleteVecMembers(results);
+            return kExitError;
+        }
+    } else {
+        fwrite(json.Get(), 1, json.size(), stdout);
+    }
+
+    int exitCode = kExitOk;
+    if (opts.baselinePath) {
+        int nRegressions = CompareWithBaseline(opts.baselinePath, opts, results);
+        if (nRegressions < 0) {
+            exitCode = kExitError;
+        } else if (nRegressions > 0) {
+            exitCode = kExitRegression;
+        }
+    }
+    DeleteVecMembers(results);
+    return exitCode;
+}
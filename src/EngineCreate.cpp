@@ -6,6 +6,7 @@
 #include "utils/WinUtil.h"
 #include "utils/GuessFileType.h"
 #include "utils/Dpi.h"
+#include "utils/Trace.h"
 
 #include "wingui/UIModels.h"
 
@@ -140,6 +141,7 @@ static EngineBase* CreateEngineForKind(Kind kind, const char* path, PasswordUI*
 
 EngineBase* CreateEngineFromFile(const char* path, PasswordUI* pwdUI, bool enableChmEngine) {
     CrashIf(!path);
+    TRACE_SPAN("CreateEngineFromFile");
 
     // try to open with the engine guess from file name
     // if that fails, try to guess the file type based on content
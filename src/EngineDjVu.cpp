@@ -13,6 +13,7 @@
 #include "utils/ByteReader.h"
 #include "utils/FileUtil.h"
 #include "utils/GuessFileType.h"
+#include "utils/ThreadUtil.h"
 #include "utils/WinUtil.h"
 
 #include "wingui/UIModels.h"
@@ -123,41 +124,30 @@ static TocItem* NewDjVuTocItem(TocItem* parent, const char* title, const char* l
     return res;
 }
 
+// ddjvu_context_create() temporarily changes the global locale
+static Mutex gDjVuCreateContextMutex;
+
+// each document gets its own ddjvu context (and thus message queue) so that
+// documents don't have to wait for each other
 struct DjVuContext {
     ddjvu_context_t* ctx = nullptr;
-    int refCount = 1;
+    // only one thread at a time pumps the message queue
     CRITICAL_SECTION lock;
 
     DjVuContext() {
         InitializeCriticalSection(&lock);
+        gDjVuCreateContextMutex.Lock();
         ctx = ddjvu_context_create("DjVuEngine");
         // reset the locale to "C" as most other code expects
         setlocale(LC_ALL, "C");
+        gDjVuCreateContextMutex.Unlock();
         CrashIf(!ctx);
     }
 
-    int AddRef() {
-        EnterCriticalSection(&lock);
-        ++refCount;
-        int res = refCount;
-        LeaveCriticalSection(&lock);
-        return res;
-    }
-
-    int Release() {
-        EnterCriticalSection(&lock);
-        CrashIf(refCount <= 0);
-        --refCount;
-        LeaveCriticalSection(&lock);
-        return refCount;
-    }
-
     ~DjVuContext() {
-        EnterCriticalSection(&lock);
         if (ctx) {
             ddjvu_context_release(ctx);
         }
-        LeaveCriticalSection(&lock);
         DeleteCriticalSection(&lock);
     }
 
@@ -179,15 +169,20 @@ struct DjVuContext {
         }
     }
 
-    ddjvu_document_t* OpenFile(const char* fileName) {
-        ScopedCritSec scope(&lock);
+    // pumps messages until isDone() returns true, see PumpUntil()
+    // (libdjvu updates the job status before posting the message about it)
+    template <typename F>
+    void WaitUntil(const F& isDone) {
+        PumpUntil(&lock, isDone, [this] { SpinMessageLoop(); });
+    }
+
+    ddjvu_document_t* OpenFile(const char* fileName) const {
         // TODO: libdjvu sooner or later crashes inside its caching code; cf.
         //       http://code.google.com/p/sumatrapdf/issues/detail?id=1434
         return ddjvu_document_create_by_filename_utf8(ctx, fileName, /* cache */ FALSE);
     }
 
-    ddjvu_document_t* OpenStream(IStream* stream) {
-        ScopedCritSec scope(&lock);
+    ddjvu_document_t* OpenStream(IStream* stream) const {
         ByteSlice d = GetDataFromStream(stream, nullptr);
         AutoFree dFree(d.Get());
         if (d.empty() || d.size() > ULONG_MAX) {
@@ -198,33 +193,7 @@ struct DjVuContext {
     }
 };
 
-// TODO: make it non-static because it accesses other static state
-// in djvu which got deleted first
-static DjVuContext* gDjVuContext;
-
-static DjVuContext* GetDjVuContext() {
-    if (!gDjVuContext) {
-        gDjVuContext = new DjVuContext();
-    } else {
-        gDjVuContext->AddRef();
-    }
-    return gDjVuContext;
-}
-
-static void ReleaseDjVuContext() {
-    CrashIf(!gDjVuContext);
-    int refCount = gDjVuContext->Release();
-    if (refCount != 0) {
-        return;
-    }
-}
-
 void CleanupEngineDjVu() {
-    if (gDjVuContext) {
-        CrashIf(gDjVuContext->refCount != 0);
-        delete gDjVuContext;
-        gDjVuContext = nullptr;
-    }
     minilisp_finish();
 }
 
@@ -283,6 +252,10 @@ class EngineDjVu : public EngineBase {
 
     Vec<ddjvu_fileinfo_t> fileInfos;
 
+    DjVuContext* djvuCtx = nullptr;
+    // protects pages' annotations and elements and tocTree
+    CRITICAL_SECTION pagesAccess;
+
     RenderedBitmap* CreateRenderedBitmap(const char* bmpData, Size size, bool grayscale) const;
     bool ExtractPageText(miniexp_t item, str::WStr& extracted, Vec<Rect>& coords);
     char* ResolveNamedDest(const char* name);
@@ -298,12 +271,11 @@ EngineDjVu::EngineDjVu() {
     str::ReplaceWithCopy(&defaultExt, ".djvu");
     // DPI isn't constant for all pages and thus premultiplied
     fileDPI = 300.0f;
-    GetDjVuContext();
+    djvuCtx = new DjVuContext();
+    InitializeCriticalSection(&pagesAccess);
 }
 
 EngineDjVu::~EngineDjVu() {
-    ScopedCritSec scope(&gDjVuContext->lock);
-
     delete tocTree;
 
     for (auto pi : pages) {
@@ -323,7 +295,9 @@ EngineDjVu::~EngineDjVu() {
     if (stream) {
         stream->Release();
     }
-    ReleaseDjVuContext();
+    // must be released after the document
+    delete djvuCtx;
+    DeleteCriticalSection(&pagesAccess);
 }
 
 EngineBase* EngineDjVu::Clone() {
@@ -448,12 +422,12 @@ bool EngineDjVu::LoadMediaboxes() {
 
 bool EngineDjVu::Load(const char* fileName) {
     SetFilePath(fileName);
-    doc = gDjVuContext->OpenFile(fileName);
+    doc = djvuCtx->OpenFile(fileName);
     return FinishLoading();
 }
 
 bool EngineDjVu::Load(IStream* stream) {
-    doc = gDjVuContext->OpenStream(stream);
+    doc = djvuCtx->OpenStream(stream);
     return FinishLoading();
 }
 
@@ -462,11 +436,7 @@ bool EngineDjVu::FinishLoading() {
         return false;
     }
 
-    ScopedCritSec scope(&gDjVuContext->lock);
-
-    while (!ddjvu_document_decoding_done(doc)) {
-        gDjVuContext->SpinMessageLoop();
-    }
+    djvuCtx->WaitUntil([&] { return ddjvu_document_decoding_done(doc); });
 
     if (ddjvu_document_decoding_error(doc)) {
         return false;
@@ -486,9 +456,7 @@ bool EngineDjVu::FinishLoading() {
         for (int i = 0; i < pageCount; i++) {
             ddjvu_status_t status;
             ddjvu_pageinfo_t info;
-            while ((status = ddjvu_document_get_pageinfo(doc, i, &info)) < DDJVU_JOB_OK) {
-                gDjVuContext->SpinMessageLoop();
-            }
+            djvuCtx->WaitUntil([&] { return (status = ddjvu_document_get_pageinfo(doc, i, &info)) >= DDJVU_JOB_OK; });
             if (DDJVU_JOB_OK == status) {
                 DjVuPageInfo* pi = pages[i];
                 float dx = (float)info.width * GetFileDPI() / (float)info.dpi;
@@ -499,9 +467,7 @@ bool EngineDjVu::FinishLoading() {
         }
     }
 
-    while ((outline = ddjvu_document_get_outline(doc)) == miniexp_dummy) {
-        gDjVuContext->SpinMessageLoop();
-    }
+    djvuCtx->WaitUntil([&] { return (outline = ddjvu_document_get_outline(doc)) != miniexp_dummy; });
     if (!miniexp_consp(outline) || miniexp_car(outline) != miniexp_symbol("bookmarks")) {
         ddjvu_miniexp_release(doc, outline);
         outline = miniexp_nil;
@@ -511,9 +477,7 @@ bool EngineDjVu::FinishLoading() {
     for (int i = 0; i < fileCount; i++) {
         ddjvu_status_t status;
         ddjvu_fileinfo_s info;
-        while ((status = ddjvu_document_get_fileinfo(doc, i, &info)) < DDJVU_JOB_OK) {
-            gDjVuContext->SpinMessageLoop();
-        }
+        djvuCtx->WaitUntil([&] { return (status = ddjvu_document_get_fileinfo(doc, i, &info)) >= DDJVU_JOB_OK; });
         if (DDJVU_JOB_OK == status && info.type == 'P' && info.pageno >= 0) {
             fileInfos.Append(info);
             hasPageLabels = hasPageLabels || !str::Eq(info.title, info.id);
@@ -559,8 +523,9 @@ RenderedBitmap* EngineDjVu::CreateRenderedBitmap(const char* bmpData, Size size,
     return new RenderedBitmap(hbmp, size, hMap);
 }
 
+// pages are decoded and rendered without holding any lock so that
+// several pages (also of different documents) can render in parallel
 RenderedBitmap* EngineDjVu::RenderPage(RenderPageArgs& args) {
-    ScopedCritSec scope(&gDjVuContext->lock);
     auto pageRect = args.pageRect;
     auto zoom = args.zoom;
     auto pageNo = args.pageNo;
@@ -574,10 +539,9 @@ RenderedBitmap* EngineDjVu::RenderPage(RenderPageArgs& args) {
     if (!page) {
         return nullptr;
     }
-    while (!ddjvu_page_decoding_done(page)) {
-        gDjVuContext->SpinMessageLoop();
-    }
+    djvuCtx->WaitUntil([&] { return ddjvu_page_decoding_done(page); });
     if (ddjvu_page_decoding_error(page)) {
+        ddjvu_page_release(page);
         return nullptr;
     }
 
@@ -641,18 +605,15 @@ RenderedBitmap* EngineDjVu::RenderPage(RenderPageArgs& args) {
 }
 
 RectF EngineDjVu::PageContentBox(int pageNo, RenderTarget) {
-    ScopedCritSec scope(&gDjVuContext->lock);
-
     RectF pageRc = PageMediabox(pageNo);
     ddjvu_page_t* page = ddjvu_page_create_by_pageno(doc, pageNo - 1);
     if (!page) {
         return pageRc;
     }
 
-    while (!ddjvu_page_decoding_done(page)) {
-        gDjVuContext->SpinMessageLoop();
-    }
+    djvuCtx->WaitUntil([&] { return ddjvu_page_decoding_done(page); });
     if (ddjvu_page_decoding_error(page)) {
+        ddjvu_page_release(page);
         return pageRc;
     }
     ddjvu_page_set_rotation(page, DDJVU_ROTATE_0);
@@ -852,12 +813,10 @@ bool EngineDjVu::ExtractPageText(miniexp_t item, str::WStr& extracted, Vec<Rect>
 
 PageText EngineDjVu::ExtractPageText(int pageNo) {
     const WCHAR* lineSep = L"\n";
-    ScopedCritSec scope(&gDjVuContext->lock);
 
     miniexp_t pagetext;
-    while ((pagetext = ddjvu_document_get_pagetext(doc, pageNo - 1, nullptr)) == miniexp_dummy) {
-        gDjVuContext->SpinMessageLoop();
-    }
+    djvuCtx->WaitUntil(
+        [&] { return (pagetext = ddjvu_document_get_pagetext(doc, pageNo - 1, nullptr)) != miniexp_dummy; });
     if (miniexp_nil == pagetext) {
         return {};
     }
@@ -878,9 +837,7 @@ PageText EngineDjVu::ExtractPageText(int pageNo) {
     CrashIf(str::Len(extracted.Get()) != coords.size());
     ddjvu_status_t status;
     ddjvu_pageinfo_t info;
-    while ((status = ddjvu_document_get_pageinfo(doc, pageNo - 1, &info)) < DDJVU_JOB_OK) {
-        gDjVuContext->SpinMessageLoop();
-    }
+    djvuCtx->WaitUntil([&] { return (status = ddjvu_document_get_pageinfo(doc, pageNo - 1, &info)) >= DDJVU_JOB_OK; });
     float dpiFactor = 1.0;
     if (DDJVU_JOB_OK == status) {
         dpiFactor = GetFileDPI() / info.dpi;
@@ -910,6 +867,7 @@ PageText EngineDjVu::ExtractPageText(int pageNo) {
 
 Vec<IPageElement*> EngineDjVu::GetElements(int pageNo) {
     CrashIf(pageNo < 1 || pageNo > PageCount());
+    ScopedCritSec scope(&pagesAccess);
     auto pi = pages[pageNo - 1];
     if (pi->gotAllElements) {
         return pi->allElements;
@@ -917,29 +875,22 @@ Vec<IPageElement*> EngineDjVu::GetElements(int pageNo) {
     pi->gotAllElements = true;
     auto& els = pi->allElements;
 
-    if (pi->annos == miniexp_dummy) {
-        ScopedCritSec scope(&gDjVuContext->lock);
-        while (pi->annos == miniexp_dummy) {
+    djvuCtx->WaitUntil([&] {
+        if (pi->annos == miniexp_dummy) {
             pi->annos = ddjvu_document_get_pageanno(doc, pageNo - 1);
-            if (pi->annos == miniexp_dummy) {
-                gDjVuContext->SpinMessageLoop();
-            }
         }
-    }
+        return pi->annos != miniexp_dummy;
+    });
 
     if (!pi->annos) {
         return els;
     }
 
-    ScopedCritSec scope(&gDjVuContext->lock);
-
     Rect page = PageMediabox(pageNo).Round();
 
     ddjvu_status_t status;
     ddjvu_pageinfo_t info;
-    while ((status = ddjvu_document_get_pageinfo(doc, pageNo - 1, &info)) < DDJVU_JOB_OK) {
-        gDjVuContext->SpinMessageLoop();
-    }
+    djvuCtx->WaitUntil([&] { return (status = ddjvu_document_get_pageinfo(doc, pageNo - 1, &info)) >= DDJVU_JOB_OK; });
     float dpiFactor = 1.0;
     if (DDJVU_JOB_OK == status) {
         dpiFactor = GetFileDPI() / info.dpi;
@@ -1159,10 +1110,10 @@ TocTree* EngineDjVu::GetToc() {
         return nullptr;
     }
 
+    ScopedCritSec scope(&pagesAccess);
     if (tocTree) {
         return tocTree;
     }
-    ScopedCritSec scope(&gDjVuContext->lock);
     int idCounter = 0;
     TocItem* root = BuildTocTree(nullptr, outline, idCounter);
     if (!root) {
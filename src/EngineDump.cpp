@@ -4,10 +4,14 @@
 #include "utils/BaseUtil.h"
 #include "utils/ScopedWin.h"
 #include "utils/CmdLineArgsIter.h"
+#include "utils/DirIter.h"
 #include "utils/FileUtil.h"
 #include "utils/GdiPlusUtil.h"
+#include "utils/GuessFileType.h"
 #include "mui/Mui.h"
 #include "utils/TgaReader.h"
+#include "utils/ThreadUtil.h"
+#include "utils/Trace.h"
 #include "utils/WinUtil.h"
 
 #include "wingui/UIModels.h"
@@ -439,19 +443,139 @@ static bool CheckRenderPath(const char* path) {
     return true;
 }
 
-static bool RenderDocument(EngineBase* engine, const char* renderPath, float zoom = 1.f, bool silent = false) {
+static bool RenderPageToFile(EngineBase* engine, int pageNo, const char* renderPath, float zoom, bool silent) {
+    RenderPageArgs args(pageNo, zoom, 0);
+    RenderedBitmap* bmp = engine->RenderPage(args);
+    if (!bmp) {
+        return false;
+    }
+    if (silent) {
+        delete bmp;
+        return true;
+    }
+    AutoFreeStr pageBmpPath(str::Format(renderPath, pageNo));
+    if (str::EndsWithI(pageBmpPath, ".png")) {
+        Gdiplus::Bitmap gbmp(bmp->GetBitmap(), nullptr);
+        CLSID pngEncId = GetEncoderClsid(L"image/png");
+        WCHAR* pageBmpPathW = ToWstrTemp(pageBmpPath);
+        gbmp.Save(pageBmpPathW, &pngEncId);
+    } else if (str::EndsWithI(pageBmpPath, ".bmp")) {
+        ByteSlice imgData = SerializeBitmap(bmp->GetBitmap());
+        if (!imgData.empty()) {
+            file::WriteFile(pageBmpPath, imgData);
+            str::Free(imgData.data());
+        }
+    } else { // render as TGA for all other file extensions
+        ByteSlice imgData = tga::SerializeBitmap(bmp->GetBitmap());
+        if (!imgData.empty()) {
+            file::WriteFile(pageBmpPath, imgData);
+            str::Free(imgData.data());
+        }
+    }
+    delete bmp;
+    return true;
+}
+
+// state shared by all workers rendering pages of a document
+struct RenderPagesJob {
+    const char* renderPath = nullptr;
+    float zoom = 1.f;
+    bool silent = false;
+    LONG nextPage = 0;
+    // per page, indexed by pageNo - 1. each slot is written by a single worker
+    bool* pageFailed = nullptr;
+    // if not nullptr, extract text into it instead of rendering
+    WCHAR** pageTexts = nullptr;
+};
+
+// renders (or extracts text of) pages taken from a shared counter so that
+// faster workers pick up more pages. each worker has its own engine and
+// holds at most a single rendered page at a time
+struct RenderPagesWorker : ThreadBase {
+    EngineBase* engine = nullptr;
+    RenderPagesJob* job = nullptr;
+
+    void Run() override {
+        int nPages = engine->PageCount();
+        for (;;) {
+            int pageNo = (int)InterlockedIncrement(&job->nextPage);
+            if (pageNo > nPages) {
+                break;
+            }
+            if (job->pageTexts) {
+                PageText pageText = engine->ExtractPageText(pageNo);
+                job->pageTexts[pageNo - 1] = str::Dup(pageText.text);
+                FreePageText(&pageText);
+                continue;
+            }
+            bool ok = RenderPageToFile(engine, pageNo, job->renderPath, job->zoom, job->silent);
+            job->pageFailed[pageNo - 1] = !ok;
+        }
+    }
+};
+
+// runs nThreads workers over all pages of the document. workers other than
+// the first get a clone of the engine because not all engines support
+// rendering from multiple threads
+static void RunRenderPagesWorkers(EngineBase* engine, int nThreads, RenderPagesJob* job) {
+    Vec<RenderPagesWorker*> workers;
+    Vec<EngineBase*> clones;
+    nThreads = std::min(nThreads, engine->PageCount());
+    for (int i = 0; i < nThreads; i++) {
+        EngineBase* workerEngine = engine;
+        if (i > 0) {
+            workerEngine = engine->Clone();
+            if (!workerEngine) {
+                break;
+            }
+            clones.Append(workerEngine);
+        }
+        auto worker = new RenderPagesWorker();
+        worker->engine = workerEngine;
+        worker->job = job;
+        worker->Start();
+        workers.Append(worker);
+    }
+    for (auto worker : workers) {
+        worker->Join();
+        delete worker;
+    }
+    DeleteVecMembers(clones);
+}
+
+static bool RenderDocument(EngineBase* engine, const char* renderPath, float zoom = 1.f, bool silent = false,
+                           int nThreads = 1) {
     if (!CheckRenderPath(renderPath)) {
         return false;
     }
 
+    int nPages = engine->PageCount();
     if (str::EndsWithI(renderPath, ".txt")) {
+        Vec<WCHAR*> pageTexts;
+        pageTexts.AppendBlanks(nPages);
+        if (nThreads > 1) {
+            RenderPagesJob job;
+            job.pageTexts = pageTexts.LendData();
+            RunRenderPagesWorkers(engine, nThreads, &job);
+        }
         str::WStr text(1024);
-        for (int pageNo = 1; pageNo <= engine->PageCount(); pageNo++) {
-            PageText pageText = engine->ExtractPageText(pageNo);
-            if (pageText.text != nullptr) {
-                text.Append(pageText.text);
+        for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+            WCHAR* pageText = pageTexts[pageNo - 1];
+            if (nThreads > 1) {
+                // in page order, regardless of which worker extracted it
+                if (pageText) {
+                    text.Append(pageText);
+                }
+                continue;
             }
-            FreePageText(&pageText);
+            PageText pt = engine->ExtractPageText(pageNo);
+            if (pt.text != nullptr) {
+                text.Append(pt.text);
+            }
+            FreePageText(&pt);
+        }
+        for (WCHAR* pageText : pageTexts) {
+            str::Free(pageText);
         }
         Replace(text, L"\n", L"\r\n");
         if (silent) {
@@ -474,43 +598,71 @@ static bool RenderDocument(EngineBase* engine, const char* renderPath, float zoo
         return PdfCreator::RenderToFile(pdfFilePath, engine);
     }
 
-    bool success = true;
-    for (int pageNo = 1; pageNo <= engine->PageCount(); pageNo++) {
-        RenderPageArgs args(pageNo, zoom, 0);
-        RenderedBitmap* bmp = engine->RenderPage(args);
-        success &= bmp != nullptr;
-        if (!bmp && !silent) {
-            ErrOut("Error: Failed to render page %d for %s!", pageNo, engine->FileName());
+    Vec<bool> pageFailed;
+    pageFailed.AppendBlanks(nPages);
+    if (nThreads > 1) {
+        RenderPagesJob job;
+        job.renderPath = renderPath;
+        job.zoom = zoom;
+        job.silent = silent;
+        job.pageFailed = pageFailed.LendData();
+        RunRenderPagesWorkers(engine, nThreads, &job);
+    } else {
+        for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+            pageFailed[pageNo - 1] = !RenderPageToFile(engine, pageNo, renderPath, zoom, silent);
         }
-        if (!bmp || silent) {
-            delete bmp;
+    }
+
+    // report errors in page order, regardless of which worker rendered a page
+    bool success = true;
+    for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+        if (!pageFailed[pageNo - 1]) {
             continue;
         }
-        AutoFreeStr pageBmpPath(str::Format(renderPath, pageNo));
-        if (str::EndsWithI(pageBmpPath, ".png")) {
-            Gdiplus::Bitmap gbmp(bmp->GetBitmap(), nullptr);
-            CLSID pngEncId = GetEncoderClsid(L"image/png");
-            WCHAR* pageBmpPathW = ToWstrTemp(pageBmpPath);
-            gbmp.Save(pageBmpPathW, &pngEncId);
-        } else if (str::EndsWithI(pageBmpPath, ".bmp")) {
-            ByteSlice imgData = SerializeBitmap(bmp->GetBitmap());
-            if (!imgData.empty()) {
-                file::WriteFile(pageBmpPath, imgData);
-                str::Free(imgData.data());
-            }
-        } else { // render as TGA for all other file extensions
-            ByteSlice imgData = tga::SerializeBitmap(bmp->GetBitmap());
-            if (!imgData.empty()) {
-                file::WriteFile(pageBmpPath, imgData);
-                str::Free(imgData.data());
-            }
+        success = false;
+        if (!silent) {
+            ErrOut("Error: Failed to render page %d for %s!", pageNo, engine->FileName());
         }
-        delete bmp;
     }
-
     return success;
 }
 
+// when dumping several documents, each document's pages are rendered to
+// <dir of renderPath>\<document name>-<name of renderPath>
+static char* RenderPathForDocument(const char* renderPath, const char* filePath, bool isMultiDoc) {
+    if (!isMultiDoc) {
+        return str::Dup(renderPath);
+    }
+    // '%' in file names would be interpreted by str::Format()
+    AutoFreeStr docName(str::Replace(path::GetBaseNameTemp(filePath), "%", "%%"));
+    char* name = str::JoinTemp(docName, "-", path::GetBaseNameTemp(renderPath));
+    char* dir = path::GetDirTemp(renderPath);
+    if (str::Eq(dir, renderPath) || str::Eq(dir, ".")) {
+        return str::Dup(name);
+    }
+    return str::Dup(path::JoinTemp(dir, name));
+}
+
+static void CollectFilesToDump(const char* path, StrVec& files) {
+    if (!dir::Exists(path)) {
+        files.Append(path);
+        return;
+    }
+    StrVec dirFiles;
+    DirTraverse(path, true, [&dirFiles](const char* path) -> bool {
+        Kind kind = GuessFileType(path, true);
+        if (IsSupportedFileType(kind, true)) {
+            dirFiles.Append(path);
+        }
+        return true;
+    });
+    // deterministic order, independent of the file system
+    dirFiles.SortNatural();
+    for (char* filePath : dirFiles) {
+        files.Append(filePath);
+    }
+}
+
 class PasswordHolder : public PasswordUI {
     const char* password;
 
@@ -532,17 +684,20 @@ int main(__unused int argc, __unused char** argv) {
 
     if (nArgs < 2) {
     Usage:
-        ErrOut("%s [-pwd <password>][-quick][-render <path-%%d.tga>] <filename>",
+        ErrOut("%s [-pwd <password>][-quick][-render <path-%%d.tga>][-j <threads>][-trace <trace.json>] <file or "
+               "dir>...",
                path::GetBaseNameTemp(argList.args[0]));
         return 2;
     }
 
-    char* filePath = nullptr;
+    StrVec filePaths;
     char* password = nullptr;
     bool fullDump = true;
     char* renderPath = nullptr;
     float renderZoom = 1.f;
     bool loadOnly = false, silent = false;
+    char* tracePath = nullptr;
+    int nThreads = 1;
 
     for (int i = 1; i < nArgs; i++) {
         if (str::Eq(argList.at(i), "-pwd") && i + 1 < nArgs && !password) {
@@ -562,16 +717,27 @@ int main(__unused int argc, __unused char** argv) {
             loadOnly = true;
         } else if (str::Eq(argList.at(i), "-silent")) {
             silent = true;
+        } else if (str::Eq(argList.at(i), "-trace") && i + 1 < nArgs && !tracePath) {
+            // writes Chrome trace events (chrome://tracing, ui.perfetto.dev)
+            tracePath = argList.at(++i);
+        } else if (str::Eq(argList.at(i), "-j") && i + 1 < nArgs) {
+            // number of threads rendering pages of a document, 0 means one per processor
+            nThreads = atoi(argList.at(++i));
+            if (nThreads <= 0) {
+                SYSTEM_INFO si;
+                GetSystemInfo(&si);
+                nThreads = (int)si.dwNumberOfProcessors;
+            }
         } else if (str::Eq(argList.at(i), "-full")) {
             // -full is for backward compatibility
             fullDump = true;
-        } else if (!filePath) {
-            filePath = argList.at(i);
-        } else {
+        } else if (argList.at(i)[0] == '-') {
             goto Usage;
+        } else {
+            CollectFilesToDump(argList.at(i), filePaths);
         }
     }
-    if (!filePath) {
+    if (filePaths.size() == 0) {
         goto Usage;
     }
 
@@ -584,31 +750,50 @@ int main(__unused int argc, __unused char** argv) {
     ScopedGdiPlus gdiPlus;
     ScopedMui miniMui;
 
-    WIN32_FIND_DATA fdata;
-    WCHAR* pathW = ToWstrTemp(filePath);
-    HANDLE hfind = FindFirstFileW(pathW, &fdata);
-    // embedded documents are referred to by an invalid path
-    // containing more information after a colon (e.g. "C:\file.pdf:3:0")
-    if (INVALID_HANDLE_VALUE != hfind) {
-        char* dir = path::GetDirTemp(filePath);
-        char* name = ToUtf8Temp(fdata.cFileName);
-        filePath = path::JoinTemp(dir, name);
-        FindClose(hfind);
+    if (tracePath) {
+        TraceStart();
     }
 
+    // documents are processed one after another (in the order given, files
+    // of a directory sorted by name) so that output order is deterministic
+    bool isMultiDoc = filePaths.size() > 1;
+    int exitCode = 0;
     PasswordHolder pwdUI(password);
-    EngineBase* engine = CreateEngineFromFile(filePath, &pwdUI, false);
-    if (!engine) {
-        ErrOut("Error: Couldn't create an engine for %s!", path::GetBaseNameTemp(filePath));
-        return 1;
-    }
-    if (!loadOnly) {
-        DumpData(engine, fullDump);
+    for (char* filePath : filePaths) {
+        WIN32_FIND_DATA fdata;
+        WCHAR* pathW = ToWstrTemp(filePath);
+        HANDLE hfind = FindFirstFileW(pathW, &fdata);
+        // embedded documents are referred to by an invalid path
+        // containing more information after a colon (e.g. "C:\file.pdf:3:0")
+        if (INVALID_HANDLE_VALUE != hfind) {
+            char* dir = path::GetDirTemp(filePath);
+            char* name = ToUtf8Temp(fdata.cFileName);
+            filePath = path::JoinTemp(dir, name);
+            FindClose(hfind);
+        }
+
+        EngineBase* engine = CreateEngineFromFile(filePath, &pwdUI, false);
+        if (!engine) {
+            ErrOut("Error: Couldn't create an engine for %s!", path::GetBaseNameTemp(filePath));
+            exitCode = 1;
+            continue;
+        }
+        if (!loadOnly) {
+            DumpData(engine, fullDump);
+        }
+        if (renderPath) {
+            AutoFreeStr docRenderPath(RenderPathForDocument(renderPath, filePath, isMultiDoc));
+            RenderDocument(engine, docRenderPath, renderZoom, silent, nThreads);
+        }
+        delete engine;
     }
-    if (renderPath) {
-        RenderDocument(engine, renderPath, renderZoom, silent);
+
+    if (tracePath) {
+        TraceStop();
+        if (!WriteTraceToFile(tracePath)) {
+            ErrOut("Error: Couldn't write trace to %s!", tracePath);
+        }
     }
-    delete engine;
 
-    return 0;
+    return exitCode;
 }
@@ -11,6 +11,7 @@
 #include "utils/FileUtil.h"
 #include "utils/GdiPlusUtil.h"
 #include "utils/HtmlParserLookup.h"
+#include "utils/CssParser.h"
 #include "utils/HtmlPullParser.h"
 #include "mui/Mui.h"
 #include "utils/TrivialHtmlParser.h"
@@ -138,6 +139,8 @@ class EngineEbook : public EngineBase {
     // page dimensions can vary between filetypes
     RectF pageRect;
     float pageBorder;
+    // set if the data of image instructions must be decoded before use
+    DecodeImageFunc decodeImage;
 
     void GetTransform(Matrix& m, float zoom, int rotation);
     bool ExtractPageAnchors();
@@ -349,7 +352,7 @@ RenderedBitmap* EngineEbook::RenderPage(RenderPageArgs& args) {
 
     mui::ITextRender* textDraw = mui::TextRenderGdiplus::Create(&g);
     DrawHtmlPage(&g, textDraw, GetHtmlPage(pageNo), pageBorder, pageBorder, false, Color((ARGB)Color::Black),
-                 cookie ? &cookie->abort : nullptr);
+                 cookie ? &cookie->abort : nullptr, decodeImage);
     delete textDraw;
     DeleteDC(hDC);
 
@@ -520,7 +523,13 @@ RenderedBitmap* EngineEbook::GetImageForPageElement(IPageElement* iel) {
     Vec<DrawInstr>* pageInstrs = GetHtmlPage(pageNo);
     auto&& i = pageInstrs->at(idx);
     CrashIf(i.type != DrawInstrType::Image);
-    return getImageFromData(i.GetImage());
+    if (!decodeImage) {
+        return getImageFromData(i.GetImage());
+    }
+    ByteSlice imgData = decodeImage(i.GetImage());
+    RenderedBitmap* res = imgData.empty() ? nullptr : getImageFromData(imgData);
+    imgData.Free();
+    return res;
 }
 
 // don't delete the result
@@ -934,6 +943,8 @@ bool EngineFb2::FinishLoading() {
         str::ReplaceWithCopy(&defaultExt, ".fb2z");
     }
 
+    // Fb2Doc only decodes images when they're drawn
+    decodeImage = [this](const ByteSlice& img) { return doc->DecodeImage(img); };
     pages = Fb2Formatter(&args, doc).FormatAllPages(false);
     // must set pageCount before ExtractPageAnchors
     pageCount = (int)pages->size();
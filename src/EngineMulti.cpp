@@ -410,6 +410,10 @@ void EngineMulti::UpdatePagesForEngines(Vec<EngineInfo>& enginesInfo) {
         }
         VisitTocTree(root, verifyPages);
     }
+    // page numbers of the ToC items have changed
+    if (tocTree) {
+        tocTree->InvalidatePageIndex();
+    }
 }
 
 bool IsEngineMultiSupportedFileType(Kind kind) {
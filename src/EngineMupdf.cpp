@@ -8,7 +8,9 @@ extern "C" {
 }
 
 #include "utils/BaseUtil.h"
+
 #include "utils/Archive.h"
+#include "utils/DirIter.h"
 #include "utils/ScopedWin.h"
 #include "utils/FileUtil.h"
 #include "utils/GdiPlusUtil.h"
@@ -19,6 +21,8 @@ extern "C" {
 #include "utils/WinUtil.h"
 #include "utils/ZipUtil.h"
 #include "utils/Timer.h"
+#include "utils/ThreadUtil.h"
+#include "utils/Trace.h"
 
 #include "wingui/UIModels.h"
 
@@ -173,6 +177,22 @@ static int FzGetPageNo(fz_context* ctx, fz_document* doc, fz_link* link, fz_outl
     return pageNo;
 }
 
+// fz_load_outline() has already resolved the destination of (most) outline items
+static int FzGetOutlinePageNo(fz_context* ctx, fz_document* doc, fz_outline* outline) {
+    if (!outline->uri || outline->page.page < 0) {
+        return FzGetPageNo(ctx, doc, nullptr, outline);
+    }
+    int pageNo = -1;
+    fz_var(pageNo);
+    fz_try(ctx) {
+        pageNo = fz_page_number_from_location(ctx, doc, outline->page);
+    }
+    fz_catch(ctx) {
+        pageNo = -1;
+    }
+    return pageNo + 1;
+}
+
 static IPageDestination* NewPageDestinationMupdf(fz_context* ctx, fz_document* doc, fz_link* link,
                                                  fz_outline* outline) {
     CrashIf(link && outline);
@@ -196,7 +216,7 @@ static IPageDestination* NewPageDestinationMupdf(fz_context* ctx, fz_document* d
 
     auto dest = new PageDestinationMupdf(link, outline);
     dest->rect = FzGetRectF(link, outline);
-    dest->pageNo = FzGetPageNo(ctx, doc, link, outline);
+    dest->pageNo = outline ? FzGetOutlinePageNo(ctx, doc, outline) : FzGetPageNo(ctx, doc, link, nullptr);
     return dest;
 }
 
@@ -306,6 +326,24 @@ static WCHAR* PdfCleanStringInPlace(WCHAR* s) {
     return s;
 }
 
+// same as PdfCleanStringInPlace() but for utf8 (which is cheaper for the common
+// case of ASCII strings). Returns nullptr for non-ASCII strings
+static char* PdfCleanAsciiString(const char* s) {
+    for (const char* c = s; *c; c++) {
+        if ((u8)*c >= 0x80) {
+            return nullptr;
+        }
+    }
+    char* res = str::Dup(s);
+    for (char* c = res; *c; c++) {
+        if ((u8)*c < 0x20) {
+            *c = ' ';
+        }
+    }
+    str::NormalizeWSInPlace(res);
+    return res;
+}
+
 struct istream_filter {
     IStream* stream;
     u8 buf[4096];
@@ -752,60 +790,42 @@ static LinkRectList* LinkifyText(const WCHAR* pageText, Rect* coords) {
     return list;
 }
 
-// try to produce an 8-bit palette for saving some memory
-static RenderedBitmap* TryRenderAsPaletteImage(fz_pixmap* pixmap) {
-    int w = pixmap->w;
-    int h = pixmap->h;
-    int rows8 = ((w + 3) / 4) * 4;
-    u8* bmpData = (u8*)calloc(rows8, h);
-    if (!bmpData) {
-        return nullptr;
-    }
+static bool gZeroCopyRender = true;
 
-    ScopedMem<BITMAPINFO> bmi((BITMAPINFO*)calloc(1, sizeof(BITMAPINFO) + 255 * sizeof(RGBQUAD)));
+// for -test-render-copies: pixels rendered by EngineMupdf::RenderPage() and the
+// number of bytes written into frames after the draw device was done with them
+static LONG64 gRenderedPixels = 0;
+static LONG64 gRenderBytesCopied = 0;
 
-    u8* dest = bmpData;
-    u8* source = pixmap->samples;
-    u32* palette = (u32*)bmi.Get()->bmiColors;
-    u8 grayIdxs[256]{};
+void SetMupdfZeroCopyRender(bool enable) {
+    gZeroCopyRender = enable;
+}
 
-    int paletteSize = 0;
-    RGBQUAD c;
-    for (int j = 0; j < h; j++) {
-        for (int i = 0; i < w; i++) {
-            c.rgbRed = *source++;
-            c.rgbGreen = *source++;
-            c.rgbBlue = *source++;
-            c.rgbReserved = 0;
-            source++;
-
-            /* find this color in the palette */
-            int k;
-            bool isGray = c.rgbRed == c.rgbGreen && c.rgbRed == c.rgbBlue;
-            if (isGray) {
-                k = grayIdxs[c.rgbRed] || palette[0] == *(u32*)&c ? grayIdxs[c.rgbRed] : paletteSize;
-            } else {
-                for (k = 0; k < paletteSize && palette[k] != *(u32*)&c; k++) {
-                    ;
-                }
-            }
-            /* add it to the palette if it isn't in there and if there's still space left */
-            if (k == paletteSize) {
-                if (++paletteSize > 256) {
-                    free(bmpData);
-                    return nullptr;
-                }
-                if (isGray) {
-                    grayIdxs[c.rgbRed] = (BYTE)k;
-                }
-                palette[k] = *(u32*)&c;
-            }
-            /* 8-bit data consists of indices into the color palette */
-            *dest++ = k;
+void GetMupdfRenderCopyStats(MupdfRenderCopyStats& statsOut, bool reset) {
+    if (reset) {
+        statsOut.pixels = InterlockedExchange64(&gRenderedPixels, 0);
+        statsOut.bytesCopied = InterlockedExchange64(&gRenderBytesCopied, 0);
+        return;
+    }
+    statsOut.pixels = InterlockedAdd64(&gRenderedPixels, 0);
+    statsOut.bytesCopied = InterlockedAdd64(&gRenderBytesCopied, 0);
+}
+
+// try to produce an 8-bit palette for saving some memory
+// samples have 4 bytes per pixel: RGBA for mupdf rgb pixmaps, BGRA for DIB sections
+// palette indices are written directly into the new DIB section
+static RenderedBitmap* TryRenderAsPaletteImage(const u8* samples, int w, int h, int stride, bool isBgr) {
+    int rows8 = ((w + 3) / 4) * 4;
+
+    PaletteQuantizer q(isBgr);
+    {
+        ScopedMem<u8> tmpRow((u8*)malloc(rows8));
+        if (!tmpRow || !q.SampleRows(samples, w, h, stride, tmpRow)) {
+            return nullptr;
         }
-        dest += rows8 - w;
     }
 
+    ScopedMem<BITMAPINFO> bmi((BITMAPINFO*)calloc(1, sizeof(BITMAPINFO) + 255 * sizeof(RGBQUAD)));
     BITMAPINFOHEADER* bmih = &bmi.Get()->bmiHeader;
     bmih->biSize = sizeof(*bmih);
     bmih->biWidth = w;
@@ -814,17 +834,40 @@ static RenderedBitmap* TryRenderAsPaletteImage(fz_pixmap* pixmap) {
     bmih->biCompression = BI_RGB;
     bmih->biBitCount = 8;
     bmih->biSizeImage = h * rows8;
-    bmih->biClrUsed = paletteSize;
+    // the real colors are set with SetDIBColorTable() once we know them
+    bmih->biClrUsed = 256;
 
     void* data = nullptr;
     HANDLE hMap = CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, bmih->biSizeImage, nullptr);
     HBITMAP hbmp = CreateDIBSection(nullptr, bmi, DIB_RGB_COLORS, &data, hMap, 0);
-    if (!hbmp) {
-        free(bmpData);
+    if (!hbmp || !data) {
+        if (hbmp) {
+            DeleteObject(hbmp);
+        }
+        if (hMap) {
+            CloseHandle(hMap);
+        }
         return nullptr;
     }
-    memcpy(data, bmpData, bmih->biSizeImage);
-    free(bmpData);
+
+    /* 8-bit data consists of indices into the color palette */
+    u8* dest = (u8*)data;
+    for (int j = 0; j < h; j++) {
+        if (!q.QuantizeRow(samples + (size_t)j * stride, w, dest)) {
+            InterlockedAdd64(&gRenderBytesCopied, (LONG64)(dest - (u8*)data));
+            DeleteObject(hbmp);
+            CloseHandle(hMap);
+            return nullptr;
+        }
+        dest += rows8;
+    }
+    InterlockedAdd64(&gRenderBytesCopied, (LONG64)bmih->biSizeImage);
+
+    HDC hdc = CreateCompatibleDC(nullptr);
+    HGDIOBJ prev = SelectObject(hdc, hbmp);
+    SetDIBColorTable(hdc, 0, q.nColors, (RGBQUAD*)q.colors);
+    SelectObject(hdc, prev);
+    DeleteDC(hdc);
     return new RenderedBitmap(hbmp, Size(w, h), hMap);
 }
 
@@ -862,7 +905,7 @@ static fz_pixmap* FzConvertPixmap2(fz_context* ctx, fz_pixmap* pix, fz_colorspac
 
 RenderedBitmap* NewRenderedFzPixmap(fz_context* ctx, fz_pixmap* pixmap) {
     if (pixmap->n == 4 && fz_colorspace_is_rgb(ctx, pixmap->colorspace)) {
-        RenderedBitmap* res = TryRenderAsPaletteImage(pixmap);
+        RenderedBitmap* res = TryRenderAsPaletteImage(pixmap->samples, pixmap->w, pixmap->h, (int)pixmap->stride, false);
         if (res) {
             return res;
         }
@@ -917,6 +960,8 @@ RenderedBitmap* NewRenderedFzPixmap(fz_context* ctx, fz_pixmap* pixmap) {
     if (data) {
         u8* samples = bgrPixmap->samples;
         memcpy(data, samples, imgSize);
+        // the conversion to bgr and the copy into the DIB section
+        InterlockedAdd64(&gRenderBytesCopied, (LONG64)imgSize * 2);
     }
     fz_drop_pixmap(ctx, bgrPixmap);
     if (!hbmp) {
@@ -1411,6 +1456,229 @@ static void InstallFitzErrorCallbacks(fz_context* ctx) {
     fz_set_error_callback(ctx, fz_print_cb, nullptr);
 }
 
+// Each EngineMupdf has its own fz_context and therefore its own fz_store
+// (so that documents don't serialize on a single lock) but all stores
+// share a single, process-wide memory budget. When the sum of all stores
+// goes over the budget, we evict from the least recently used documents
+// first (which are usually documents in inactive tabs).
+#if IS_64BIT
+static const size_t gMupdfStoreBudget = 768 * 1024 * 1024;
+#else
+static const size_t gMupdfStoreBudget = 256 * 1024 * 1024;
+#endif
+
+size_t GetMupdfStoreBudget() {
+    return gMupdfStoreBudget;
+}
+
+// protects gMupdfEngines, gMupdfStoreUseCounter and EngineMupdf::storeLastUsed
+// never acquire it while holding EngineMupdf::ctxAccess
+static Mutex gMupdfStoresMutex;
+static Vec<EngineMupdf*> gMupdfEngines;
+static i64 gMupdfStoreUseCounter = 0;
+
+static void RegisterMupdfStore(EngineMupdf* e) {
+    gMupdfStoresMutex.Lock();
+    e->storeLastUsed = ++gMupdfStoreUseCounter;
+    gMupdfEngines.Append(e);
+    gMupdfStoresMutex.Unlock();
+}
+
+static void UnregisterMupdfStore(EngineMupdf* e) {
+    gMupdfStoresMutex.Lock();
+    gMupdfEngines.Remove(e);
+    gMupdfStoresMutex.Unlock();
+}
+
+static int CmpMupdfStoreLastUsed(EngineMupdf** e1, EngineMupdf** e2) {
+    i64 d = (*e1)->storeLastUsed - (*e2)->storeLastUsed;
+    if (d < 0) {
+        return -1;
+    }
+    return d > 0 ? 1 : 0;
+}
+
+// must be called with gMupdfStoresMutex held
+static void EnforceMupdfStoreBudgetLocked() {
+    size_t total = 0;
+    for (EngineMupdf* e : gMupdfEngines) {
+        total += fz_store_current_size(e->ctx);
+    }
+    if (total <= gMupdfStoreBudget) {
+        return;
+    }
+
+    Vec<EngineMupdf*> byAge;
+    byAge.Append(gMupdfEngines.LendData(), gMupdfEngines.size());
+    byAge.SortTyped(CmpMupdfStoreLastUsed);
+    size_t freedTotal = 0;
+    for (EngineMupdf* e : byAge) {
+        // evicting drops objects that belong to e's document, which is only
+        // safe while holding its ctxAccess. if e is busy (e.g. rendering on
+        // another thread) we skip it rather than wait, which also avoids
+        // a deadlock with threads that hold ctxAccess
+        if (!TryEnterCriticalSection(e->ctxAccess)) {
+            continue;
+        }
+        size_t excess = total - gMupdfStoreBudget;
+        size_t freed = fz_evict_store_bytes(e->ctx, excess);
+        LeaveCriticalSection(e->ctxAccess);
+        freedTotal += freed;
+        total -= std::min(freed, total);
+        if (total <= gMupdfStoreBudget) {
+            break;
+        }
+    }
+    logf("EnforceMupdfStoreBudget: evicted %d kB, store total: %d kB\n", (int)(freedTotal / 1024),
+         (int)(total / 1024));
+}
+
+// marks e as the most recently used document and evicts from
+// other documents if we're over the shared budget
+// must not be called while holding e->ctxAccess
+static void TouchMupdfStore(EngineMupdf* e) {
+    gMupdfStoresMutex.Lock();
+    e->storeLastUsed = ++gMupdfStoreUseCounter;
+    EnforceMupdfStoreBudgetLocked();
+    gMupdfStoresMutex.Unlock();
+}
+
+static void AddToStoreStats(void* arg, const fz_store_type* type, const fz_storable* val, size_t size) {
+    MupdfStoreStats* stats = (MupdfStoreStats*)arg;
+    stats->total += size;
+    if (val->drop == fz_drop_image_imp || str::Eq(type->name, "fz_image")) {
+        // fz_image objects (keyed by pdf_obj) and their decoded pixmaps (keyed by fz_image)
+        stats->images += size;
+    } else if (pdf_is_font_storable(val)) {
+        stats->fonts += size;
+    } else if (val->drop == fz_drop_colorspace_imp) {
+        stats->colorspaces += size;
+    } else if (fz_is_display_list_storable(val)) {
+        stats->displayLists += size;
+    } else {
+        stats->other += size;
+    }
+}
+
+// returns resident fz_store memory for each open EngineMupdf document,
+// most recently used first
+// filePath in the result is only valid as long as the engine is alive
+void GetMupdfStoreStats(Vec<MupdfStoreStats>& statsOut) {
+    gMupdfStoresMutex.Lock();
+    for (EngineMupdf* e : gMupdfEngines) {
+        MupdfStoreStats stats;
+        stats.filePath = e->FilePath();
+        stats.lastUsed = e->storeLastUsed;
+        fz_enumerate_store(e->ctx, AddToStoreStats, &stats);
+        statsOut.Append(stats);
+    }
+    gMupdfStoresMutex.Unlock();
+    statsOut.SortTyped([](const MupdfStoreStats* s1, const MupdfStoreStats* s2) -> int {
+        if (s1->lastUsed == s2->lastUsed) {
+            return 0;
+        }
+        return s1->lastUsed > s2->lastUsed ? -1 : 1;
+    });
+}
+
+// xref tables of broken PDF files reconstructed by pdf_repair_xref are
+// saved in gRepairedXrefCacheDir so that we only scan the whole file once.
+// key is a fingerprint of file's size and content, calculated by mupdf
+static char* gRepairedXrefCacheDir = nullptr;
+
+// we keep the most recently used files, up to a limit on count and total size
+constexpr int kMaxRepairedXrefFiles = 64;
+constexpr i64 kMaxRepairedXrefTotalSize = 32 * 1024 * 1024;
+
+struct RepairedXrefFile {
+    char* path = nullptr;
+    u64 lastUsed = 0;
+    i64 size = 0;
+};
+
+static char* RepairedXrefCachePathTemp(const char* key) {
+    return path::JoinTemp(gRepairedXrefCacheDir, str::JoinTemp(key, ".xref"));
+}
+
+static fz_buffer* LoadRepairedXref(fz_context* ctx, const char* key) {
+    char* path = RepairedXrefCachePathTemp(key);
+    ByteSlice d = file::ReadFile(path);
+    if (d.empty()) {
+        return nullptr;
+    }
+    fz_buffer* buf = nullptr;
+    fz_try(ctx) {
+        buf = fz_new_buffer_from_copied_data(ctx, d.data(), d.size());
+    }
+    fz_always(ctx) {
+        d.Free();
+    }
+    fz_catch(ctx) {
+        fz_rethrow(ctx);
+    }
+    // bump modification time so that PruneRepairedXrefCache() keeps it
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    file::SetModificationTime(path, now);
+    logf("LoadRepairedXref: using '%s'\n", path);
+    return buf;
+}
+
+static void PruneRepairedXrefCache() {
+    Vec<RepairedXrefFile> files;
+    DirTraverse(gRepairedXrefCacheDir, false, [&files](WIN32_FIND_DATAW* fd, const char* path) -> bool {
+        if (str::EndsWithI(path, ".xref")) {
+            RepairedXrefFile f;
+            f.path = str::Dup(path);
+            f.lastUsed = ((u64)fd->ftLastWriteTime.dwHighDateTime << 32) | fd->ftLastWriteTime.dwLowDateTime;
+            f.size = GetFileSize(fd);
+            files.Append(f);
+        }
+        return true;
+    });
+    // most recently used first
+    files.SortTyped([](const RepairedXrefFile* f1, const RepairedXrefFile* f2) -> int {
+        if (f1->lastUsed == f2->lastUsed) {
+            return 0;
+        }
+        return f1->lastUsed > f2->lastUsed ? -1 : 1;
+    });
+    i64 totalSize = 0;
+    int n = 0;
+    for (RepairedXrefFile& f : files) {
+        totalSize += f.size;
+        n++;
+        if (n > kMaxRepairedXrefFiles || (n > 1 && totalSize > kMaxRepairedXrefTotalSize)) {
+            file::Delete(f.path);
+            logf("PruneRepairedXrefCache: deleted '%s'\n", f.path);
+        }
+        str::Free(f.path);
+    }
+}
+
+static void SaveRepairedXref(fz_context* ctx, const char* key, fz_buffer* buf) {
+    u8* data = nullptr;
+    size_t size = fz_buffer_storage(ctx, buf, &data);
+    char* path = RepairedXrefCachePathTemp(key);
+    dir::CreateAll(gRepairedXrefCacheDir);
+    bool ok = file::WriteFile(path, {data, size});
+    logf("SaveRepairedXref: saved '%s', ok: %d\n", path, (int)ok);
+    if (ok) {
+        PruneRepairedXrefCache();
+    }
+}
+
+// should be called once, at startup, before opening any documents
+// nullptr disables caching of repaired xref tables
+void SetMupdfRepairedXrefCacheDir(const char* dir) {
+    str::ReplaceWithCopy(&gRepairedXrefCacheDir, dir);
+    if (dir) {
+        pdf_set_repair_cache_funcs(LoadRepairedXref, SaveRepairedXref);
+    } else {
+        pdf_set_repair_cache_funcs(nullptr, nullptr);
+    }
+}
+
 EngineMupdf::EngineMupdf() {
     kind = kindEngineMupdf;
     defaultExt = str::Dup(".pdf");
@@ -1430,9 +1698,13 @@ EngineMupdf::EngineMupdf() {
 
     pdf_install_load_system_font_funcs(ctx);
     fz_register_document_handlers(ctx);
+    RegisterMupdfStore(this);
 }
 
 EngineMupdf::~EngineMupdf() {
+    // must be done before taking ctxAccess
+    UnregisterMupdfStore(this);
+
     EnterCriticalSection(&pagesAccess);
 
     // TODO: remove this lock and see what happens
@@ -1495,7 +1767,6 @@ class PasswordCloner : public PasswordUI {
 };
 
 EngineBase* EngineMupdf::Clone() {
-    ScopedCritSec scope(ctxAccess);
     if (!FilePath()) {
         // before port we could clone streams but it's no longer possible
         return nullptr;
@@ -1503,12 +1774,17 @@ EngineBase* EngineMupdf::Clone() {
 
     // use this document's encryption key (if any) to load the clone
     PasswordCloner* pwdUI = nullptr;
-    if (pdfdoc) {
-        if (pdf_crypt_key(ctx, pdfdoc->crypt)) {
-            pwdUI = new PasswordCloner(pdf_crypt_key(ctx, pdfdoc->crypt));
+    {
+        ScopedCritSec scope(ctxAccess);
+        if (pdfdoc) {
+            if (pdf_crypt_key(ctx, pdfdoc->crypt)) {
+                pwdUI = new PasswordCloner(pdf_crypt_key(ctx, pdfdoc->crypt));
+            }
         }
     }
 
+    // note: must not hold ctxAccess when creating the clone because
+    // it registers with the shared store budget (gMupdfStoresMutex)
     EngineMupdf* clone = new EngineMupdf();
     bool ok = clone->Load(FilePath(), pwdUI);
     if (!ok) {
@@ -1636,6 +1912,7 @@ static ByteSlice PalmDocToHTML(const char* path) {
 }
 
 bool EngineMupdf::Load(const char* path, PasswordUI* pwdUI) {
+    TRACE_SPAN("EngineMupdf::Load");
     const char* pathA = path;
     CrashIf(FilePath() || _doc || !ctx);
     SetFilePath(path);
@@ -1988,17 +2265,6 @@ static void FinishNonPDFLoading(EngineMupdf* e) {
         pageInfo->mediabox = ToRectF(mbox);
         pageInfo->pageNo = i + 1;
     }
-
-    fz_try(ctx) {
-        e->outline = fz_load_outline(ctx, e->_doc);
-    }
-    fz_catch(ctx) {
-        // ignore errors from pdf_load_outline()
-        // this information is not critical and checking the
-        // error might prevent loading some pdfs that would
-        // otherwise get displayed
-        fz_warn(ctx, "Couldn't load outline");
-    }
 }
 
 bool EngineMupdf::FinishLoading() {
@@ -2120,17 +2386,6 @@ bool EngineMupdf::FinishLoading() {
         logfa("Failed to load page tree for '%s'\n", FilePath());
     }
 
-    fz_try(ctx) {
-        outline = fz_load_outline(ctx, _doc);
-    }
-    fz_catch(ctx) {
-        // ignore errors from pdf_load_outline()
-        // this information is not critical and checking the
-        // error might prevent loading some pdfs that would
-        // otherwise get displayed
-        logfa("Couldn't load outline for '%s'\n", FilePath());
-    }
-
     attachments = PdfLoadAttachments(ctx, pdfdoc, FilePath());
 
     pdf_obj* origInfo = nullptr;
@@ -2223,6 +2478,9 @@ TocItem* EngineMupdf::BuildTocTree(TocItem* parent, fz_outline* outline, int& id
         char* name = nullptr;
         WCHAR* nameW = nullptr;
         if (outline->title) {
+            name = PdfCleanAsciiString(outline->title);
+        }
+        if (outline->title && !name) {
             // must convert to Unicode because PdfCleanString() doesn't work on utf8
             nameW = ToWstr(outline->title);
             PdfCleanStringInPlace(nameW);
@@ -2233,7 +2491,12 @@ TocItem* EngineMupdf::BuildTocTree(TocItem* parent, fz_outline* outline, int& id
             name = str::Dup("");
         }
 
-        int pageNo = FzGetPageNo(ctx, _doc, nullptr, outline);
+        int pageNo;
+        if (isAttachment) {
+            pageNo = FzGetPageNo(ctx, _doc, nullptr, outline);
+        } else {
+            pageNo = FzGetOutlinePageNo(ctx, _doc, outline);
+        }
 
         IPageDestination* dest = nullptr;
         if (isAttachment) {
@@ -2279,18 +2542,59 @@ TocItem* EngineMupdf::BuildTocTree(TocItem* parent, fz_outline* outline, int& id
 }
 
 // TODO: maybe build in FinishLoading
+// called during load (e.g. to decide whether to show the ToC) so for PDFs
+// it only checks for /Outlines instead of loading the outline
+bool EngineMupdf::HasToc() {
+    if (tocTree || attachments) {
+        return true;
+    }
+    if (!pdfdoc || outlineLoaded) {
+        return EngineBase::HasToc();
+    }
+
+    ScopedCritSec cs(ctxAccess);
+    bool hasOutline = false;
+    fz_var(hasOutline);
+    fz_try(ctx) {
+        pdf_obj* root = pdf_dict_get(ctx, pdf_trailer(ctx, pdfdoc), PDF_NAME(Root));
+        pdf_obj* outlines = pdf_dict_get(ctx, root, PDF_NAME(Outlines));
+        hasOutline = pdf_is_dict(ctx, pdf_dict_get(ctx, outlines, PDF_NAME(First)));
+    }
+    fz_catch(ctx) {
+        hasOutline = false;
+    }
+    return hasOutline;
+}
+
 TocTree* EngineMupdf::GetToc() {
     if (tocTree) {
         return tocTree;
     }
+
+    TRACE_SPAN("EngineMupdf::GetToc");
+    ScopedCritSec cs(ctxAccess);
+
+    // loading the outline resolves the destinations of all its items,
+    // so it's only done once the ToC is needed
+    if (!outlineLoaded) {
+        outlineLoaded = true;
+        fz_try(ctx) {
+            outline = fz_load_outline(ctx, _doc);
+        }
+        fz_catch(ctx) {
+            // ignore errors from pdf_load_outline()
+            // this information is not critical and checking the
+            // error might prevent loading some pdfs that would
+            // otherwise get displayed
+            logfa("Couldn't load outline for '%s'\n", FilePath());
+        }
+    }
     if (outline == nullptr && attachments == nullptr) {
         return nullptr;
     }
 
     int idCounter = 0;
 
-    ScopedCritSec cs(ctxAccess);
-
     TocItem* root = nullptr;
     TocItem* att = nullptr;
     if (outline) {
@@ -2490,6 +2794,7 @@ FzPageInfo* EngineMupdf::GetFzPageInfo(int pageNo, bool loadQuick) {
 
     ScopedCritSec ctxScope(ctxAccess);
     if (!pageInfo->page) {
+        TRACE_SPAN_PAGE("EngineMupdf: fz_load_page", pageNo);
         fz_try(ctx) {
             pageInfo->page = fz_load_page(ctx, _doc, pageIdx);
         }
@@ -2627,8 +2932,72 @@ RectF EngineMupdf::Transform(const RectF& rect, int pageNo, float zoom, int rota
     return ToRectF(rect2);
 }
 
+// creates the pixmap RenderPage() draws into. Unless zero-copy rendering is disabled,
+// its samples are the memory of a 32-bit BGRA DIB section (returned in bmpOut)
+// so that the draw device rasterizes directly into the final bitmap
+static fz_pixmap* NewRenderPixmap(fz_context* ctx, fz_irect bbox, RenderedBitmap** bmpOut) {
+    if (!gZeroCopyRender) {
+        return fz_new_pixmap_with_bbox(ctx, fz_device_rgb(ctx), bbox, nullptr, 1);
+    }
+    Size size(bbox.x1 - bbox.x0, bbox.y1 - bbox.y0);
+    HANDLE hMap = nullptr;
+    HBITMAP hbmp = CreateMemoryBitmap(size, &hMap);
+    DIBSECTION ds{};
+    if (!hbmp || !GetObject(hbmp, sizeof(ds), &ds) || !ds.dsBm.bmBits) {
+        if (hbmp) {
+            DeleteObject(hbmp);
+        }
+        if (hMap) {
+            CloseHandle(hMap);
+        }
+        fz_throw(ctx, FZ_ERROR_GENERIC, "cannot create %dx%d DIB section", size.dx, size.dy);
+    }
+    *bmpOut = new RenderedBitmap(hbmp, size, hMap);
+    return fz_new_pixmap_with_bbox_and_data(ctx, fz_device_bgr(ctx), bbox, nullptr, 1, (u8*)ds.dsBm.bmBits);
+}
+
+// turns a pixmap from NewRenderPixmap() into the final bitmap: either the DIB section
+// it was rendered into or, if the page has few enough colors, an 8-bit version of it
+static RenderedBitmap* FinishRenderPixmap(fz_context* ctx, fz_pixmap* pix, RenderedBitmap* bmp) {
+    InterlockedAdd64(&gRenderedPixels, (LONG64)pix->w * pix->h);
+    if (!bmp) {
+        return NewRenderedFzPixmap(ctx, pix);
+    }
+    RenderedBitmap* res = TryRenderAsPaletteImage(pix->samples, pix->w, pix->h, (int)pix->stride, true);
+    if (!res) {
+        return bmp;
+    }
+    delete bmp;
+    return res;
+}
+
+// previews are rendered without anti-aliasing, which is noticeably
+// faster for pages with lots of vector graphics
+struct ScopedNoAntiAliasing {
+    fz_context* ctx = nullptr;
+    int textAA = 0;
+    int graphicsAA = 0;
+
+    ScopedNoAntiAliasing(fz_context* ctx, bool enable) {
+        if (!enable) {
+            return;
+        }
+        this->ctx = ctx;
+        textAA = fz_text_aa_level(ctx);
+        graphicsAA = fz_graphics_aa_level(ctx);
+        fz_set_aa_level(ctx, 0);
+    }
+    ~ScopedNoAntiAliasing() {
+        if (ctx) {
+            fz_set_text_aa_level(ctx, textAA);
+            fz_set_graphics_aa_level(ctx, graphicsAA);
+        }
+    }
+};
+
 RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
     auto pageNo = args.pageNo;
+    TRACE_SPAN_PAGE("EngineMupdf::RenderPage", pageNo);
 
     FzPageInfo* pageInfo = GetFzPageInfo(pageNo, false);
     if (!pageInfo || !pageInfo->page) {
@@ -2644,6 +3013,8 @@ RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
         fzcookie = &cookie->cookie;
     }
 
+    TouchMupdfStore(this);
+
     ScopedCritSec cs(ctxAccess);
 
     auto pageRect = args.pageRect;
@@ -2659,7 +3030,6 @@ RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
     fz_matrix ctm = viewctm(page, zoom, rotation);
     fz_irect bbox = fz_round_rect(fz_transform_rect(pRect, ctm));
 
-    fz_colorspace* csRgb = fz_device_rgb(ctx);
     fz_irect ibounds = bbox;
 
     fz_pixmap* pix = nullptr;
@@ -2670,6 +3040,8 @@ RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
     fz_var(pix);
     fz_var(bitmap);
 
+    ScopedNoAntiAliasing noAA(ctx, args.target == RenderTarget::Preview);
+
     const char* usage = "View";
     switch (args.target) {
         case RenderTarget::Print:
@@ -2682,14 +3054,14 @@ RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
     if (pdfdoc) {
         fz_try(ctx) {
             pdfpage = pdf_page_from_fz_page(ctx, page);
-            pix = fz_new_pixmap_with_bbox(ctx, csRgb, ibounds, nullptr, 1);
+            pix = NewRenderPixmap(ctx, ibounds, &bitmap);
             fz_clear_pixmap_with_value(ctx, pix, 0xff);
             // TODO: in printing different style. old code use pdf_run_page_with_usage(), with usage ="View"
             // or "Print". "Export" is not used
             dev = fz_new_draw_device(ctx, ctm, pix);
             pdf_run_page_with_usage(ctx, pdfpage, dev, fz_identity, usage, fzcookie);
-            bitmap = NewRenderedFzPixmap(ctx, pix);
             fz_close_device(ctx, dev);
+            bitmap = FinishRenderPixmap(ctx, pix, bitmap);
         }
         fz_always(ctx) {
             if (dev) {
@@ -2703,7 +3075,7 @@ RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
         }
     } else {
         fz_try(ctx) {
-            pix = fz_new_pixmap_with_bbox(ctx, csRgb, ibounds, nullptr, 1);
+            pix = NewRenderPixmap(ctx, ibounds, &bitmap);
             // TODO: to have uniform background needs to set custom css
             // background-color and clear pixmap with the same color
             fz_clear_pixmap_with_value(ctx, pix, 0xff);
@@ -2713,7 +3085,7 @@ RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
             fz_run_page_contents(ctx, page, dev, fz_identity, NULL);
             fz_close_device(ctx, dev);
             fz_drop_device(ctx, dev);
-            bitmap = NewRenderedFzPixmap(ctx, pix);
+            bitmap = FinishRenderPixmap(ctx, pix, bitmap);
         }
         fz_always(ctx) {
             fz_drop_pixmap(ctx, pix);
@@ -2875,6 +3247,7 @@ RenderedBitmap* EngineMupdf::GetPageImage(int pageNo, RectF rect, int imageIdx)
 }
 
 PageText EngineMupdf::ExtractPageText(int pageNo) {
+    TRACE_SPAN_PAGE("EngineMupdf::ExtractPageText", pageNo);
     FzPageInfo* pageInfo = GetFzPageInfo(pageNo, true);
     if (!pageInfo) {
         return {};
@@ -69,6 +69,7 @@ class EngineMupdf : public EngineBase {
     RenderedBitmap* GetImageForPageElement(IPageElement*) override;
 
     IPageDestination* GetNamedDest(const char* name) override;
+    bool HasToc() override;
     TocTree* GetToc() override;
 
     char* GetPageLabel(int pageNo) const override;
@@ -85,12 +86,16 @@ class EngineMupdf : public EngineBase {
 
     fz_context* ctx = nullptr;
     fz_locks_context fz_locks_ctx;
+    // for evicting from least recently used fz_store first, protected by gMupdfStoresMutex
+    i64 storeLastUsed = 0;
     int displayDPI{96};
     fz_document* _doc = nullptr;
     pdf_document* pdfdoc = nullptr;
     fz_stream* docStream = nullptr;
     Vec<FzPageInfo*> pages;
+    // loaded on first GetToc()
     fz_outline* outline = nullptr;
+    bool outlineLoaded = false;
     fz_outline* attachments = nullptr;
     pdf_obj* pdfInfo = nullptr;
     StrVec* pageLabels = nullptr;
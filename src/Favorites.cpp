@@ -689,16 +689,17 @@ void AddFavoriteWithLabelAndName(MainWindow* win, int pageNo, const char* pageLa
         win->expandedFavorites.Append(fav);
     }
     UpdateFavoritesTreeForAllWindows();
-    SaveSettings();
+    SaveFileStateSettings(path);
 }
 
 void AddFavoriteForCurrentPage(MainWindow* win, int pageNo) {
     char* name = nullptr;
     auto tab = win->CurrentTab();
     auto* ctrl = tab->ctrl;
-    if (ctrl->HasToc()) {
+    // HasToc() is cheap but the outline might still turn out to be empty
+    auto* docTree = ctrl->HasToc() ? ctrl->GetToc() : nullptr;
+    if (docTree) {
         // use the current ToC heading as default name
-        auto* docTree = ctrl->GetToc();
         TocItem* root = docTree->root;
         TocItem* item = TocItemForPageNo(root, pageNo);
         if (item) {
@@ -724,7 +725,7 @@ void DelFavorite(const char* filePath, int pageNo) {
     RememberFavTreeExpansionStateForAllWindows();
     gFavorites.Remove(filePath, pageNo);
     UpdateFavoritesTreeForAllWindows();
-    SaveSettings();
+    SaveFileStateSettings(filePath);
 }
 
 void RememberFavTreeExpansionState(MainWindow* win) {
@@ -821,7 +822,8 @@ static void FavTreeContextMenu(ContextMenuEvent* ev) {
         FavTreeItem* fti = (FavTreeItem*)ti;
         Favorite* toDelete = fti->favorite;
         FileState* f = gFavorites.GetByFavorite(toDelete);
-        char* fp = f->filePath;
+        // f might be deleted when removing its favorites
+        AutoFreeStr fp = str::Dup(f->filePath);
         if (fti->parent) {
             gFavorites.Remove(fp, toDelete->pageNo);
         } else {
@@ -829,7 +831,7 @@ static void FavTreeContextMenu(ContextMenuEvent* ev) {
             gFavorites.RemoveAllForFile(fp);
         }
         UpdateFavoritesTreeForAllWindows();
-        SaveSettings();
+        SaveFileStateSettings(fp);
     }
 }
 
@@ -55,17 +55,114 @@ static int cmpOpenCount(const void* a, const void* b) {
     return dsA->index < dsB->index ? -1 : 1;
 }
 
+void FileHistory::InvalidatePathIndex() const {
+    pathIndexValid = false;
+}
+
+// must only be called with a valid index
+void FileHistory::AddToPathIndex(FileState* fs) const {
+    CrashIf(!pathIndexValid);
+    // keep the table at most half full
+    if ((pathIndexCount + 1) * 2 > pathIndex.isize()) {
+        BuildPathIndex();
+        return;
+    }
+    int mask = pathIndex.isize() - 1;
+    int i = (int)(MurmurHashStrI(fs->filePath) & (u32)mask);
+    while (pathIndex[i]) {
+        if (pathIndex[i] == fs) {
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    pathIndex[i] = fs;
+    pathIndexCount++;
+}
+
+void FileHistory::BuildPathIndex() const {
+    int n = states ? states->isize() : 0;
+    int size = 64;
+    while (size < n * 2 + 2) {
+        size *= 2;
+    }
+    pathIndex.Reset();
+    pathIndex.AppendBlanks(size);
+    pathIndexCount = 0;
+    pathIndexValid = true;
+    for (int i = 0; i < n; i++) {
+        AddToPathIndex(states->at(i));
+    }
+}
+
 void FileHistory::Append(FileState* fs) const {
     CrashIf(!fs->filePath);
     states->Append(fs);
+    if (pathIndexValid) {
+        AddToPathIndex(fs);
+    }
 }
 
 void FileHistory::Remove(FileState* fs) const {
     states->Remove(fs);
+    InvalidatePathIndex();
 }
 
 void FileHistory::UpdateStatesSource(Vec<FileState*>* states) {
     this->states = states;
+    InvalidatePathIndex();
+}
+
+void FileHistory::SetPath(FileState* fs, const char* filePath) const {
+    SetFileStatePath(fs, filePath);
+    InvalidatePathIndex();
+}
+
+// replaces the state for the same file with state (or adds it, if there's none)
+// if isMostRecent, the state is moved to the front of the list
+void FileHistory::MergeState(FileState* fs, bool isMostRecent) const {
+    CrashIf(!fs->filePath);
+    FileState* prev = FindByPath(fs->filePath);
+    int idx = prev ? states->Find(prev) : 0;
+    if (prev) {
+        states->RemoveAt(idx);
+        InvalidatePathIndex();
+        DeleteDisplayState(prev);
+    }
+    if (isMostRecent) {
+        idx = 0;
+    }
+    states->InsertAt(idx, fs);
+    if (pathIndexValid) {
+        AddToPathIndex(fs);
+    }
+}
+
+// merges the entries of a settings journal (see SaveFileStateSettings())
+// that were written after minTime, returns the number of complete entries
+// note: modifies journal
+int FileHistory::MergeJournal(char* journal, const FILETIME& minTime) const {
+    int nEntries = 0;
+    char* s = journal;
+    for (;;) {
+        char* end = (char*)str::Find(s, kSettingsJournalEntryEnd);
+        if (!end) {
+            // the last entry is incomplete (or there are no more)
+            break;
+        }
+        *end = 0;
+        bool isMostRecent = false;
+        FILETIME time{};
+        FileState* fs = DeserializeFileStateJournalEntry(s, &isMostRecent, &time);
+        if (fs && CompareFileTime(&time, &minTime) > 0) {
+            MergeState(fs, isMostRecent);
+        } else if (fs) {
+            // already contained in (or superseded by) the settings file
+            DeleteDisplayState(fs);
+        }
+        nEntries++;
+        s = end + str::Len(kSettingsJournalEntryEnd);
+    }
+    return nEntries;
 }
 
 void FileHistory::Clear(bool keepFavorites) const {
@@ -82,6 +179,7 @@ void FileHistory::Clear(bool keepFavorites) const {
         }
     }
     *states = keep;
+    InvalidatePathIndex();
 }
 
 FileState* FileHistory::Get(size_t index) const {
@@ -92,18 +190,23 @@ FileState* FileHistory::Get(size_t index) const {
 }
 
 FileState* FileHistory::FindByPath(const char* filePath) const {
-    int idxExact = -1;
-    int n = states->isize();
-    for (int i = 0; i < n; i++) {
-        FileState* fs = states->at(i);
+    if (!filePath) {
+        return nullptr;
+    }
+    if (!pathIndexValid) {
+        BuildPathIndex();
+    }
+    // MurmurHashStrI() ignores ASCII case, same as str::EqI()
+    int mask = pathIndex.isize() - 1;
+    int i = (int)(MurmurHashStrI(filePath) & (u32)mask);
+    while (pathIndex[i]) {
+        FileState* fs = pathIndex[i];
         if (str::EqI(fs->filePath, filePath)) {
-            idxExact = i;
+            return fs;
         }
+        i = (i + 1) & mask;
     }
-    if (idxExact == -1) {
-        return nullptr;
-    }
-    return states->at(idxExact);
+    return nullptr;
 }
 
 // returns an exact match by path or match by just file name
@@ -143,11 +246,15 @@ FileState* FileHistory::MarkFileLoaded(const char* filePath) const {
     if (!fs) {
         fs = NewDisplayState(filePath);
         fs->useDefaultState = true;
+        states->InsertAt(0, fs);
+        if (pathIndexValid) {
+            AddToPathIndex(fs);
+        }
     } else {
         states->Remove(fs);
+        states->InsertAt(0, fs);
         fs->isMissing = false;
     }
-    states->InsertAt(0, fs);
     fs->openCount++;
     return fs;
 }
@@ -233,6 +340,7 @@ void FileHistory::Purge(bool alwaysUseDefaultState) const {
             continue;
         }
         DeleteDisplayState(state);
+        InvalidatePathIndex();
     }
 }
 
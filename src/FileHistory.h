@@ -14,6 +14,12 @@ struct FileHistory {
     // owned by gGlobalPrefs->fileStates
     Vec<FileState*>* states = nullptr;
 
+    // hash table (with linear probing) of states by path, for FindByPath()
+    // built on first use and rebuilt after states have been removed
+    mutable Vec<FileState*> pathIndex;
+    mutable int pathIndexCount = 0;
+    mutable bool pathIndexValid = false;
+
     FileHistory() = default;
     ~FileHistory() = default;
 
@@ -28,6 +34,14 @@ struct FileHistory {
     void GetFrequencyOrder(Vec<FileState*>& list) const;
     void Purge(bool alwaysUseDefaultState = false) const;
     void UpdateStatesSource(Vec<FileState*>* states);
+    void SetPath(FileState* state, const char* filePath) const;
+    void MergeState(FileState* state, bool isMostRecent) const;
+    int MergeJournal(char* journal, const FILETIME& minTime) const;
+
+  private:
+    void BuildPathIndex() const;
+    void AddToPathIndex(FileState* state) const;
+    void InvalidatePathIndex() const;
 };
 
 int RecentlyCloseDocumentsCount();
@@ -3,31 +3,101 @@
 
 #include "utils/BaseUtil.h"
 #include "utils/CryptoUtil.h"
+#include "utils/Dict.h"
 #include "utils/FileUtil.h"
 #include "utils/DirIter.h"
-#include "utils/GdiPlusUtil.h"
+#include "utils/GuessFileType.h"
+#include "utils/ScopedWin.h"
+#include "utils/ThreadUtil.h"
+#include "utils/Timer.h"
 #include "utils/WinUtil.h"
 
 #include "Settings.h"
 #include "DocController.h"
-#include "FzImgReader.h"
+#include "EngineBase.h"
+#include "EngineAll.h"
 #include "FileHistory.h"
 
 #include "AppTools.h"
 #include "FileThumbnails.h"
 
+#include "utils/Log.h"
+
 constexpr const char* kThumbnailsDirName = "sumatrapdfcache";
+constexpr const char* kThumbnailsStoreName = "thumbnails.dat";
+// thumbnails used to be stored as one .png file per document
 constexpr const char* kPngExt = "*.png";
 
-static char* GetThumbnailPathTemp(const char* filePath) {
-    // create a fingerprint of a (normalized) path for the file name
+// All thumbnails are stored in a single file which is memory-mapped for reading.
+// The file consists of a ThumbnailStoreHeader followed by fixed-size slots, each
+// of which is a ThumbnailSlot followed by the thumbnail's (top-down, 32bpp) pixels.
+// Since all slots have the same size, a thumbnail can always be updated in place.
+// Removed thumbnails only mark their slot as unused (to be re-used by the next
+// thumbnail) until the store is compacted in CleanUpThumbnailCache().
+// The file grows by doubling its number of slots, so that it only rarely
+// has to be re-mapped when thumbnails are added.
+// Several SumatraPDF processes can use the store at the same time, so growing
+// it and allocating slots is serialized with a named mutex (see LockThumbnailStoreFile).
+
+constexpr u32 kThumbnailStoreMagic = 0x48545053; // "SPTH"
+constexpr u32 kThumbnailStoreVersion = 1;
+constexpr int kThumbnailMaxPixelsSize = kThumbnailDx * kThumbnailDy * 4;
+
+struct ThumbnailStoreHeader {
+    u32 magic;
+    u32 version;
+    // if the size of thumbnails changes, the store is discarded
+    u32 slotSize;
+    // incremented whenever a slot is allocated or the store grows, so that
+    // other processes know that their index is out of date
+    u32 nChanges;
+};
+
+struct ThumbnailSlot {
+    // md5 of the document's (normalized) path
+    u8 fingerprint[16];
+    // when the thumbnail was created (to find out-of-date thumbnails)
+    FILETIME created;
+    int dx;
+    int dy;
+    u32 isUsed;
+    // created by -pregen-thumbnails, so CleanUpThumbnailCache() keeps it
+    // even if the document isn't in file history
+    u32 isPregenerated;
+};
+
+constexpr int kThumbnailSlotSize = (int)sizeof(ThumbnailSlot) + kThumbnailMaxPixelsSize;
+// number of slots of a new store (which grows by doubling it)
+constexpr int kThumbnailStoreMinSlots = 16;
+
+struct ThumbnailStore {
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    HANDLE hMap = nullptr;
+    // read-write view of the whole file
+    u8* data = nullptr;
+    // number of slots the file has room for (used or not)
+    int nSlots = 0;
+    // fingerprint (as hex) of used slots => slot number
+    dict::MapStrToInt* index = nullptr;
+    Vec<int> unusedSlots;
+    // ThumbnailStoreHeader::nChanges when index and unusedSlots were built
+    u32 nChangesSeen = 0;
+};
+
+static ThumbnailStore gThumbnailStore;
+// protects gThumbnailStore and writes to the store file
+static Mutex gThumbnailStoreMutex;
+// named mutex shared by all processes using the store file
+static HANDLE gThumbnailStoreFileLock = nullptr;
+
+static bool GetFingerprint(const char* filePath, u8 (&digest)[16]) {
+    // create a fingerprint of a (normalized) path
     // I'd have liked to also include the file's last modification time
     // in the fingerprint (much quicker than hashing the entire file's
     // content), but that's too expensive for files on slow drives
-    u8 digest[16]{};
     // TODO: why is this happening? Seen in crash reports e.g. 35043
     if (!filePath) {
-        return nullptr;
+        return false;
     }
     char* path = str::DupTemp(filePath);
     if (path::HasVariableDriveLetter(path)) {
@@ -35,68 +105,520 @@ static char* GetThumbnailPathTemp(const char* filePath) {
         path[0] = '?';
     }
     CalcMD5Digest((u8*)path, str::Len(path), digest);
-    AutoFreeStr fingerPrint = str::MemToHex(digest, dimof(digest));
+    return true;
+}
 
+static char* FingerprintKeyTemp(const u8* fingerprint) {
+    AutoFreeStr hex = str::MemToHex(fingerprint, 16);
+    return str::DupTemp(hex);
+}
+
+static char* GetThumbnailStorePathTemp() {
     char* thumbsDir = AppGenDataFilenameTemp(kThumbnailsDirName);
     if (!thumbsDir) {
         return nullptr;
     }
+    return path::JoinTemp(thumbsDir, kThumbnailsStoreName);
+}
+
+// must be called with gThumbnailStoreMutex held
+static bool LockThumbnailStoreFile() {
+    if (!gThumbnailStoreFileLock) {
+        char* path = GetThumbnailStorePathTemp();
+        if (!path) {
+            return false;
+        }
+        // mutex names can't contain backslashes, so the name is based on a hash of the path
+        u8 digest[16];
+        CalcMD5Digest((u8*)path, str::Len(path), digest);
+        char* name = str::JoinTemp("SumatraPDF-thumbnails-", FingerprintKeyTemp(digest));
+        gThumbnailStoreFileLock = CreateMutexW(nullptr, FALSE, ToWstrTemp(name));
+        if (!gThumbnailStoreFileLock) {
+            return false;
+        }
+    }
+    DWORD res = WaitForSingleObject(gThumbnailStoreFileLock, INFINITE);
+    // WAIT_ABANDONED means that a process died while holding the lock (which we now own)
+    return res == WAIT_OBJECT_0 || res == WAIT_ABANDONED;
+}
+
+static void UnlockThumbnailStoreFile() {
+    ReleaseMutex(gThumbnailStoreFileLock);
+}
+
+static ThumbnailStoreHeader* GetStoreHeader() {
+    CrashIf(!gThumbnailStore.data);
+    return (ThumbnailStoreHeader*)gThumbnailStore.data;
+}
+
+static ThumbnailSlot* GetSlot(int slotNo) {
+    CrashIf(!gThumbnailStore.data || slotNo < 0 || slotNo >= gThumbnailStore.nSlots);
+    u8* d = gThumbnailStore.data + sizeof(ThumbnailStoreHeader) + (size_t)slotNo * kThumbnailSlotSize;
+    return (ThumbnailSlot*)d;
+}
+
+static i64 SlotOffset(int slotNo) {
+    return (i64)sizeof(ThumbnailStoreHeader) + (i64)slotNo * kThumbnailSlotSize;
+}
+
+static void UnmapThumbnailStore() {
+    auto& store = gThumbnailStore;
+    if (store.data) {
+        UnmapViewOfFile(store.data);
+        store.data = nullptr;
+    }
+    if (store.hMap) {
+        CloseHandle(store.hMap);
+        store.hMap = nullptr;
+    }
+}
+
+// must be called with gThumbnailStoreMutex held
+static void CloseThumbnailStore() {
+    auto& store = gThumbnailStore;
+    UnmapThumbnailStore();
+    if (store.hFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(store.hFile);
+    }
+    delete store.index;
+    store = ThumbnailStore{};
+}
+
+// maps size bytes of the store file (which grows the file if it's smaller)
+static bool MapThumbnailStore(i64 size) {
+    auto& store = gThumbnailStore;
+    LARGE_INTEGER li;
+    li.QuadPart = size;
+    store.hMap = CreateFileMappingW(store.hFile, nullptr, PAGE_READWRITE, li.HighPart, li.LowPart, nullptr);
+    if (store.hMap) {
+        store.data = (u8*)MapViewOfFile(store.hMap, FILE_MAP_WRITE, 0, 0, 0);
+    }
+    return store.data != nullptr;
+}
+
+// a single pass over the slots so that looking up a thumbnail
+// doesn't have to touch the whole store
+static void BuildThumbnailStoreIndex() {
+    auto& store = gThumbnailStore;
+    delete store.index;
+    store.index = new dict::MapStrToInt(std::max(store.nSlots, kThumbnailStoreMinSlots));
+    store.unusedSlots.Reset();
+    store.nChangesSeen = GetStoreHeader()->nChanges;
+    for (int i = store.nSlots - 1; i >= 0; i--) {
+        ThumbnailSlot* slot = GetSlot(i);
+        if (!slot->isUsed) {
+            // in reverse order so that the first unused slot is re-used first
+            store.unusedSlots.Append(i);
+            continue;
+        }
+        // if there are several, the first one is used (as it's the one that's updated)
+        char* key = FingerprintKeyTemp(slot->fingerprint);
+        if (!store.index->Insert(key, i)) {
+            store.index->Remove(key, nullptr);
+            store.index->Insert(key, i);
+        }
+    }
+}
+
+// maps the store file into memory (if it isn't already)
+// must be called with gThumbnailStoreMutex held
+static bool OpenThumbnailStore() {
+    auto& store = gThumbnailStore;
+    if (store.data) {
+        return true;
+    }
+    char* path = GetThumbnailStorePathTemp();
+    if (!path) {
+        return false;
+    }
+    WCHAR* pathW = ToWstrTemp(path);
+    DWORD access = GENERIC_READ | GENERIC_WRITE;
+    DWORD share = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+    store.hFile = CreateFileW(pathW, access, share, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (store.hFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(store.hFile, &size) || size.QuadPart < (LONGLONG)sizeof(ThumbnailStoreHeader) ||
+        size.QuadPart > INT_MAX) {
+        CloseThumbnailStore();
+        return false;
+    }
+    if (!MapThumbnailStore(size.QuadPart)) {
+        CloseThumbnailStore();
+        return false;
+    }
+    auto hdr = GetStoreHeader();
+    if (hdr->magic != kThumbnailStoreMagic || hdr->version != kThumbnailStoreVersion ||
+        hdr->slotSize != kThumbnailSlotSize) {
+        CloseThumbnailStore();
+        return false;
+    }
+    store.nSlots = (int)((size.QuadPart - sizeof(ThumbnailStoreHeader)) / kThumbnailSlotSize);
+    BuildThumbnailStoreIndex();
+    return true;
+}
+
+// must be called with gThumbnailStoreMutex held
+static int FindThumbnailSlot(const u8 (&fingerprint)[16]) {
+    if (!OpenThumbnailStore()) {
+        return -1;
+    }
+    auto& store = gThumbnailStore;
+    int slotNo;
+    if (!store.index->Get(FingerprintKeyTemp(fingerprint), &slotNo)) {
+        return -1;
+    }
+    ThumbnailSlot* slot = GetSlot(slotNo);
+    if (!slot->isUsed || !memeq(slot->fingerprint, fingerprint, sizeof(fingerprint))) {
+        // another instance has changed the store
+        BuildThumbnailStoreIndex();
+        if (!store.index->Get(FingerprintKeyTemp(fingerprint), &slotNo)) {
+            return -1;
+        }
+    }
+    return slotNo;
+}
+
+static bool WriteAt(HANDLE h, i64 offset, const void* data, int size) {
+    LARGE_INTEGER off;
+    off.QuadPart = offset;
+    if (!SetFilePointerEx(h, off, nullptr, FILE_BEGIN)) {
+        return false;
+    }
+    DWORD written = 0;
+    BOOL ok = WriteFile(h, data, (DWORD)size, &written, nullptr);
+    return ok && (int)written == size;
+}
+
+static HANDLE OpenThumbnailStoreForWriting(const char* path, DWORD disposition) {
+    WCHAR* pathW = ToWstrTemp(path);
+    DWORD share = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+    return CreateFileW(pathW, GENERIC_WRITE, share, nullptr, disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+}
+
+static bool WriteThumbnailStoreHeader(HANDLE h) {
+    ThumbnailStoreHeader hdr{};
+    hdr.magic = kThumbnailStoreMagic;
+    hdr.version = kThumbnailStoreVersion;
+    hdr.slotSize = kThumbnailSlotSize;
+    return WriteAt(h, 0, &hdr, (int)sizeof(hdr));
+}
+
+static bool CreateThumbnailStore() {
+    char* path = GetThumbnailStorePathTemp();
+    if (!path || !dir::CreateForFile(path)) {
+        return false;
+    }
+    AutoCloseHandle h = OpenThumbnailStoreForWriting(path, CREATE_ALWAYS);
+    return h.IsValid() && WriteThumbnailStoreHeader(h);
+}
+
+// catches up with changes made by other processes: the file might have
+// been grown and slots that are unused in our index might have been used
+// must be called with gThumbnailStoreMutex and the store file lock held
+static bool SyncThumbnailStore() {
+    auto& store = gThumbnailStore;
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(store.hFile, &size) || size.QuadPart > INT_MAX) {
+        return false;
+    }
+    int nSlots = (int)((size.QuadPart - sizeof(ThumbnailStoreHeader)) / kThumbnailSlotSize);
+    if (nSlots > store.nSlots) {
+        UnmapThumbnailStore();
+        if (!MapThumbnailStore(size.QuadPart)) {
+            CloseThumbnailStore();
+            return false;
+        }
+        store.nSlots = nSlots;
+        BuildThumbnailStoreIndex();
+        return true;
+    }
+    if (GetStoreHeader()->nChanges != store.nChangesSeen) {
+        BuildThumbnailStoreIndex();
+    }
+    return true;
+}
+
+// doubles the number of slots so that adding thumbnails
+// only rarely has to re-map the file
+// must be called with gThumbnailStoreMutex and the store file lock held
+static bool GrowThumbnailStore() {
+    auto& store = gThumbnailStore;
+    int nSlots = std::max(store.nSlots * 2, kThumbnailStoreMinSlots);
+    if (SlotOffset(nSlots) > INT_MAX) {
+        return false;
+    }
+    UnmapThumbnailStore();
+    if (!MapThumbnailStore(SlotOffset(nSlots))) {
+        CloseThumbnailStore();
+        return false;
+    }
+    // the file is extended with zeros i.e. unused slots
+    for (int i = nSlots - 1; i >= store.nSlots; i--) {
+        store.unusedSlots.Append(i);
+    }
+    store.nSlots = nSlots;
+    return true;
+}
+
+// returns an unused slot, growing the store if there are none
+// must be called with gThumbnailStoreMutex and the store file lock held
+static int AllocThumbnailSlot() {
+    auto& store = gThumbnailStore;
+    for (;;) {
+        if (store.unusedSlots.IsEmpty() && !GrowThumbnailStore()) {
+            return -1;
+        }
+        int slotNo = store.unusedSlots.Pop();
+        // re-check the header in the file in case SyncThumbnailStore() didn't
+        // notice that another process has used the slot
+        ThumbnailSlot* slot = GetSlot(slotNo);
+        if (!slot->isUsed) {
+            return slotNo;
+        }
+        store.index->Insert(FingerprintKeyTemp(slot->fingerprint), slotNo);
+    }
+}
+
+// slot is a ThumbnailSlot followed by pixel data
+// must be called with gThumbnailStoreMutex held
+static bool WriteThumbnailSlot(u8* slot) {
+    auto& store = gThumbnailStore;
+    auto newSlot = (ThumbnailSlot*)slot;
+    if (!LockThumbnailStoreFile()) {
+        return false;
+    }
+    defer {
+        UnlockThumbnailStoreFile();
+    };
+    if (!OpenThumbnailStore() && !(CreateThumbnailStore() && OpenThumbnailStore())) {
+        return false;
+    }
+    if (!SyncThumbnailStore()) {
+        return false;
+    }
+    // update the thumbnail in place or re-use an unused slot
+    int slotNo = FindThumbnailSlot(newSlot->fingerprint);
+    if (slotNo >= 0) {
+        // a pregenerated thumbnail stays pregenerated when it's updated
+        newSlot->isPregenerated |= GetSlot(slotNo)->isPregenerated;
+    } else {
+        slotNo = AllocThumbnailSlot();
+        if (slotNo < 0) {
+            return false;
+        }
+        store.index->Insert(FingerprintKeyTemp(newSlot->fingerprint), slotNo);
+        store.nChangesSeen = ++GetStoreHeader()->nChanges;
+    }
+    // the pixels are written before the slot is marked as used
+    ThumbnailSlot* dst = GetSlot(slotNo);
+    dst->isUsed = 0;
+    memcpy((u8*)dst + sizeof(ThumbnailSlot), slot + sizeof(ThumbnailSlot), kThumbnailMaxPixelsSize);
+    *dst = *newSlot;
+    return true;
+}
+
+// must be called with gThumbnailStoreMutex held
+static void MarkThumbnailSlotUnused(int slotNo) {
+    auto& store = gThumbnailStore;
+    ThumbnailSlot* slot = GetSlot(slotNo);
+    char* key = FingerprintKeyTemp(slot->fingerprint);
+    int indexedSlotNo;
+    if (store.index->Get(key, &indexedSlotNo) && indexedSlotNo == slotNo) {
+        store.index->Remove(key, nullptr);
+    }
+    *slot = ThumbnailSlot{};
+    store.unusedSlots.Append(slotNo);
+}
+
+// fills a ThumbnailSlot followed by the bitmap's pixels
+// returns nullptr if the bitmap can't be stored
+static u8* NewThumbnailSlot(const u8 (&fingerprint)[16], RenderedBitmap* bmp) {
+    Size size = bmp->Size();
+    if (size.IsEmpty()) {
+        return nullptr;
+    }
+    // rounding might make thumbnails a pixel larger than requested
+    int dx = std::min(size.dx, kThumbnailDx);
+    int dy = std::min(size.dy, kThumbnailDy);
+
+    BITMAPINFO bmi{};
+    bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
+    bmi.bmiHeader.biWidth = size.dx;
+    bmi.bmiHeader.biHeight = -size.dy;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    ScopedMem<u8> pixels((u8*)malloc((size_t)size.dx * size.dy * 4));
+    if (!pixels) {
+        return nullptr;
+    }
+    HDC hdc = CreateCompatibleDC(nullptr);
+    int nLines = GetDIBits(hdc, bmp->GetBitmap(), 0, size.dy, pixels, &bmi, DIB_RGB_COLORS);
+    DeleteDC(hdc);
+    if (nLines != size.dy) {
+        return nullptr;
+    }
 
-    char* res = path::JoinTemp(thumbsDir, str::JoinTemp(fingerPrint, ".png"));
+    u8* res = (u8*)calloc(1, kThumbnailSlotSize);
+    if (!res) {
+        return nullptr;
+    }
+    auto slot = (ThumbnailSlot*)res;
+    memcpy(slot->fingerprint, fingerprint, sizeof(fingerprint));
+    GetSystemTimeAsFileTime(&slot->created);
+    slot->dx = dx;
+    slot->dy = dy;
+    slot->isUsed = 1;
+    u8* dst = res + sizeof(ThumbnailSlot);
+    for (int y = 0; y < dy; y++) {
+        memcpy(dst + (size_t)y * dx * 4, pixels + (size_t)y * size.dx * 4, (size_t)dx * 4);
+    }
     return res;
 }
 
+static RenderedBitmap* BitmapFromThumbnailSlot(ThumbnailSlot* slot) {
+    Size size(slot->dx, slot->dy);
+    if (size.IsEmpty() || size.dx > kThumbnailDx || size.dy > kThumbnailDy) {
+        return nullptr;
+    }
+    HBITMAP hbmp = CreateMemoryBitmap(size);
+    if (!hbmp) {
+        return nullptr;
+    }
+    DIBSECTION info{};
+    if (!GetObject(hbmp, sizeof(info), &info) || !info.dsBm.bmBits) {
+        DeleteObject(hbmp);
+        return nullptr;
+    }
+    // top-down 32bpp, same as CreateMemoryBitmap()
+    memcpy(info.dsBm.bmBits, (u8*)slot + sizeof(ThumbnailSlot), (size_t)size.dx * size.dy * 4);
+    return new RenderedBitmap(hbmp, size);
+}
+
 void DeleteThumbnailCacheDirectory() {
+    gThumbnailStoreMutex.Lock();
+    CloseThumbnailStore();
+    gThumbnailStoreMutex.Unlock();
+
     char* thumbsDir = AppGenDataFilenameTemp(kThumbnailsDirName);
     dir::RemoveAll(thumbsDir);
 }
 
 // removes thumbnails that don't belong to any frequently used item in file history
+// (except for pregenerated ones) and compacts the store
 void CleanUpThumbnailCache(const FileHistory& fileHistory) {
     char* thumbsDir = AppGenDataFilenameTemp(kThumbnailsDirName);
     char* pattern = path::JoinTemp(thumbsDir, kPngExt);
 
-    StrVec filePaths;
-
-    bool ok = CollectPathsFromDirectory(pattern, filePaths, false);
-    if (!ok) {
-        return;
+    // remove .png thumbnails from older versions
+    StrVec pngPaths;
+    CollectPathsFromDirectory(pattern, pngPaths, false);
+    for (char* path : pngPaths) {
+        file::Delete(path);
     }
 
-    // remove files that should not be deleted
     Vec<FileState*> list;
     fileHistory.GetFrequencyOrder(list);
+
+    gThumbnailStoreMutex.Lock();
+    defer {
+        gThumbnailStoreMutex.Unlock();
+    };
+    // compacting replaces the store file
+    if (!LockThumbnailStoreFile()) {
+        return;
+    }
+    defer {
+        UnlockThumbnailStoreFile();
+    };
+
+    if (!OpenThumbnailStore() || !SyncThumbnailStore()) {
+        return;
+    }
+    Vec<int> toKeep;
     int n = 0;
     for (auto& fs : list) {
         if (n++ > kFileHistoryMaxFrequent * 2) {
             break;
         }
-        char* path = GetThumbnailPathTemp(fs->filePath);
-        if (path) {
-            filePaths.Remove(path);
+        u8 fingerprint[16];
+        if (!GetFingerprint(fs->filePath, fingerprint)) {
+            continue;
+        }
+        int slotNo = FindThumbnailSlot(fingerprint);
+        if (slotNo >= 0 && !toKeep.Contains(slotNo)) {
+            toKeep.Append(slotNo);
         }
     }
+    auto& store = gThumbnailStore;
+    for (int i = 0; i < store.nSlots; i++) {
+        ThumbnailSlot* slot = GetSlot(i);
+        if (!slot->isUsed || slot->isPregenerated) {
+            continue;
+        }
+        if (!toKeep.Contains(i)) {
+            MarkThumbnailSlotUnused(i);
+        }
+    }
+    // only compact once less than half of the store is used, as it would
+    // otherwise soon be grown again (and pregenerated stores can be big)
+    int nUsed = store.nSlots - store.unusedSlots.isize();
+    if (store.nSlots <= kThumbnailStoreMinSlots || nUsed >= store.nSlots / 2) {
+        return;
+    }
 
-    for (char* path : filePaths) {
-        file::Delete(path);
+    // write the thumbnails to keep into a new store and replace the old one
+    char* path = GetThumbnailStorePathTemp();
+    char* tmpPath = str::JoinTemp(path, ".tmp");
+    bool ok;
+    {
+        AutoCloseHandle h = OpenThumbnailStoreForWriting(tmpPath, CREATE_ALWAYS);
+        ok = h.IsValid() && WriteThumbnailStoreHeader(h);
+        int slotNo = 0;
+        for (int i = 0; ok && i < store.nSlots; i++) {
+            if (GetSlot(i)->isUsed) {
+                ok = WriteAt(h, SlotOffset(slotNo++), GetSlot(i), kThumbnailSlotSize);
+            }
+        }
+    }
+    CloseThumbnailStore();
+    if (ok) {
+        WCHAR* tmpPathW = ToWstrTemp(tmpPath);
+        WCHAR* pathW = ToWstrTemp(path);
+        ok = MoveFileExW(tmpPathW, pathW, MOVEFILE_REPLACE_EXISTING);
     }
+    if (!ok) {
+        file::Delete(tmpPath);
+    }
+}
+
+// must be called with gThumbnailStoreMutex held
+static int FindThumbnailSlotForFile(const char* filePath) {
+    u8 fingerprint[16];
+    if (!GetFingerprint(filePath, fingerprint)) {
+        return -1;
+    }
+    return FindThumbnailSlot(fingerprint);
 }
 
 bool LoadThumbnail(FileState* ds) {
     delete ds->thumbnail;
     ds->thumbnail = nullptr;
 
-    char* bmpPath = GetThumbnailPathTemp(ds->filePath);
-    if (!bmpPath) {
-        return false;
+    gThumbnailStoreMutex.Lock();
+    RenderedBitmap* bmp = nullptr;
+    int slotNo = FindThumbnailSlotForFile(ds->filePath);
+    if (slotNo >= 0) {
+        bmp = BitmapFromThumbnailSlot(GetSlot(slotNo));
     }
+    gThumbnailStoreMutex.Unlock();
 
-    RenderedBitmap* bmp = LoadRenderedBitmap(bmpPath);
-    if (!bmp || bmp->Size().IsEmpty()) {
-        delete bmp;
+    if (!bmp) {
         return false;
     }
-
     ds->thumbnail = bmp;
     return true;
 }
@@ -106,14 +628,20 @@ bool HasThumbnail(FileState* ds) {
         return false;
     }
 
-    char* bmpPath = GetThumbnailPathTemp(ds->filePath);
-    if (!bmpPath) {
+    gThumbnailStoreMutex.Lock();
+    int slotNo = FindThumbnailSlotForFile(ds->filePath);
+    FILETIME created{};
+    if (slotNo >= 0) {
+        created = GetSlot(slotNo)->created;
+    }
+    gThumbnailStoreMutex.Unlock();
+    if (slotNo < 0) {
         return true;
     }
-    FILETIME bmpTime = file::GetModificationTime(bmpPath);
+
     FILETIME fileTime = file::GetModificationTime(ds->filePath);
     // delete the thumbnail if the file is newer than the thumbnail
-    if (FileTimeDiffInSecs(fileTime, bmpTime) > 0) {
+    if (FileTimeDiffInSecs(fileTime, created) > 0) {
         delete ds->thumbnail;
         ds->thumbnail = nullptr;
     }
@@ -133,24 +661,27 @@ void SetThumbnail(FileState* ds, RenderedBitmap* bmp) {
     SaveThumbnail(ds);
 }
 
-void SaveThumbnail(FileState* ds) {
-    if (!ds->thumbnail) {
-        return;
+static bool SaveThumbnailForFile(const char* filePath, RenderedBitmap* bmp, bool isPregenerated = false) {
+    u8 fingerprint[16];
+    if (!GetFingerprint(filePath, fingerprint)) {
+        return false;
+    }
+    ScopedMem<u8> slot(NewThumbnailSlot(fingerprint, bmp));
+    if (!slot) {
+        return false;
     }
+    ((ThumbnailSlot*)slot.Get())->isPregenerated = isPregenerated ? 1 : 0;
+    gThumbnailStoreMutex.Lock();
+    bool ok = WriteThumbnailSlot(slot);
+    gThumbnailStoreMutex.Unlock();
+    return ok;
+}
 
-    char* path = ds->filePath;
-    char* bmpPath = GetThumbnailPathTemp(path);
-    if (!bmpPath) {
+void SaveThumbnail(FileState* ds) {
+    if (!ds->thumbnail) {
         return;
     }
-    char* thumbsPath = path::GetDirTemp(bmpPath);
-    if (dir::Create(thumbsPath)) {
-        CrashIf(!str::EndsWithI(bmpPath, ".png"));
-        Gdiplus::Bitmap bmp(ds->thumbnail->GetBitmap(), nullptr);
-        CLSID tmpClsid = GetEncoderClsid(L"image/png");
-        WCHAR* bmpPathW = ToWstrTemp(bmpPath);
-        bmp.Save(bmpPathW, &tmpClsid, nullptr);
-    }
+    SaveThumbnailForFile(ds->filePath, ds->thumbnail);
 }
 
 void RemoveThumbnail(FileState* ds) {
@@ -158,10 +689,106 @@ void RemoveThumbnail(FileState* ds) {
         return;
     }
 
-    char* bmpPath = GetThumbnailPathTemp(ds->filePath);
-    if (bmpPath) {
-        file::Delete(bmpPath);
+    gThumbnailStoreMutex.Lock();
+    int slotNo = FindThumbnailSlotForFile(ds->filePath);
+    if (slotNo >= 0) {
+        MarkThumbnailSlotUnused(slotNo);
     }
+    gThumbnailStoreMutex.Unlock();
+
     delete ds->thumbnail;
     ds->thumbnail = nullptr;
 }
+
+// same as ControllerCallbackHandler::RenderThumbnail() but synchronous
+static RenderedBitmap* RenderThumbnail(EngineBase* engine, Size size) {
+    RectF pageRect = engine->PageMediabox(1);
+    if (pageRect.IsEmpty()) {
+        return nullptr;
+    }
+    pageRect = engine->Transform(pageRect, 1, 1.0f, 0);
+    float zoom = size.dx / (float)pageRect.dx;
+    if (pageRect.dy > (float)size.dy / zoom) {
+        pageRect.dy = (float)size.dy / zoom;
+    }
+    pageRect = engine->Transform(pageRect, 1, 1.0f, 0, true);
+
+    RenderPageArgs args(1, zoom, 0, &pageRect, RenderTarget::View);
+    return engine->RenderPage(args);
+}
+
+struct ThumbnailsThread : ThreadBase {
+    StrVec* files = nullptr;
+    LONG* nextFile = nullptr;
+    LONG* nCreated = nullptr;
+
+    void Run() override {
+        int nFiles = files->Size();
+        for (;;) {
+            int i = (int)InterlockedIncrement(nextFile) - 1;
+            if (i >= nFiles) {
+                break;
+            }
+            char* path = files->at(i);
+            // password protected documents fail to load and don't get a thumbnail
+            EngineBase* engine = CreateEngineFromFile(path, nullptr, true);
+            if (!engine) {
+                logf("PregenerateThumbnails: failed to load '%s'\n", path);
+                continue;
+            }
+            RenderedBitmap* bmp = RenderThumbnail(engine, Size(kThumbnailDx, kThumbnailDy));
+            delete engine;
+            if (bmp && SaveThumbnailForFile(path, bmp, true)) {
+                InterlockedIncrement(nCreated);
+            } else {
+                logf("PregenerateThumbnails: failed to create thumbnail for '%s'\n", path);
+            }
+            delete bmp;
+        }
+    }
+};
+
+// creates thumbnails for all supported documents in dir (and its sub-directories)
+// using nThreads threads (0 means one per processor), without creating any windows
+// used to pre-seed the thumbnail store for deployments
+void PregenerateThumbnails(const char* dir, int nThreads) {
+    auto timeStart = TimeGet();
+    StrVec files;
+    DirTraverse(dir, true, [&files](const char* path) -> bool {
+        Kind kind = GuessFileType(path, true);
+        if (IsSupportedFileType(kind, true)) {
+            files.Append(path::NormalizeTemp(path));
+        }
+        return true;
+    });
+
+    if (nThreads <= 0) {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        nThreads = (int)si.dwNumberOfProcessors;
+    }
+    nThreads = std::clamp(nThreads, 1, std::max(files.Size(), 1));
+
+    LONG nextFile = 0;
+    LONG nCreated = 0;
+    Vec<ThumbnailsThread*> threads;
+    for (int i = 0; i < nThreads; i++) {
+        auto thread = new ThumbnailsThread();
+        thread->files = &files;
+        thread->nextFile = &nextFile;
+        thread->nCreated = &nCreated;
+        thread->Start();
+        threads.Append(thread);
+    }
+    for (auto thread : threads) {
+        thread->Join();
+        delete thread;
+    }
+
+    gThumbnailStoreMutex.Lock();
+    CloseThumbnailStore();
+    gThumbnailStoreMutex.Unlock();
+
+    logf("PregenerateThumbnails: created %d thumbnails for %d files in '%s' with %d threads in %.2f ms\n",
+         (int)nCreated, files.Size(), dir, nThreads, TimeSinceInMs(timeStart));
+}
@@ -13,3 +13,5 @@ void RemoveThumbnail(FileState* ds);
 
 void DeleteThumbnailCacheDirectory();
 void CleanUpThumbnailCache(const FileHistory& fileHistory);
+
+void PregenerateThumbnails(const char* dir, int nThreads);
@@ -3,6 +3,7 @@
 
 #include "utils/BaseUtil.h"
 #include "utils/CmdLineArgsIter.h"
+#include "utils/FileUtil.h"
 #include "utils/WinUtil.h"
 
 #include "Settings.h"
@@ -67,6 +68,8 @@
     V(Render, "render")                          \
     V(ExtractText, "extract-text")               \
     V(Bench, "bench")                            \
+    V(PregenThumbnails, "pregen-thumbnails")     \
+    V(TraceFile, "trace-file")                   \
     V(Dir, "d")                                  \
     V(InstallDir, "install-dir")                 \
     V(Lang, "lang")                              \
@@ -84,6 +87,8 @@
     V(AllUsers2, "allusers")                     \
     V(RunInstallNow, "run-install-now")          \
     V(TestBrowser, "test-browser")               \
+    V(TestRenderThreads, "test-render-threads")  \
+    V(TestRenderCopies, "test-render-copies")    \
     V(Adobe, "a")                                \
     V(DDE, "dde")                                \
     V(SetColorRange, "set-color-range")
@@ -479,6 +484,14 @@ void ParseFlags(const WCHAR* cmdLine, Flags& i) {
             i.testBrowser = true;
             continue;
         }
+        if (arg == Arg::TestRenderThreads) {
+            i.testRenderThreads = true;
+            continue;
+        }
+        if (arg == Arg::TestRenderCopies) {
+            i.testRenderCopies = true;
+            continue;
+        }
         if (arg == Arg::AllUsers || arg == Arg::AllUsers2) {
             i.allUsers = true;
             continue;
@@ -642,6 +655,23 @@ void ParseFlags(const WCHAR* cmdLine, Flags& i) {
             i.exitImmediately = true;
             continue;
         }
+        if (arg == Arg::PregenThumbnails) {
+            // -pregen-thumbnails <dir> [<number of threads>]
+            i.pregenThumbnailsDir = str::Dup(param);
+            const char* s = args.AdditionalParam(1);
+            if (s && str::IsDigit(*s)) {
+                i.pregenThumbnailsThreads = atoi(args.EatParam());
+            }
+            i.exitImmediately = true;
+            continue;
+        }
+        if (arg == Arg::TraceFile) {
+            // -trace-file <path> : record hot-path trace events and write
+            // them to <path> (Chrome trace event JSON) on exit.
+            // absolute because we change current directory during startup
+            i.traceFilePath = str::Dup(path::NormalizeTemp(param));
+            continue;
+        }
         if (arg == Arg::Dir || arg == Arg::InstallDir) {
             i.installDir = str::Dup(param);
             continue;
@@ -724,6 +754,8 @@ Flags::~Flags() {
     str::Free(stressTestPath);
     str::Free(stressTestFilter);
     str::Free(stressTestRanges);
+    str::Free(pregenThumbnailsDir);
+    str::Free(traceFilePath);
     str::Free(lang);
     str::Free(updateSelfTo);
     str::Free(deleteFile);
@@ -84,6 +84,14 @@ struct Flags {
     bool testApp = false;
     char* dde = nullptr;
 
+    // -pregen-thumbnails
+    char* pregenThumbnailsDir = nullptr;
+    // 0 means one thread per processor
+    int pregenThumbnailsThreads = 0;
+
+    // -trace-file
+    char* traceFilePath = nullptr;
+
     bool crashOnOpen = false;
 
     // deprecated flags
@@ -111,6 +119,8 @@ struct Flags {
     int sleepMs = 0;
 
     bool testBrowser = false;
+    bool testRenderThreads = false;
+    bool testRenderCopies = false;
 
     Flags() = default;
     ~Flags();
@@ -71,6 +71,50 @@ ByteSlice SerializeGlobalPrefs(GlobalPrefs* prefs, const char* prevData) {
     return serialized;
 }
 
+// an entry in the settings journal (see SaveFileStateSettings())
+struct FileStateJournalEntry {
+    // FILETIME (as a decimal number) of when the entry was written
+    char* time;
+    bool isMostRecent;
+    // always contains a single state
+    Vec<FileState*>* fileStates;
+};
+
+static const FieldInfo gFileStateJournalEntryFields[] = {
+    {offsetof(FileStateJournalEntry, time), SettingType::String, 0},
+    {offsetof(FileStateJournalEntry, isMostRecent), SettingType::Bool, false},
+    {offsetof(FileStateJournalEntry, fileStates), SettingType::Array, (intptr_t)&gFileStateInfo},
+};
+static const StructInfo gFileStateJournalEntryInfo = {sizeof(FileStateJournalEntry), 3,
+                                                      gFileStateJournalEntryFields, "Time\0MostRecent\0FileStates"};
+
+// caller has to free()
+ByteSlice SerializeFileStateJournalEntry(FileState* fs, bool isMostRecent, const FILETIME& time) {
+    Vec<FileState*> fileStates;
+    fileStates.Append(fs);
+    u64 t = ((u64)time.dwHighDateTime << 32) | time.dwLowDateTime;
+    char timeStr[32];
+    str::BufFmt(timeStr, dimof(timeStr), "%llu", t);
+    FileStateJournalEntry entry{timeStr, isMostRecent, &fileStates};
+    return SerializeStruct(&gFileStateJournalEntryInfo, &entry);
+}
+
+// returns nullptr if data isn't a valid journal entry
+// timeOut is zero for entries written before they were timestamped
+FileState* DeserializeFileStateJournalEntry(const char* data, bool* isMostRecent, FILETIME* timeOut) {
+    auto entry = (FileStateJournalEntry*)DeserializeStruct(&gFileStateJournalEntryInfo, data);
+    FileState* fs = nullptr;
+    if (entry->fileStates->size() == 1 && entry->fileStates->at(0)->filePath) {
+        fs = entry->fileStates->PopAt(0);
+    }
+    *isMostRecent = entry->isMostRecent;
+    u64 t = entry->time ? strtoull(entry->time, nullptr, 10) : 0;
+    timeOut->dwLowDateTime = (DWORD)t;
+    timeOut->dwHighDateTime = (DWORD)(t >> 32);
+    FreeStruct(&gFileStateJournalEntryInfo, entry);
+    return fs;
+}
+
 void DeleteGlobalPrefs(GlobalPrefs* gp) {
     if (!gp) {
         return;
@@ -13,6 +13,13 @@ GlobalPrefs* NewGlobalPrefs(const char* data);
 ByteSlice SerializeGlobalPrefs(GlobalPrefs* prefs, const char* prevData);
 void DeleteGlobalPrefs(GlobalPrefs* gp);
 
+// marks the end of a complete entry in the settings journal
+// (so that partially written ones are ignored)
+constexpr const char* kSettingsJournalEntryEnd = "#EndOfEntry\n";
+
+ByteSlice SerializeFileStateJournalEntry(FileState* fs, bool isMostRecent, const FILETIME& time);
+FileState* DeserializeFileStateJournalEntry(const char* data, bool* isMostRecent, FILETIME* timeOut);
+
 SessionData* NewSessionData();
 TabState* NewTabState(FileState* fs);
 void ResetSessionState(Vec<SessionData*>* sessionData);
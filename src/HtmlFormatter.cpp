@@ -110,54 +110,6 @@ DrawInstr DrawInstr::Anchor(const char* s, size_t len, RectF bbox) {
     return di;
 }
 
-// parses size in the form "1em", "3pt" or "15px"
-static void ParseSizeWithUnit(const char* s, size_t len, float* size, StyleRule::Unit* unit) {
-    if (str::Parse(s, len, "%fem", size)) {
-        *unit = StyleRule::em;
-    } else if (str::Parse(s, len, "%fin", size)) {
-        *unit = StyleRule::pt;
-        *size *= 72; // 1 inch is 72 points
-    } else if (str::Parse(s, len, "%fpt", size)) {
-        *unit = StyleRule::pt;
-    } else if (str::Parse(s, len, "%fpx", size)) {
-        *unit = StyleRule::px;
-    } else {
-        *unit = StyleRule::inherit;
-    }
-}
-
-StyleRule StyleRule::Parse(CssPullParser* parser) {
-    StyleRule rule;
-    const CssProperty* prop;
-    while ((prop = parser->NextProperty()) != nullptr) {
-        switch (prop->type) {
-            case Css_Text_Align:
-                rule.textAlign = FindAlignAttr(prop->s, prop->sLen);
-                break;
-            // TODO: some documents use Css_Padding_Left for indentation
-            case Css_Text_Indent:
-                ParseSizeWithUnit(prop->s, prop->sLen, &rule.textIndent, &rule.textIndentUnit);
-                break;
-        }
-    }
-    return rule;
-}
-
-StyleRule StyleRule::Parse(const char* s, size_t len) {
-    CssPullParser parser(s, len);
-    return Parse(&parser);
-}
-
-void StyleRule::Merge(StyleRule& source) {
-    if (source.textAlign != AlignAttr::NotFound) {
-        textAlign = source.textAlign;
-    }
-    if (source.textIndentUnit != StyleRule::inherit) {
-        textIndent = source.textIndent;
-        textIndentUnit = source.textIndentUnit;
-    }
-}
-
 HtmlFormatter::HtmlFormatter(HtmlFormatterArgs* args)
     : pageDx(args->pageDx), pageDy(args->pageDy), textAllocator(args->textAllocator) {
     currReparseIdx = args->reparseIdx;
@@ -591,7 +543,12 @@ static bool HasPreviousLineSingleImage(Vec<DrawInstr>& instrs) {
 
 bool HtmlFormatter::EmitImage(const ByteSlice* img) {
     CrashIf(img->empty());
-    Size imgSize = BitmapSizeFromData(*img);
+    return EmitImage(img, BitmapSizeFromData(*img));
+}
+
+// img is only referenced by the image instruction, so it
+// doesn't have to be decoded if imgSize is already known
+bool HtmlFormatter::EmitImage(const ByteSlice* img, Size imgSize) {
     if (imgSize.IsEmpty()) {
         return false;
     }
@@ -969,44 +926,16 @@ void HtmlFormatter::HandleTagPre(HtmlToken* t) {
     }
 }
 
-StyleRule* HtmlFormatter::FindStyleRule(HtmlTag tag, const char* clazz, size_t clazzLen) {
-    u32 classHash = clazz ? MurmurHash2(clazz, clazzLen) : 0;
-    for (size_t i = 0; i < styleRules.size(); i++) {
-        StyleRule& rule = styleRules.at(i);
-        if (tag == rule.tag && classHash == rule.classHash) {
-            return &rule;
-        }
-    }
-    return nullptr;
-}
-
 StyleRule HtmlFormatter::ComputeStyleRule(HtmlToken* t) {
-    StyleRule rule;
-    // get style rules ordered by specificity
-    StyleRule* prevRule = FindStyleRule(Tag_Body, nullptr, 0);
-    if (prevRule) {
-        rule.Merge(*prevRule);
-    }
-    prevRule = FindStyleRule(Tag_Any, nullptr, 0);
-    if (prevRule) {
-        rule.Merge(*prevRule);
-    }
-    prevRule = FindStyleRule(t->tag, nullptr, 0);
-    if (prevRule) {
-        rule.Merge(*prevRule);
-    }
     // TODO: support multiple class names
     AttrInfo* attr = t->GetAttrByName("class");
+    StyleRule rule;
     if (attr) {
-        prevRule = FindStyleRule(Tag_Any, attr->val, attr->valLen);
-        if (prevRule) {
-            rule.Merge(*prevRule);
-        }
-        prevRule = FindStyleRule(t->tag, attr->val, attr->valLen);
-        if (prevRule) {
-            rule.Merge(*prevRule);
-        }
+        rule = styleRules.ComputeStyle(t->tag, attr->val, attr->valLen);
+    } else {
+        rule = styleRules.ComputeStyle(t->tag, nullptr, 0);
     }
+
     attr = t->GetAttrByName("style");
     if (attr) {
         StyleRule newRule = StyleRule::Parse(attr->val, attr->valLen);
@@ -1016,24 +945,7 @@ StyleRule HtmlFormatter::ComputeStyleRule(HtmlToken* t) {
 }
 
 void HtmlFormatter::ParseStyleSheet(const char* data, size_t len) {
-    CssPullParser parser(data, len);
-    while (parser.NextRule()) {
-        StyleRule rule = StyleRule::Parse(&parser);
-        const CssSelector* sel;
-        while ((sel = parser.NextSelector()) != nullptr) {
-            if (Tag_NotFound == sel->tag) {
-                continue;
-            }
-            StyleRule* prevRule = FindStyleRule(sel->tag, sel->clazz, sel->clazzLen);
-            if (prevRule) {
-                prevRule->Merge(rule);
-            } else {
-                rule.tag = sel->tag;
-                rule.classHash = sel->clazz ? MurmurHash2(sel->clazz, sel->clazzLen) : 0;
-                styleRules.Append(rule);
-            }
-        }
-    }
+    styleRules.ParseStyleSheet(data, len);
 }
 
 void HtmlFormatter::HandleTagStyle(HtmlToken* t) {
@@ -1392,7 +1304,7 @@ Vec<HtmlPage*>* HtmlFormatter::FormatAllPages(bool skipEmptyPages) {
 // strings, not about the whitespace and we should underline the whitespace as well. Also the text
 // should be underlined at a baseline
 void DrawHtmlPage(Graphics* g, mui::ITextRender* textDraw, Vec<DrawInstr>* drawInstructions, float offX, float offY,
-                  bool showBbox, Color textColor, bool* abortCookie) {
+                  bool showBbox, Color textColor, bool* abortCookie, const DecodeImageFunc& decodeImage) {
     Pen debugPen(Color(255, 0, 0), 1);
     // Pen linePen(Color(0, 0, 0), 2.f);
     Pen linePen(Color(0x5F, 0x4B, 0x32), 2.f);
@@ -1445,7 +1357,11 @@ void DrawHtmlPage(Graphics* g, mui::ITextRender* textDraw, Vec<DrawInstr>* drawI
             CrashIf(status != Ok);
         } else if (DrawInstrType::Image == i.type) {
             // TODO: cache the bitmap somewhere (?)
-            Bitmap* bmp = BitmapFromData(i.GetImage());
+            ByteSlice imgData = decodeImage ? decodeImage(i.GetImage()) : i.GetImage();
+            Bitmap* bmp = imgData.empty() ? nullptr : BitmapFromData(imgData);
+            if (decodeImage) {
+                imgData.Free();
+            }
             if (bmp) {
                 status = g->DrawImage(bmp, ToGdipRectF(bbox), 0, 0, (float)bmp->GetWidth(), (float)bmp->GetHeight(),
                                       UnitPixel);
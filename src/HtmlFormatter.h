@@ -78,26 +78,6 @@ struct DrawInstr {
     static DrawInstr Anchor(const char* s, size_t len, RectF bbox);
 };
 
-class CssPullParser;
-
-struct StyleRule {
-    HtmlTag tag = Tag_NotFound;
-    u32 classHash = 0;
-
-    enum Unit { px, pt, em, inherit };
-
-    float textIndent = 0;
-    Unit textIndentUnit = inherit;
-    AlignAttr textAlign = AlignAttr::NotFound;
-
-    StyleRule() = default;
-
-    void Merge(StyleRule& source);
-
-    static StyleRule Parse(CssPullParser* parser);
-    static StyleRule Parse(const char* s, size_t len);
-};
-
 struct DrawStyle {
     mui::CachedFont* font = nullptr;
     AlignAttr align{AlignAttr::NotFound};
@@ -196,6 +176,7 @@ class HtmlFormatter {
     void UpdateLinkBboxes(HtmlPage* page);
 
     bool EmitImage(const ByteSlice* img);
+    bool EmitImage(const ByteSlice* img, Size imgSize);
     void EmitHr();
     void EmitTextRun(const char* s, const char* end);
     void EmitElasticSpace();
@@ -218,7 +199,6 @@ class HtmlFormatter {
     void RevertStyleChange();
 
     void ParseStyleSheet(const char* data, size_t len);
-    StyleRule* FindStyleRule(HtmlTag tag, const char* clazz, size_t clazzLen);
     StyleRule ComputeStyleRule(HtmlToken* t);
 
     void AppendInstr(const DrawInstr& di);
@@ -258,7 +238,7 @@ class HtmlFormatter {
     Vec<HtmlTag> tagNesting;
     bool keepTagNesting = false;
     // set from CSS and to be checked by the individual tag handlers
-    Vec<StyleRule> styleRules;
+    StyleRules styleRules;
 
     // isntructions for the current line
     Vec<DrawInstr> currLineInstr;
@@ -292,8 +272,13 @@ class HtmlFormatter {
     Vec<HtmlPage*>* FormatAllPages(bool skipEmptyPages = true);
 };
 
+// returns the decoded data (which the caller must free) of an image instruction
+// for documents that keep images encoded until they're drawn (i.e. FB2)
+using DecodeImageFunc = std::function<ByteSlice(const ByteSlice& img)>;
+
 void DrawHtmlPage(Graphics* g, mui::ITextRender* textDraw, Vec<DrawInstr>* drawInstructions, float offX, float offY,
-                  bool showBbox, Color textColor, bool* abortCookie = nullptr);
+                  bool showBbox, Color textColor, bool* abortCookie = nullptr,
+                  const DecodeImageFunc& decodeImage = nullptr);
 
 mui::TextRenderMethod GetTextRenderMethod();
 void SetTextRenderMethod(mui::TextRenderMethod method);
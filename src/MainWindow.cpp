@@ -596,7 +596,7 @@ void LinkHandler::GotoNamedDest(const char* name) {
     if (dest) {
         ScrollTo(dest);
         delete dest;
-    } else if (ctrl->HasToc()) {
+    } else if (ctrl->HasToc() && ctrl->GetToc()) {
         auto* docTree = ctrl->GetToc();
         TocItem* root = docTree->root;
         AutoFreeStr fuzName(NormalizeFuzzy(name));
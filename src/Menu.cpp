@@ -9,6 +9,7 @@
 #include "utils/BitManip.h"
 #include "utils/Dpi.h"
 #include "utils/GdiPlusUtil.h"
+#include "utils/Trace.h"
 #include "mui/Mui.h"
 #include "utils/WinUtil.h"
 
@@ -493,6 +494,14 @@ static MenuDef menuDefDebug[] = {
         "Show notification",
         CmdDebugShowNotif,
     },
+    {
+        "Trace hot paths",
+        CmdDebugToggleTrace,
+    },
+    {
+        "Show memory stats",
+        CmdDebugShowMemoryStats,
+    },
     {
         nullptr,
         0,
@@ -1516,6 +1525,7 @@ static void MenuUpdateStateForWindow(MainWindow* win) {
 #endif
 
     MenuSetChecked(win->menu, CmdDebugShowLinks, gDebugShowLinks);
+    MenuSetChecked(win->menu, CmdDebugToggleTrace, gTraceEnabled);
 }
 
 void OnAboutContextMenu(MainWindow* win, int x, int y) {
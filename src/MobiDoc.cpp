@@ -6,6 +6,8 @@
 #include "utils/ByteOrderDecoder.h"
 #include "utils/ScopedWin.h"
 #include "utils/FileUtil.h"
+#include "utils/ThreadUtil.h"
+#include "utils/Trace.h"
 #include "utils/GuessFileType.h"
 #include "utils/GdiPlusUtil.h"
 #include "utils/HtmlParserLookup.h"
@@ -142,10 +144,22 @@ static bool PalmdocUncompress(const u8* src, size_t srcLen, str::Str& dst) {
             if (back > dst.size() || 0 == back) {
                 return false;
             }
-            for (u8 n = (c2 & 7) + 3; n > 0; n--) {
-                char ctmp = dst.at(dst.size() - back);
-                dst.AppendChar(ctmp);
+            // copy at most 10 bytes through a temporary buffer (instead of
+            // appending them one at a time) because Append() might move
+            // the data we're copying from. when the source and destination
+            // overlap, the copy repeats the last back bytes
+            size_t n = (c2 & 7) + 3;
+            const char* from = dst.Get() + dst.size() - back;
+            char tmp[10];
+            if (back >= n) {
+                memcpy(tmp, from, n);
+            } else {
+                memcpy(tmp, from, back);
+                for (size_t i = back; i < n; i++) {
+                    tmp[i] = tmp[i - back];
+                }
             }
+            dst.Append(tmp, n);
         } else {
             // c >= 192
             dst.AppendChar(' ');
@@ -209,6 +223,7 @@ class HuffDicDecompressor {
 
     bool SetHuffData(u8* huffData, size_t huffDataLen);
     bool AddCdicData(u8* cdicData, u32 cdicDataLen);
+    // has per-decompression state so each thread needs its own copy
     bool Decompress(u8* src, size_t srcSize, str::Str& dst);
     bool DecodeOne(u32 code, str::Str& dst);
 };
@@ -242,10 +257,13 @@ bool HuffDicDecompressor::DecodeOne(u32 code, str::Str& dst) {
             return false;
         }
         recursionGuard.Append(code);
-        if (!Decompress(p, symLen, dst)) {
+        // pop even on failure so that the outcome for a record doesn't
+        // depend on which records this decompressor has seen before
+        bool ok = Decompress(p, symLen, dst);
+        recursionGuard.Pop();
+        if (!ok) {
             return false;
         }
-        recursionGuard.Pop();
     } else {
         symLen &= 0x7fff;
         if (symLen > 127) {
@@ -816,7 +834,7 @@ static size_t GetRealRecordSize(const u8* recData, size_t recLen, size_t trailer
 
 // Load a given record of a document into strOut, uncompressing if necessary.
 // Returns false if error.
-bool MobiDoc::LoadDocRecordIntoBuffer(size_t recNo, str::Str& strOut) {
+bool MobiDoc::LoadDocRecordIntoBuffer(size_t recNo, str::Str& strOut, HuffDicDecompressor* huffDic) {
     auto rec = pdbReader->GetRecord(recNo);
     u8* recData = rec.data();
     if (nullptr == recData) {
@@ -857,18 +875,100 @@ bool MobiDoc::LoadDocRecordIntoBuffer(size_t recNo, str::Str& strOut) {
     return false;
 }
 
+// records can be decompressed independently of each other so
+// for big documents we spread them over several threads
+constexpr size_t kMinRecordsForParallelLoad = 64;
+constexpr int kMaxRecordsLoadThreads = 8;
+
+struct MobiRecordsJob {
+    // one buffer per record, concatenated in order when all are done
+    str::Str* recs = nullptr;
+    LONG nextRecNo = 0;
+    LONG nFailed = 0;
+};
+
+struct MobiRecordsWorker : ThreadBase {
+    MobiDoc* mobiDoc = nullptr;
+    MobiRecordsJob* job = nullptr;
+    // owned
+    HuffDicDecompressor* huffDic = nullptr;
+
+    ~MobiRecordsWorker() override {
+        delete huffDic;
+    }
+
+    void Run() override {
+        size_t nRecs = mobiDoc->docRecCount;
+        for (;;) {
+            size_t recNo = (size_t)InterlockedIncrement(&job->nextRecNo);
+            if (recNo > nRecs) {
+                break;
+            }
+            if (!mobiDoc->LoadDocRecordIntoBuffer(recNo, job->recs[recNo - 1], huffDic)) {
+                InterlockedIncrement(&job->nFailed);
+            }
+        }
+    }
+};
+
+// decompresses all records into doc using nThreads threads
+// returns the number of records that failed to decompress
+size_t MobiDoc::LoadDocRecordsParallel(int nThreads) {
+    MobiRecordsJob job;
+    job.recs = new str::Str[docRecCount];
+
+    Vec<MobiRecordsWorker*> workers;
+    for (int i = 0; i < nThreads; i++) {
+        auto worker = new MobiRecordsWorker();
+        worker->mobiDoc = this;
+        worker->job = &job;
+        if (huffDic) {
+            worker->huffDic = new HuffDicDecompressor(*huffDic);
+        }
+        worker->Start();
+        workers.Append(worker);
+    }
+    for (auto worker : workers) {
+        worker->Join();
+        delete worker;
+    }
+
+    // uncompressedDocSize from the header isn't always accurate
+    size_t totalSize = 0;
+    for (size_t i = 0; i < docRecCount; i++) {
+        totalSize += job.recs[i].size();
+    }
+    doc = new str::Str(totalSize);
+    for (size_t i = 0; i < docRecCount; i++) {
+        doc->Append(job.recs[i]);
+    }
+    delete[] job.recs;
+    return (size_t)job.nFailed;
+}
+
 bool MobiDoc::LoadForPdbReader(PdbReader* pdbReader) {
     this->pdbReader = pdbReader;
     if (!ParseHeader()) {
         return false;
     }
 
+    TRACE_SPAN("MobiDoc::LoadDocRecords");
     CrashIf(doc != nullptr);
-    doc = new str::Str(docUncompressedSize);
+    int nThreads = 1;
+    if (docRecCount >= kMinRecordsForParallelLoad) {
+        SYSTEM_INFO si{};
+        GetSystemInfo(&si);
+        nThreads = std::min((int)si.dwNumberOfProcessors, kMaxRecordsLoadThreads);
+    }
     size_t nFailed = 0;
-    for (size_t i = 1; i <= docRecCount; i++) {
-        if (!LoadDocRecordIntoBuffer(i, *doc)) {
-            nFailed++;
+    if (nThreads > 1) {
+        nFailed = LoadDocRecordsParallel(nThreads);
+    } else {
+        doc = new str::Str(docUncompressedSize);
+        for (size_t i = 1; i <= docRecCount; i++) {
+            if (!LoadDocRecordIntoBuffer(i, *doc, huffDic)) {
+                nFailed++;
+            }
         }
     }
 
@@ -34,12 +34,15 @@ class MobiDoc {
     explicit MobiDoc(const char* filePath);
 
     bool ParseHeader();
-    bool LoadDocRecordIntoBuffer(size_t recNo, str::Str& strOut);
+    bool LoadDocRecordIntoBuffer(size_t recNo, str::Str& strOut, HuffDicDecompressor* huffDic);
+    size_t LoadDocRecordsParallel(int nThreads);
     void LoadImages();
     bool LoadImage(size_t imageNo);
     bool LoadForPdbReader(PdbReader* pdbReader);
     bool DecodeExthHeader(const u8* data, size_t dataLen);
 
+    friend struct MobiRecordsWorker;
+
   public:
     str::Str* doc = nullptr;
 
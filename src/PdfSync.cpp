@@ -14,53 +14,6 @@
 
 #include "utils/Log.h"
 
-// size of the mark highlighting the location calculated by forward-search
-#define MARK_SIZE 10
-// maximum error in the source file line number when doing forward-search
-#define EPSILON_LINE 5
-// Minimal error distance^2 between a point clicked by the user and a PDF mark
-#define PDFSYNC_EPSILON_SQUARE 800
-// Minimal vertical distance
-#define PDFSYNC_EPSILON_Y 20
-
-struct PdfsyncFileIndex {
-    size_t start, end; // first and one-after-last index of lines associated with a file
-};
-
-struct PdfsyncLine {
-    UINT record = 0; // index for mapping line(s) to point(s)
-    size_t file = 0; // index into srcfiles
-    UINT line = 0;
-    UINT column = 0;
-};
-
-struct PdfsyncPoint {
-    UINT record; // index for mapping point(s) to line(s)
-    UINT page, x, y;
-};
-
-// Synchronizer based on .pdfsync file generated with the pdfsync tex package
-class Pdfsync : public Synchronizer {
-  public:
-    Pdfsync(const char* syncfilename, EngineBase* engine) : Synchronizer(syncfilename), engine(engine) {
-        CrashIf(!str::EndsWithI(syncfilename, ".pdfsync"));
-    }
-
-    int DocToSource(int pageNo, Point pt, AutoFreeStr& filename, int* line, int* col) override;
-    int SourceToDoc(const char* srcfilename, int line, int col, int* page, Vec<Rect>& rects) override;
-
-  private:
-    int RebuildIndexIfNeeded();
-    UINT SourceToRecord(const char* srcfilename, int line, int col, Vec<size_t>& records);
-
-    EngineBase* engine;              // needed for converting between coordinate systems
-    StrVec srcfiles;                 // source file names
-    Vec<PdfsyncLine> lines;          // record-to-line mapping
-    Vec<PdfsyncPoint> points;        // record-to-point mapping
-    Vec<PdfsyncFileIndex> fileIndex; // start and end of entries for a file in <lines>
-    Vec<size_t> sheetIndex;          // start of entries for a sheet in <points>
-};
-
 // Synchronizer based on .synctex file generated with SyncTex
 class SyncTex : public Synchronizer {
   public:
@@ -84,10 +37,20 @@ class SyncTex : public Synchronizer {
     synctex_scanner_t scanner;
 };
 
+// a SyncTeX file might only exist in its compressed form (.synctex.gz)
+// in which case we track changes to that file instead
+static int StatSyncFile(const char* path, struct _stat* st) {
+    WCHAR* ws = ToWstrTemp(path);
+    if (_wstat(ws, st) == 0) {
+        return 0;
+    }
+    ws = ToWstrTemp(str::JoinTemp(path, ".gz"));
+    return _wstat(ws, st);
+}
+
 Synchronizer::Synchronizer(const char* syncFilePathIn) {
     syncFilePath = str::Dup(syncFilePathIn);
-    WCHAR* path = ToWstrTemp(syncFilePathIn);
-    _wstat(path, &syncfileTimestamp);
+    StatSyncFile(syncFilePath, &syncfileTimestamp);
 }
 
 bool Synchronizer::NeedsToRebuildIndex() const {
@@ -98,8 +61,7 @@ bool Synchronizer::NeedsToRebuildIndex() const {
 
     // has the synchronization file been changed on disk?
     struct _stat newstamp;
-    WCHAR* path = ToWstrTemp(syncFilePath);
-    if (_wstat(path, &newstamp) == 0 && difftime(newstamp.st_mtime, syncfileTimestamp.st_mtime) > 0) {
+    if (StatSyncFile(syncFilePath, &newstamp) == 0 && difftime(newstamp.st_mtime, syncfileTimestamp.st_mtime) != 0) {
         // update time stamp
         memcpy((void*)&syncfileTimestamp, &newstamp, sizeof(syncfileTimestamp));
         return true; // the file has changed!
@@ -110,8 +72,7 @@ bool Synchronizer::NeedsToRebuildIndex() const {
 
 int Synchronizer::MarkIndexWasRebuilt() {
     needsToRebuildIndex = false;
-    WCHAR* path = ToWstrTemp(syncFilePath);
-    _wstat(path, &syncfileTimestamp);
+    StatSyncFile(syncFilePath, &syncfileTimestamp);
     return PDFSYNCERR_SUCCESS;
 }
 
@@ -157,6 +118,14 @@ int Synchronizer::Create(const char* path, EngineBase* engine, Synchronizer** sy
 
 // PDFSYNC synchronizer
 
+int Pdfsync::PageCount() {
+    return engine->PageCount();
+}
+
+RectF Pdfsync::PageMediabox(int pageNo) {
+    return engine->PageMediabox(pageNo);
+}
+
 // move to the next line in a list of zero-terminated lines
 static char* Advance0Line(char* line, char* end) {
     line += str::Len(line);
@@ -218,7 +187,7 @@ int Pdfsync::RebuildIndexIfNeeded() {
     PdfsyncPoint pspoint;
 
     // parse data
-    int maxPageNo = engine->PageCount();
+    int maxPageNo = PageCount();
     while (true) {
         line = Advance0Line(line, dataEnd);
         if (!line) {
@@ -298,16 +267,67 @@ int Pdfsync::RebuildIndexIfNeeded() {
     fileIndex.at(0).end = lines.size();
     ReportIf(filestack.size() != 1);
 
+    BuildLookupIndexes();
     return MarkIndexWasRebuilt();
 }
 
-// convert a coordinate from the sync file into a PDF coordinate
-#define SYNC_TO_PDF_COORDINATE(c) (c / 65781.76)
-
 static int cmpLineRecords(const void* a, const void* b) {
     return ((PdfsyncLine*)a)->record - ((PdfsyncLine*)b)->record;
 }
 
+// only points closer than this vertically can match in DocToSource()
+static const int kPdfsyncMaxDy = std::max((int)sqrt(PDFSYNC_EPSILON_SQUARE), PDFSYNC_EPSILON_Y);
+
+void Pdfsync::BuildLookupIndexes() {
+    pagePoints.Reset();
+    pagePointsStart.Reset();
+    pointsByRecord.Reset();
+    linesByFile.Reset();
+
+    // for every page the run of points starting at sheetIndex[pageNo],
+    // sorted by y so that DocToSource() only looks at a narrow band
+    pagePointsStart.Append(0); // there's no page 0
+    for (size_t pageNo = 1; pageNo < sheetIndex.size(); pageNo++) {
+        size_t start = pagePoints.size();
+        pagePointsStart.Append(start);
+        for (size_t i = sheetIndex.at(pageNo); i < points.size() && points.at(i).page == (UINT)pageNo; i++) {
+            PdfsyncPoint& p = points.at(i);
+            PdfsyncPagePoint pp;
+            pp.x = (int)SYNC_TO_PDF_COORDINATE(p.x);
+            pp.y = (int)SYNC_TO_PDF_COORDINATE(p.y);
+            pp.record = p.record;
+            pp.idx = i;
+            pagePoints.Append(pp);
+        }
+        std::sort(pagePoints.begin() + start, pagePoints.end(),
+                  [](const PdfsyncPagePoint& p1, const PdfsyncPagePoint& p2) {
+                      return p1.y != p2.y ? p1.y < p2.y : p1.idx < p2.idx;
+                  });
+    }
+    pagePointsStart.Append(pagePoints.size());
+
+    for (size_t i = 0; i < points.size(); i++) {
+        pointsByRecord.Append(i);
+    }
+    std::sort(pointsByRecord.begin(), pointsByRecord.end(), [this](size_t i1, size_t i2) {
+        UINT r1 = points.at(i1).record;
+        UINT r2 = points.at(i2).record;
+        return r1 != r2 ? r1 < r2 : i1 < i2;
+    });
+
+    for (size_t i = 0; i < lines.size(); i++) {
+        linesByFile.Append(i);
+    }
+    std::sort(linesByFile.begin(), linesByFile.end(), [this](size_t i1, size_t i2) {
+        PdfsyncLine& l1 = lines.at(i1);
+        PdfsyncLine& l2 = lines.at(i2);
+        if (l1.file != l2.file) {
+            return l1.file < l2.file;
+        }
+        return l1.line != l2.line ? l1.line < l2.line : i1 < i2;
+    });
+}
+
 int Pdfsync::DocToSource(int pageNo, Point pt, AutoFreeStr& filename, int* line, int* col) {
     int res = RebuildIndexIfNeeded();
     if (res != PDFSYNCERR_SUCCESS) {
@@ -315,13 +335,13 @@ int Pdfsync::DocToSource(int pageNo, Point pt, AutoFreeStr& filename, int* line,
     }
 
     // find the entry in the index corresponding to this page
-    int nPages = engine->PageCount();
+    int nPages = PageCount();
     if (pageNo == 0 || pageNo >= sheetIndex.isize() || pageNo > nPages) {
         return PDFSYNCERR_INVALID_PAGE_NUMBER;
     }
 
     // PdfSync coordinates are y-inversed
-    Rect mbox = engine->PageMediabox(pageNo).Round();
+    Rect mbox = PageMediabox(pageNo).Round();
     pt.y = mbox.dy - pt.y;
 
     // distance to the closest pdf location (in the range <PDFSYNC_EPSILON_SQUARE)
@@ -333,19 +353,31 @@ int Pdfsync::DocToSource(int pageNo, Point pt, AutoFreeStr& filename, int* line,
     UINT closest_ydist = UINT_MAX;        // vertical distance between the hit point and the vertically-closest record
     UINT closest_xdist = UINT_MAX;        // horizontal distance between the hit point and the vertically-closest record
     UINT closest_ydist_record = UINT_MAX; // vertically-closest record
-
-    // read all the sections of 'p' declarations for this pdf sheet
-    for (size_t i = sheetIndex.at((size_t)pageNo); i < points.size() && points.at(i).page == (uint)pageNo; i++) {
+    size_t selected_idx = 0;
+    size_t closest_ydist_idx = 0;
+
+    // only look at the points of this pdf sheet that are vertically close enough
+    PdfsyncPagePoint* pagePointsData = pagePoints.LendData();
+    PdfsyncPagePoint* end = pagePointsData + pagePointsStart.at((size_t)pageNo + 1);
+    PdfsyncPagePoint* first = std::lower_bound(pagePointsData + pagePointsStart.at((size_t)pageNo), end,
+                                               pt.y - kPdfsyncMaxDy,
+                                               [](const PdfsyncPagePoint& p, int y) { return p.y < y; });
+    for (PdfsyncPagePoint* p = first; p < end && p->y <= pt.y + kPdfsyncMaxDy; p++) {
         // check whether it is closer than the closest point found so far
-        UINT dx = abs(pt.x - (int)SYNC_TO_PDF_COORDINATE(points.at(i).x));
-        UINT dy = abs(pt.y - (int)SYNC_TO_PDF_COORDINATE(points.at(i).y));
+        // (ties go to the point declared first in the sync file)
+        UINT dx = abs(pt.x - p->x);
+        UINT dy = abs(pt.y - p->y);
         UINT dist = dx * dx + dy * dy;
-        if (dist < PDFSYNC_EPSILON_SQUARE && dist < closest_xydist) {
-            selected_record = points.at(i).record;
+        if (dist < PDFSYNC_EPSILON_SQUARE &&
+            (dist < closest_xydist || (dist == closest_xydist && p->idx < selected_idx))) {
+            selected_record = p->record;
+            selected_idx = p->idx;
             closest_xydist = dist;
-        } else if ((closest_xydist == UINT_MAX) && dy < PDFSYNC_EPSILON_Y &&
-                   (dy < closest_ydist || (dy == closest_ydist && dx < closest_xdist))) {
-            closest_ydist_record = points.at(i).record;
+        } else if (dy < PDFSYNC_EPSILON_Y &&
+                   (dy < closest_ydist || (dy == closest_ydist && dx < closest_xdist) ||
+                    (dy == closest_ydist && dx == closest_xdist && p->idx < closest_ydist_idx))) {
+            closest_ydist_record = p->record;
+            closest_ydist_idx = p->idx;
             closest_ydist = dy;
             closest_xdist = dx;
         }
@@ -421,24 +453,26 @@ UINT Pdfsync::SourceToRecord(const char* srcfilename, int line, int, Vec<size_t>
         return PDFSYNCERR_NORECORD_IN_SOURCEFILE; // there is not any record declaration for that particular source file
     }
 
-    // look for sections belonging to the specified file
-    // starting with the first section that is declared within the scope of the file.
+    // look for sections belonging to the specified file within EPSILON_LINE
+    // of the requested line. for equally close sections, the one declared first wins
     UINT min_distance = EPSILON_LINE; // distance to the closest record
     size_t lineIx = (size_t)-1;       // closest record-line index
 
-    for (size_t isec = fileIndex.at(isrc).start; isec < fileIndex.at(isrc).end; isec++) {
-        // does this section belong to the desired file?
-        if (lines.at(isec).file != isrc) {
-            continue;
-        }
-
+    int minLine = line - EPSILON_LINE + 1;
+    size_t* end = linesByFile.end();
+    size_t* first = std::lower_bound(linesByFile.begin(), end, minLine, [this, isrc](size_t i, int n) {
+        PdfsyncLine& l = lines.at(i);
+        return l.file != isrc ? l.file < isrc : (int)l.line < n;
+    });
+    for (size_t* it = first; it < end && lines.at(*it).file == isrc; it++) {
+        size_t isec = *it;
         UINT d = abs((int)lines.at(isec).line - (int)line);
-        if (d < min_distance) {
+        if (d >= EPSILON_LINE) {
+            break;
+        }
+        if (d < min_distance || (d == min_distance && isec < lineIx)) {
             min_distance = d;
             lineIx = isec;
-            if (0 == d) {
-                break; // We have found a record for the requested line!
-            }
         }
     }
     if (lineIx == (size_t)-1) {
@@ -469,18 +503,30 @@ int Pdfsync::SourceToDoc(const char* srcfilename, int line, int col, int* page,
 
     // records have been found for the desired source position:
     // we now find the page and positions in the PDF corresponding to these found records
-    int firstPage = UINT_MAX;
-    for (PdfsyncPoint& p : points) {
-        if (!found_records.Contains(p.record)) {
-            continue;
+    // (in the order in which the points were declared)
+    Vec<size_t> found_points;
+    for (size_t record : found_records) {
+        size_t* end = pointsByRecord.end();
+        size_t* it = std::lower_bound(pointsByRecord.begin(), end, record,
+                                      [this](size_t i, size_t r) { return points.at(i).record < r; });
+        for (; it < end && points.at(*it).record == record; it++) {
+            if (!found_points.Contains(*it)) {
+                found_points.Append(*it);
+            }
         }
+    }
+    std::sort(found_points.begin(), found_points.end());
+
+    int firstPage = UINT_MAX;
+    for (size_t i : found_points) {
+        PdfsyncPoint& p = points.at(i);
         if (firstPage != UINT_MAX && firstPage != (int)p.page) {
             continue;
         }
         firstPage = *page = (int)p.page;
         RectF rc(SYNC_TO_PDF_COORDINATE(p.x), SYNC_TO_PDF_COORDINATE(p.y), MARK_SIZE, MARK_SIZE);
         // PdfSync coordinates are y-inversed
-        RectF mbox = engine->PageMediabox(firstPage);
+        RectF mbox = PageMediabox(firstPage);
         rc.y = mbox.dy - (rc.y + rc.dy);
         rects.Append(rc.Round());
     }
@@ -55,3 +55,73 @@ class Synchronizer {
   public:
     static int Create(const char* pdffilename, EngineBase* engine, Synchronizer** sync);
 };
+
+// convert a coordinate from the sync file into a PDF coordinate
+#define SYNC_TO_PDF_COORDINATE(c) (c / 65781.76)
+
+// size of the mark highlighting the location calculated by forward-search
+#define MARK_SIZE 10
+// maximum error in the source file line number when doing forward-search
+#define EPSILON_LINE 5
+// Minimal error distance^2 between a point clicked by the user and a PDF mark
+#define PDFSYNC_EPSILON_SQUARE 800
+// Minimal vertical distance
+#define PDFSYNC_EPSILON_Y 20
+
+struct PdfsyncFileIndex {
+    size_t start, end; // first and one-after-last index of lines associated with a file
+};
+
+struct PdfsyncLine {
+    UINT record = 0; // index for mapping line(s) to point(s)
+    size_t file = 0; // index into srcfiles
+    UINT line = 0;
+    UINT column = 0;
+};
+
+struct PdfsyncPoint {
+    UINT record; // index for mapping point(s) to line(s)
+    UINT page, x, y;
+};
+
+// a point in PDF coordinates, for looking up the points of a page by y
+struct PdfsyncPagePoint {
+    int x = 0;
+    int y = 0;
+    UINT record = 0;
+    size_t idx = 0; // index into points, ties go to the point declared first
+};
+
+// Synchronizer based on .pdfsync file generated with the pdfsync tex package
+// (declared here so that it can be tested without an engine)
+class Pdfsync : public Synchronizer {
+  public:
+    Pdfsync(const char* syncfilename, EngineBase* engine) : Synchronizer(syncfilename), engine(engine) {
+        CrashIf(!str::EndsWithI(syncfilename, ".pdfsync"));
+    }
+
+    int DocToSource(int pageNo, Point pt, AutoFreeStr& filename, int* line, int* col) override;
+    int SourceToDoc(const char* srcfilename, int line, int col, int* page, Vec<Rect>& rects) override;
+
+  protected:
+    // the engine is only needed for these (tests override them)
+    virtual int PageCount();
+    virtual RectF PageMediabox(int pageNo);
+
+    int RebuildIndexIfNeeded();
+    void BuildLookupIndexes();
+    UINT SourceToRecord(const char* srcfilename, int line, int col, Vec<size_t>& records);
+
+    EngineBase* engine;              // needed for converting between coordinate systems
+    StrVec srcfiles;                 // source file names
+    Vec<PdfsyncLine> lines;          // record-to-line mapping
+    Vec<PdfsyncPoint> points;        // record-to-point mapping
+    Vec<PdfsyncFileIndex> fileIndex; // start and end of entries for a file in <lines>
+    Vec<size_t> sheetIndex;          // start of entries for a sheet in <points>
+
+    // built by BuildLookupIndexes() so that lookups don't have to scan all points and lines
+    Vec<PdfsyncPagePoint> pagePoints; // points of every page, sorted by y
+    Vec<size_t> pagePointsStart;      // start of entries for a page in <pagePoints>
+    Vec<size_t> pointsByRecord;       // indices into <points>, sorted by record
+    Vec<size_t> linesByFile;          // indices into <lines>, sorted by file and line
+};
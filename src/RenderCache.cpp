@@ -5,6 +5,7 @@
 #include "utils/ScopedWin.h"
 #include "utils/WinUtil.h"
 #include "utils/Timer.h"
+#include "utils/Trace.h"
 
 #include "wingui/UIModels.h"
 
@@ -58,6 +59,12 @@ RenderCache::~RenderCache() {
         ReportIf(true);
     }
 
+    logf("RenderCache::~RenderCache: bitmap hits: %d, compressed hits: %d, misses: %d\n", stats.bitmapHits,
+         stats.compressedHits, stats.misses);
+    logf("RenderCache::~RenderCache: %d of %d pages were in the cache when scrolled into view\n",
+         stats.pagesShownCached, stats.pagesShown);
+    FreeCompressed();
+
     LeaveCriticalSection(&cacheAccess);
     DeleteCriticalSection(&cacheAccess);
     LeaveCriticalSection(&requestAccess);
@@ -86,11 +93,23 @@ bool RenderCache::Exists(DisplayModel* dm, int pageNo, int rotation, float zoom,
     BitmapCacheEntry* entry = Find(dm, pageNo, rotation, zoom, tile);
     if (entry) {
         DropCacheEntry(entry);
+        return true;
     }
-    return entry != nullptr;
+
+    // a compressed bitmap is restored when the tile is painted
+    ScopedCritSec scope(&cacheAccess);
+    rotation = NormalizeRotation(rotation);
+    for (auto e : compressed) {
+        if ((dm == e->dm) && (pageNo == e->pageNo) && (rotation == e->rotation) &&
+            (kInvalidZoom == zoom || zoom == e->zoom) && (!tile || e->tile == *tile)) {
+            return true;
+        }
+    }
+    return false;
 }
 
-bool RenderCache::DropCacheEntry(BitmapCacheEntry* entry) {
+// if keepCompressed is true, the bitmap of an evicted entry is moved to the second cache tier
+bool RenderCache::DropCacheEntry(BitmapCacheEntry* entry, bool keepCompressed) {
     ScopedCritSec scope(&cacheAccess);
     CrashIf(!entry);
     if (!entry) {
@@ -112,6 +131,9 @@ bool RenderCache::DropCacheEntry(BitmapCacheEntry* entry) {
     logf("RenderCache::DropCacheEntry: pageNo: %d, rotation: %d, zoom: %.2f\n", entry->pageNo, entry->rotation,
          entry->zoom);
 
+    if (keepCompressed) {
+        CompressCacheEntry(entry);
+    }
     delete entry;
 
     // fast removal by replacing freed item with the item at the end
@@ -127,18 +149,17 @@ bool RenderCache::DropCacheEntry(BitmapCacheEntry* entry) {
     return true;
 }
 
-static bool FreeIfFull(RenderCache* rc, const PageRenderRequest& req) {
+static bool FreeIfFull(RenderCache* rc, DisplayModel* dm) {
     int n = rc->cacheCount;
     if (n < MAX_BITMAPS_CACHED) {
         return true;
     }
 
-    DisplayModel* dm = req.dm;
     // free an invisible page of the same DisplayModel ...
     for (int i = 0; i < n; i++) {
         auto entry = rc->cache[i];
         if (entry->dm == dm && !dm->PageVisibleNearby(entry->pageNo)) {
-            bool didDrop = rc->DropCacheEntry(entry);
+            bool didDrop = rc->DropCacheEntry(entry, true);
             if (didDrop) {
                 return true;
             }
@@ -155,7 +176,7 @@ static bool FreeIfFull(RenderCache* rc, const PageRenderRequest& req) {
             // in a different window, but it's harder to detect
             continue;
         }
-        bool didDrop = rc->DropCacheEntry(entry);
+        bool didDrop = rc->DropCacheEntry(entry, true);
         if (didDrop) {
             return true;
         }
@@ -163,6 +184,176 @@ static bool FreeIfFull(RenderCache* rc, const PageRenderRequest& req) {
     return false;
 }
 
+// only 8-bit and 32-bit DIB sections (as created by EngineMupdf::RenderPage) are compressed
+static bool CompressBitmap(RenderedBitmap* bmp, CompressedBitmapCacheEntry* res) {
+    HBITMAP hbmp = bmp ? bmp->GetBitmap() : nullptr;
+    if (!hbmp) {
+        return false;
+    }
+    DIBSECTION info{};
+    int ret = GetObject(hbmp, sizeof(info), &info);
+    if (ret != sizeof(info) || !info.dsBm.bmBits || info.dsBmih.biCompression != BI_RGB) {
+        return false;
+    }
+    int bpp = info.dsBm.bmBitsPixel;
+    if (bpp != 8 && bpp != 32) {
+        return false;
+    }
+
+    res->bmi = (BITMAPINFO*)calloc(1, sizeof(BITMAPINFO) + 255 * sizeof(RGBQUAD));
+    if (!res->bmi) {
+        return false;
+    }
+    res->bmi->bmiHeader = info.dsBmih;
+    if (bpp == 8) {
+        HDC hdc = CreateCompatibleDC(nullptr);
+        HGDIOBJ prev = SelectObject(hdc, hbmp);
+        uint nColors = GetDIBColorTable(hdc, 0, 256, res->bmi->bmiColors);
+        SelectObject(hdc, prev);
+        DeleteDC(hdc);
+        res->bmi->bmiHeader.biClrUsed = nColors;
+    }
+
+    res->rawSize = (size_t)info.dsBm.bmWidthBytes * info.dsBm.bmHeight;
+    // not worth keeping bitmaps that don't compress well (i.e. photos)
+    size_t maxSize = res->rawSize / 2;
+    u8* d = (u8*)malloc(maxSize);
+    if (!d) {
+        return false;
+    }
+    size_t size;
+    if (bpp == 8) {
+        size = RleEncode((const u8*)info.dsBm.bmBits, res->rawSize, d, maxSize);
+    } else {
+        size = RleEncode((const u32*)info.dsBm.bmBits, res->rawSize / 4, d, maxSize);
+    }
+    if (size == 0) {
+        free(d);
+        return false;
+    }
+    res->data.Set((u8*)realloc(d, size), size);
+    return true;
+}
+
+static RenderedBitmap* DecompressBitmap(CompressedBitmapCacheEntry* e) {
+    BITMAPINFOHEADER* bmih = &e->bmi->bmiHeader;
+    // GetObject() always reports a positive biHeight, but the pixels were
+    // compressed in the memory order of a top-down DIB section
+    bmih->biHeight = -abs(bmih->biHeight);
+    HANDLE hMap = CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, (DWORD)e->rawSize, nullptr);
+    void* data = nullptr;
+    HBITMAP hbmp = CreateDIBSection(nullptr, e->bmi, DIB_RGB_COLORS, &data, hMap, 0);
+    bool ok = false;
+    if (hbmp && data) {
+        if (bmih->biBitCount == 8) {
+            ok = RleDecode(e->data.data(), e->data.size(), (u8*)data, e->rawSize);
+        } else {
+            ok = RleDecode(e->data.data(), e->data.size(), (u32*)data, e->rawSize / 4);
+        }
+    }
+    if (!ok) {
+        if (hbmp) {
+            DeleteObject(hbmp);
+        }
+        if (hMap) {
+            CloseHandle(hMap);
+        }
+        return nullptr;
+    }
+    return new RenderedBitmap(hbmp, Size(bmih->biWidth, abs(bmih->biHeight)), hMap);
+}
+
+// moves the bitmap of an entry that is being evicted to the second tier
+void RenderCache::CompressCacheEntry(BitmapCacheEntry* entry) {
+    ScopedCritSec scope(&cacheAccess);
+    if (entry->outOfDate || entry->zoom == kInvalidZoom || !entry->damaged.IsEmpty()) {
+        return;
+    }
+    auto e = new CompressedBitmapCacheEntry();
+    if (!CompressBitmap(entry->bitmap, e)) {
+        delete e;
+        return;
+    }
+    e->dm = entry->dm;
+    e->pageNo = entry->pageNo;
+    e->rotation = entry->rotation;
+    e->zoom = entry->zoom;
+    e->tile = entry->tile;
+    compressed.Append(e);
+    compressedSize += e->data.size();
+
+    // evict the least recently evicted bitmaps if over budget
+    while (compressedSize > MAX_COMPRESSED_CACHE_SIZE && compressed.size() > 0) {
+        CompressedBitmapCacheEntry* oldest = compressed.PopAt(0);
+        compressedSize -= oldest->data.size();
+        delete oldest;
+    }
+}
+
+// restores a compressed bitmap into the first tier (and removes it from the second)
+// call DropCacheEntry when you no longer need the returned entry
+BitmapCacheEntry* RenderCache::FindCompressed(DisplayModel* dm, int pageNo, int rotation, float zoom,
+                                              TilePosition* tile) {
+    ScopedCritSec scope(&cacheAccess);
+    rotation = NormalizeRotation(rotation);
+    int n = compressed.isize();
+    for (int i = 0; i < n; i++) {
+        CompressedBitmapCacheEntry* e = compressed[i];
+        if ((dm != e->dm) || (pageNo != e->pageNo) || (rotation != e->rotation) || (zoom != e->zoom) ||
+            (tile && !(e->tile == *tile))) {
+            continue;
+        }
+        compressed.RemoveAt(i);
+        compressedSize -= e->data.size();
+        RenderedBitmap* bmp = DecompressBitmap(e);
+        TilePosition entryTile = e->tile;
+        delete e;
+        if (!bmp || !FreeIfFull(this, dm)) {
+            delete bmp;
+            return nullptr;
+        }
+        auto entry = new BitmapCacheEntry(dm, pageNo, rotation, zoom, entryTile, bmp);
+        entry->cacheIdx = cacheCount;
+        cache[cacheCount] = entry;
+        cacheCount++;
+        entry->refs++;
+        return entry;
+    }
+    return nullptr;
+}
+
+// drops compressed bitmaps of a specific page (or tile), of all pages
+// of the given DisplayModel or all of them
+void RenderCache::FreeCompressed(DisplayModel* dm, int pageNo, TilePosition* tile) {
+    ScopedCritSec scope(&cacheAccess);
+    for (int i = compressed.isize() - 1; i >= 0; i--) {
+        CompressedBitmapCacheEntry* e = compressed[i];
+        bool shouldFree = !dm || (e->dm == dm);
+        if (pageNo != kInvalidPageNo) {
+            shouldFree = shouldFree && (e->pageNo == pageNo);
+        }
+        if (tile) {
+            shouldFree = shouldFree && (e->tile == *tile);
+        }
+        if (shouldFree) {
+            compressed.RemoveAt(i);
+            compressedSize -= e->data.size();
+            delete e;
+        }
+    }
+}
+
+void RenderCache::GetStats(RenderCacheStats& statsOut) {
+    ScopedCritSec scope(&cacheAccess);
+    statsOut = stats;
+    statsOut.compressedCount = compressed.isize();
+    statsOut.compressedSize = compressedSize;
+    statsOut.compressedRawSize = 0;
+    for (auto e : compressed) {
+        statsOut.compressedRawSize += e->rawSize;
+    }
+}
+
 void RenderCache::Add(PageRenderRequest& req, RenderedBitmap* bmp) {
     ScopedCritSec scope(&cacheAccess);
     CrashIf(!req.dm);
@@ -172,8 +363,9 @@ void RenderCache::Add(PageRenderRequest& req, RenderedBitmap* bmp) {
 
     /* It's possible there still is a cached bitmap with different zoom/rotation */
     FreePage(req.dm, req.pageNo, &req.tile);
+    FreeCompressed(req.dm, req.pageNo, &req.tile);
 
-    bool hasSpace = FreeIfFull(this, req);
+    bool hasSpace = FreeIfFull(this, req.dm);
     CrashIf(!hasSpace); // TODO: FreeIfFull() might actually fail to free
     CrashIf(cacheCount > MAX_BITMAPS_CACHED);
 
@@ -227,7 +419,7 @@ static bool IsTileVisible(DisplayModel* dm, int pageNo, TilePosition tile, float
     }
     int rotation = dm->GetRotation();
     float zoom = dm->GetZoomReal(pageNo);
-    Rect r = pageInfo->pageOnScreen;
+    Rect r = dm->GetPageOnScreen(pageNo);
     Rect tileOnScreen = GetTileOnScreen(engine, pageNo, rotation, zoom, tile, r);
     // consider nearby tiles visible depending on the fuzz factor
     tileOnScreen.x -= (int)(tileOnScreen.dx * fuzz * 0.5);
@@ -270,13 +462,52 @@ void RenderCache::FreePage(DisplayModel* dm, int pageNo, TilePosition* tile) {
             }
         }
         if (shouldFree) {
-            DropCacheEntry(entry);
+            // keep invisible pages in the second tier in case the user scrolls back
+            DropCacheEntry(entry, !dm);
         }
     }
 }
 
 void RenderCache::FreeForDisplayModel(DisplayModel* dm) {
     FreePage(dm);
+    FreeCompressed(dm);
+
+    ScopedCritSec scope(&cacheAccess);
+    for (auto& rt : renderTimes) {
+        if (rt.dm == dm) {
+            rt = {};
+        }
+    }
+}
+
+// pages rendering slower than this get a low resolution preview first
+constexpr float kSlowRenderMs = 150.f;
+// zoom of previews relative to the zoom of the tile
+constexpr float kPreviewZoomFactor = 0.25f;
+
+void RenderCache::AddRenderTime(DisplayModel* dm, int pageNo, float ms) {
+    ScopedCritSec scope(&cacheAccess);
+    renderTimes[nextRenderTime] = {dm, pageNo, ms};
+    nextRenderTime = (nextRenderTime + 1) % MAX_RENDER_TIMES;
+}
+
+// true if this page was slow to render the last time or, if it hasn't
+// been rendered yet, if another page of the document was
+bool RenderCache::ShouldRenderPreview(DisplayModel* dm, int pageNo) {
+    ScopedCritSec scope(&cacheAccess);
+    bool docIsSlow = false;
+    // go from the most recent time
+    for (int i = 1; i <= MAX_RENDER_TIMES; i++) {
+        auto& rt = renderTimes[(nextRenderTime - i + MAX_RENDER_TIMES) % MAX_RENDER_TIMES];
+        if (rt.dm != dm) {
+            continue;
+        }
+        if (rt.pageNo == pageNo) {
+            return rt.ms > kSlowRenderMs;
+        }
+        docIsSlow = docIsSlow || rt.ms > kSlowRenderMs;
+    }
+    return docIsSlow;
 }
 
 void RenderCache::FreeNotVisible() {
@@ -287,6 +518,7 @@ void RenderCache::FreeNotVisible() {
 // mark invisible pages as out-of-date to prevent inconsistencies
 void RenderCache::KeepForDisplayModel(DisplayModel* oldDm, DisplayModel* newDm) {
     ScopedCritSec scope(&cacheAccess);
+    FreeCompressed(oldDm);
     for (int i = 0; i < cacheCount; i++) {
         BitmapCacheEntry* entry = cache[i];
         if (entry->dm != oldDm) {
@@ -301,7 +533,67 @@ void RenderCache::KeepForDisplayModel(DisplayModel* oldDm, DisplayModel* newDm)
     }
 }
 
-// marks all tiles containing rect of pageNo as out of date
+// returns the bits of a 32-bit DIB section, which is what RepairTile can update in place
+static bool GetDibSection32(RenderedBitmap* bmp, DIBSECTION& info) {
+    HBITMAP hbmp = bmp ? bmp->GetBitmap() : nullptr;
+    if (!hbmp) {
+        return false;
+    }
+    int ret = GetObject(hbmp, sizeof(info), &info);
+    return ret == sizeof(info) && info.dsBm.bmBits && info.dsBmih.biCompression == BI_RGB &&
+           info.dsBm.bmBitsPixel == 32;
+}
+
+// copies src into the 32-bit DIB section dst at (x, y), clipped to dst
+static bool CopyIntoBitmap(RenderedBitmap* src, RenderedBitmap* dst, int x, int y) {
+    DIBSECTION info{};
+    if (!src->GetBitmap() || !GetDibSection32(dst, info)) {
+        return false;
+    }
+    Size size = src->Size();
+    int dx = std::min(size.dx, info.dsBm.bmWidth - x);
+    int dy = std::min(size.dy, info.dsBm.bmHeight - y);
+    if (x < 0 || y < 0 || dx <= 0 || dy <= 0) {
+        return false;
+    }
+
+    // whatever format src has been rendered in, get it as top-down 32-bit rows
+    BITMAPINFO bmi{};
+    bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
+    bmi.bmiHeader.biWidth = size.dx;
+    bmi.bmiHeader.biHeight = -size.dy;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    u32* pixels = (u32*)malloc((size_t)size.dx * size.dy * sizeof(u32));
+    if (!pixels) {
+        return false;
+    }
+    HDC hdc = GetDC(nullptr);
+    int nLines = GetDIBits(hdc, src->GetBitmap(), 0, size.dy, pixels, &bmi, DIB_RGB_COLORS);
+    ReleaseDC(nullptr, hdc);
+    if (nLines != size.dy) {
+        free(pixels);
+        return false;
+    }
+
+    GdiFlush();
+    u8* bits = (u8*)info.dsBm.bmBits;
+    bool isBottomUp = info.dsBmih.biHeight > 0;
+    for (int row = 0; row < dy; row++) {
+        int dstRow = isBottomUp ? info.dsBm.bmHeight - 1 - (y + row) : y + row;
+        u32* d = (u32*)(bits + (size_t)dstRow * info.dsBm.bmWidthBytes) + x;
+        memcpy(d, pixels + (size_t)row * size.dx, dx * sizeof(u32));
+    }
+    free(pixels);
+    return true;
+}
+
+// rect (in page coordinates) of pageNo has changed (e.g. an annotation has been moved):
+// instead of re-rendering all the tiles it touches, only rect is re-rendered
+// and copied into the cached bitmaps (see RepairTile). Tiles that can't be
+// repaired (e.g. rendered at a different zoom or as 8-bit palette images)
+// are marked as out of date
 void RenderCache::Invalidate(DisplayModel* dm, int pageNo, RectF rect) {
     ScopedCritSec scopeReq(&requestAccess);
 
@@ -310,15 +602,95 @@ void RenderCache::Invalidate(DisplayModel* dm, int pageNo, RectF rect) {
         AbortCurrentRequest();
     }
 
-    ScopedCritSec scopeCache(&cacheAccess);
+    int rotation = NormalizeRotation(dm->GetRotation());
+    float zoom = dm->GetZoomReal(pageNo);
+    Vec<TilePosition> damagedTiles;
+    {
+        ScopedCritSec scopeCache(&cacheAccess);
+        FreeCompressed(dm, pageNo);
+
+        RectF mediabox = dm->GetEngine()->PageMediabox(pageNo);
+        for (int i = 0; i < cacheCount; i++) {
+            auto e = cache[i];
+            if (e->dm != dm || e->pageNo != pageNo || GetTileRect(mediabox, e->tile).Intersect(rect).IsEmpty()) {
+                continue;
+            }
+            DIBSECTION info{};
+            bool canRepair = !e->outOfDate && e->zoom == zoom && e->rotation == rotation &&
+                             GetDibSection32(e->bitmap, info);
+            if (!canRepair) {
+                e->zoom = kInvalidZoom;
+                e->outOfDate = true;
+                continue;
+            }
+            e->damaged = e->damaged.Union(rect);
+            damagedTiles.Append(e->tile);
+        }
+    }
 
-    RectF mediabox = dm->GetEngine()->PageMediabox(pageNo);
-    for (int i = 0; i < cacheCount; i++) {
-        auto e = cache[i];
-        if (e->dm == dm && e->pageNo == pageNo && !GetTileRect(mediabox, e->tile).Intersect(rect).IsEmpty()) {
-            e->zoom = kInvalidZoom;
-            e->outOfDate = true;
+    // requests for damaged tiles that get dropped are queued again by PaintTile
+    for (TilePosition& tile : damagedTiles) {
+        RequestRepair(dm, pageNo, tile);
+    }
+}
+
+void RenderCache::RequestRepair(DisplayModel* dm, int pageNo, TilePosition tile) {
+    int rotation = NormalizeRotation(dm->GetRotation());
+    float zoom = dm->GetZoomReal(pageNo);
+    // Render() doesn't queue it again if the same repair is already queued
+    Render(dm, pageNo, rotation, zoom, &tile, nullptr, nullptr, RenderPriority::Repair);
+}
+
+// called on the rendering thread: renders the damaged part of a cached tile
+// and copies it into the tile's bitmap
+void RenderCache::RepairTile(PageRenderRequest& req) {
+    RectF damaged;
+    BitmapCacheEntry* entry = Find(req.dm, req.pageNo, req.rotation, req.zoom, &req.tile);
+    if (!entry) {
+        return;
+    }
+    {
+        ScopedCritSec scope(&cacheAccess);
+        damaged = entry->damaged;
+        entry->damaged = RectF();
+    }
+    DropCacheEntry(entry);
+    if (damaged.IsEmpty()) {
+        return;
+    }
+
+    EngineBase* engine = req.dm->GetEngine();
+    Rect tileBox = GetTileRectDevice(engine, req.pageNo, req.rotation, req.zoom, req.tile);
+    Rect box = engine->Transform(damaged, req.pageNo, req.zoom, req.rotation).Round();
+    // include the pixels that are only partially covered by the damaged rect
+    box.Inflate(1, 1);
+    box = box.Intersect(tileBox);
+    if (box.IsEmpty()) {
+        return;
+    }
+    RectF area = engine->Transform(ToRectF(box), req.pageNo, req.zoom, req.rotation, true);
+    RenderPageArgs args(req.pageNo, req.zoom, req.rotation, &area, RenderTarget::View, &req.abortCookie);
+    TRACE_SPAN_PAGE("RenderCache::RepairTile", req.pageNo);
+    RenderedBitmap* bmp = engine->RenderPage(args);
+    if (bmp && !req.abort && !engine->IsImageCollection()) {
+        UpdateBitmapColors(bmp->GetBitmap(), textColor, backgroundColor);
+    }
+
+    entry = Find(req.dm, req.pageNo, req.rotation, req.zoom, &req.tile);
+    if (entry) {
+        ScopedCritSec scope(&cacheAccess);
+        if (req.abort) {
+            // the damage is repaired by the request that aborted this one
+            entry->damaged = entry->damaged.Union(damaged);
+        } else if (!bmp || !CopyIntoBitmap(bmp, entry->bitmap, box.x - tileBox.x, box.y - tileBox.y)) {
+            entry->zoom = kInvalidZoom;
+            entry->outOfDate = true;
         }
+        DropCacheEntry(entry);
+    }
+    delete bmp;
+    if (!req.abort) {
+        req.dm->RepaintDisplay();
     }
 }
 
@@ -391,30 +763,76 @@ bool RenderCache::ReduceTileSize() {
     while (requestCount > 0) {
         ClearQueueForDisplayModel(requests[0].dm);
     }
+    FreeCompressed();
     AbortCurrentRequest();
 
     return true;
 }
 
-void RenderCache::RequestRendering(DisplayModel* dm, int pageNo) {
+// Prefetch and Normal requests produce the same bitmap (and differ only in
+// when they're rendered) while Preview and Repair requests produce different ones
+static bool RendersSameBitmap(RenderPriority p1, RenderPriority p2) {
+    auto isView = [](RenderPriority p) { return p == RenderPriority::Prefetch || p == RenderPriority::Normal; };
+    return p1 == p2 || (isView(p1) && isView(p2));
+}
+
+static bool IsSameTileRequest(PageRenderRequest* req, DisplayModel* dm, int pageNo, TilePosition& tile,
+                              RenderPriority priority) {
+    return req->dm == dm && req->pageNo == pageNo && req->tile == tile && !req->renderCb &&
+           RendersSameBitmap(req->priority, priority);
+}
+
+// e.g. a Prefetch request for a page that has become visible
+static void PromoteRequest(PageRenderRequest* req, RenderPriority priority) {
+    if (priority > req->priority) {
+        req->priority = priority;
+    }
+}
+
+void RenderCache::RequestRendering(DisplayModel* dm, int pageNo, RenderPriority priority) {
     TilePosition tile(GetTileRes(dm, pageNo), 0, 0);
     // only honor the request if there's a good chance that the
     // rendered tile will actually be used
     if (tile.res > 1) {
         return;
     }
+    // leave room in the queue for the pages that are visible
+    if (priority == RenderPriority::Prefetch && requestCount >= MAX_PAGE_REQUESTS / 2) {
+        return;
+    }
 
-    RequestRendering(dm, pageNo, tile);
+    RequestRendering(dm, pageNo, tile, true, priority);
     // render both tiles of the first row when splitting a page in four
     // (which always happens on larger displays for Fit Width)
     if (tile.res == 1 && !IsRenderQueueFull()) {
         tile.col = 1;
-        RequestRendering(dm, pageNo, tile, false);
+        RequestRendering(dm, pageNo, tile, false, priority);
+    }
+}
+
+// drops queued (and aborts the current) prefetch requests for dm
+void RenderCache::CancelPrefetch(DisplayModel* dm) {
+    ScopedCritSec scope(&requestAccess);
+    int curPos = 0;
+    for (int i = 0; i < requestCount; i++) {
+        PageRenderRequest* req = &(requests[i]);
+        if (req->dm == dm && req->priority == RenderPriority::Prefetch) {
+            continue;
+        }
+        if (i != curPos) {
+            requests[curPos] = *req;
+        }
+        curPos++;
+    }
+    requestCount = curPos;
+    if (curReq && curReq->dm == dm && curReq->priority == RenderPriority::Prefetch) {
+        AbortCurrentRequest();
     }
 }
 
 /* Render a bitmap for page <pageNo> in <dm>. */
-void RenderCache::RequestRendering(DisplayModel* dm, int pageNo, TilePosition tile, bool clearQueueForPage) {
+void RenderCache::RequestRendering(DisplayModel* dm, int pageNo, TilePosition tile, bool clearQueueForPage,
+                                   RenderPriority priority) {
     logf("RenderCache::RequestRendering(): pageNo %d\n", pageNo);
     ScopedCritSec scope(&requestAccess);
     CrashIf(!dm);
@@ -427,12 +845,18 @@ void RenderCache::RequestRendering(DisplayModel* dm, int pageNo, TilePosition ti
 
     if (curReq && (curReq->pageNo == pageNo) && (curReq->dm == dm) && (curReq->tile == tile)) {
         if ((curReq->zoom == zoom) && (curReq->rotation == rotation)) {
-            /* we're already rendering exactly the same page */
-            return;
+            if (RendersSameBitmap(curReq->priority, priority)) {
+                /* we're already rendering exactly the same page
+                   (promoted so that CancelPrefetch() doesn't abort it) */
+                PromoteRequest(curReq, priority);
+                return;
+            }
+            /* we're rendering the preview for this page (or the other way around) */
+        } else {
+            /* Currently rendered page is for the same page but with different zoom
+            or rotation, so abort it */
+            AbortCurrentRequest();
         }
-        /* Currently rendered page is for the same page but with different zoom
-        or rotation, so abort it */
-        AbortCurrentRequest();
     }
 
     // clear requests for tiles of different resolution and invisible tiles
@@ -442,7 +866,8 @@ void RenderCache::RequestRendering(DisplayModel* dm, int pageNo, TilePosition ti
 
     for (int i = 0; i < requestCount; i++) {
         PageRenderRequest* req = &(requests[i]);
-        if ((req->pageNo == pageNo) && (req->dm == dm) && (req->tile == tile)) {
+        if (IsSameTileRequest(req, dm, pageNo, tile, priority)) {
+            PromoteRequest(req, priority);
             if ((req->zoom == zoom) && (req->rotation == rotation)) {
                 /* Request with exactly the same parameters already queued for
                    rendering. Move it to the top of the queue so that it'll
@@ -467,7 +892,7 @@ void RenderCache::RequestRendering(DisplayModel* dm, int pageNo, TilePosition ti
         return;
     }
 
-    Render(dm, pageNo, rotation, zoom, &tile);
+    Render(dm, pageNo, rotation, zoom, &tile, nullptr, nullptr, priority);
 }
 
 void RenderCache::Render(DisplayModel* dm, int pageNo, int rotation, float zoom, RectF pageRect,
@@ -479,7 +904,7 @@ void RenderCache::Render(DisplayModel* dm, int pageNo, int rotation, float zoom,
 }
 
 bool RenderCache::Render(DisplayModel* dm, int pageNo, int rotation, float zoom, TilePosition* tile, RectF* pageRect,
-                         RenderingCallback* renderCb) {
+                         RenderingCallback* renderCb, RenderPriority priority) {
     logf("RenderCache::Render(): pageNo %d\n", pageNo);
     CrashIf(!dm);
     if (!dm || dm->dontRenderFlag) {
@@ -494,6 +919,31 @@ bool RenderCache::Render(DisplayModel* dm, int pageNo, int rotation, float zoom,
     ScopedCritSec scope(&requestAccess);
     PageRenderRequest* newRequest;
 
+    // don't render the same tile twice: if it's already being rendered or
+    // queued (e.g. as Prefetch), promote that request to the higher priority.
+    // a repair that is already being rendered might have been started before
+    // the tile got damaged again, so those are only matched in the queue
+    if (tile && !renderCb) {
+        auto isSame = [&](PageRenderRequest* req) {
+            return IsSameTileRequest(req, dm, pageNo, *tile, priority) && req->zoom == zoom &&
+                   req->rotation == rotation;
+        };
+        if (curReq && !curReq->abort && priority != RenderPriority::Repair && isSame(curReq)) {
+            PromoteRequest(curReq, priority);
+            return true;
+        }
+        for (int i = 0; i < requestCount; i++) {
+            PageRenderRequest* req = &(requests[i]);
+            if (isSame(req)) {
+                PromoteRequest(req, priority);
+                /* move it to the top of the queue */
+                std::swap(*req, requests[requestCount - 1]);
+                SetEvent(startRendering);
+                return true;
+            }
+        }
+    }
+
     /* add request to the queue */
     if (requestCount == MAX_PAGE_REQUESTS) {
         /* queue is full -> remove the oldest items on the queue */
@@ -526,6 +976,7 @@ bool RenderCache::Render(DisplayModel* dm, int pageNo, int rotation, float zoom,
     newRequest->abortCookie = nullptr;
     newRequest->timestamp = GetTickCount();
     newRequest->renderCb = renderCb;
+    newRequest->priority = priority;
 
     SetEvent(startRendering);
 
@@ -557,8 +1008,15 @@ bool RenderCache::GetNextRequest(PageRenderRequest* req) {
 
     CrashIf(requestCount < 0);
     CrashIf(requestCount > MAX_PAGE_REQUESTS);
+    int idx = requestCount - 1;
+    for (int i = idx - 1; i >= 0; i--) {
+        if (requests[i].priority > requests[idx].priority) {
+            idx = i;
+        }
+    }
+    *req = requests[idx];
     requestCount--;
-    *req = requests[requestCount];
+    memmove(&(requests[idx]), &(requests[idx + 1]), sizeof(PageRenderRequest) * (requestCount - idx));
     curReq = req;
     CrashIf(requestCount < 0);
     CrashIf(req->abort);
@@ -650,6 +1108,13 @@ DWORD WINAPI RenderCache::RenderCacheThread(LPVOID data) {
         if (!cache->GetNextRequest(&req)) {
             continue;
         }
+        if (req.priority == RenderPriority::Repair) {
+            // tiles of pages that are no longer visible are repaired once they're painted again
+            if (req.dm->PageVisibleNearby(req.pageNo) && !req.dm->dontRenderFlag) {
+                cache->RepairTile(req);
+            }
+            continue;
+        }
 
         if (!req.dm->PageVisibleNearby(req.pageNo) && !req.renderCb) {
             continue;
@@ -669,11 +1134,23 @@ DWORD WINAPI RenderCache::RenderCacheThread(LPVOID data) {
             req.dm->textCache->GetTextForPage(req.pageNo);
         }
 
+        bool isPreview = req.priority == RenderPriority::Preview;
+        bool canSkip = isPreview || req.priority == RenderPriority::Prefetch;
+        if (canSkip && cache->Exists(req.dm, req.pageNo, req.rotation, req.zoom, &req.tile)) {
+            // the real tile is already there
+            continue;
+        }
+
         CrashIf(req.abortCookie != nullptr);
         EngineBase* engine = req.dm->GetEngine();
-        RenderPageArgs args(req.pageNo, req.zoom, req.rotation, &req.pageRect, RenderTarget::View, &req.abortCookie);
+        float zoom = isPreview ? req.zoom * kPreviewZoomFactor : req.zoom;
+        RenderTarget target = isPreview ? RenderTarget::Preview : RenderTarget::View;
+        RenderPageArgs args(req.pageNo, zoom, req.rotation, &req.pageRect, target, &req.abortCookie);
         auto timeStart = TimeGet();
-        bmp = engine->RenderPage(args);
+        {
+            TRACE_SPAN_PAGE(isPreview ? "RenderCacheThread: render preview" : "RenderCacheThread: render", req.pageNo);
+            bmp = engine->RenderPage(args);
+        }
         if (req.abort) {
             delete bmp;
             if (req.renderCb) {
@@ -682,6 +1159,9 @@ DWORD WINAPI RenderCache::RenderCacheThread(LPVOID data) {
             continue;
         }
         auto durMs = TimeSinceInMs(timeStart);
+        if (!isPreview && !req.renderCb) {
+            cache->AddRenderTime(req.dm, req.pageNo, (float)durMs);
+        }
         if (durMs > 100) {
             auto path = engine->FilePath();
             logfa("Slow rendering: %.2f ms, page: %d in '%s'\n", (float)durMs, req.pageNo, path);
@@ -696,6 +1176,10 @@ DWORD WINAPI RenderCache::RenderCacheThread(LPVOID data) {
             if (bmp && !engine->IsImageCollection()) {
                 UpdateBitmapColors(bmp->GetBitmap(), cache->textColor, cache->backgroundColor);
             }
+            if (isPreview) {
+                // cached at its real zoom, so it's only painted (scaled) in place of the missing tile
+                req.zoom = zoom;
+            }
             cache->Add(req, bmp);
             req.dm->RepaintDisplay();
         }
@@ -712,6 +1196,28 @@ int RenderCache::PaintTile(HDC hdc, Rect bounds, DisplayModel* dm, int pageNo, T
     BitmapCacheEntry* entry = Find(dm, pageNo, dm->GetRotation(), zoom, &tile);
     int renderDelay = 0;
 
+    if (entry) {
+        stats.bitmapHits++;
+        TraceInstant("RenderCache: hit", pageNo);
+        bool isDamaged;
+        {
+            ScopedCritSec scope(&cacheAccess);
+            isDamaged = !entry->damaged.IsEmpty();
+        }
+        if (isDamaged && renderMissing) {
+            RequestRepair(dm, pageNo, tile);
+        }
+    } else {
+        entry = FindCompressed(dm, pageNo, dm->GetRotation(), zoom, &tile);
+        if (entry) {
+            stats.compressedHits++;
+            TraceInstant("RenderCache: compressed hit", pageNo);
+        } else {
+            stats.misses++;
+            TraceInstant("RenderCache: miss", pageNo);
+        }
+    }
+
     if (!entry) {
         if (!isRemoteSession) {
             if (renderedReplacement) {
@@ -722,6 +1228,10 @@ int RenderCache::PaintTile(HDC hdc, Rect bounds, DisplayModel* dm, int pageNo, T
         renderDelay = GetRenderDelay(dm, pageNo, tile);
         if (renderMissing && RENDER_DELAY_UNDEFINED == renderDelay && !IsRenderQueueFull()) {
             RequestRendering(dm, pageNo, tile);
+            // there's nothing to show in the meantime: for slow pages, quickly render a preview first
+            if (!entry && !IsRenderQueueFull() && ShouldRenderPreview(dm, pageNo)) {
+                RequestRendering(dm, pageNo, tile, false, RenderPriority::Preview);
+            }
         }
     }
     RenderedBitmap* renderedBmp = entry ? entry->bitmap : nullptr;
@@ -869,6 +1379,14 @@ int RenderCache::Paint(HDC hdc, Rect bounds, DisplayModel* dm, int pageNo, PageI
         }
     }
 
+    if (!pageInfo->painted) {
+        pageInfo->painted = true;
+        stats.pagesShown++;
+        if (!neededScaling) {
+            stats.pagesShownCached++;
+        }
+    }
+
 #ifdef CONSERVE_MEMORY
     if (!neededScaling) {
         if (renderOutOfDateCue) {
@@ -12,6 +12,9 @@ constexpr int RENDER_DELAY_UNDEFINED = std::numeric_limits<int>::max() - 2;
 // TODO: this should be based on amount of memory taken by rendered pages
 // i.e. one big page can use as much memory as lots of small pages
 #define MAX_BITMAPS_CACHED 64
+// bitmaps evicted from the cache are kept compressed in RAM,
+// up to this many bytes of compressed data
+#define MAX_COMPRESSED_CACHE_SIZE (64 * 1024 * 1024)
 
 struct PageInfo;
 
@@ -53,6 +56,9 @@ struct BitmapCacheEntry {
     // owned by the BitmapCacheEntry
     RenderedBitmap* bitmap = nullptr;
     bool outOfDate = false;
+    // part of the page (in page coordinates) that changed since the bitmap
+    // was rendered and is about to be re-rendered into it (see RenderCache::Invalidate)
+    RectF damaged;
     int refs = 1;
 
     BitmapCacheEntry(DisplayModel* dm, int pageNo, int rotation, float zoom, TilePosition tile,
@@ -69,6 +75,55 @@ struct BitmapCacheEntry {
     }
 };
 
+/* Second cache tier: when a BitmapCacheEntry is evicted, its bitmap is
+   run-length encoded (rendered pages are mostly flat background and most of
+   them have an 8-bit palette) so that scrolling back to the page doesn't need
+   to render it again. */
+struct CompressedBitmapCacheEntry {
+    DisplayModel* dm = nullptr;
+    int pageNo = 0;
+    int rotation = 0;
+    float zoom = 0.f;
+    TilePosition tile;
+
+    // header and color table of the DIB section
+    BITMAPINFO* bmi = nullptr;
+    size_t rawSize = 0;
+    ByteSlice data;
+
+    ~CompressedBitmapCacheEntry() {
+        free(bmi);
+        data.Free();
+    }
+};
+
+// lookups of tiles to paint, per cache tier
+struct RenderCacheStats {
+    int bitmapHits = 0;
+    int compressedHits = 0;
+    int misses = 0;
+    // pages painted for the first time since they were scrolled into view,
+    // and how many of them were completely painted from the cache
+    int pagesShown = 0;
+    int pagesShownCached = 0;
+    int compressedCount = 0;
+    size_t compressedSize = 0;
+    size_t compressedRawSize = 0;
+};
+
+// the render thread picks the request with the highest priority
+// (and of those, the most recently queued one)
+enum class RenderPriority {
+    // pages predicted to become visible soon (see DisplayModel::PrefetchPredictedPages)
+    Prefetch = 0,
+    Normal,
+    // a quick, low resolution render of a slow page, shown until
+    // the Normal request for the same tile is done
+    Preview,
+    // re-rendering only the damaged part of a cached tile (see RenderCache::Invalidate)
+    Repair,
+};
+
 /* Even though this looks a lot like a BitmapCacheEntry, we keep it
    separate for clarity in the code (PageRenderRequests are reused,
    while BitmapCacheEntries are ref-counted) */
@@ -86,11 +141,27 @@ struct PageRenderRequest {
     // owned by the PageRenderRequest (use it before reusing the request)
     // on rendering success, the callback gets handed the RenderedBitmap
     RenderingCallback* renderCb = nullptr;
+    RenderPriority priority = RenderPriority::Normal;
 };
 
+// how long rendering a tile of a page took, to decide which pages need previews
+struct PageRenderTime {
+    DisplayModel* dm = nullptr;
+    int pageNo = 0;
+    float ms = 0;
+};
+
+#define MAX_RENDER_TIMES 32
+
 struct RenderCache {
     BitmapCacheEntry* cache[MAX_BITMAPS_CACHED]{};
     int cacheCount = 0;
+    // ordered from least to most recently evicted
+    Vec<CompressedBitmapCacheEntry*> compressed;
+    size_t compressedSize = 0;
+    RenderCacheStats stats;
+    PageRenderTime renderTimes[MAX_RENDER_TIMES]{};
+    int nextRenderTime = 0;
     // make sure to never ask for requestAccess in a cacheAccess
     // protected critical section in order to avoid deadlocks
     CRITICAL_SECTION cacheAccess;
@@ -115,13 +186,15 @@ struct RenderCache {
     RenderCache& operator=(RenderCache const&) = delete;
     ~RenderCache();
 
-    void RequestRendering(DisplayModel* dm, int pageNo);
+    void RequestRendering(DisplayModel* dm, int pageNo, RenderPriority priority = RenderPriority::Normal);
+    void CancelPrefetch(DisplayModel* dm);
     void Render(DisplayModel* dm, int pageNo, int rotation, float zoom, RectF pageRect, RenderingCallback& callback);
     void CancelRendering(DisplayModel* dm);
     bool Exists(DisplayModel* dm, int pageNo, int rotation, float zoom = kInvalidZoom, TilePosition* tile = nullptr);
     void FreeForDisplayModel(DisplayModel* dm);
     void KeepForDisplayModel(DisplayModel* oldDm, DisplayModel* newDm);
     void Invalidate(DisplayModel* dm, int pageNo, RectF rect);
+    void GetStats(RenderCacheStats& statsOut);
     // returns how much time in ms has past since the most recent rendering
     // request for the visible part of the page if nothing at all could be
     // painted, 0 if something has been painted and RENDER_DELAY_FAILED on failure
@@ -139,17 +212,26 @@ struct RenderCache {
         return requestCount == MAX_PAGE_REQUESTS;
     }
     int GetRenderDelay(DisplayModel* dm, int pageNo, TilePosition tile);
-    void RequestRendering(DisplayModel* dm, int pageNo, TilePosition tile, bool clearQueueForPage = true);
+    void RequestRendering(DisplayModel* dm, int pageNo, TilePosition tile, bool clearQueueForPage = true,
+                          RenderPriority priority = RenderPriority::Normal);
     bool Render(DisplayModel* dm, int pageNo, int rotation, float zoom, TilePosition* tile = nullptr,
-                RectF* pageRect = nullptr, RenderingCallback* renderCb = nullptr);
+                RectF* pageRect = nullptr, RenderingCallback* renderCb = nullptr,
+                RenderPriority priority = RenderPriority::Normal);
+    void AddRenderTime(DisplayModel* dm, int pageNo, float ms);
+    bool ShouldRenderPreview(DisplayModel* dm, int pageNo);
     void ClearQueueForDisplayModel(DisplayModel* dm, int pageNo = kInvalidPageNo, TilePosition* tile = nullptr);
     void AbortCurrentRequest();
+    void RequestRepair(DisplayModel* dm, int pageNo, TilePosition tile);
+    void RepairTile(PageRenderRequest& req);
 
     static DWORD WINAPI RenderCacheThread(LPVOID data);
 
     BitmapCacheEntry* Find(DisplayModel* dm, int pageNo, int rotation, float zoom = kInvalidZoom,
                            TilePosition* tile = nullptr);
-    bool DropCacheEntry(BitmapCacheEntry* entry);
+    bool DropCacheEntry(BitmapCacheEntry* entry, bool keepCompressed = false);
+    void CompressCacheEntry(BitmapCacheEntry* entry);
+    BitmapCacheEntry* FindCompressed(DisplayModel* dm, int pageNo, int rotation, float zoom, TilePosition* tile);
+    void FreeCompressed(DisplayModel* dm = nullptr, int pageNo = kInvalidPageNo, TilePosition* tile = nullptr);
     void FreePage(DisplayModel* dm = nullptr, int pageNo = -1, TilePosition* tile = nullptr);
     void FreeNotVisible();
 
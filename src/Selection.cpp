@@ -51,14 +51,19 @@ Rect SelectionOnPage::GetRect(DisplayModel* dm) const {
 Vec<SelectionOnPage>* SelectionOnPage::FromRectangle(DisplayModel* dm, Rect rect) {
     Vec<SelectionOnPage>* sel = new Vec<SelectionOnPage>();
 
-    for (int pageNo = dm->GetEngine()->PageCount(); pageNo >= 1; --pageNo) {
+    // only look at the pages the rectangle vertically overlaps with
+    int first, last;
+    dm->GetPagesInRange(rect.y + dm->GetViewPort().y, rect.dy, &first, &last);
+    first = std::max(first, 1);
+    last = std::min(last, dm->GetEngine()->PageCount());
+    for (int pageNo = last; pageNo >= first; --pageNo) {
         PageInfo* pageInfo = dm->GetPageInfo(pageNo);
         CrashIf(!(!pageInfo || 0.0 == pageInfo->visibleRatio || pageInfo->shown));
         if (!pageInfo || !pageInfo->shown) {
             continue;
         }
 
-        Rect intersect = rect.Intersect(pageInfo->pageOnScreen);
+        Rect intersect = rect.Intersect(dm->GetPageOnScreen(pageNo));
         if (intersect.IsEmpty()) {
             continue;
         }
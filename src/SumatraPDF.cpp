@@ -20,6 +20,7 @@
 #include "utils/GdiPlusUtil.h"
 #include "utils/Archive.h"
 #include "utils/Timer.h"
+#include "utils/Trace.h"
 
 #include "wingui/UIModels.h"
 #include "wingui/Layout.h"
@@ -687,6 +688,8 @@ struct ControllerCallbackHandler : DocControllerCallback {
     void PageNoChanged(DocController* ctrl, int pageNo) override;
     void UpdateScrollbars(Size canvas) override;
     void RequestRendering(int pageNo) override;
+    void PrefetchRendering(int pageNo) override;
+    void CancelPrefetchRendering() override;
     void CleanUp(DisplayModel* dm) override;
     void RenderThumbnail(DisplayModel* dm, Size size, const onBitmapRenderedCb&) override;
     void GotoLink(IPageDestination* dest) override {
@@ -768,6 +771,22 @@ void ControllerCallbackHandler::RequestRendering(int pageNo) {
     }
 }
 
+// pages DisplayModel predicts to scroll into view soon are rendered
+// after all visible pages
+void ControllerCallbackHandler::PrefetchRendering(int pageNo) {
+    DisplayModel* dm = win->AsFixed();
+    if (dm && dm->ShouldCacheRendering(pageNo)) {
+        gRenderCache.RequestRendering(dm, pageNo, RenderPriority::Prefetch);
+    }
+}
+
+void ControllerCallbackHandler::CancelPrefetchRendering() {
+    DisplayModel* dm = win->AsFixed();
+    if (dm) {
+        gRenderCache.CancelPrefetch(dm);
+    }
+}
+
 void ControllerCallbackHandler::CleanUp(DisplayModel* dm) {
     gRenderCache.CancelRendering(dm);
     gRenderCache.FreeForDisplayModel(dm);
@@ -1545,7 +1564,7 @@ static void RenameFileInHistory(const char* oldPath, const char* newPath) {
     }
     fs = gFileHistory.FindByName(oldPath, nullptr);
     if (fs) {
-        SetFileStatePath(fs, newPath);
+        gFileHistory.SetPath(fs, newPath);
         // merge Frequently Read data, so that a file
         // doesn't accidentally vanish from there
         fs->isPinned = fs->isPinned || oldIsPinned;
@@ -1731,10 +1750,9 @@ MainWindow* LoadDocumentFinish(LoadArgs* args, bool lazyload) {
         if (!lazyload && gGlobalPrefs->showStartPage) {
             CreateThumbnailForFile(win, ds);
         }
-        // TODO: this seems to save the state of file that we just opened
-        // add a way to skip saving currTab?
+        // only the state of the file that we just opened has changed
         if (!args->noSavePrefs) {
-            SaveSettings();
+            SaveFileStateSettings(fullPath, true);
         }
     }
 
@@ -1841,6 +1859,7 @@ static StrVec gFilesFailedToOpen;
 
 MainWindow* LoadDocument(LoadArgs* args, bool lazyload) {
     CrashAlwaysIf(gCrashOnOpen);
+    TRACE_SPAN("LoadDocument");
 
     MainWindow* win = args->win;
     bool failEarly = AdjustPathForMaybeMovedFile(args);
@@ -2055,6 +2074,21 @@ void MainWindowRerender(MainWindow* win, bool includeNonClientArea) {
     }
 }
 
+// re-render only rect (in page coordinates) of pageNo,
+// e.g. the area covered by an annotation before and after it was changed
+void MainWindowRerender(MainWindow* win, int pageNo, RectF rect) {
+    DisplayModel* dm = win->AsFixed();
+    if (!dm) {
+        return;
+    }
+    if (!dm->ValidPageNo(pageNo) || rect.IsEmpty()) {
+        MainWindowRerender(win);
+        return;
+    }
+    gRenderCache.Invalidate(dm, pageNo, rect);
+    win->RedrawAll(true);
+}
+
 static void RerenderEverything() {
     for (auto* win : gWindows) {
         MainWindowRerender(win);
@@ -4529,6 +4563,39 @@ void ShowLogFileSmart() {
     }
 }
 
+// writes memory use and hit counts of caches to a text file and opens it
+static void ShowMemoryStats() {
+    str::Str s;
+    Vec<MupdfStoreStats> stores;
+    GetMupdfStoreStats(stores);
+    size_t total = 0;
+    for (MupdfStoreStats& st : stores) {
+        total += st.total;
+    }
+    s.AppendFmt("mupdf store: %d kB of %d kB budget\r\n", (int)(total / 1024), (int)(GetMupdfStoreBudget() / 1024));
+    for (MupdfStoreStats& st : stores) {
+        s.AppendFmt("  %s\r\n", st.filePath ? st.filePath : "(no path)");
+        s.AppendFmt("    total: %d kB, images: %d kB, fonts: %d kB, colorspaces: %d kB", (int)(st.total / 1024),
+                    (int)(st.images / 1024), (int)(st.fonts / 1024), (int)(st.colorspaces / 1024));
+        s.AppendFmt(", display lists: %d kB, other: %d kB\r\n", (int)(st.displayLists / 1024), (int)(st.other / 1024));
+    }
+
+    RenderCacheStats rcs;
+    gRenderCache.GetStats(rcs);
+    s.AppendFmt("render cache: bitmap hits: %d, compressed hits: %d, misses: %d\r\n", rcs.bitmapHits,
+                rcs.compressedHits, rcs.misses);
+    s.AppendFmt("  %d compressed bitmaps: %d kB (%d kB uncompressed)\r\n", rcs.compressedCount,
+                (int)(rcs.compressedSize / 1024), (int)(rcs.compressedRawSize / 1024));
+    s.AppendFmt("  %d of %d pages were in the cache when scrolled into view\r\n", rcs.pagesShownCached,
+                rcs.pagesShown);
+    logf("%s", s.Get());
+
+    char* path = AppGenDataFilenameTemp("SumatraPDF-memory-stats.txt");
+    if (path && file::WriteFile(path, s.AsByteSlice())) {
+        LaunchFileIfExists(path);
+    }
+}
+
 void ReopenLastClosedFile(MainWindow* win) {
     char* path = PopRecentlyClosedDocument();
     if (!path) {
@@ -5176,6 +5243,26 @@ static LRESULT FrameOnCommand(MainWindow* win, HWND hwnd, UINT msg, WPARAM wp, L
             }
             break;
 
+        case CmdDebugToggleTrace: {
+            if (!gTraceEnabled) {
+                TraceStart();
+                break;
+            }
+            TraceStop();
+            char* path = AppGenDataFilenameTemp("SumatraPDF-trace.json");
+            if (path && WriteTraceToFile(path) && win) {
+                AutoFreeStr msg(str::Format("Wrote trace to %s", path));
+                NotificationCreateArgs nargs;
+                nargs.hwndParent = win->hwndCanvas;
+                nargs.msg = msg;
+                ShowNotification(nargs);
+            }
+        } break;
+
+        case CmdDebugShowMemoryStats:
+            ShowMemoryStats();
+            break;
+
 #if defined(DEBUG)
         case CmdDebugTestApp:
             extern void TestApp(HINSTANCE hInstance);
@@ -14,6 +14,7 @@
 #include "mui/Mui.h"
 #include "utils/SquareTreeParser.h"
 #include "utils/ThreadUtil.h"
+#include "utils/Trace.h"
 #include "utils/UITask.h"
 #include "utils/WinUtil.h"
 
@@ -1019,6 +1020,10 @@ int APIENTRY WinMain(HINSTANCE hInstance, __unused HINSTANCE hPrevInstance, __un
         char* s = ToUtf8Temp(GetCommandLineW());
         logf("Starting SumatraPDF %s, GetCommandLineW():\n%s\n", UPDATE_CHECK_VERA, s);
     }
+
+    if (flags.traceFilePath) {
+        TraceStart();
+    }
 #if defined(DEBUG)
     if (gIsDebugBuild || gIsPreReleaseBuild) {
         if (flags.tester) {
@@ -1118,6 +1123,18 @@ int APIENTRY WinMain(HINSTANCE hInstance, __unused HINSTANCE hPrevInstance, __un
         ShutdownCommon();
         return 0;
     }
+
+    if (flags.testRenderThreads) {
+        TestRenderThreads(flags);
+        ShutdownCommon();
+        return 0;
+    }
+
+    if (flags.testRenderCopies) {
+        TestRenderCopies(flags);
+        ShutdownCommon();
+        return 0;
+    }
 #endif
 
     if (flags.appdataDir) {
@@ -1161,10 +1178,19 @@ int APIENTRY WinMain(HINSTANCE hInstance, __unused HINSTANCE hPrevInstance, __un
         BenchFileOrDir(flags.pathsToBenchmark);
     }
 
+    if (flags.pregenThumbnailsDir) {
+        if (HasPermission(Perm::SavePreferences)) {
+            PregenerateThumbnails(flags.pregenThumbnailsDir, flags.pregenThumbnailsThreads);
+        }
+    }
+
     if (flags.exitImmediately) {
         goto Exit;
     }
 
+    // from now on, logging from render threads etc. doesn't block
+    StartAsyncLogging();
+
     gCrashOnOpen = flags.crashOnOpen;
 
     GetFixedPageUiColors(gRenderCache.textColor, gRenderCache.backgroundColor);
@@ -1185,6 +1211,11 @@ int APIENTRY WinMain(HINSTANCE hInstance, __unused HINSTANCE hPrevInstance, __un
         }
     }
 
+    if (HasPermission(Perm::DiskAccess) && !gPluginMode) {
+        // broken PDF files only need to be repaired once
+        SetMupdfRepairedXrefCacheDir(AppGenDataFilenameTemp("xrefcache"));
+    }
+
     {
         // search only applies if there's 1 file
         auto nFiles = flags.fileNames.size();
@@ -1376,6 +1407,11 @@ ContinueOpenWindow:
 
 Exit:
     logf("Exiting with exit code: %d\n", exitCode);
+    if (flags.traceFilePath) {
+        TraceStop();
+        WriteTraceToFile(flags.traceFilePath);
+    }
+    FlushLogs();
     UnregisterSettingsForFileChanges();
 
     HandleRedirectedConsoleOnShutdown();
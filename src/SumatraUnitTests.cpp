@@ -15,7 +15,9 @@
 #include "Settings.h"
 #include "DocController.h"
 #include "EngineBase.h"
+#include "PdfSync.h"
 #include "GlobalPrefs.h"
+#include "FileHistory.h"
 #include "Flags.h"
 
 #include <float.h>
@@ -223,10 +225,366 @@ static void colorTest() {
     utassert(c == c2);
 }
 
+static u32 gPdfsyncRandState = 1;
+
+static int PdfsyncRand(int n) {
+    gPdfsyncRandState = gPdfsyncRandState * 1103515245 + 12345;
+    return (int)((gPdfsyncRandState >> 8) % (u32)n);
+}
+
+constexpr int kPdfsyncFixturePages = 5;
+
+// Pdfsync for a document with kPdfsyncFixturePages letter-sized pages, together with
+// DocToSource() and SourceToDoc() as they were before the lookup indexes (i.e. linear scans)
+struct PdfsyncFixture : Pdfsync {
+    explicit PdfsyncFixture(const char* syncfilename) : Pdfsync(syncfilename, nullptr) {
+    }
+
+    int PageCount() override {
+        return kPdfsyncFixturePages;
+    }
+    RectF PageMediabox(int) override {
+        return RectF(0, 0, 612, 792);
+    }
+
+    int LinearDocToSource(int pageNo, Point pt, AutoFreeStr& filename, int* line, int* col) {
+        if (pageNo == 0 || pageNo >= sheetIndex.isize() || pageNo > PageCount()) {
+            return PDFSYNCERR_INVALID_PAGE_NUMBER;
+        }
+        Rect mbox = PageMediabox(pageNo).Round();
+        pt.y = mbox.dy - pt.y;
+
+        UINT closest_xydist = UINT_MAX;
+        UINT selected_record = UINT_MAX;
+        UINT closest_ydist = UINT_MAX;
+        UINT closest_xdist = UINT_MAX;
+        UINT closest_ydist_record = UINT_MAX;
+        for (size_t i = sheetIndex.at((size_t)pageNo); i < points.size() && points.at(i).page == (UINT)pageNo; i++) {
+            UINT dx = abs(pt.x - (int)SYNC_TO_PDF_COORDINATE(points.at(i).x));
+            UINT dy = abs(pt.y - (int)SYNC_TO_PDF_COORDINATE(points.at(i).y));
+            UINT dist = dx * dx + dy * dy;
+            if (dist < PDFSYNC_EPSILON_SQUARE && dist < closest_xydist) {
+                selected_record = points.at(i).record;
+                closest_xydist = dist;
+            } else if ((closest_xydist == UINT_MAX) && dy < PDFSYNC_EPSILON_Y &&
+                       (dy < closest_ydist || (dy == closest_ydist && dx < closest_xdist))) {
+                closest_ydist_record = points.at(i).record;
+                closest_ydist = dy;
+                closest_xdist = dx;
+            }
+        }
+        if (selected_record == UINT_MAX) {
+            selected_record = closest_ydist_record;
+        }
+        if (selected_record == UINT_MAX) {
+            return PDFSYNCERR_NO_SYNC_AT_LOCATION;
+        }
+        for (PdfsyncLine& l : lines) {
+            if (l.record == selected_record) {
+                filename.SetCopy(srcfiles[l.file]);
+                *line = (int)l.line;
+                *col = (int)l.column;
+                return PDFSYNCERR_SUCCESS;
+            }
+        }
+        return PDFSYNCERR_NO_SYNC_AT_LOCATION;
+    }
+
+    int LinearSourceToDoc(const char* srcfilename, int line, int* page, Vec<Rect>& rects) {
+        AutoFreeStr srcfilepath(PrependDir(srcfilename));
+        size_t isrc;
+        for (isrc = 0; isrc < srcfiles.size(); isrc++) {
+            if (path::IsSame(srcfilepath, srcfiles[isrc])) {
+                break;
+            }
+        }
+        if (isrc == srcfiles.size()) {
+            return PDFSYNCERR_UNKNOWN_SOURCEFILE;
+        }
+        if (fileIndex.at(isrc).start == fileIndex.at(isrc).end) {
+            return PDFSYNCERR_NORECORD_IN_SOURCEFILE;
+        }
+
+        UINT min_distance = EPSILON_LINE;
+        size_t lineIx = (size_t)-1;
+        for (size_t isec = fileIndex.at(isrc).start; isec < fileIndex.at(isrc).end; isec++) {
+            if (lines.at(isec).file != isrc) {
+                continue;
+            }
+            UINT d = abs((int)lines.at(isec).line - line);
+            if (d < min_distance) {
+                min_distance = d;
+                lineIx = isec;
+                if (0 == d) {
+                    break;
+                }
+            }
+        }
+        if (lineIx == (size_t)-1) {
+            return PDFSYNCERR_NORECORD_FOR_THATLINE;
+        }
+        Vec<size_t> records;
+        for (size_t i = lineIx; i < lines.size() && lines.at(i).line == lines.at(lineIx).line; i++) {
+            records.Append(lines.at(i).record);
+        }
+
+        rects.Reset();
+        int firstPage = UINT_MAX;
+        for (PdfsyncPoint& p : points) {
+            if (!records.Contains(p.record)) {
+                continue;
+            }
+            if (firstPage != UINT_MAX && firstPage != (int)p.page) {
+                continue;
+            }
+            firstPage = *page = (int)p.page;
+            RectF rc(SYNC_TO_PDF_COORDINATE(p.x), SYNC_TO_PDF_COORDINATE(p.y), MARK_SIZE, MARK_SIZE);
+            RectF mbox = PageMediabox(firstPage);
+            rc.y = mbox.dy - (rc.y + rc.dy);
+            rects.Append(rc.Round());
+        }
+        return rects.size() > 0 ? PDFSYNCERR_SUCCESS : PDFSYNCERR_NOSYNCPOINT_FOR_LINERECORD;
+    }
+};
+
+// a main file including 3 files (one of them nested) with some lines having several records
+// and some records without points, and pages with points at the same or close positions
+static char* MakePdfsyncFixture(int* nRecords) {
+    str::Str s;
+    s.Append("pdfsync-fixture\nversion 1\n");
+    int record = 0;
+    auto appendLines = [&](int nLines) {
+        int line = 1;
+        for (int i = 0; i < nLines; i++) {
+            line += PdfsyncRand(3) == 0 ? 0 : 1 + PdfsyncRand(4);
+            if (PdfsyncRand(2)) {
+                s.AppendFmt("l %d %d %d\n", ++record, line, PdfsyncRand(40));
+            } else {
+                s.AppendFmt("l %d %d\n", ++record, line);
+            }
+        }
+    };
+    appendLines(40);
+    s.Append("(chapter1\n");
+    appendLines(60);
+    s.Append(")\n");
+    appendLines(10);
+    s.Append("(chapter2.tex\n");
+    appendLines(30);
+    s.Append("(chapter2-figure\n");
+    appendLines(20);
+    s.Append(")\n");
+    appendLines(30);
+    s.Append(")\n");
+    appendLines(10);
+
+    // coordinates are multiples of 65782 so that (rounded) pdf coordinates can be equal
+    for (int page = 1; page <= kPdfsyncFixturePages; page++) {
+        s.AppendFmt("s %d\n", page);
+        int x = 0, y = 0;
+        for (int i = 0; i < 150; i++) {
+            // repeat the previous position now and then
+            if (i == 0 || PdfsyncRand(8) != 0) {
+                x = 50 + PdfsyncRand(500);
+                y = PdfsyncRand(4) == 0 ? y : 30 + PdfsyncRand(730);
+            }
+            // not every record has a point
+            int rec = 1 + PdfsyncRand(record);
+            s.AppendFmt("%s %d %d %d\n", PdfsyncRand(2) ? "p" : "p*", rec, x * 65782, y * 65782);
+        }
+    }
+    *nRecords = record;
+    return s.StealData();
+}
+
+static bool IsSameAsLinearDocToSource(PdfsyncFixture* sync, int pageNo, Point pt) {
+    AutoFreeStr file1, file2;
+    int line1 = 0, col1 = 0, line2 = 0, col2 = 0;
+    int res1 = sync->DocToSource(pageNo, pt, file1, &line1, &col1);
+    int res2 = sync->LinearDocToSource(pageNo, pt, file2, &line2, &col2);
+    if (res1 != res2) {
+        return false;
+    }
+    return res1 != PDFSYNCERR_SUCCESS || (str::Eq(file1, file2) && line1 == line2 && col1 == col2);
+}
+
+static bool IsSameAsLinearSourceToDoc(PdfsyncFixture* sync, const char* srcfilename, int line) {
+    int page1 = 0, page2 = 0;
+    Vec<Rect> rects1, rects2;
+    int res1 = sync->SourceToDoc(srcfilename, line, 0, &page1, rects1);
+    int res2 = sync->LinearSourceToDoc(srcfilename, line, &page2, rects2);
+    if (res1 != res2) {
+        return false;
+    }
+    if (res1 != PDFSYNCERR_SUCCESS) {
+        return true;
+    }
+    if (page1 != page2 || rects1.size() != rects2.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < rects1.size(); i++) {
+        if (!rects1.at(i).Equals(rects2.at(i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void PdfsyncTest() {
+    int nRecords = 0;
+    AutoFreeStr fixture = MakePdfsyncFixture(&nRecords);
+    char* syncPath = path::JoinTemp(GetTempDirTemp(), "SumatraPDF-unittest.pdfsync");
+    bool ok = file::WriteFile(syncPath, fixture.Get());
+    utassert(ok);
+    if (!ok) {
+        return;
+    }
+
+    auto sync = new PdfsyncFixture(syncPath);
+    bool sameDocToSource = true;
+    for (int pageNo = 0; pageNo <= kPdfsyncFixturePages + 1; pageNo++) {
+        for (int y = 0; y < 800; y += 3) {
+            for (int x = 0; x < 620; x += 5) {
+                sameDocToSource &= IsSameAsLinearDocToSource(sync, pageNo, Point(x, y));
+            }
+        }
+    }
+    utassert(sameDocToSource);
+
+    const char* srcfiles[] = {"pdfsync-fixture.tex", "chapter1.tex", "chapter2.tex", "chapter2-figure.tex",
+                              "unknown.tex"};
+    bool sameSourceToDoc = true;
+    for (const char* srcfile : srcfiles) {
+        for (int line = 0; line < 250; line++) {
+            sameSourceToDoc &= IsSameAsLinearSourceToDoc(sync, srcfile, line);
+        }
+    }
+    utassert(sameSourceToDoc);
+
+    delete sync;
+    file::Delete(syncPath);
+}
+
+static void DeleteFileStates(Vec<FileState*>& states) {
+    for (FileState* fs : states) {
+        DeleteDisplayState(fs);
+    }
+    states.Reset();
+}
+
+static void FileHistoryTest() {
+    Vec<FileState*> states;
+    FileHistory history;
+    history.UpdateStatesSource(&states);
+
+    // enough states for the path index to be rebuilt a few times
+    const int n = 300;
+    for (int i = 0; i < n; i++) {
+        history.Append(NewDisplayState(fmt::FormatTemp("C:\\docs\\file%d.pdf", i)));
+    }
+    bool allFound = true;
+    for (int i = 0; i < n; i++) {
+        // paths are compared case-insensitively
+        FileState* fs = history.FindByPath(fmt::FormatTemp("c:\\DOCS\\File%d.PDF", i));
+        allFound &= fs == states.at(i);
+    }
+    utassert(allFound);
+    utassert(!history.FindByPath("C:\\docs\\file300.pdf"));
+
+    // removing and renaming states must update the index
+    FileState* fs = history.FindByPath("C:\\docs\\file7.pdf");
+    history.Remove(fs);
+    utassert(!history.FindByPath("C:\\docs\\file7.pdf"));
+    utassert(history.FindByPath("C:\\docs\\file8.pdf") == states.at(7));
+    DeleteDisplayState(fs);
+
+    fs = history.FindByPath("C:\\docs\\file9.pdf");
+    history.SetPath(fs, "C:\\docs\\renamed.pdf");
+    utassert(!history.FindByPath("C:\\docs\\file9.pdf"));
+    utassert(history.FindByPath("C:\\docs\\renamed.pdf") == fs);
+
+    // MarkFileLoaded() adds new states at the front
+    fs = history.MarkFileLoaded("C:\\docs\\new.pdf");
+    utassert(states.at(0) == fs);
+    utassert(history.FindByPath("C:\\docs\\new.pdf") == fs);
+    fs = history.MarkFileLoaded("C:\\docs\\file20.pdf");
+    utassert(states.at(0) == fs);
+    utassert(history.FindByPath("C:\\docs\\file20.pdf") == fs);
+
+    // merged states replace the previous state for the same path
+    FileState* merged = NewDisplayState("C:\\docs\\FILE30.pdf");
+    merged->pageNo = 12;
+    history.MergeState(merged, false);
+    utassert(history.FindByPath("C:\\docs\\file30.pdf") == merged);
+    utassert(states.Size() == n);
+
+    DeleteFileStates(states);
+    history.UpdateStatesSource(nullptr);
+}
+
+static FILETIME FileTimeFromU64(u64 t) {
+    FILETIME ft;
+    ft.dwLowDateTime = (DWORD)t;
+    ft.dwHighDateTime = (DWORD)(t >> 32);
+    return ft;
+}
+
+static void AppendJournalEntry(str::Str& journal, const char* path, int pageNo, bool isMostRecent, u64 time) {
+    FileState* fs = NewDisplayState(path);
+    fs->pageNo = pageNo;
+    ByteSlice entry = SerializeFileStateJournalEntry(fs, isMostRecent, FileTimeFromU64(time));
+    journal.Append((const char*)entry.data(), entry.size());
+    journal.Append(kSettingsJournalEntryEnd);
+    str::Free(entry.data());
+    DeleteDisplayState(fs);
+}
+
+static void SettingsJournalTest() {
+    Vec<FileState*> states;
+    FileHistory history;
+    history.UpdateStatesSource(&states);
+    for (int i = 0; i < 3; i++) {
+        FileState* fs = NewDisplayState(fmt::FormatTemp("C:\\docs\\file%d.pdf", i));
+        fs->pageNo = 1;
+        history.Append(fs);
+    }
+
+    // the settings file was last written at time 1000
+    FILETIME settingsTime = FileTimeFromU64(1000);
+    str::Str journal;
+    // older than the settings file: must not override it
+    AppendJournalEntry(journal, "C:\\docs\\file1.pdf", 5, true, 999);
+    AppendJournalEntry(journal, "C:\\docs\\file1.pdf", 6, false, 1000);
+    // entries written before they were timestamped are ignored as well
+    AppendJournalEntry(journal, "C:\\docs\\file0.pdf", 7, false, 0);
+    AppendJournalEntry(journal, "C:\\docs\\file2.pdf", 8, false, 1001);
+    AppendJournalEntry(journal, "C:\\docs\\other.pdf", 9, true, 1002);
+    // an incomplete entry (e.g. from a process that's still writing it)
+    journal.Append("MostRecent = true\nFileStates [\n  [\n    FilePath = C:\\docs\\file0.pdf\n");
+
+    int nEntries = history.MergeJournal(journal.Get(), settingsTime);
+    utassert(nEntries == 5);
+    utassert(states.Size() == 4);
+    utassert(history.FindByPath("C:\\docs\\file0.pdf")->pageNo == 1);
+    utassert(history.FindByPath("C:\\docs\\file1.pdf")->pageNo == 1);
+    utassert(history.FindByPath("C:\\docs\\file2.pdf")->pageNo == 8);
+    // merged in place
+    utassert(states.at(3) == history.FindByPath("C:\\docs\\file2.pdf"));
+    // most recent entries are moved to the front
+    utassert(states.at(0) == history.FindByPath("C:\\docs\\other.pdf"));
+    utassert(states.at(0)->pageNo == 9);
+
+    DeleteFileStates(states);
+    history.UpdateStatesSource(nullptr);
+}
+
 void SumatraPDF_UnitTests() {
     colorTest();
     BenchRangeTest();
     ParseCommandLineTest();
     versioncheck_test();
     hexstrTest();
+    PdfsyncTest();
+    FileHistoryTest();
+    SettingsJournalTest();
 }
@@ -243,41 +243,17 @@ void ToggleTocBox(MainWindow* win) {
 
 // find the closest item in tree view to a given page number
 static TocItem* TreeItemForPageNo(TreeView* treeView, int pageNo) {
-    TocItem* bestMatch = nullptr;
-    int bestMatchPageNo = 0;
-
-    TreeModel* tm = treeView->treeModel;
-    if (!tm) {
+    // the ToC tree view always shows a TocTree
+    auto tocTree = (TocTree*)treeView->treeModel;
+    if (!tocTree) {
         return 0;
     }
-    int nItems = 0;
-    VisitTreeModelItems(tm, [&](TreeModel* tm, TreeItem ti) {
-        auto tocItem = (TocItem*)ti;
-        if (!tocItem) {
-            return true;
-        }
-        if (!bestMatch) {
-            // if nothing else matches, match the root node
-            bestMatch = tocItem;
-        }
-        ++nItems;
-        int page = tocItem->pageNo;
-        if ((page <= pageNo) && (page >= bestMatchPageNo) && (page >= 1)) {
-            bestMatch = tocItem;
-            bestMatchPageNo = page;
-            if (pageNo == bestMatchPageNo) {
-                // we can stop earlier if we found the exact match
-                return false;
-            }
-        }
-        return true;
-    });
     // if there's only one item, we want to unselect it so that it can
     // be selected by the user
-    if (nItems < 2) {
+    if (tocTree->ItemCount() < 2) {
         return 0;
     }
-    return bestMatch;
+    return tocTree->FindItemForPageNo(pageNo);
 }
 
 // TODO: I can't use TreeItem->IsExpanded() because it's not in sync with
@@ -14,6 +14,7 @@
 #include "utils/GuessFileType.h"
 #include "utils/GdiPlusUtil.h"
 #include "utils/HtmlParserLookup.h"
+#include "utils/CssParser.h"
 #include "utils/HtmlPrettyPrint.h"
 #include "mui/Mui.h"
 #include "utils/Timer.h"
@@ -3,6 +3,8 @@
 
 #include "utils/BaseUtil.h"
 #include "utils/ScopedWin.h"
+#include "utils/ThreadUtil.h"
+#include "utils/Timer.h"
 #include "utils/WinUtil.h"
 
 #include "wingui/UIModels.h"
@@ -98,3 +100,134 @@ void TestExtractPage(const Flags& ci) {
         delete engine;
     }
 }
+
+struct RenderPagesThread : ThreadBase {
+    EngineBase* engine = nullptr;
+    float zoom = 1.f;
+    LONG* nextPage = nullptr;
+    LONG* failed = nullptr;
+
+    void Run() override {
+        int nPages = engine->PageCount();
+        for (;;) {
+            int pageNo = (int)InterlockedIncrement(nextPage);
+            if (pageNo > nPages) {
+                break;
+            }
+            RenderPageArgs args(pageNo, zoom, 0);
+            auto bmp = engine->RenderPage(args);
+            if (!bmp) {
+                InterlockedIncrement(failed);
+            }
+            delete bmp;
+        }
+    }
+};
+
+// renders all pages of a document with 1, 2, 4 ... threads sharing
+// the same engine and prints how long it took, to verify that
+// engines can render pages in parallel
+void TestRenderThreads(const Flags& i) {
+    if (i.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    auto files = i.fileNames;
+    if (files.size() == 0) {
+        printf("no file provided\n");
+        return;
+    }
+    float zoom = kZoomActualSize;
+    if (i.startZoom != kInvalidZoom) {
+        zoom = i.startZoom;
+    }
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    int maxThreads = (int)si.dwNumberOfProcessors;
+
+    for (auto fileName : files) {
+        auto engine = CreateEngineFromFile(fileName, nullptr, true);
+        if (engine == nullptr) {
+            printf("failed to create engine for file '%s'\n", fileName);
+            continue;
+        }
+        printf("rendering %d pages of '%s', zoom: %.2f\n", engine->PageCount(), fileName, zoom);
+        double singleThreadMs = 0;
+        for (int nThreads = 1; nThreads <= maxThreads; nThreads *= 2) {
+            LONG nextPage = 0;
+            LONG failed = 0;
+            Vec<RenderPagesThread*> threads;
+            auto start = TimeGet();
+            for (int n = 0; n < nThreads; n++) {
+                auto thread = new RenderPagesThread();
+                thread->engine = engine;
+                thread->zoom = zoom;
+                thread->nextPage = &nextPage;
+                thread->failed = &failed;
+                thread->Start();
+                threads.Append(thread);
+            }
+            for (auto thread : threads) {
+                thread->Join();
+                delete thread;
+            }
+            double ms = TimeSinceInMs(start);
+            if (nThreads == 1) {
+                singleThreadMs = ms;
+            }
+            printf("%2d threads: %8.2f ms, speedup: %.2fx, failed pages: %d\n", nThreads, ms, singleThreadMs / ms,
+                   (int)failed);
+        }
+        delete engine;
+    }
+}
+
+// renders all pages of a document the old way (rgb pixmap converted to bgr and
+// copied into a DIB section) and directly into DIB section memory, and prints
+// how many bytes had to be copied per rendered megapixel
+void TestRenderCopies(const Flags& i) {
+    if (i.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    auto files = i.fileNames;
+    if (files.size() == 0) {
+        printf("no file provided\n");
+        return;
+    }
+    float zoom = kZoomActualSize;
+    if (i.startZoom != kInvalidZoom) {
+        zoom = i.startZoom;
+    }
+
+    for (auto fileName : files) {
+        auto engine = CreateEngineFromFile(fileName, nullptr, true);
+        if (engine == nullptr) {
+            printf("failed to create engine for file '%s'\n", fileName);
+            continue;
+        }
+        int nPages = engine->PageCount();
+        printf("rendering %d pages of '%s', zoom: %.2f\n", nPages, fileName, zoom);
+        for (int zeroCopy = 0; zeroCopy < 2; zeroCopy++) {
+            SetMupdfZeroCopyRender(zeroCopy != 0);
+            MupdfRenderCopyStats stats;
+            GetMupdfRenderCopyStats(stats, true);
+            auto start = TimeGet();
+            for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+                RenderPageArgs args(pageNo, zoom, 0);
+                delete engine->RenderPage(args);
+            }
+            double ms = TimeSinceInMs(start);
+            GetMupdfRenderCopyStats(stats, true);
+            if (stats.pixels == 0) {
+                printf("not rendered by EngineMupdf\n");
+                break;
+            }
+            double mpx = (double)stats.pixels / (1024 * 1024);
+            printf("%-9s: %8.2f ms, %8.2f megapixels, %10.0f bytes copied per megapixel\n",
+                   zeroCopy ? "zero-copy" : "copy", ms, mpx, (double)stats.bytesCopied / mpx);
+        }
+        SetMupdfZeroCopyRender(true);
+        delete engine;
+    }
+}
@@ -3,3 +3,5 @@
 
 void TestRenderPage(const Flags& i);
 void TestExtractPage(const Flags& i);
+void TestRenderThreads(const Flags& i);
+void TestRenderCopies(const Flags& i);
@@ -4,6 +4,7 @@
 #include "utils/BaseUtil.h"
 #include "utils/ScopedWin.h"
 #include "utils/WinUtil.h"
+#include "utils/Trace.h"
 
 #include "wingui/UIModels.h"
 
@@ -254,6 +255,7 @@ static const WCHAR* GetNextIndex(const WCHAR* base, int offset, bool forward) {
 }
 
 bool TextSearch::FindTextInPage(int pageNo, TextSearch::PageAndOffset* finalGlyph) {
+    TRACE_SPAN_PAGE("TextSearch::FindTextInPage", pageNo);
     if (str::IsEmpty(findText)) {
         return false;
     }
@@ -351,6 +353,7 @@ bool TextSearch::FindStartingAtPage(int pageNo, ProgressUpdateUI* tracker) {
 }
 
 TextSel* TextSearch::FindFirst(int page, const WCHAR* text, ProgressUpdateUI* tracker) {
+    TRACE_SPAN_PAGE("TextSearch::FindFirst", page);
     SetText(text);
 
     if (FindStartingAtPage(page, tracker)) {
@@ -360,6 +363,7 @@ TextSel* TextSearch::FindFirst(int page, const WCHAR* text, ProgressUpdateUI* tr
 }
 
 TextSel* TextSearch::FindNext(ProgressUpdateUI* tracker) {
+    TRACE_SPAN("TextSearch::FindNext");
     CrashIf(!findText);
     if (!findText) {
         return nullptr;
@@ -4,6 +4,7 @@
 #include "utils/BaseUtil.h"
 #include "utils/ScopedWin.h"
 #include "utils/WinUtil.h"
+#include "utils/Trace.h"
 
 #include "wingui/UIModels.h"
 
@@ -54,6 +55,7 @@ const WCHAR* DocumentTextCache::GetTextForPage(int pageNo, int* lenOut, Rect** c
     PageText* pageText = &pagesText[pageNo - 1];
 
     if (!pageText->text) {
+        TRACE_SPAN_PAGE("DocumentTextCache: extract text", pageNo);
         *pageText = engine->ExtractPageText(pageNo);
         if (!pageText->text) {
             pageText->text = str::Dup(L"");
@@ -24,6 +24,7 @@ To write new regression test:
 #include "utils/GuessFileType.h"
 #include "utils/GdiPlusUtil.h"
 #include "utils/HtmlParserLookup.h"
+#include "utils/CssParser.h"
 #include "mui/Mui.h"
 #include "utils/WinUtil.h"
 
@@ -12,6 +12,7 @@ extern void SumatraPDF_UnitTests();
 
 extern void BaseUtilTest();
 extern void ByteOrderTests();
+extern void ColorUtilTest();
 extern void CryptoUtilTest();
 extern void CssParser_UnitTests();
 extern void DictTest();
@@ -19,26 +20,47 @@ extern void FileUtilTest();
 extern void HtmlPrettyPrintTest();
 extern void HtmlPullParser_UnitTests();
 extern void JsonTest();
+extern void LogTest();
+extern void MupdfDrawTest();
 extern void SettingsUtilTest();
 extern void SimpleLogTest();
 extern void SquareTreeTest();
 extern void StrFormatTest();
 extern void StrTest();
+extern void ThreadUtilTest();
 extern void TrivialHtmlParser_UnitTests();
 extern void VecTest();
 extern void WinUtilTest();
 extern void StrFormatTest();
 
+// benchmarks, only run with -bench
+extern void CssParserBench();
+extern void LogBench();
+extern void MupdfDrawBench();
+
 void _uploadDebugReportIfFunc(__unused bool cond, __unused const char* condStr) {
     // no-op implementation to satisfy SubmitBugReport()
 }
 
-int main(__unused int argc, __unused char** argv) {
-    printf("Running unit tests\n");
+static int RunBenchmarks() {
+    printf("Running benchmarks\n");
+    CssParserBench();
+    LogBench();
+    MupdfDrawBench();
+    DestroyTempAllocator();
+    return 0;
+}
 
+int main(int argc, char** argv) {
     InitDynCalls();
+    if (argc > 1 && str::Eq(argv[1], "-bench")) {
+        return RunBenchmarks();
+    }
+
+    printf("Running unit tests\n");
     BaseUtilTest();
     ByteOrderTests();
+    ColorUtilTest();
     CryptoUtilTest();
     CssParser_UnitTests();
     DictTest();
@@ -46,11 +68,14 @@ int main(__unused int argc, __unused char** argv) {
     HtmlPrettyPrintTest();
     HtmlPullParser_UnitTests();
     JsonTest();
+    LogTest();
+    MupdfDrawTest();
     SettingsUtilTest();
     SimpleLogTest();
     SquareTreeTest();
     StrFormatTest();
     StrTest();
+    ThreadUtilTest();
     TrivialHtmlParser_UnitTests();
     VecTest();
     WinUtilTest();
@@ -5,6 +5,10 @@
 #include "utils/ScopedWin.h"
 #include "utils/WinUtil.h"
 
+#if IS_INTEL_32 || IS_INTEL_64
+#include <emmintrin.h>
+#endif
+
 COLORREF MkColor(u8 r, u8 g, u8 b, u8 a) {
     COLORREF r2 = r;
     COLORREF g2 = (COLORREF)g << 8;
@@ -230,3 +234,72 @@ u8 GetAlpha(COLORREF rgb) {
     rgb = (rgb >> 24) & 0xff;
     return (u8)rgb;
 }
+
+PaletteQuantizer::PaletteQuantizer(bool isBgr) {
+    memset(keys, 0xff, sizeof(keys));
+    ri = isBgr ? 2 : 0;
+    bi = isBgr ? 0 : 2;
+    for (int& idx : grayIdxs) {
+        idx = -1;
+    }
+}
+
+// quantizes w pixels into dest, returns false if there are more than 256 colors
+bool PaletteQuantizer::QuantizeRow(const u8* s, int w, u8* dest) {
+    int i = 0;
+#if IS_INTEL_32 || IS_INTEL_64
+    // most pixels of rendered pages are anti-aliased black on white,
+    // so detect runs of 4 gray pixels (r == g == b) at once
+    const __m128i lo16 = _mm_set1_epi32(0xffff);
+    for (; i + 4 <= w; i += 4, s += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)s);
+        __m128i x = _mm_and_si128(_mm_xor_si128(v, _mm_srli_epi32(v, 8)), lo16);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(x, _mm_setzero_si128())) == 0xffff) {
+            int k0 = GrayIdx(s[0]);
+            int k1 = GrayIdx(s[4]);
+            int k2 = GrayIdx(s[8]);
+            int k3 = GrayIdx(s[12]);
+            if ((k0 | k1 | k2 | k3) < 0) {
+                return false;
+            }
+            dest[i] = (u8)k0;
+            dest[i + 1] = (u8)k1;
+            dest[i + 2] = (u8)k2;
+            dest[i + 3] = (u8)k3;
+            continue;
+        }
+        for (int j = 0; j < 4; j++) {
+            int k = PixelIdx(s + j * 4);
+            if (k < 0) {
+                return false;
+            }
+            dest[i + j] = (u8)k;
+        }
+    }
+#endif
+    for (; i < w; i++, s += 4) {
+        int k = PixelIdx(s);
+        if (k < 0) {
+            return false;
+        }
+        dest[i] = (u8)k;
+    }
+    return true;
+}
+
+// looks at a few evenly spaced rows first: if they already have more than
+// 256 colors, so does the whole image and we can give up before allocating
+// the 8-bit bitmap. Colors found are kept so the indices stay valid.
+bool PaletteQuantizer::SampleRows(const u8* samples, int w, int h, int stride, u8* tmpRow) {
+    constexpr int kSampleRows = 32;
+    if (h < kSampleRows * 4) {
+        return true;
+    }
+    int step = h / kSampleRows;
+    for (int y = step / 2; y < h; y += step) {
+        if (!QuantizeRow(samples + (size_t)y * stride, w, tmpRow)) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -52,3 +52,150 @@ u8 GetRed(COLORREF rgb);
 u8 GetGreen(COLORREF rgb);
 u8 GetBlue(COLORREF rgb);
 u8 GetAlpha(COLORREF rgb);
+
+// maps 32-bit pixels (RGBA or BGRA, alpha is ignored) to indices into a palette
+// of at most 256 colors, with fast paths for gray and repeated colors
+struct PaletteQuantizer {
+    // open-addressed hash from a 24-bit color (in RGBQUAD layout) to its palette index
+    // at most 256 colors so the load factor stays below 1/4
+    static constexpr int kSlots = 1024;
+    static constexpr u32 kEmpty = 0xffffffff;
+
+    u32 keys[kSlots];
+    u8 idxs[kSlots];
+    // in RGBQUAD layout, can be passed to SetDIBColorTable()
+    u32 colors[256]{};
+    int nColors = 0;
+
+    int grayIdxs[256];
+    u32 lastColor = kEmpty;
+    int lastIdx = -1;
+    int ri = 0;
+    int bi = 2;
+
+    explicit PaletteQuantizer(bool isBgr);
+
+    // returns -1 if c is not in the palette and the palette is full
+    int FindOrAdd(u32 c) {
+        u32 slot = (c * 0x9E3779B1) >> 22;
+        for (;;) {
+            u32 key = keys[slot];
+            if (key == c) {
+                return idxs[slot];
+            }
+            if (key == kEmpty) {
+                break;
+            }
+            slot = (slot + 1) & (kSlots - 1);
+        }
+        if (nColors == 256) {
+            return -1;
+        }
+        keys[slot] = c;
+        idxs[slot] = (u8)nColors;
+        colors[nColors] = c;
+        return nColors++;
+    }
+
+    int GrayIdx(u8 v) {
+        int k = grayIdxs[v];
+        if (k < 0) {
+            k = FindOrAdd(v * 0x010101);
+            grayIdxs[v] = k;
+        }
+        return k;
+    }
+
+    int ColorIdx(const u8* s) {
+        u32 c = s[bi] | (s[1] << 8) | (s[ri] << 16);
+        if (c != lastColor) {
+            lastIdx = FindOrAdd(c);
+            lastColor = c;
+        }
+        return lastIdx;
+    }
+
+    int PixelIdx(const u8* s) {
+        if (s[0] == s[1] && s[1] == s[2]) {
+            return GrayIdx(s[0]);
+        }
+        return ColorIdx(s);
+    }
+
+    bool QuantizeRow(const u8* s, int w, u8* dest);
+    bool SampleRows(const u8* samples, int w, int h, int stride, u8* tmpRow);
+};
+
+// run-length encoding of n pixels of type T: a control byte c < 128 is followed
+// by c + 1 literal pixels, c >= 128 by a single pixel repeated c - 126 times
+// returns 0 if the result doesn't fit into dstSize bytes
+template <typename T>
+size_t RleEncode(const T* src, size_t n, u8* dst, size_t dstSize) {
+    u8* d = dst;
+    u8* end = dst + dstSize;
+    size_t i = 0;
+    while (i < n) {
+        size_t run = 1;
+        while (i + run < n && run < 129 && src[i + run] == src[i]) {
+            run++;
+        }
+        if (run > 1) {
+            if (d + 1 + sizeof(T) > end) {
+                return 0;
+            }
+            *d++ = (u8)(run + 126);
+            memcpy(d, &src[i], sizeof(T));
+            d += sizeof(T);
+            i += run;
+            continue;
+        }
+        // literal pixels up to the start of the next run
+        size_t lit = 1;
+        while (i + lit < n && lit < 128 && !(i + lit + 1 < n && src[i + lit] == src[i + lit + 1])) {
+            lit++;
+        }
+        if (d + 1 + lit * sizeof(T) > end) {
+            return 0;
+        }
+        *d++ = (u8)(lit - 1);
+        memcpy(d, &src[i], lit * sizeof(T));
+        d += lit * sizeof(T);
+        i += lit;
+    }
+    return d - dst;
+}
+
+// returns false if s is not a valid encoding of exactly n pixels
+template <typename T>
+bool RleDecode(const u8* s, size_t size, T* dst, size_t n) {
+    const u8* end = s + size;
+    size_t i = 0;
+    while (i < n) {
+        if (s >= end) {
+            return false;
+        }
+        u8 c = *s++;
+        if (c < 128) {
+            size_t lit = c + 1;
+            if (i + lit > n || s + lit * sizeof(T) > end) {
+                return false;
+            }
+            memcpy(&dst[i], s, lit * sizeof(T));
+            s += lit * sizeof(T);
+            i += lit;
+            continue;
+        }
+        size_t run = c - 126;
+        if (i + run > n || s + sizeof(T) > end) {
+            return false;
+        }
+        T v;
+        memcpy(&v, s, sizeof(T));
+        s += sizeof(T);
+        for (size_t j = 0; j < run; j++) {
+            dst[i + j] = v;
+        }
+        i += run;
+    }
+    return true;
+}
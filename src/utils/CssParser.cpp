@@ -235,3 +235,219 @@ GetNextProperty:
 
     return &prop;
 }
+
+// parses size in the form "1em", "3pt" or "15px"
+static void ParseSizeWithUnit(const char* s, size_t len, float* size, StyleRule::Unit* unit) {
+    if (str::Parse(s, len, "%fem", size)) {
+        *unit = StyleRule::em;
+    } else if (str::Parse(s, len, "%fin", size)) {
+        *unit = StyleRule::pt;
+        *size *= 72; // 1 inch is 72 points
+    } else if (str::Parse(s, len, "%fpt", size)) {
+        *unit = StyleRule::pt;
+    } else if (str::Parse(s, len, "%fpx", size)) {
+        *unit = StyleRule::px;
+    } else {
+        *unit = StyleRule::inherit;
+    }
+}
+
+StyleRule StyleRule::Parse(CssPullParser* parser) {
+    StyleRule rule;
+    const CssProperty* prop;
+    while ((prop = parser->NextProperty()) != nullptr) {
+        switch (prop->type) {
+            case Css_Text_Align:
+                rule.textAlign = FindAlignAttr(prop->s, prop->sLen);
+                break;
+            // TODO: some documents use Css_Padding_Left for indentation
+            case Css_Text_Indent:
+                ParseSizeWithUnit(prop->s, prop->sLen, &rule.textIndent, &rule.textIndentUnit);
+                break;
+        }
+    }
+    return rule;
+}
+
+StyleRule StyleRule::Parse(const char* s, size_t len) {
+    CssPullParser parser(s, len);
+    return Parse(&parser);
+}
+
+void StyleRule::Merge(StyleRule& source) {
+    if (source.textAlign != AlignAttr::NotFound) {
+        textAlign = source.textAlign;
+    }
+    if (source.textIndentUnit != StyleRule::inherit) {
+        textIndent = source.textIndent;
+        textIndentUnit = source.textIndentUnit;
+    }
+}
+
+static u32 StyleRuleHash(HtmlTag tag, u32 classHash) {
+    // classHash is already well distributed, mix in the tag
+    u32 h = classHash ^ ((u32)tag * 0x9E3779B1);
+    h ^= h >> 16;
+    return h;
+}
+
+// size of hash tables is a power of 2, kept at most half full
+static int StyleHashTableSize(int nEntries) {
+    int size = 16;
+    while (size < nEntries * 2) {
+        size *= 2;
+    }
+    return size;
+}
+
+static void AddToStyleRulesIndex(Vec<int>& index, Vec<StyleRule>& rules, int ruleIdx) {
+    StyleRule& rule = rules.at(ruleIdx);
+    int mask = index.isize() - 1;
+    int slot = (int)(StyleRuleHash(rule.tag, rule.classHash) & (u32)mask);
+    while (index[slot] != -1) {
+        slot = (slot + 1) & mask;
+    }
+    index[slot] = ruleIdx;
+}
+
+static void RebuildStyleRulesIndex(Vec<int>& index, Vec<StyleRule>& rules) {
+    index.Reset();
+    int size = StyleHashTableSize(rules.isize());
+    for (int i = 0; i < size; i++) {
+        index.Append(-1);
+    }
+    for (int i = 0; i < rules.isize(); i++) {
+        AddToStyleRulesIndex(index, rules, i);
+    }
+}
+
+StyleRule* StyleRules::Find(HtmlTag tag, u32 classHash) {
+    if (index.size() == 0) {
+        return nullptr;
+    }
+    int mask = index.isize() - 1;
+    int slot = (int)(StyleRuleHash(tag, classHash) & (u32)mask);
+    for (;;) {
+        int idx = index[slot];
+        if (idx == -1) {
+            return nullptr;
+        }
+        StyleRule& rule = rules.at(idx);
+        if (tag == rule.tag && classHash == rule.classHash) {
+            return &rule;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+StyleRule* StyleRules::Find(HtmlTag tag, const char* clazz, size_t clazzLen) {
+    u32 classHash = clazz ? MurmurHash2(clazz, clazzLen) : 0;
+    return Find(tag, classHash);
+}
+
+void StyleRules::Reset() {
+    rules.Reset();
+    index.Reset();
+    computed.Reset();
+    nComputed = 0;
+}
+
+void StyleRules::ParseStyleSheet(const char* data, size_t len) {
+    CssPullParser parser(data, len);
+    while (parser.NextRule()) {
+        StyleRule rule = StyleRule::Parse(&parser);
+        const CssSelector* sel;
+        while ((sel = parser.NextSelector()) != nullptr) {
+            if (Tag_NotFound == sel->tag) {
+                continue;
+            }
+            StyleRule* prevRule = Find(sel->tag, sel->clazz, sel->clazzLen);
+            if (prevRule) {
+                prevRule->Merge(rule);
+            } else {
+                rule.tag = sel->tag;
+                rule.classHash = sel->clazz ? MurmurHash2(sel->clazz, sel->clazzLen) : 0;
+                rules.Append(rule);
+                if (rules.isize() * 2 > index.isize()) {
+                    RebuildStyleRulesIndex(index, rules);
+                } else {
+                    AddToStyleRulesIndex(index, rules, rules.isize() - 1);
+                }
+            }
+        }
+    }
+    // previously computed styles might have changed
+    computed.Reset();
+    nComputed = 0;
+}
+
+// returns the slot for (tag, classHash) in computed, which
+// has Tag_NotFound as tag if the style hasn't been computed yet
+static int FindComputedStyleSlot(Vec<StyleRule>& computed, HtmlTag tag, u32 classHash) {
+    int mask = computed.isize() - 1;
+    int slot = (int)(StyleRuleHash(tag, classHash) & (u32)mask);
+    for (;;) {
+        StyleRule& rule = computed.at(slot);
+        if (rule.tag == Tag_NotFound || (tag == rule.tag && classHash == rule.classHash)) {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+StyleRule StyleRules::ComputeStyle(HtmlTag tag, const char* clazz, size_t clazzLen) {
+    u32 classHash = clazz ? MurmurHash2(clazz, clazzLen) : 0;
+
+    // the result only depends on the tag and the class (and not on
+    // enclosing tags), so it can be re-used for all tags with the same
+    // tag and class until a new style sheet is parsed
+    if (nComputed * 2 >= computed.isize()) {
+        Vec<StyleRule> prev(computed);
+        computed.Reset();
+        computed.AppendBlanks(StyleHashTableSize(nComputed + 1));
+        for (StyleRule& rule : computed) {
+            rule.tag = Tag_NotFound;
+        }
+        for (StyleRule& rule : prev) {
+            if (rule.tag != Tag_NotFound) {
+                int slot = FindComputedStyleSlot(computed, rule.tag, rule.classHash);
+                computed[slot] = rule;
+            }
+        }
+    }
+
+    int slot = FindComputedStyleSlot(computed, tag, classHash);
+    if (computed[slot].tag != Tag_NotFound) {
+        return computed[slot];
+    }
+
+    // get style rules ordered by specificity
+    StyleRule rule;
+    StyleRule* prevRule = Find(Tag_Body, 0);
+    if (prevRule) {
+        rule.Merge(*prevRule);
+    }
+    prevRule = Find(Tag_Any, 0);
+    if (prevRule) {
+        rule.Merge(*prevRule);
+    }
+    prevRule = Find(tag, 0);
+    if (prevRule) {
+        rule.Merge(*prevRule);
+    }
+    if (clazz) {
+        prevRule = Find(Tag_Any, classHash);
+        if (prevRule) {
+            rule.Merge(*prevRule);
+        }
+        prevRule = Find(tag, classHash);
+        if (prevRule) {
+            rule.Merge(*prevRule);
+        }
+    }
+    rule.tag = tag;
+    rule.classHash = classHash;
+    computed[slot] = rule;
+    nComputed++;
+    return rule;
+}
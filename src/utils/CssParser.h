@@ -45,3 +45,43 @@ class CssPullParser {
     const CssSelector* NextSelector();
     const CssProperty* NextProperty();
 };
+
+// style properties (as far as they're supported) that a style sheet
+// or a style attribute sets for a tag (Tag_Any for all tags) and class
+struct StyleRule {
+    HtmlTag tag = Tag_NotFound;
+    u32 classHash = 0;
+
+    enum Unit { px, pt, em, inherit };
+
+    float textIndent = 0;
+    Unit textIndentUnit = inherit;
+    AlignAttr textAlign = AlignAttr::NotFound;
+
+    StyleRule() = default;
+
+    void Merge(StyleRule& source);
+
+    static StyleRule Parse(CssPullParser* parser);
+    static StyleRule Parse(const char* s, size_t len);
+};
+
+// the rules of all style sheets of a document
+class StyleRules {
+  public:
+    Vec<StyleRule> rules;
+    // hash table (with linear probing) of indexes into rules
+    // by (tag, classHash), -1 for empty slots
+    Vec<int> index;
+    // memoized results of ComputeStyle() by (tag, classHash), only
+    // valid until rules change. tag is Tag_NotFound for empty slots
+    Vec<StyleRule> computed;
+    int nComputed = 0;
+
+    void ParseStyleSheet(const char* data, size_t len);
+    StyleRule* Find(HtmlTag tag, const char* clazz, size_t clazzLen);
+    StyleRule* Find(HtmlTag tag, u32 classHash);
+    // merges all rules that apply to tag with class clazz (which can be nullptr)
+    StyleRule ComputeStyle(HtmlTag tag, const char* clazz, size_t clazzLen);
+    void Reset();
+};
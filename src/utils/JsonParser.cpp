@@ -248,4 +248,19 @@ bool Parse(const char* data, ValueVisitor* visitor) {
     return args.canceled || !*SkipWS(end);
 }
 
+void AppendString(str::Str& out, const char* s) {
+    out.AppendChar('"');
+    for (const char* c = s; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            out.AppendChar('\\');
+        }
+        if ((u8)*c < 0x20) {
+            out.AppendFmt("\\u%04x", (int)*c);
+            continue;
+        }
+        out.AppendChar(*c);
+    }
+    out.AppendChar('"');
+}
+
 } // namespace json
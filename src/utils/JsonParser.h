@@ -27,4 +27,7 @@ class ValueVisitor {
 // returns false on error
 bool Parse(const char* data, ValueVisitor* visitor);
 
+// appends s as a quoted and escaped JSON string
+void AppendString(str::Str& out, const char* s);
+
 } // namespace json
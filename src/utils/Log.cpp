@@ -6,6 +6,7 @@
 #include "utils/ScopedWin.h"
 #include "utils/WinUtil.h"
 #include "utils/FileUtil.h"
+#include "utils/Timer.h"
 
 constexpr const WCHAR* kPipeName = L"\\\\.\\pipe\\SumatraPDFLogger";
 
@@ -39,6 +40,95 @@ char* gLogFilePath = nullptr;
 // 1 MB - 128 to stay under 1 MB even after appending (an estimate)
 constexpr int kMaxLogBuf = 1024 * 1024 - 128;
 
+/*
+Asynchronous logging
+
+After StartAsyncLogging(), log() and logf() don't format or write anything.
+Instead, the calling thread appends a binary record (the format string and
+copies of the arguments) to its own ring buffer, without taking any locks.
+A background thread drains the ring buffers every kLogWriterIntervalMs (or
+sooner, when one of them is half full), formats the records in timestamp
+order and writes them to gLogBuf, console, log file and logview pipe.
+
+Memory is bounded: each thread that logs gets a single ring buffer of
+kLogRingSize bytes, which is freed after the thread exits and its records
+have been written. When a ring buffer is full, the message is dropped
+(logging never blocks) and the number of dropped messages is logged once
+there's space again.
+Messages larger than kMaxLogRecordSize or with format specifiers we don't
+know how to copy (e.g. %n) are formatted and logged synchronously.
+*/
+
+// must be a power of 2
+constexpr u32 kLogRingSize = 64 * 1024;
+constexpr int kMaxLogRecordSize = 2 * 1024;
+constexpr DWORD kLogWriterIntervalMs = 50;
+
+enum class LogArg : u8 {
+    Int,
+    Long,
+    LongLong,
+    SizeT,
+    Double,
+    Ptr,
+    Str,
+    WStr,
+};
+
+constexpr u16 kLogRecordPadding = 0x1;
+// record is text to log as is (not a format string)
+constexpr u16 kLogRecordPlain = 0x2;
+// log even if the same line was logged before
+constexpr u16 kLogRecordAlways = 0x4;
+
+struct LogRecord {
+    // size of the whole record, multiple of 8
+    u32 size;
+    u16 flags;
+    u16 reserved;
+    i64 time;
+    // followed by zero-terminated format string and arguments
+};
+
+struct LogRing {
+    // kLogRingSize bytes
+    u8* data = nullptr;
+    // only written by the thread that owns the ring
+    volatile LONG head = 0;
+    // only written by the thread that drains the ring
+    volatile LONG tail = 0;
+    volatile LONG nDropped = 0;
+    // set when the owning thread exits
+    volatile LONG isOrphaned = 0;
+    DWORD threadId = 0;
+    // records are built here before being copied into data
+    u8 scratch[kMaxLogRecordSize];
+};
+
+struct LogRingOwner {
+    LogRing* ring = nullptr;
+    ~LogRingOwner() {
+        if (ring) {
+            InterlockedExchange(&ring->isOrphaned, 1);
+        }
+    }
+};
+
+thread_local static LogRingOwner gThreadLogRing;
+
+// rings of all threads that have logged
+static Vec<LogRing*>* gLogRings = nullptr;
+static Mutex gLogRingsMutex;
+// serializes draining of rings (by the writer thread and FlushLogs())
+static Mutex gLogDrainMutex;
+static HANDLE gLogWriterThread = nullptr;
+static HANDLE gLogWakeEvent = nullptr;
+static bool gLogWriterStop = false;
+
+bool gLogAsync = false;
+// number of messages dropped because a ring buffer was full
+LONG gLogDroppedCount = 0;
+
 #if 0
 // TODO: add more codes
 static const char* getWinError(DWORD errCode) {
@@ -116,7 +206,7 @@ static void logToPipe(const char* s, size_t n = 0) {
     }
 }
 
-void log(const char* s, bool always) {
+static void logSync(const char* s, bool always) {
     bool skipLog = !always && gSkipDuplicateLines && gLogBuf && gLogBuf->Contains(s);
 
     if (!skipLog) {
@@ -179,6 +269,503 @@ void log(const char* s, bool always) {
     gLogMutex.Unlock();
 }
 
+static LogRing* GetThreadLogRing() {
+    LogRing* ring = gThreadLogRing.ring;
+    if (ring) {
+        return ring;
+    }
+    ring = (LogRing*)calloc(1, sizeof(LogRing));
+    u8* data = (u8*)malloc(kLogRingSize);
+    if (!ring || !data) {
+        free(ring);
+        free(data);
+        return nullptr;
+    }
+    ring->data = data;
+    ring->threadId = GetCurrentThreadId();
+    gLogRingsMutex.Lock();
+    if (!gLogRings) {
+        gLogRings = new Vec<LogRing*>();
+    }
+    gLogRings->Append(ring);
+    gLogRingsMutex.Unlock();
+    gThreadLogRing.ring = ring;
+    return ring;
+}
+
+struct LogRecordWriter {
+    u8* d = nullptr;
+    int pos = 0;
+    bool overflow = false;
+
+    void Write(const void* p, int n) {
+        if (pos + n > kMaxLogRecordSize) {
+            overflow = true;
+            return;
+        }
+        memcpy(d + pos, p, (size_t)n);
+        pos += n;
+    }
+    template <typename T>
+    void WriteArg(LogArg type, T v) {
+        Write(&type, 1);
+        Write(&v, (int)sizeof(v));
+    }
+    void WriteStr(LogArg type, const void* s, int nBytes) {
+        u32 n = (u32)nBytes;
+        Write(&type, 1);
+        Write(&n, (int)sizeof(n));
+        Write(s, nBytes);
+    }
+};
+
+// parses printf-style format specification (s points after '%')
+// returns the end of the specification or nullptr if not supported
+static const char* ParseFmtSpec(const char* s, int& nStars, LogArg& type) {
+    nStars = 0;
+    while (*s && str::FindChar("-+ #0", *s)) {
+        s++;
+    }
+    if (*s == '*') {
+        nStars++;
+        s++;
+    }
+    while (str::IsDigit(*s)) {
+        s++;
+    }
+    if (*s == '.') {
+        s++;
+        if (*s == '*') {
+            nStars++;
+            s++;
+        }
+        while (str::IsDigit(*s)) {
+            s++;
+        }
+    }
+
+    enum { None, Long, LongLong, SizeT, Wide } len = None;
+    if (*s == 'h') {
+        s += (s[1] == 'h') ? 2 : 1;
+    } else if (*s == 'l') {
+        len = (s[1] == 'l') ? LongLong : Long;
+        s += (s[1] == 'l') ? 2 : 1;
+    } else if (str::StartsWith(s, "I64")) {
+        len = LongLong;
+        s += 3;
+    } else if (str::StartsWith(s, "I32")) {
+        s += 3;
+    } else if (*s == 'I' || *s == 'z' || *s == 't') {
+        len = SizeT;
+        s++;
+    } else if (*s == 'j') {
+        len = LongLong;
+        s++;
+    } else if (*s == 'L') {
+        s++;
+    } else if (*s == 'w') {
+        len = Wide;
+        s++;
+    }
+
+    switch (*s) {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            type = (len == LongLong) ? LogArg::LongLong
+                   : (len == Long)   ? LogArg::Long
+                   : (len == SizeT)  ? LogArg::SizeT
+                                     : LogArg::Int;
+            break;
+        case 'c':
+        case 'C':
+            type = LogArg::Int;
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            type = LogArg::Double;
+            break;
+        case 'p':
+            type = LogArg::Ptr;
+            break;
+        case 's':
+            type = (len == Long || len == Wide) ? LogArg::WStr : LogArg::Str;
+            break;
+        case 'S':
+            type = LogArg::WStr;
+            break;
+        default:
+            return nullptr;
+    }
+    return s + 1;
+}
+
+// copies the format string and arguments into a record
+// returns false if the message has to be logged synchronously
+static bool BuildLogRecord(LogRecordWriter& w, const char* fmt, va_list args) {
+    w.Write(fmt, (int)str::Len(fmt) + 1);
+    const char* s = fmt;
+    while (*s && !w.overflow) {
+        if (*s++ != '%') {
+            continue;
+        }
+        if (*s == '%') {
+            s++;
+            continue;
+        }
+        int nStars;
+        LogArg type;
+        s = ParseFmtSpec(s, nStars, type);
+        if (!s) {
+            return false;
+        }
+        for (int i = 0; i < nStars; i++) {
+            w.WriteArg(LogArg::Int, va_arg(args, int));
+        }
+        switch (type) {
+            case LogArg::Int:
+                w.WriteArg(type, va_arg(args, int));
+                break;
+            case LogArg::Long:
+                w.WriteArg(type, va_arg(args, long));
+                break;
+            case LogArg::LongLong:
+                w.WriteArg(type, va_arg(args, long long));
+                break;
+            case LogArg::SizeT:
+                w.WriteArg(type, va_arg(args, size_t));
+                break;
+            case LogArg::Double:
+                w.WriteArg(type, va_arg(args, double));
+                break;
+            case LogArg::Ptr:
+                w.WriteArg(type, va_arg(args, void*));
+                break;
+            case LogArg::Str: {
+                const char* str = va_arg(args, const char*);
+                if (!str) {
+                    str = "(null)";
+                }
+                w.WriteStr(type, str, (int)str::Len(str) + 1);
+                break;
+            }
+            case LogArg::WStr: {
+                const WCHAR* str = va_arg(args, const WCHAR*);
+                if (!str) {
+                    str = L"(null)";
+                }
+                w.WriteStr(type, str, ((int)str::Len(str) + 1) * (int)sizeof(WCHAR));
+                break;
+            }
+        }
+    }
+    return !w.overflow;
+}
+
+static void PushLogRecord(LogRing* ring, const u8* rec, u32 size) {
+    u32 head = (u32)ring->head;
+    u32 tail = (u32)InterlockedCompareExchange(&ring->tail, 0, 0);
+    u32 off = head & (kLogRingSize - 1);
+    u32 toEnd = kLogRingSize - off;
+    // records are not split, so the rest of the ring is skipped if it's too small
+    u32 needed = (size > toEnd) ? toEnd + size : size;
+    if (head - tail + needed > kLogRingSize) {
+        InterlockedIncrement(&ring->nDropped);
+        InterlockedIncrement(&gLogDroppedCount);
+        return;
+    }
+    if (size > toEnd) {
+        auto pad = (LogRecord*)(ring->data + off);
+        pad->size = toEnd;
+        pad->flags = kLogRecordPadding;
+        head += toEnd;
+        off = 0;
+    }
+    memcpy(ring->data + off, rec, size);
+    head += size;
+    InterlockedExchange(&ring->head, (LONG)head);
+    if (head - tail > kLogRingSize / 2) {
+        SetEvent(gLogWakeEvent);
+    }
+}
+
+// returns false if the message has to be logged synchronously
+static bool logAsync(const char* s, va_list* args, bool always) {
+    if (!gLogAsync || gReducedLogging || gStopLogging) {
+        return false;
+    }
+    LogRing* ring = GetThreadLogRing();
+    if (!ring) {
+        return false;
+    }
+    LogRecordWriter w;
+    w.d = ring->scratch;
+    LogRecord rec{};
+    w.Write(&rec, (int)sizeof(rec));
+    bool ok;
+    if (args) {
+        ok = BuildLogRecord(w, s, *args);
+    } else {
+        rec.flags |= kLogRecordPlain;
+        w.Write(s, (int)str::Len(s) + 1);
+        ok = !w.overflow;
+    }
+    if (!ok) {
+        return false;
+    }
+    int size = (w.pos + 7) & ~7;
+    if (size > kMaxLogRecordSize) {
+        return false;
+    }
+    rec.size = (u32)size;
+    rec.flags |= always ? kLogRecordAlways : 0;
+    rec.time = TimeGet().QuadPart;
+    memcpy(ring->scratch, &rec, sizeof(rec));
+    PushLogRecord(ring, ring->scratch, (u32)size);
+    return true;
+}
+
+template <typename T>
+static void AppendFmtSpec(str::Str& out, const char* spec, int nStars, const int* stars, T v) {
+    switch (nStars) {
+        case 0:
+            out.AppendFmt(spec, v);
+            break;
+        case 1:
+            out.AppendFmt(spec, stars[0], v);
+            break;
+        default:
+            out.AppendFmt(spec, stars[0], stars[1], v);
+            break;
+    }
+}
+
+template <typename T>
+static T ReadLogArg(const u8*& a) {
+    T v;
+    memcpy(&v, a + 1, sizeof(v));
+    a += 1 + sizeof(v);
+    return v;
+}
+
+static const void* ReadLogStrArg(const u8*& a) {
+    u32 n;
+    memcpy(&n, a + 1, sizeof(n));
+    const void* s = a + 1 + sizeof(n);
+    a += 1 + sizeof(n) + n;
+    return s;
+}
+
+// inverse of BuildLogRecord()
+static void FormatLogRecord(const LogRecord* rec, str::Str& out) {
+    const char* fmt = (const char*)(rec + 1);
+    if (rec->flags & kLogRecordPlain) {
+        out.Append(fmt);
+        return;
+    }
+    const u8* a = (const u8*)fmt + str::Len(fmt) + 1;
+    const char* s = fmt;
+    while (*s) {
+        const char* start = s;
+        while (*s && *s != '%') {
+            s++;
+        }
+        out.Append(start, s - start);
+        if (!*s) {
+            break;
+        }
+        start = s++;
+        if (*s == '%') {
+            out.AppendChar('%');
+            s++;
+            continue;
+        }
+        int nStars;
+        LogArg type;
+        s = ParseFmtSpec(s, nStars, type);
+        char spec[32];
+        int specLen = (int)(s - start);
+        if (specLen >= (int)sizeof(spec)) {
+            out.Append(start, specLen);
+            continue;
+        }
+        memcpy(spec, start, specLen);
+        spec[specLen] = 0;
+        int stars[2]{};
+        for (int i = 0; i < nStars; i++) {
+            stars[i] = ReadLogArg<int>(a);
+        }
+        switch (type) {
+            case LogArg::Int:
+                AppendFmtSpec(out, spec, nStars, stars, ReadLogArg<int>(a));
+                break;
+            case LogArg::Long:
+                AppendFmtSpec(out, spec, nStars, stars, ReadLogArg<long>(a));
+                break;
+            case LogArg::LongLong:
+                AppendFmtSpec(out, spec, nStars, stars, ReadLogArg<long long>(a));
+                break;
+            case LogArg::SizeT:
+                AppendFmtSpec(out, spec, nStars, stars, ReadLogArg<size_t>(a));
+                break;
+            case LogArg::Double:
+                AppendFmtSpec(out, spec, nStars, stars, ReadLogArg<double>(a));
+                break;
+            case LogArg::Ptr:
+                AppendFmtSpec(out, spec, nStars, stars, ReadLogArg<void*>(a));
+                break;
+            case LogArg::Str:
+                AppendFmtSpec(out, spec, nStars, stars, (const char*)ReadLogStrArg(a));
+                break;
+            case LogArg::WStr:
+                AppendFmtSpec(out, spec, nStars, stars, (const WCHAR*)ReadLogStrArg(a));
+                break;
+        }
+    }
+}
+
+struct PendingLogRecord {
+    LogRecord* rec;
+    int ringIdx;
+};
+
+// formats fmt and its arguments the way asynchronous logging does it i.e. by
+// copying them into a record and formatting the record (used by tests)
+// returns false for messages that would be logged synchronously
+bool FormatAsLogRecord(str::Str& out, const char* fmt, ...) {
+    alignas(8) u8 d[kMaxLogRecordSize];
+    LogRecordWriter w;
+    w.d = d;
+    LogRecord rec{};
+    w.Write(&rec, (int)sizeof(rec));
+    va_list args;
+    va_start(args, fmt);
+    bool ok = BuildLogRecord(w, fmt, args);
+    va_end(args);
+    if (!ok) {
+        return false;
+    }
+    rec.size = (u32)w.pos;
+    memcpy(d, &rec, sizeof(rec));
+    FormatLogRecord((const LogRecord*)d, out);
+    return true;
+}
+
+// writes out all records queued so far
+// note: while handling a crash (gReducedLogging) we don't risk formatting
+// and allocating, which is why DumpExceptionHandler() flushes the logs
+// before setting gReducedLogging
+void FlushLogs() {
+    if (!gLogRings || gReducedLogging) {
+        return;
+    }
+    gLogDrainMutex.Lock();
+
+    // only drainers remove rings, so it's safe to use a copy of the list
+    gLogRingsMutex.Lock();
+    Vec<LogRing*> rings(*gLogRings);
+    gLogRingsMutex.Unlock();
+
+    Vec<PendingLogRecord> pending;
+    Vec<u32> newTails;
+    int nRings = rings.isize();
+    for (int i = 0; i < nRings; i++) {
+        LogRing* ring = rings[i];
+        u32 tail = (u32)ring->tail;
+        u32 head = (u32)InterlockedCompareExchange(&ring->head, 0, 0);
+        while (tail != head) {
+            auto rec = (LogRecord*)(ring->data + (tail & (kLogRingSize - 1)));
+            if (!(rec->flags & kLogRecordPadding)) {
+                pending.Append({rec, i});
+            }
+            tail += rec->size;
+        }
+        newTails.Append(tail);
+    }
+
+    // records of a single thread are already ordered by time
+    std::stable_sort(pending.begin(), pending.end(), [](const PendingLogRecord& r1, const PendingLogRecord& r2) {
+        return r1.rec->time < r2.rec->time;
+    });
+
+    str::Str s;
+    for (auto& p : pending) {
+        s.Reset();
+        FormatLogRecord(p.rec, s);
+        logSync(s.Get(), (p.rec->flags & kLogRecordAlways) != 0);
+    }
+
+    for (int i = 0; i < nRings; i++) {
+        LogRing* ring = rings[i];
+        InterlockedExchange(&ring->tail, (LONG)newTails[i]);
+        LONG nDropped = InterlockedExchange(&ring->nDropped, 0);
+        if (nDropped > 0) {
+            char buf[128];
+            str::BufFmt(buf, dimof(buf), "log: dropped %d messages from thread %d\n", (int)nDropped,
+                        (int)ring->threadId);
+            logSync(buf, true);
+        }
+        bool isDone = ring->isOrphaned && (u32)InterlockedCompareExchange(&ring->head, 0, 0) == newTails[i];
+        if (isDone) {
+            gLogRingsMutex.Lock();
+            gLogRings->Remove(ring);
+            gLogRingsMutex.Unlock();
+            free(ring->data);
+            free(ring);
+        }
+    }
+    gLogDrainMutex.Unlock();
+}
+
+static DWORD WINAPI LogWriterThread(void*) {
+    SetThreadName("LogWriterThread");
+    while (!gLogWriterStop) {
+        WaitForSingleObject(gLogWakeEvent, kLogWriterIntervalMs);
+        FlushLogs();
+    }
+    return 0;
+}
+
+// switches log() and logf() to asynchronous logging (see the comment at the top)
+void StartAsyncLogging() {
+    if (gLogWriterThread) {
+        return;
+    }
+    gLogWakeEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    gLogWriterThread = CreateThread(nullptr, 0, LogWriterThread, nullptr, 0, nullptr);
+    gLogAsync = gLogWakeEvent && gLogWriterThread;
+}
+
+static void StopAsyncLogging() {
+    if (!gLogWriterThread) {
+        return;
+    }
+    gLogAsync = false;
+    gLogWriterStop = true;
+    SetEvent(gLogWakeEvent);
+    WaitForSingleObject(gLogWriterThread, 1000);
+    CloseHandle(gLogWriterThread);
+    CloseHandle(gLogWakeEvent);
+    gLogWriterThread = nullptr;
+    gLogWakeEvent = nullptr;
+    FlushLogs();
+}
+
+void log(const char* s, bool always) {
+    if (!logAsync(s, nullptr, always)) {
+        logSync(s, always);
+    }
+}
+
 void logf(const char* fmt, ...) {
     if (gReducedLogging || gStopLogging) {
         return;
@@ -186,8 +773,13 @@ void logf(const char* fmt, ...) {
 
     va_list args;
     va_start(args, fmt);
-    AutoFreeStr s = str::FmtV(fmt, args);
-    log(s.Get(), false);
+    va_list args2;
+    va_copy(args2, args);
+    if (!logAsync(fmt, &args2, false)) {
+        AutoFreeStr s = str::FmtV(fmt, args);
+        logSync(s.Get(), false);
+    }
+    va_end(args2);
     va_end(args);
 }
 
@@ -198,8 +790,13 @@ void logfa(const char* fmt, ...) {
 
     va_list args;
     va_start(args, fmt);
-    AutoFreeStr s = str::FmtV(fmt, args);
-    log(s.Get(), true);
+    va_list args2;
+    va_copy(args2, args);
+    if (!logAsync(fmt, &args2, true)) {
+        AutoFreeStr s = str::FmtV(fmt, args);
+        logSync(s.Get(), true);
+    }
+    va_end(args2);
     va_end(args);
 }
 
@@ -212,6 +809,10 @@ void StartLogToFile(const char* path, bool removeIfExists) {
 }
 
 bool WriteCurrentLogToFile(const char* path) {
+    FlushLogs();
+    if (!gLogBuf) {
+        return false;
+    }
     ByteSlice slice = gLogBuf->AsByteSlice();
     if (slice.empty()) {
         return false;
@@ -221,6 +822,7 @@ bool WriteCurrentLogToFile(const char* path) {
 }
 
 void DestroyLogging() {
+    StopAsyncLogging();
     gStopLogging = true;
     gLogMutex.Lock();
     delete gLogBuf;
@@ -10,8 +10,13 @@ extern bool gLogToPipe;
 extern bool gStopLogging;
 extern const char* gLogAppName;
 extern char* gLogFilePath;
+extern bool gLogAsync;
+extern LONG gLogDroppedCount;
 void StartLogToFile(const char* path, bool removeIfExists);
 bool WriteCurrentLogToFile(const char* path);
+void StartAsyncLogging();
+void FlushLogs();
+bool FormatAsLogRecord(str::Str& out, const char* fmt, ...);
 
 /*
 If you do:
@@ -67,6 +67,25 @@ class ThreadBase {
     virtual void Run() = 0;
 };
 
+// calls pump() until isDone() returns true. Several threads can wait at the
+// same time: whoever holds cs pumps (and handles messages for everyone), the
+// others re-check their condition before waiting, so that no completion gets
+// lost as long as a job's status is updated before the message about it is posted
+template <typename IsDone, typename Pump>
+void PumpUntil(CRITICAL_SECTION* cs, const IsDone& isDone, const Pump& pump) {
+    while (!isDone()) {
+        EnterCriticalSection(cs);
+        bool done = isDone();
+        if (!done) {
+            pump();
+        }
+        LeaveCriticalSection(cs);
+        if (done) {
+            break;
+        }
+    }
+}
+
 void SetThreadName(const char* threadName, DWORD threadId = 0);
 
 void RunAsync(const std::function<void()>&);
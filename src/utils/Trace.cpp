@@ -0,0 +1,175 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+#include "utils/BaseUtil.h"
+#include "utils/ThreadUtil.h"
+#include "utils/FileUtil.h"
+#include "utils/JsonParser.h"
+
+#include "utils/Trace.h"
+
+#include "utils/Log.h"
+
+bool gTraceEnabled = false;
+
+// events are stored in per-thread buffers made of fixed-size chunks
+// so that recording never re-allocates (and never moves) events
+// that WriteTraceToFile() might be reading from another thread
+constexpr int kTraceEventsPerChunk = 4096;
+// caps memory use at ~4 MB per thread
+constexpr int kTraceMaxChunks = 32;
+
+struct TraceEvent {
+    const char* name;
+    i64 start;
+    // -1 for instant events
+    i64 dur;
+    int pageNo;
+};
+
+struct TraceBuffer {
+    TraceEvent* chunks[kTraceMaxChunks] = {};
+    // number of recorded events, only written by the owning thread
+    volatile LONG nEvents = 0;
+    volatile LONG nDropped = 0;
+    // events recorded in an earlier TraceStart() session are stale
+    LONG generation = 0;
+    DWORD threadId = 0;
+};
+
+thread_local static TraceBuffer* gThreadTraceBuffer = nullptr;
+
+// buffers of all threads that have ever recorded an event. they're
+// never freed because a thread might be recording while we write
+static Vec<TraceBuffer*>* gTraceBuffers = nullptr;
+static Mutex gTraceBuffersMutex;
+static volatile LONG gTraceGeneration = 0;
+static i64 gTraceStartTime = 0;
+
+i64 TraceTimeNow() {
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return t.QuadPart;
+}
+
+static TraceBuffer* GetThreadTraceBuffer() {
+    TraceBuffer* buf = gThreadTraceBuffer;
+    if (buf) {
+        return buf;
+    }
+    buf = new TraceBuffer();
+    buf->threadId = GetCurrentThreadId();
+    buf->generation = gTraceGeneration;
+    gTraceBuffersMutex.Lock();
+    if (!gTraceBuffers) {
+        gTraceBuffers = new Vec<TraceBuffer*>();
+    }
+    gTraceBuffers->Append(buf);
+    gTraceBuffersMutex.Unlock();
+    gThreadTraceBuffer = buf;
+    return buf;
+}
+
+void TraceRecord(const char* name, i64 start, i64 dur, int pageNo) {
+    if (!gTraceEnabled) {
+        return;
+    }
+    TraceBuffer* buf = GetThreadTraceBuffer();
+    LONG generation = gTraceGeneration;
+    if (buf->generation != generation) {
+        // chunks are re-used for the new session
+        buf->generation = generation;
+        InterlockedExchange(&buf->nDropped, 0);
+        InterlockedExchange(&buf->nEvents, 0);
+    }
+    LONG n = buf->nEvents;
+    int chunkNo = n / kTraceEventsPerChunk;
+    if (chunkNo >= kTraceMaxChunks) {
+        InterlockedIncrement(&buf->nDropped);
+        return;
+    }
+    TraceEvent* chunk = buf->chunks[chunkNo];
+    if (!chunk) {
+        chunk = (TraceEvent*)malloc(sizeof(TraceEvent) * kTraceEventsPerChunk);
+        if (!chunk) {
+            InterlockedIncrement(&buf->nDropped);
+            return;
+        }
+        buf->chunks[chunkNo] = chunk;
+    }
+    TraceEvent& ev = chunk[n % kTraceEventsPerChunk];
+    ev.name = name;
+    ev.start = start;
+    ev.dur = dur;
+    ev.pageNo = pageNo;
+    // publish the event only after it has been fully written
+    InterlockedExchange(&buf->nEvents, n + 1);
+}
+
+// starts a new tracing session, discarding previously recorded events
+void TraceStart() {
+    InterlockedIncrement(&gTraceGeneration);
+    gTraceStartTime = TraceTimeNow();
+    gTraceEnabled = true;
+}
+
+void TraceStop() {
+    gTraceEnabled = false;
+}
+
+// writes events recorded in the current session in Chrome's trace
+// event format. can be called while tracing is still enabled
+bool WriteTraceToFile(const char* path) {
+    gTraceBuffersMutex.Lock();
+    Vec<TraceBuffer*> buffers;
+    if (gTraceBuffers) {
+        buffers.Append(gTraceBuffers->begin(), gTraceBuffers->size());
+    }
+    gTraceBuffersMutex.Unlock();
+
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    double usPerTick = 1000000.0 / (double)freq.QuadPart;
+    DWORD pid = GetCurrentProcessId();
+    LONG generation = gTraceGeneration;
+
+    str::Str s;
+    s.Append("{\"traceEvents\":[\n");
+    bool isFirst = true;
+    int nWritten = 0;
+    int nDropped = 0;
+    for (TraceBuffer* buf : buffers) {
+        if (buf->generation != generation) {
+            continue;
+        }
+        int n = (int)InterlockedCompareExchange(&buf->nEvents, 0, 0);
+        nDropped += (int)buf->nDropped;
+        for (int i = 0; i < n; i++) {
+            TraceEvent& ev = buf->chunks[i / kTraceEventsPerChunk][i % kTraceEventsPerChunk];
+            if (!isFirst) {
+                s.Append(",\n");
+            }
+            isFirst = false;
+            s.Append("{\"name\":");
+            json::AppendString(s, ev.name);
+            double ts = (double)(ev.start - gTraceStartTime) * usPerTick;
+            if (ev.dur < 0) {
+                s.AppendFmt(",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f", ts);
+            } else {
+                double dur = (double)ev.dur * usPerTick;
+                s.AppendFmt(",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f", ts, dur);
+            }
+            s.AppendFmt(",\"pid\":%d,\"tid\":%d", (int)pid, (int)buf->threadId);
+            if (ev.pageNo >= 0) {
+                s.AppendFmt(",\"args\":{\"pageNo\":%d}", ev.pageNo);
+            }
+            s.AppendChar('}');
+            nWritten++;
+        }
+    }
+    s.Append("\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    bool ok = file::WriteFile(path, s.AsByteSlice());
+    logf("WriteTraceToFile: wrote %d events (%d dropped) to '%s', ok: %d\n", nWritten, nDropped, path, (int)ok);
+    return ok;
+}
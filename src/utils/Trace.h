@@ -0,0 +1,47 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+// Lightweight tracing of hot paths. Spans are always compiled in but
+// only recorded while gTraceEnabled is set. Recorded events can be
+// written out in Chrome's trace event format and viewed in
+// chrome://tracing or https://ui.perfetto.dev
+
+extern bool gTraceEnabled;
+
+void TraceStart();
+void TraceStop();
+bool WriteTraceToFile(const char* path);
+
+i64 TraceTimeNow();
+void TraceRecord(const char* name, i64 start, i64 dur, int pageNo);
+
+// records a point-in-time event (e.g. a cache hit)
+inline void TraceInstant(const char* name, int pageNo = -1) {
+    if (gTraceEnabled) {
+        TraceRecord(name, TraceTimeNow(), -1, pageNo);
+    }
+}
+
+// records the time between construction and destruction
+struct TraceSpan {
+    const char* name = nullptr;
+    int pageNo = -1;
+    i64 start = 0;
+
+    explicit TraceSpan(const char* name, int pageNo = -1) {
+        if (gTraceEnabled) {
+            this->name = name;
+            this->pageNo = pageNo;
+            start = TraceTimeNow();
+        }
+    }
+    ~TraceSpan() {
+        if (name) {
+            TraceRecord(name, start, TraceTimeNow() - start, pageNo);
+        }
+    }
+};
+
+// name must be a string literal (or otherwise outlive the trace)
+#define TRACE_SPAN(name) TraceSpan CONCAT(traceSpan__, __LINE__)(name)
+#define TRACE_SPAN_PAGE(name, pageNo) TraceSpan CONCAT(traceSpan__, __LINE__)(name, pageNo)
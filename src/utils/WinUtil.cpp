@@ -10,6 +10,9 @@
 #include "utils/WinUtil.h"
 
 #include <mlang.h>
+#if IS_INTEL_32 || IS_INTEL_64
+#include <emmintrin.h>
+#endif
 
 #include "utils/Log.h"
 
@@ -1888,18 +1891,103 @@ BitmapPixels* GetBitmapPixels(HBITMAP hbmp) {
     return res;
 }
 
-void UpdateBitmapColors(HBITMAP hbmp, COLORREF textColor, COLORREF bgColor) {
-    if ((textColor & 0xFFFFFF) == WIN_COL_BLACK && (bgColor & 0xFFFFFF) == WIN_COL_WHITE) {
-        return;
-    }
+// per-channel lookup tables, in DIB order (blue, green, red, alpha), that
+// map black to the text color and white to the background color
+struct BitmapColorsLut {
+    u8 ch[4][256];
+};
 
-    // color order in DIB is blue-green-red-alpha
+static void BuildBitmapColorsLut(BitmapColorsLut& lut, COLORREF textColor, COLORREF bgColor) {
     byte rt, gt, bt;
     UnpackColor(textColor, rt, gt, bt);
     const int base[4] = {bt, gt, rt, 0};
     byte rb, gb, bb;
     UnpackColor(bgColor, rb, gb, bb);
-    int diff[4] = {(int)bb - base[0], (int)gb - base[1], (int)rb - base[2], 255};
+    const int diff[4] = {(int)bb - base[0], (int)gb - base[1], (int)rb - base[2], 255};
+    for (int k = 0; k < 4; k++) {
+        for (int i = 0; i < 256; i++) {
+            lut.ch[k][i] = (u8)(base[k] + mul255(i, diff[k]));
+        }
+    }
+}
+
+static inline u32 RecolorPixel32(const BitmapColorsLut& lut, u32 c) {
+    u32 b = lut.ch[0][c & 0xff];
+    u32 g = lut.ch[1][(c >> 8) & 0xff];
+    u32 r = lut.ch[2][(c >> 16) & 0xff];
+    u32 a = lut.ch[3][c >> 24];
+    return b | (g << 8) | (r << 16) | (a << 24);
+}
+
+static void RecolorPixels32(const BitmapColorsLut& lut, u8* data, size_t nPixels) {
+    u32* px = (u32*)data;
+    size_t i = 0;
+#if IS_INTEL_32 || IS_INTEL_64
+    // rendered pages are mostly flat areas (like the white background):
+    // when 4 pixels are the same, only one of them has to be looked up
+    for (; i + 4 <= nPixels; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(px + i));
+        __m128i first = _mm_shuffle_epi32(v, 0);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(v, first)) == 0xffff) {
+            u32 c = RecolorPixel32(lut, px[i]);
+            _mm_storeu_si128((__m128i*)(px + i), _mm_set1_epi32((int)c));
+            continue;
+        }
+        px[i] = RecolorPixel32(lut, px[i]);
+        px[i + 1] = RecolorPixel32(lut, px[i + 1]);
+        px[i + 2] = RecolorPixel32(lut, px[i + 2]);
+        px[i + 3] = RecolorPixel32(lut, px[i + 3]);
+    }
+#endif
+    for (; i < nPixels; i++) {
+        px[i] = RecolorPixel32(lut, px[i]);
+    }
+}
+
+static void RecolorRow24(const BitmapColorsLut& lut, u8* d, int nBytes) {
+    int x = 0;
+#if IS_INTEL_32 || IS_INTEL_64
+    // 48 bytes are 16 whole pixels: if they're all white, copy recolored white
+    u8 white[48];
+    for (int k = 0; k < 48; k++) {
+        white[k] = lut.ch[k % 3][255];
+    }
+    const __m128i w0 = _mm_loadu_si128((const __m128i*)white);
+    const __m128i w1 = _mm_loadu_si128((const __m128i*)(white + 16));
+    const __m128i w2 = _mm_loadu_si128((const __m128i*)(white + 32));
+    const __m128i ones = _mm_set1_epi8((char)0xff);
+    for (; x + 48 <= nBytes; x += 48) {
+        __m128i v0 = _mm_loadu_si128((const __m128i*)(d + x));
+        __m128i v1 = _mm_loadu_si128((const __m128i*)(d + x + 16));
+        __m128i v2 = _mm_loadu_si128((const __m128i*)(d + x + 32));
+        __m128i all = _mm_and_si128(_mm_and_si128(v0, v1), v2);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(all, ones)) == 0xffff) {
+            _mm_storeu_si128((__m128i*)(d + x), w0);
+            _mm_storeu_si128((__m128i*)(d + x + 16), w1);
+            _mm_storeu_si128((__m128i*)(d + x + 32), w2);
+            continue;
+        }
+        for (int k = x; k < x + 48; k += 3) {
+            d[k] = lut.ch[0][d[k]];
+            d[k + 1] = lut.ch[1][d[k + 1]];
+            d[k + 2] = lut.ch[2][d[k + 2]];
+        }
+    }
+#endif
+    for (; x + 3 <= nBytes; x += 3) {
+        d[x] = lut.ch[0][d[x]];
+        d[x + 1] = lut.ch[1][d[x + 1]];
+        d[x + 2] = lut.ch[2][d[x + 2]];
+    }
+}
+
+void UpdateBitmapColors(HBITMAP hbmp, COLORREF textColor, COLORREF bgColor) {
+    if ((textColor & 0xFFFFFF) == WIN_COL_BLACK && (bgColor & 0xFFFFFF) == WIN_COL_WHITE) {
+        return;
+    }
+
+    BitmapColorsLut lut;
+    BuildBitmapColorsLut(lut, textColor, bgColor);
 
     DIBSECTION info{};
     int ret = GetObject(hbmp, sizeof(info), &info);
@@ -1909,12 +1997,7 @@ void UpdateBitmapColors(HBITMAP hbmp, COLORREF textColor, COLORREF bgColor) {
     // for mapped 32-bit DI bitmaps: directly access the pixel data
     if (ret >= sizeof(info.dsBm) && info.dsBm.bmBits && 32 == info.dsBm.bmBitsPixel &&
         size.dx * 4 == info.dsBm.bmWidthBytes) {
-        int bmpBytes = size.dx * size.dy * 4;
-        u8* bmpData = (u8*)info.dsBm.bmBits;
-        for (int i = 0; i < bmpBytes; i++) {
-            int k = i % 4;
-            bmpData[i] = (u8)(base[k] + mul255(bmpData[i], diff[k]));
-        }
+        RecolorPixels32(lut, (u8*)info.dsBm.bmBits, (size_t)size.dx * size.dy);
         return;
     }
 
@@ -1923,10 +2006,7 @@ void UpdateBitmapColors(HBITMAP hbmp, COLORREF textColor, COLORREF bgColor) {
         info.dsBm.bmWidthBytes >= size.dx * 3) {
         u8* bmpData = (u8*)info.dsBm.bmBits;
         for (int y = 0; y < size.dy; y++) {
-            for (int x = 0; x < size.dx * 3; x++) {
-                int k = x % 3;
-                bmpData[x] = (u8)(base[k] + mul255(bmpData[x], diff[k]));
-            }
+            RecolorRow24(lut, bmpData, size.dx * 3);
             bmpData += info.dsBm.bmWidthBytes;
         }
         return;
@@ -1940,9 +2020,9 @@ void UpdateBitmapColors(HBITMAP hbmp, COLORREF textColor, COLORREF bgColor) {
         DeleteObject(SelectObject(hDC, hbmp));
         uint num = GetDIBColorTable(hDC, 0, dimof(palette), palette);
         for (uint i = 0; i < num; i++) {
-            palette[i].rgbRed = (u8)(base[2] + mul255(palette[i].rgbRed, diff[2]));
-            palette[i].rgbGreen = (u8)(base[1] + mul255(palette[i].rgbGreen, diff[1]));
-            palette[i].rgbBlue = (u8)(base[0] + mul255(palette[i].rgbBlue, diff[0]));
+            palette[i].rgbRed = lut.ch[2][palette[i].rgbRed];
+            palette[i].rgbGreen = lut.ch[1][palette[i].rgbGreen];
+            palette[i].rgbBlue = lut.ch[0][palette[i].rgbBlue];
         }
         if (num > 0) {
             SetDIBColorTable(hDC, 0, num, palette);
@@ -1965,10 +2045,7 @@ void UpdateBitmapColors(HBITMAP hbmp, COLORREF textColor, COLORREF bgColor) {
     CrashIf(!bmpData);
 
     if (GetDIBits(hDC, hbmp, 0, size.dy, bmpData, &bmi, DIB_RGB_COLORS)) {
-        for (int i = 0; i < bmpBytes; i++) {
-            int k = i % 4;
-            bmpData[i] = (u8)(base[k] + mul255(bmpData[i], diff[k]));
-        }
+        RecolorPixels32(lut, bmpData, (size_t)size.dx * size.dy);
         SetDIBits(hDC, hbmp, 0, size.dy, bmpData, &bmi, DIB_RGB_COLORS);
     }
 
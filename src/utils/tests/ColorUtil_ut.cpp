@@ -0,0 +1,187 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+#include "utils/BaseUtil.h"
+
+// must be last due to assert() over-write
+#include "utils/UtAssert.h"
+
+static u32 gRandState = 1;
+
+static u32 Rand32() {
+    gRandState = gRandState * 1103515245 + 12345;
+    return gRandState >> 8;
+}
+
+// w x h RGBA pixels picked randomly from nColors colors, the first half of which are gray.
+// rows are padded (like pixmaps) and alpha is random as the quantizer must ignore it
+struct QuantizerTestImage {
+    int w = 0;
+    int h = 0;
+    int stride = 0;
+    u8* rgba = nullptr;
+    u8* bgra = nullptr;
+
+    QuantizerTestImage(int w, int h, int nColors) : w(w), h(h) {
+        stride = w * 4 + 12;
+        rgba = AllocArray<u8>((size_t)stride * h);
+        bgra = AllocArray<u8>((size_t)stride * h);
+        Vec<u32> palette;
+        for (int i = 0; i < nColors; i++) {
+            u32 c = i < nColors / 2 ? (u32)(i * 0x010101) : 0x800000 | (u32)i;
+            palette.Append(c);
+        }
+        for (int y = 0; y < h; y++) {
+            u8* d = rgba + (size_t)y * stride;
+            for (int x = 0; x < w; x++, d += 4) {
+                // runs of the same color, as in rendered pages
+                u32 c = palette[(x / 5 + y * 7 + (int)(Rand32() % 3)) % nColors];
+                d[0] = (u8)(c >> 16);
+                d[1] = (u8)(c >> 8);
+                d[2] = (u8)c;
+                d[3] = (u8)Rand32();
+            }
+        }
+        for (int i = 0; i < stride * h; i += 4) {
+            bgra[i] = rgba[i + 2];
+            bgra[i + 1] = rgba[i + 1];
+            bgra[i + 2] = rgba[i];
+            bgra[i + 3] = rgba[i + 3];
+        }
+    }
+    ~QuantizerTestImage() {
+        free(rgba);
+        free(bgra);
+    }
+};
+
+static bool Quantize(PaletteQuantizer& q, const u8* samples, const QuantizerTestImage& img, u8* indices) {
+    if (!q.SampleRows(samples, img.w, img.h, img.stride, indices)) {
+        return false;
+    }
+    for (int y = 0; y < img.h; y++) {
+        if (!q.QuantizeRow(samples + (size_t)y * img.stride, img.w, indices + (size_t)y * img.w)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// every index must point to the color of its pixel (in RGBQUAD layout)
+// and the palette must have each color of the image exactly once
+static bool IsSameAsNaiveQuantization(const PaletteQuantizer& q, const QuantizerTestImage& img, const u8* indices) {
+    Vec<u32> distinct;
+    for (int y = 0; y < img.h; y++) {
+        const u8* s = img.rgba + (size_t)y * img.stride;
+        for (int x = 0; x < img.w; x++, s += 4) {
+            u32 c = s[2] | (s[1] << 8) | (s[0] << 16);
+            if (q.colors[indices[y * img.w + x]] != c) {
+                return false;
+            }
+            if (!distinct.Contains(c)) {
+                distinct.Append(c);
+            }
+        }
+    }
+    return distinct.isize() == q.nColors;
+}
+
+static void PaletteQuantizerTest() {
+    // 131 is not a multiple of 4 (the gray fast path handles 4 pixels at once)
+    // and h is big enough for SampleRows() to sample
+    for (int nColors : {1, 2, 100, 256}) {
+        QuantizerTestImage img(131, 150, nColors);
+        u8* indices1 = AllocArray<u8>((size_t)img.w * img.h);
+        u8* indices2 = AllocArray<u8>((size_t)img.w * img.h);
+
+        auto q1 = new PaletteQuantizer(false);
+        auto q2 = new PaletteQuantizer(true);
+        utassert(Quantize(*q1, img.rgba, img, indices1));
+        utassert(Quantize(*q2, img.bgra, img, indices2));
+        utassert(IsSameAsNaiveQuantization(*q1, img, indices1));
+
+        // RGBA and BGRA input must give the same result
+        utassert(q1->nColors == q2->nColors);
+        utassert(memcmp(q1->colors, q2->colors, sizeof(q1->colors)) == 0);
+        utassert(memcmp(indices1, indices2, (size_t)img.w * img.h) == 0);
+
+        delete q1;
+        delete q2;
+        free(indices1);
+        free(indices2);
+    }
+
+    // more than 256 colors can't be quantized
+    {
+        QuantizerTestImage img(131, 150, 300);
+        u8* indices = AllocArray<u8>((size_t)img.w * img.h);
+        auto q = new PaletteQuantizer(false);
+        utassert(!Quantize(*q, img.rgba, img, indices));
+        delete q;
+        free(indices);
+    }
+}
+
+// encodes and decodes n pixels, with enough room for the worst case
+// (a control byte for every pixel)
+template <typename T>
+static bool RleRoundTrips(const T* src, size_t n) {
+    size_t dstSize = n * (sizeof(T) + 1);
+    u8* enc = AllocArray<u8>(dstSize);
+    T* dec = AllocArray<T>(n);
+    size_t size = RleEncode(src, n, enc, dstSize);
+    bool ok = size > 0 && RleDecode(enc, size, dec, n) && memcmp(src, dec, n * sizeof(T)) == 0;
+    // truncated data must be rejected
+    ok = ok && !RleDecode(enc, size - 1, dec, n);
+    free(enc);
+    free(dec);
+    return ok;
+}
+
+static void RleTest() {
+    // sizes around the maximum run (129) and literal (128) lengths
+    for (int n : {1, 2, 3, 127, 128, 129, 130, 257, 5000}) {
+        u8* px8 = AllocArray<u8>(n);
+        u32* px32 = AllocArray<u32>(n);
+        // like rendered pages: long runs of background and short runs of anti-aliased text
+        u32 v = 0;
+        for (int i = 0; i < n; i++) {
+            if (i % 1000 < 400) {
+                v = 0xffffffff;
+            } else if (Rand32() % 4 == 0) {
+                v = Rand32();
+            }
+            px8[i] = (u8)v;
+            px32[i] = v;
+        }
+        utassert(RleRoundTrips(px8, n));
+        utassert(RleRoundTrips(px32, n));
+        free(px8);
+        free(px32);
+    }
+
+    // random pixels don't compress: RenderCache only keeps bitmaps
+    // that fit into half of their size
+    {
+        const int n = 4096;
+        u8* px8 = AllocArray<u8>(n);
+        u32* px32 = AllocArray<u32>(n);
+        for (int i = 0; i < n; i++) {
+            px32[i] = Rand32();
+            px8[i] = (u8)px32[i];
+        }
+        u8* enc = AllocArray<u8>(n * 4 / 2);
+        utassert(RleEncode(px8, n, enc, n / 2) == 0);
+        utassert(RleEncode(px32, n, enc, n * 4 / 2) == 0);
+        utassert(RleRoundTrips(px8, n));
+        utassert(RleRoundTrips(px32, n));
+        free(enc);
+        free(px8);
+        free(px32);
+    }
+}
+
+void ColorUtilTest() {
+    PaletteQuantizerTest();
+    RleTest();
+}
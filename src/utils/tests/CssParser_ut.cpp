@@ -4,6 +4,7 @@
 #include "utils/BaseUtil.h"
 #include "utils/HtmlParserLookup.h"
 #include "utils/CssParser.h"
+#include "utils/Timer.h"
 
 // must be last due to assert() over-write
 #include "utils/UtAssert.h"
@@ -184,6 +185,130 @@ static void Test08() {
     utassert(!ok);
 }
 
+// StyleRules without the index and the memo, as a reference
+struct LinearStyleRules {
+    Vec<StyleRule> rules;
+
+    StyleRule* Find(HtmlTag tag, const char* clazz, size_t clazzLen) {
+        u32 classHash = clazz ? MurmurHash2(clazz, clazzLen) : 0;
+        for (StyleRule& rule : rules) {
+            if (tag == rule.tag && classHash == rule.classHash) {
+                return &rule;
+            }
+        }
+        return nullptr;
+    }
+
+    void ParseStyleSheet(const char* data, size_t len) {
+        CssPullParser parser(data, len);
+        while (parser.NextRule()) {
+            StyleRule rule = StyleRule::Parse(&parser);
+            const CssSelector* sel;
+            while ((sel = parser.NextSelector()) != nullptr) {
+                if (Tag_NotFound == sel->tag) {
+                    continue;
+                }
+                StyleRule* prevRule = Find(sel->tag, sel->clazz, sel->clazzLen);
+                if (prevRule) {
+                    prevRule->Merge(rule);
+                } else {
+                    rule.tag = sel->tag;
+                    rule.classHash = sel->clazz ? MurmurHash2(sel->clazz, sel->clazzLen) : 0;
+                    rules.Append(rule);
+                }
+            }
+        }
+    }
+
+    StyleRule ComputeStyle(HtmlTag tag, const char* clazz, size_t clazzLen) {
+        StyleRule rule;
+        StyleRule* candidates[] = {Find(Tag_Body, nullptr, 0), Find(Tag_Any, nullptr, 0), Find(tag, nullptr, 0),
+                                   clazz ? Find(Tag_Any, clazz, clazzLen) : nullptr,
+                                   clazz ? Find(tag, clazz, clazzLen) : nullptr};
+        for (StyleRule* r : candidates) {
+            if (r) {
+                rule.Merge(*r);
+            }
+        }
+        return rule;
+    }
+};
+
+static bool IsSameStyle(const StyleRule& r1, const StyleRule& r2) {
+    return r1.textIndent == r2.textIndent && r1.textIndentUnit == r2.textIndentUnit && r1.textAlign == r2.textAlign;
+}
+
+// all (tag, class) combinations must give the same result as a linear scan,
+// both when they're computed and when they come from the memo
+static bool IsSameAsLinearScan(StyleRules& rules, LinearStyleRules& expected, int nClasses) {
+    HtmlTag tags[] = {Tag_P, Tag_Div, Tag_Span, Tag_Body, Tag_H1};
+    for (int pass = 0; pass < 2; pass++) {
+        for (HtmlTag tag : tags) {
+            for (int i = -1; i < nClasses; i++) {
+                char buf[16];
+                str::BufFmt(buf, dimof(buf), "c%d", i);
+                const char* clazz = i < 0 ? nullptr : buf;
+                size_t clazzLen = str::Len(clazz);
+                StyleRule* r1 = rules.Find(tag, clazz, clazzLen);
+                StyleRule* r2 = expected.Find(tag, clazz, clazzLen);
+                if (!r1 != !r2 || (r1 && !IsSameStyle(*r1, *r2))) {
+                    return false;
+                }
+                StyleRule s1 = rules.ComputeStyle(tag, clazz, clazzLen);
+                StyleRule s2 = expected.ComputeStyle(tag, clazz, clazzLen);
+                if (!IsSameStyle(s1, s2)) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static const char* kAlignNames[] = {"left", "right", "center", "justify"};
+
+// rules for classes c0 to c(nClasses - 1), some of them repeated (and merged)
+static char* MakeStyleSheet(int nClasses, int seed) {
+    str::Str s;
+    s.AppendFmt("body { text-indent: %dpx } p { text-align: %s }\n", seed, kAlignNames[seed % 4]);
+    for (int i = 0; i < nClasses; i++) {
+        int n = i * 7 + seed;
+        s.AppendFmt(".c%d { text-indent: %d%s }\n", i, n % 13, (n % 3 == 0) ? "em" : "pt");
+        if (n % 2 == 0) {
+            s.AppendFmt("p.c%d, div.c%d { text-align: %s }\n", i, (i * 3) % nClasses, kAlignNames[n % 4]);
+        }
+        if (n % 5 == 0) {
+            s.AppendFmt(".c%d { text-align: %s }\n", (i * 11) % nClasses, kAlignNames[(n / 5) % 4]);
+        }
+    }
+    return s.StealData();
+}
+
+static void Test09() {
+    // enough rules for the index to grow several times
+    constexpr int kClasses = 300;
+    StyleRules rules;
+    LinearStyleRules expected;
+    AutoFreeStr css1 = MakeStyleSheet(kClasses, 1);
+    rules.ParseStyleSheet(css1, str::Len(css1));
+    expected.ParseStyleSheet(css1, str::Len(css1));
+    utassert(rules.rules.size() == expected.rules.size());
+    utassert(IsSameAsLinearScan(rules, expected, kClasses + 10));
+
+    // the memoized styles must be invalidated by a second style sheet
+    // that overrides some rules and adds new ones
+    AutoFreeStr css2 = MakeStyleSheet(kClasses + 5, 2);
+    rules.ParseStyleSheet(css2, str::Len(css2));
+    expected.ParseStyleSheet(css2, str::Len(css2));
+    utassert(rules.rules.size() == expected.rules.size());
+    utassert(IsSameAsLinearScan(rules, expected, kClasses + 10));
+
+    rules.Reset();
+    utassert(!rules.Find(Tag_P, nullptr, 0));
+    StyleRule rule = rules.ComputeStyle(Tag_P, "c1", 2);
+    utassert(IsSameStyle(rule, StyleRule()));
+}
+
 void CssParser_UnitTests() {
     Test01();
     Test02();
@@ -193,4 +318,42 @@ void CssParser_UnitTests() {
     Test06();
     Test07();
     Test08();
+    Test09();
+}
+
+// computes the styles of nElements paragraphs and divs with classes
+// from a style sheet with rules for nClasses classes, returns time in ms
+template <typename Rules>
+static double TimeComputeStyles(const char* css, int nClasses, int nElements) {
+    auto start = TimeGet();
+    Rules rules;
+    rules.ParseStyleSheet(css, str::Len(css));
+    // volatile so that computing the styles isn't optimized away
+    volatile float textIndent = 0;
+    for (int i = 0; i < nElements; i++) {
+        char buf[16];
+        str::BufFmt(buf, dimof(buf), "c%d", nClasses > 0 ? (i * 7) % nClasses : 0);
+        size_t len = str::Len(buf);
+        float indent = rules.ComputeStyle(Tag_P, buf, len).textIndent;
+        textIndent = indent + rules.ComputeStyle(Tag_Div, buf, len).textIndent;
+    }
+    return TimeSinceInMs(start);
+}
+
+// measures how long computing the styles of the same elements takes with
+// style sheets of increasing size, to verify that matching CSS rules doesn't
+// depend on the number of rules (the linear scan is only a reference)
+void CssParserBench() {
+    constexpr int kElements = 10000;
+    int classCounts[] = {0, 100, 1000, 5000, 20000};
+    for (int nClasses : classCounts) {
+        AutoFreeStr css = MakeStyleSheet(nClasses, 1);
+        double ms = TimeComputeStyles<StyleRules>(css, nClasses, kElements);
+        printf("CssParser: %5d classes, %d elements: %8.2f ms", nClasses, kElements, ms);
+        if (nClasses <= 5000) {
+            double linearMs = TimeComputeStyles<LinearStyleRules>(css, nClasses, kElements);
+            printf(" (linear scan: %8.2f ms)", linearMs);
+        }
+        printf("\n");
+    }
 }
@@ -135,4 +135,14 @@ void JsonTest() {
 }";
     JsonVerifier sampleVerifier(testData, dimof(testData));
     utassert(json::Parse(jsonSample, &sampleVerifier));
+
+    // AppendString() must produce a JSON string that parses back to the original
+    {
+        const char* s = "quote \" backslash \\ slash / tab \t newline \n ctrl \x01 \xC4\xA3";
+        str::Str json;
+        json::AppendString(json, s);
+        JsonValue exp("", s);
+        JsonVerifier verifier(&exp, 1);
+        utassert(json::Parse(json.Get(), &verifier));
+    }
 }
@@ -0,0 +1,108 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+#include "utils/BaseUtil.h"
+
+#include "utils/Log.h"
+#include "utils/ThreadUtil.h"
+#include "utils/Timer.h"
+
+// must be last due to assert() over-write
+#include "utils/UtAssert.h"
+
+// asynchronous logging copies the arguments into a record and formats them
+// later, which must give the same result as formatting them right away
+template <typename... Args>
+static bool IsSameAsFormat(const char* fmt, Args... args) {
+    str::Str s;
+    if (!FormatAsLogRecord(s, fmt, args...)) {
+        return false;
+    }
+    AutoFreeStr exp = str::Format(fmt, args...);
+    return str::Eq(s.Get(), exp.Get());
+}
+
+static void LogRecordRoundTripTest() {
+    utassert(IsSameAsFormat("plain text\n"));
+    utassert(IsSameAsFormat("100%% done\n"));
+    utassert(IsSameAsFormat("%d %i %u\n", -5, 42, 7u));
+    utassert(IsSameAsFormat("%x %X %o %#x\n", 0xbeef, 0xBEEF, 8, 255));
+    utassert(IsSameAsFormat("[%5d] [%-5d] [%05d] [%+d]\n", 12, 12, 12, 12));
+    utassert(IsSameAsFormat("%hd %hhu\n", (short)-3, (unsigned char)250));
+    utassert(IsSameAsFormat("%ld %lu\n", -123456L, 123456UL));
+    utassert(IsSameAsFormat("%lld %llx %I64d\n", -1234567890123LL, 0x123456789abcULL, 9876543210LL));
+    utassert(IsSameAsFormat("%zu %Iu %I32d\n", (size_t)123456, (size_t)654321, 32));
+    utassert(IsSameAsFormat("%f %.2f %e %g\n", 3.14159, 2.71828, 12345.678, 0.0001));
+    utassert(IsSameAsFormat("[%*d] [%-*d]\n", 6, 42, 6, 42));
+    utassert(IsSameAsFormat("[%.*f] [%*.*f]\n", 3, 3.14159, 10, 2, 3.14159));
+    utassert(IsSameAsFormat("%c%c%c\n", 'a', 'b', 'c'));
+    utassert(IsSameAsFormat("%p\n", (void*)&LogRecordRoundTripTest));
+    utassert(IsSameAsFormat("%s: %s (%.3s) [%10s]\n", "file.pdf", "", "truncated", "right"));
+    utassert(IsSameAsFormat("%S and %ls and %ws\n", L"wide", L"also wide", L"wide too"));
+    utassert(IsSameAsFormat("%s %d %s %.1f %c\n", "mixed", 1, "args", 2.5, 'z'));
+
+    // not supported: logged synchronously
+    str::Str s;
+    utassert(!FormatAsLogRecord(s, "%q\n", 1));
+    // too big for a record: logged synchronously
+    char* big = AllocArray<char>(4096);
+    memset(big, 'x', 4095);
+    utassert(!FormatAsLogRecord(s, "%s\n", big));
+    free(big);
+}
+
+void LogTest() {
+    LogRecordRoundTripTest();
+}
+
+struct LogThread : ThreadBase {
+    int nCalls = 0;
+    double ms = 0;
+
+    void Run() override {
+        auto start = TimeGet();
+        for (int i = 0; i < nCalls; i++) {
+            logf("LogThread %d: message %d of %d, %s, %.2f\n", (int)GetNo(), i, nCalls, "some string", i * 0.5);
+        }
+        ms = TimeSinceInMs(start);
+    }
+};
+
+// returns average time of a logf() call in nanoseconds
+static double TimeLogThreads(int nThreads, int nCalls) {
+    Vec<LogThread*> threads;
+    for (int n = 0; n < nThreads; n++) {
+        auto thread = new LogThread();
+        thread->nCalls = nCalls;
+        thread->Start();
+        threads.Append(thread);
+    }
+    double totalMs = 0;
+    for (auto thread : threads) {
+        thread->Join();
+        totalMs += thread->ms;
+        delete thread;
+    }
+    return totalMs * 1000 * 1000 / ((double)nThreads * nCalls);
+}
+
+// measures the cost of a logf() call with 8 threads logging at the same time,
+// first with synchronous and then with asynchronous logging
+void LogBench() {
+    constexpr int kThreads = 8;
+    constexpr int kCalls = 20000;
+
+    bool logToConsole = gLogToConsole;
+    gLogToConsole = false;
+    double syncNs = TimeLogThreads(kThreads, kCalls);
+    StartAsyncLogging();
+    LONG nDropped = gLogDroppedCount;
+    double asyncNs = TimeLogThreads(kThreads, kCalls);
+    nDropped = gLogDroppedCount - nDropped;
+    FlushLogs();
+    gLogToConsole = logToConsole;
+
+    printf("LogBench: %d threads, %d logf() calls per thread\n", kThreads, kCalls);
+    printf("sync:  %8.1f ns per call\n", syncNs);
+    printf("async: %8.1f ns per call, dropped messages: %d\n", asyncNs, (int)nDropped);
+}
@@ -0,0 +1,142 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+extern "C" {
+#include <mupdf/fitz.h>
+}
+
+#include "utils/BaseUtil.h"
+#include "utils/Timer.h"
+
+// must be last due to assert() over-write
+#include "utils/UtAssert.h"
+
+// the SSE2 / AVX2 painters (mupdf/source/fitz/draw-simd.c) must produce
+// exactly the same pixels as the scalar ones, so we draw the same page
+// with every simd level and compare with what the scalar painters drew
+
+static u32 gRandState = 1;
+
+static u8 Rand8() {
+    gRandState = gRandState * 1103515245 + 12345;
+    return (u8)(gRandState >> 16);
+}
+
+// random premultiplied rgba pixels, with many fully transparent and opaque ones
+static fz_image* NewRandomImage(fz_context* ctx, int w, int h) {
+    fz_pixmap* pix = fz_new_pixmap(ctx, fz_device_rgb(ctx), w, h, nullptr, 1);
+    for (int y = 0; y < h; y++) {
+        u8* d = fz_pixmap_samples(ctx, pix) + (size_t)y * fz_pixmap_stride(ctx, pix);
+        for (int x = 0; x < w; x++, d += 4) {
+            int a = Rand8();
+            if (a < 64) {
+                a = 0;
+            } else if (a > 192) {
+                a = 255;
+            }
+            d[0] = (u8)(Rand8() * a / 255);
+            d[1] = (u8)(Rand8() * a / 255);
+            d[2] = (u8)(Rand8() * a / 255);
+            d[3] = (u8)a;
+        }
+    }
+    fz_image* img = fz_new_image_from_pixmap(ctx, pix, nullptr);
+    fz_drop_pixmap(ctx, pix);
+    return img;
+}
+
+// uses every painter that has a vectorized version: solid color (rectangles),
+// span with color (anti-aliased edges), span over span (transparency groups)
+// and the bilinear image painters
+static fz_pixmap* DrawSimdTestPage(fz_context* ctx, fz_image* img, int simdLevel) {
+    fz_set_draw_simd_max_level(simdLevel);
+
+    const int dx = 601; // not a multiple of the vector width
+    const int dy = 403;
+    fz_colorspace* rgb = fz_device_rgb(ctx);
+    fz_color_params cp = fz_default_color_params;
+    fz_pixmap* pix = fz_new_pixmap(ctx, rgb, dx, dy, nullptr, 1);
+    fz_clear_pixmap_with_value(ctx, pix, 0x40);
+    fz_device* dev = fz_new_draw_device(ctx, fz_identity, pix);
+
+    float red[3] = {0.9f, 0.1f, 0.2f};
+    float blue[3] = {0.1f, 0.3f, 0.8f};
+    fz_path* rect = fz_new_path(ctx);
+    fz_rectto(ctx, rect, 50, 60, 350, 260);
+    fz_fill_path(ctx, dev, rect, 0, fz_identity, rgb, red, 1.0f, cp);
+    fz_fill_path(ctx, dev, rect, 0, fz_translate(120, 90), rgb, blue, 0.5f, cp);
+    fz_drop_path(ctx, rect);
+
+    fz_path* shape = fz_new_path(ctx);
+    fz_moveto(ctx, shape, 10, 10);
+    fz_curveto(ctx, shape, 300, -50, 500, 400, 590, 390);
+    fz_lineto(ctx, shape, 20, 380);
+    fz_closepath(ctx, shape);
+    fz_fill_path(ctx, dev, shape, 0, fz_identity, rgb, blue, 1.0f, cp);
+    fz_fill_path(ctx, dev, shape, 1, fz_translate(7, -5), rgb, red, 0.6f, cp);
+    fz_drop_path(ctx, shape);
+
+    // rotated so that the bilinear (and not the nearest neighbour) painters are used
+    fz_matrix ctm = fz_concat(fz_scale(img->w * 1.5f, img->h * 1.5f), fz_rotate(10));
+    fz_fill_image(ctx, dev, img, fz_concat(ctm, fz_translate(150, 20)), 1.0f, cp);
+    fz_fill_image(ctx, dev, img, fz_concat(ctm, fz_translate(40, 80)), 0.6f, cp);
+
+    fz_begin_group(ctx, dev, fz_make_rect(0, 0, dx, dy), nullptr, 1, 0, FZ_BLEND_NORMAL, 0.7f);
+    fz_fill_image(ctx, dev, img, fz_concat(fz_scale(img->w, img->h), fz_translate(300, 100)), 1.0f, cp);
+    fz_end_group(ctx, dev);
+
+    fz_close_device(ctx, dev);
+    fz_drop_device(ctx, dev);
+    return pix;
+}
+
+static bool PixmapsEqual(fz_context* ctx, fz_pixmap* pix1, fz_pixmap* pix2) {
+    size_t n = (size_t)fz_pixmap_stride(ctx, pix1) * fz_pixmap_height(ctx, pix1);
+    return memcmp(fz_pixmap_samples(ctx, pix1), fz_pixmap_samples(ctx, pix2), n) == 0;
+}
+
+void MupdfDrawTest() {
+    fz_set_draw_simd_max_level(FZ_DRAW_SIMD_AVX2);
+    int maxLevel = fz_draw_simd_level();
+    if (maxLevel == FZ_DRAW_SIMD_NONE) {
+        return;
+    }
+
+    fz_context* ctx = fz_new_context(nullptr, nullptr, FZ_STORE_UNLIMITED);
+    utassert(ctx != nullptr);
+    fz_image* img = NewRandomImage(ctx, 301, 211);
+    fz_pixmap* expected = DrawSimdTestPage(ctx, img, FZ_DRAW_SIMD_NONE);
+    for (int level = FZ_DRAW_SIMD_SSE2; level <= maxLevel; level++) {
+        fz_pixmap* pix = DrawSimdTestPage(ctx, img, level);
+        utassert(PixmapsEqual(ctx, expected, pix));
+        fz_drop_pixmap(ctx, pix);
+    }
+    fz_set_draw_simd_max_level(FZ_DRAW_SIMD_AVX2);
+
+    fz_drop_pixmap(ctx, expected);
+    fz_drop_image(ctx, img);
+    fz_drop_context(ctx);
+}
+
+// times drawing the test page with the scalar painters and with every simd level
+void MupdfDrawBench() {
+    fz_set_draw_simd_max_level(FZ_DRAW_SIMD_AVX2);
+    int maxLevel = fz_draw_simd_level();
+
+    fz_context* ctx = fz_new_context(nullptr, nullptr, FZ_STORE_UNLIMITED);
+    fz_image* img = NewRandomImage(ctx, 301, 211);
+    const int kIterations = 200;
+    for (int level = FZ_DRAW_SIMD_NONE; level <= maxLevel; level++) {
+        auto start = TimeGet();
+        for (int i = 0; i < kIterations; i++) {
+            fz_pixmap* pix = DrawSimdTestPage(ctx, img, level);
+            fz_drop_pixmap(ctx, pix);
+        }
+        double dur = TimeSinceInMs(start);
+        printf("MupdfDraw: simd level %d: %.2f ms per page\n", level, dur / kIterations);
+    }
+    fz_set_draw_simd_max_level(FZ_DRAW_SIMD_AVX2);
+
+    fz_drop_image(ctx, img);
+    fz_drop_context(ctx);
+}
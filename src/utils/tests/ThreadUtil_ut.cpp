@@ -0,0 +1,107 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: Simplified BSD (see COPYING.BSD) */
+
+#include "utils/BaseUtil.h"
+#include "utils/ThreadUtil.h"
+
+// must be last due to assert() over-write
+#include "utils/UtAssert.h"
+
+// simulates a library (like libdjvu) that finishes jobs on its own thread,
+// updates their status and then posts a message about it. Each message is
+// a count on a semaphore and a pump waits for one and handles all pending.
+struct PumpTestJobs {
+    static constexpr int kJobCount = 64;
+    LONG done[kJobCount] = {};
+    HANDLE messages = nullptr;
+    CRITICAL_SECTION lock;
+
+    PumpTestJobs() {
+        messages = CreateSemaphoreW(nullptr, 0, kJobCount, nullptr);
+        InitializeCriticalSection(&lock);
+    }
+    ~PumpTestJobs() {
+        CloseHandle(messages);
+        DeleteCriticalSection(&lock);
+    }
+
+    bool IsDone(int job) {
+        return InterlockedAdd(&done[job], 0) != 0;
+    }
+
+    void Pump() {
+        WaitForSingleObject(messages, INFINITE);
+        while (WaitForSingleObject(messages, 0) == WAIT_OBJECT_0) {
+            // pop all pending messages
+        }
+    }
+};
+
+struct PumpTestProducer : ThreadBase {
+    PumpTestJobs* jobs = nullptr;
+
+    void Run() override {
+        // finish the jobs out of order, with a short pause every few jobs
+        // so that the waiters are actually waiting
+        for (int i = 0; i < PumpTestJobs::kJobCount; i++) {
+            int job = (i * 37) % PumpTestJobs::kJobCount;
+            InterlockedExchange(&jobs->done[job], 1);
+            ReleaseSemaphore(jobs->messages, 1, nullptr);
+            if (i % 8 == 0) {
+                Sleep(1);
+            }
+        }
+    }
+};
+
+struct PumpTestWaiter : ThreadBase {
+    PumpTestJobs* jobs = nullptr;
+    int job = 0;
+
+    void Run() override {
+        auto isDone = [this] { return jobs->IsDone(job); };
+        auto pump = [this] { jobs->Pump(); };
+        PumpUntil(&jobs->lock, isDone, pump);
+    }
+};
+
+static void PumpUntilTest() {
+    auto jobs = new PumpTestJobs();
+    Vec<PumpTestWaiter*> waiters;
+    for (int i = 0; i < PumpTestJobs::kJobCount; i++) {
+        auto waiter = new PumpTestWaiter();
+        waiter->jobs = jobs;
+        waiter->job = i;
+        waiter->Start();
+        waiters.Append(waiter);
+    }
+    auto producer = new PumpTestProducer();
+    producer->jobs = jobs;
+    producer->Start();
+    bool producerFinished = producer->Join(10000);
+    utassert(producerFinished);
+    if (!producerFinished) {
+        return;
+    }
+    delete producer;
+
+    // every waiter must notice that its job is done
+    // even if another thread handled the message about it
+    bool allFinished = true;
+    for (auto waiter : waiters) {
+        allFinished &= waiter->Join(10000);
+    }
+    utassert(allFinished);
+    if (!allFinished) {
+        // leak jobs and waiters as they're still in use
+        return;
+    }
+    for (auto waiter : waiters) {
+        delete waiter;
+    }
+    delete jobs;
+}
+
+void ThreadUtilTest() {
+    PumpUntilTest();
+}